@@ -0,0 +1,198 @@
+#pragma once
+
+// tells you which asset files changed on disk since the last poll, so a
+// chapter can reload just those instead of restarting.
+//
+// on linux it uses inotify on the directories holding the files. editors
+// often save by writing a temp file and renaming it over the original, which
+// replaces the inode, so watching the file itself would go quiet after the
+// first save. everywhere else (or if inotify can't be set up) it falls back to
+// checking modification times a few times a second.
+//
+// a file is only reported once it has been quiet for settleTime, so something
+// written in several goes (an exporter flushing a big obj) is read once,
+// after it's finished.
+//
+//  assetWatcher::Watcher watcher;
+//  watcher.watch("tommy.obj");
+//  ...every frame
+//  for (const auto& filePath : watcher.poll()) { reload(filePath); }
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace assetWatcher {
+
+class Watcher {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Watcher(Clock::duration settleTime = std::chrono::milliseconds(100))
+        : settleTime(settleTime) {
+#if defined(__linux__)
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) {
+            fmt::print(stderr, "inotify unavailable, polling modification times instead\n");
+        }
+#endif
+    }
+
+    ~Watcher() {
+#if defined(__linux__)
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+#endif
+    }
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // poll() hands back filePath exactly as given here
+    void watch(const std::string& filePath) {
+        for (const auto& file : files) {
+            if (file.filePath == filePath) {
+                return;
+            }
+        }
+        std::error_code error;
+        auto absolutePath = std::filesystem::absolute(filePath, error).lexically_normal();
+        WatchedFile file{filePath, absolutePath, lastWriteTime(absolutePath), -1, false, {}};
+
+#if defined(__linux__)
+        if (inotifyFd >= 0) {
+            auto directory = absolutePath.parent_path().string();
+            file.watchDescriptor = inotify_add_watch(inotifyFd, directory.c_str(),
+                                                     IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (file.watchDescriptor < 0) {
+                fmt::print(stderr, "can't watch {}, polling it instead\n", directory);
+            }
+        }
+#endif
+        files.push_back(std::move(file));
+    }
+
+    void unwatch(const std::string& filePath) {
+        files.erase(std::remove_if(files.begin(), files.end(),
+                                   [&](const WatchedFile& file) {
+                                       return file.filePath == filePath;
+                                   }),
+                    files.end());
+        // directory watches are shared between files and cheap, so they stay
+    }
+
+    // the watched files that changed and have since settled, each once
+    std::vector<std::string> poll() {
+        auto now = Clock::now();
+        readEvents(now);
+        pollModificationTimes(now);
+
+        std::vector<std::string> changed;
+        for (auto& file : files) {
+            if (file.pending && now - file.lastEvent >= settleTime) {
+                file.pending = false;
+                changed.push_back(file.filePath);
+            }
+        }
+        return changed;
+    }
+
+  private:
+    struct WatchedFile {
+        std::string filePath;
+        std::filesystem::path absolutePath;
+        std::filesystem::file_time_type lastWrite;
+        // inotify watch on the parent directory, -1 when polled
+        int watchDescriptor;
+        bool pending;
+        Clock::time_point lastEvent;
+    };
+
+    static std::filesystem::file_time_type lastWriteTime(const std::filesystem::path& path) {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        return error ? std::filesystem::file_time_type::min() : time;
+    }
+
+    void markChanged(WatchedFile& file, Clock::time_point now) {
+        file.pending = true;
+        file.lastEvent = now;
+    }
+
+    void readEvents(Clock::time_point now) {
+#if defined(__linux__)
+        if (inotifyFd < 0) {
+            return;
+        }
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            auto length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                // events were dropped, so anything could have changed
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (auto& file : files) {
+                        markChanged(file, now);
+                    }
+                    continue;
+                }
+                if (event->len == 0) {
+                    continue;
+                }
+                for (auto& file : files) {
+                    if (file.watchDescriptor == event->wd &&
+                        file.absolutePath.filename() == event->name) {
+                        markChanged(file, now);
+                    }
+                }
+            }
+        }
+#else
+        (void)now;
+#endif
+    }
+
+    // for files without an inotify watch. stat is cheap but not free, so at
+    // most a few times a second
+    void pollModificationTimes(Clock::time_point now) {
+        if (now - lastStatTime < std::chrono::milliseconds(250)) {
+            return;
+        }
+        lastStatTime = now;
+        for (auto& file : files) {
+            if (file.watchDescriptor >= 0) {
+                continue;
+            }
+            auto time = lastWriteTime(file.absolutePath);
+            if (time != file.lastWrite) {
+                file.lastWrite = time;
+                markChanged(file, now);
+            }
+        }
+    }
+
+    Clock::duration settleTime;
+    std::vector<WatchedFile> files;
+    Clock::time_point lastStatTime{};
+#if defined(__linux__)
+    int inotifyFd = -1;
+#endif
+};
+
+} // namespace assetWatcher
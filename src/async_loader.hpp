@@ -0,0 +1,450 @@
+#pragma once
+
+// loads meshes and texture arrays without holding up the render loop.
+//
+// a second, hidden glfw window gives us a gl context that shares objects with
+// the main one. a loader thread owns it: it parses/decodes on its own job
+// system, creates and fills the buffers and textures on its context, then
+// drops a fence and flushes. the render thread polls the fences once a frame
+// (without waiting) and only hands a resource out once its fence has
+// signalled, so it never sees a half uploaded buffer.
+//
+//  asyncLoading::Loader loader(window);
+//  auto mesh = loader.loadMesh("tommy.obj");
+//  ...every frame
+//  loader.poll();
+//  if (auto* resident = loader.mesh(mesh)) { draw(resident); }
+//
+// vertex array objects aren't shared between contexts, so the render thread
+// has to make its own around the buffers it gets back.
+//
+// if the shared context can't be made (some drivers and remote sessions won't)
+// there is no loader thread. poll() then decodes and uploads whatever was
+// asked for on the main context itself, so loads still finish, they just
+// hold up the frame they happen in.
+
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "trace.hpp"
+
+#include "stb_image.h"
+
+#include <fmt/core.h>
+
+#ifndef GLFW_INCLUDE_NONE
+#define GLFW_INCLUDE_NONE
+#endif
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gl;
+
+namespace asyncLoading {
+
+using Handle = uint32_t;
+
+enum class State { Loading, Resident, Failed };
+
+struct MeshResource {
+    std::string filePath;
+    GLuint vertexBuffer = 0;
+    GLuint elementBuffer = 0;
+    // the mesh without its vertices and indices, those only live on the gpu
+    std::vector<objLoader::groupInfo> groupInfos;
+    bounds::Bounds bounds;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+};
+
+struct TextureResource {
+    std::vector<std::string> filePaths;
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// how long each step took, from the load call
+struct Timings {
+    double decodeMs = 0.0;
+    double uploadMs = 0.0;
+    double residentMs = 0.0;
+};
+
+class Loader {
+  public:
+    // call on the main thread with the main window's context current.
+    // decodeThreads is the loader's own job system, 0 picks half the cores so
+    // loading leaves room for whatever the frame is doing
+    explicit Loader(GLFWwindow* mainWindow, unsigned decodeThreads = 0) {
+        if (decodeThreads == 0) {
+            decodeThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+        // the shared context has to come from a window, and glfw only makes
+        // windows on the main thread. it stays hidden
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        uploadWindow = glfwCreateWindow(1, 1, "loader", nullptr, mainWindow);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (!uploadWindow) {
+            fmt::print(stderr, "couldn't create the loader's shared context, loading on the "
+                               "main thread instead\n");
+            // made here so the main thread is its thread 0
+            fallbackJobSystem = std::make_unique<jobs::JobSystem>(decodeThreads);
+            return;
+        }
+        loaderThread = std::thread([this, decodeThreads] { run(decodeThreads); });
+    }
+
+    ~Loader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (loaderThread.joinable()) {
+            loaderThread.join();
+        }
+        // everything lives in the share group, so it can go from here
+        for (auto& entry : entries) {
+            if (entry->fence) {
+                glDeleteSync(entry->fence);
+            }
+            glDeleteBuffers(1, &entry->mesh.vertexBuffer);
+            glDeleteBuffers(1, &entry->mesh.elementBuffer);
+            glDeleteTextures(1, &entry->textures.texture);
+        }
+        if (uploadWindow) {
+            glfwDestroyWindow(uploadWindow);
+        }
+    }
+
+    Loader(const Loader&) = delete;
+    Loader& operator=(const Loader&) = delete;
+
+    Handle loadMesh(const std::string& filePath) {
+        auto entry = std::make_unique<Entry>();
+        entry->kind = Kind::Mesh;
+        entry->mesh.filePath = filePath;
+        return submit(std::move(entry));
+    }
+
+    // one file per layer, every layer the size of the first file
+    Handle loadTextureArray(const std::vector<std::string>& filePaths) {
+        auto entry = std::make_unique<Entry>();
+        entry->kind = Kind::TextureArray;
+        entry->textures.filePaths = filePaths;
+        return submit(std::move(entry));
+    }
+
+    // render thread, once a frame. never blocks on the gpu (but does the
+    // loading itself without a shared context, see the top). returns the
+    // handles that became resident (or failed) since the last call
+    std::vector<Handle> poll() {
+        TRACE_SCOPE("loader poll");
+        if (fallbackJobSystem) {
+            std::vector<Entry*> batch;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch.assign(queue.begin(), queue.end());
+                queue.clear();
+            }
+            loadBatch(*fallbackJobSystem, batch);
+        }
+
+        std::vector<Handle> changed;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto handle = 0u; handle < entries.size(); ++handle) {
+            auto& entry = *entries[handle];
+            if (entry.state != State::Loading || !entry.uploaded) {
+                continue;
+            }
+            if (entry.fence) {
+                auto result = glClientWaitSync(entry.fence, GL_NONE_BIT, 0);
+                if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+                    continue;
+                }
+                glDeleteSync(entry.fence);
+                entry.fence = nullptr;
+                entry.state = State::Resident;
+            } else {
+                entry.state = State::Failed;
+            }
+            entry.timings.residentMs = millisecondsSince(entry.requested);
+            changed.push_back(handle);
+        }
+        return changed;
+    }
+
+    State state(Handle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries[handle]->state;
+    }
+
+    // null until resident
+    const MeshResource* mesh(Handle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto& entry = *entries[handle];
+        return entry.state == State::Resident && entry.kind == Kind::Mesh ? &entry.mesh : nullptr;
+    }
+
+    const TextureResource* textures(Handle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto& entry = *entries[handle];
+        return entry.state == State::Resident && entry.kind == Kind::TextureArray
+                   ? &entry.textures
+                   : nullptr;
+    }
+
+    Timings timings(Handle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries[handle]->timings;
+    }
+
+    // true once nothing is left loading
+    bool idle() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : entries) {
+            if (entry->state == State::Loading) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    enum class Kind { Mesh, TextureArray };
+
+    struct DecodedImage {
+        stbi_uc* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+
+    struct Entry {
+        Kind kind;
+        State state = State::Loading;
+        // set by the loader thread once the fence is in
+        bool uploaded = false;
+        GLsync fence = nullptr;
+        std::chrono::steady_clock::time_point requested = std::chrono::steady_clock::now();
+        Timings timings;
+
+        MeshResource mesh;
+        TextureResource textures;
+
+        // between decode and upload, only touched by the loader thread
+        objLoader::MeshDataElements meshData;
+        std::vector<DecodedImage> images;
+        bool decoded = false;
+    };
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() *
+               1e3;
+    }
+
+    Handle submit(std::unique_ptr<Entry> entry) {
+        Handle handle;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            handle = static_cast<Handle>(entries.size());
+            queue.push_back(entry.get());
+            entries.push_back(std::move(entry));
+        }
+        wake.notify_one();
+        return handle;
+    }
+
+    void run(unsigned decodeThreads) {
+        tracer::setThreadName("loader");
+        glfwMakeContextCurrent(uploadWindow);
+        // glbinding keeps function pointers per context, and which context a
+        // thread uses is per thread
+        glbinding::initialize(reinterpret_cast<glbinding::ContextHandle>(uploadWindow),
+                              glfwGetProcAddress, true, false);
+
+        // made here so this thread is its thread 0 and can wait on it
+        jobs::JobSystem jobSystem(decodeThreads);
+
+        while (true) {
+            std::vector<Entry*> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) {
+                    break;
+                }
+                batch.assign(queue.begin(), queue.end());
+                queue.clear();
+            }
+            loadBatch(jobSystem, batch);
+        }
+
+        glbinding::releaseContext();
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    // on whichever thread has the context that uploads. everything in the
+    // batch decodes at once, and each one is uploaded as soon as it's done,
+    // in the order they were asked for
+    void loadBatch(jobs::JobSystem& jobSystem, const std::vector<Entry*>& batch) {
+        std::vector<jobs::Counter> decodeJobs(batch.size());
+        for (auto i = 0u; i < batch.size(); ++i) {
+            decode(jobSystem, decodeJobs[i], *batch[i]);
+        }
+        for (auto i = 0u; i < batch.size(); ++i) {
+            // the jobs point into the entries, so they always have to finish
+            jobSystem.wait(decodeJobs[i]);
+            if (stopping) {
+                for (auto& image : batch[i]->images) {
+                    stbi_image_free(image.pixels);
+                }
+                continue;
+            }
+            upload(*batch[i], millisecondsSince(batch[i]->requested));
+        }
+    }
+
+    void decode(jobs::JobSystem& jobSystem, jobs::Counter& counter, Entry& entry) {
+        if (entry.kind == Kind::Mesh) {
+            jobSystem.run(counter, [&entry] {
+                TRACE_SCOPE("async mesh parse");
+                // the loader doesn't cope with missing files
+                if (std::filesystem::exists(entry.mesh.filePath)) {
+                    entry.meshData = objLoader::readObjElements(entry.mesh.filePath);
+                    entry.decoded = !entry.meshData.indices.empty();
+                }
+            });
+            return;
+        }
+
+        stbi_set_flip_vertically_on_load(true);
+        entry.images.resize(entry.textures.filePaths.size());
+        for (auto i = 0u; i < entry.images.size(); ++i) {
+            jobSystem.run(counter, [&entry, i] {
+                TRACE_SCOPE("async texture decode");
+                auto& image = entry.images[i];
+                int channels;
+                image.pixels = stbi_load(entry.textures.filePaths[i].c_str(), &image.width,
+                                         &image.height, &channels, 3);
+            });
+        }
+    }
+
+    void upload(Entry& entry, double decodeMs) {
+        TRACE_SCOPE("async upload");
+        bool uploaded = entry.kind == Kind::Mesh ? uploadMesh(entry) : uploadTextures(entry);
+
+        GLsync fence = nullptr;
+        if (uploaded) {
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+            // the fence has to actually reach the gpu before another context
+            // can see it signal
+            glFlush();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entry.fence = fence;
+        entry.uploaded = true;
+        entry.timings.decodeMs = decodeMs;
+        entry.timings.uploadMs = millisecondsSince(entry.requested);
+    }
+
+    bool uploadMesh(Entry& entry) {
+        if (!entry.decoded) {
+            fmt::print(stderr, "{} failed to load\n", entry.mesh.filePath);
+            return false;
+        }
+        auto& meshData = entry.meshData;
+        auto& mesh = entry.mesh;
+
+        glCreateBuffers(1, &mesh.vertexBuffer);
+        glNamedBufferStorage(mesh.vertexBuffer, meshData.vertices.size() * sizeof(vertex3D),
+                             meshData.vertices.data(), GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &mesh.elementBuffer);
+        glNamedBufferStorage(mesh.elementBuffer, meshData.indices.size() * sizeof(GLuint),
+                             meshData.indices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        mesh.groupInfos = std::move(meshData.groupInfos);
+        mesh.bounds = meshData.bounds;
+        mesh.vertexCount = static_cast<uint32_t>(meshData.vertices.size());
+        mesh.indexCount = static_cast<uint32_t>(meshData.indices.size());
+        meshData = {};
+        return true;
+    }
+
+    bool uploadTextures(Entry& entry) {
+        auto& textures = entry.textures;
+        bool loaded = !entry.images.empty();
+        for (auto i = 0u; i < entry.images.size(); ++i) {
+            if (!entry.images[i].pixels) {
+                fmt::print(stderr, "texture {} failed to load\n", textures.filePaths[i]);
+                loaded = false;
+            }
+        }
+        if (loaded) {
+            textures.width = entry.images[0].width;
+            textures.height = entry.images[0].height;
+            GLsizei levels = 1;
+            for (auto size = std::max(textures.width, textures.height); size > 1; size /= 2) {
+                ++levels;
+            }
+
+            glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textures.texture);
+            glTextureStorage3D(textures.texture, levels, GL_RGB8, textures.width, textures.height,
+                               static_cast<GLsizei>(entry.images.size()));
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (auto i = 0u; i < entry.images.size(); ++i) {
+                const auto& image = entry.images[i];
+                if (image.width != textures.width || image.height != textures.height) {
+                    fmt::print(stderr, "{} is {}x{}, layer 0 is {}x{}. skipping it\n",
+                               textures.filePaths[i], image.width, image.height, textures.width,
+                               textures.height);
+                    continue;
+                }
+                glTextureSubImage3D(textures.texture, 0, 0, 0, i, image.width, image.height, 1,
+                                    GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            glTextureParameteri(textures.texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTextureParameteri(textures.texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTextureParameteri(textures.texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTextureParameteri(textures.texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glGenerateTextureMipmap(textures.texture);
+        }
+
+        for (auto& image : entry.images) {
+            stbi_image_free(image.pixels);
+        }
+        entry.images.clear();
+        return loaded;
+    }
+
+    GLFWwindow* uploadWindow = nullptr;
+    std::thread loaderThread;
+    // only without a shared context, poll() loads on the main thread with it
+    std::unique_ptr<jobs::JobSystem> fallbackJobSystem;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping{false};
+    // unique_ptr so entries stay put while the vector grows
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::deque<Entry*> queue;
+};
+
+} // namespace asyncLoading
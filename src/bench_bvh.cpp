@@ -0,0 +1,212 @@
+// build time and ray throughput for bvh.hpp. every mesh is built and traced
+// with one thread and then with all of them, one json line each.
+//
+// two kinds of ray: coherent ones from a camera framing the mesh (neighbours
+// take the same path down the tree, like picking or primary rays) and random
+// ones between points round the bounding sphere and inside the box (like
+// ambient occlusion or bounces, much harder on the caches).
+//
+//   bench_bvh [mesh.obj ...]  meshes to test (default tommy.obj)
+//   --synthetic N            also a generated mesh of about N triangles, can
+//                            be given more than once
+//   --rays N                 rays of each kind per run (default 1000000)
+//   --runs N                 best of N (default 3)
+//   --max-threads N          the "all threads" count (default hardware_concurrency)
+//   --directory DIR          where generated meshes are cached (default .)
+
+#include "bvh.hpp"
+#include "framing.hpp"
+#include "job_system.hpp"
+#include "obj_generator.hpp"
+#include "obj_loader.hpp"
+
+#include <fmt/core.h>
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+struct RaySet {
+    std::vector<bvh::Ray> rays;
+    const char* kind;
+};
+
+// a square image worth of rays through a camera looking at the mesh
+RaySet cameraRays(const bounds::Bounds& meshBounds, uint32_t rayCount) {
+    auto camera = framing::frame(meshBounds, 40.0f, 1.0f);
+    auto eye = camera.target + glm::vec3(0.3f, 0.4f, 0.87f) * camera.distance;
+    auto forward = glm::normalize(camera.target - eye);
+    auto right = glm::normalize(glm::cross(forward, glm::vec3(0.f, 1.f, 0.f)));
+    auto up = glm::cross(right, forward);
+    float halfHeight = std::tan(camera.verticalFov * 0.5f);
+
+    auto side = static_cast<uint32_t>(std::max(1.0, std::sqrt(static_cast<double>(rayCount))));
+    RaySet set{{}, "coherent"};
+    set.rays.reserve(size_t(side) * side);
+    for (auto y = 0u; y < side; ++y) {
+        for (auto x = 0u; x < side; ++x) {
+            float u = ((x + 0.5f) / side * 2.f - 1.f) * halfHeight;
+            float v = ((y + 0.5f) / side * 2.f - 1.f) * halfHeight;
+            set.rays.push_back({eye, glm::normalize(forward + right * u + up * v)});
+        }
+    }
+    return set;
+}
+
+RaySet randomRays(const bounds::Bounds& meshBounds, uint32_t rayCount) {
+    objGenerator::Random random(7);
+    auto pointIn = [&](float scale) {
+        return meshBounds.centre + glm::vec3(random.signedUnit(), random.signedUnit(),
+                                             random.signedUnit()) *
+                                       meshBounds.radius * scale;
+    };
+    RaySet set{{}, "random"};
+    set.rays.reserve(rayCount);
+    for (auto i = 0u; i < rayCount; ++i) {
+        auto origin = pointIn(1.5f);
+        auto target = pointIn(0.5f);
+        set.rays.push_back({origin, glm::normalize(target - origin)});
+    }
+    return set;
+}
+
+struct TraceResult {
+    double seconds = 1e30;
+    uint64_t hits = 0;
+};
+
+TraceResult trace(jobs::JobSystem& jobSystem, const bvh::Bvh& tree, const RaySet& set,
+                  int runs) {
+    TraceResult best;
+    for (int run = 0; run < runs; ++run) {
+        std::atomic<uint64_t> hits{0};
+        auto startTime = steady_clock::now();
+        jobSystem.parallelFor(set.rays.size(), 4096, [&](size_t begin, size_t end) {
+            uint64_t chunkHits = 0;
+            for (auto i = begin; i < end; ++i) {
+                chunkHits += bvh::intersect(tree, set.rays[i]).hit();
+            }
+            hits.fetch_add(chunkHits, std::memory_order_relaxed);
+        });
+        auto seconds = duration<double>(steady_clock::now() - startTime).count();
+        if (seconds < best.seconds) {
+            best = {seconds, hits.load()};
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> meshPaths;
+    std::vector<uint32_t> syntheticTriangles;
+    uint32_t rayCount = 1000000;
+    int runs = 3;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::string directory = ".";
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--synthetic") {
+            syntheticTriangles.push_back(
+                static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10)));
+        } else if (arg == "--rays") {
+            rayCount = static_cast<uint32_t>(std::max(1l, std::atol(nextValue())));
+        } else if (arg == "--runs") {
+            runs = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--max-threads") {
+            maxThreads = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--directory") {
+            directory = nextValue();
+        } else if (arg.rfind("--", 0) == 0) {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        } else {
+            meshPaths.push_back(arg);
+        }
+    }
+    if (meshPaths.empty() && syntheticTriangles.empty()) {
+        meshPaths.push_back("tommy.obj");
+    }
+
+    for (auto triangles : syntheticTriangles) {
+        objGenerator::GeneratorSettings settings;
+        settings.faceCount = std::max(triangles, 2u);
+        settings.vertexCount = std::max(settings.faceCount / 2, 4u);
+        settings.textureCoords = false;
+        auto filePath =
+            (std::filesystem::path(directory) / objGenerator::fileNameFor(settings)).string();
+        if (!std::filesystem::exists(filePath)) {
+            fmt::print(stderr, "generating {}\n", filePath);
+            objGenerator::writeObj(filePath, settings);
+        }
+        meshPaths.push_back(filePath);
+    }
+
+    std::vector<unsigned> threadCounts{1};
+    if (maxThreads > 1) {
+        threadCounts.push_back(maxThreads);
+    }
+
+    for (const auto& meshPath : meshPaths) {
+        if (!std::filesystem::exists(meshPath)) {
+            fmt::print(stderr, "can't find {}, skipping\n", meshPath);
+            continue;
+        }
+        auto meshData = objLoader::readObjElements(meshPath);
+        if (meshData.indices.empty()) {
+            fmt::print(stderr, "{} has no faces, skipping\n", meshPath);
+            continue;
+        }
+        auto triangleCount = meshData.indices.size() / 3;
+        const RaySet raySets[] = {cameraRays(meshData.bounds, rayCount),
+                                  randomRays(meshData.bounds, rayCount)};
+
+        double singleThreadBuildMs = 0.0;
+        for (auto threads : threadCounts) {
+            jobs::JobSystem jobSystem(threads);
+
+            bvh::Bvh tree;
+            double buildMs = 1e30;
+            for (int run = 0; run < runs; ++run) {
+                auto startTime = steady_clock::now();
+                tree = bvh::build(jobSystem, meshData);
+                buildMs = std::min(buildMs,
+                                   duration<double>(steady_clock::now() - startTime).count() * 1e3);
+            }
+            if (threads == 1) {
+                singleThreadBuildMs = buildMs;
+            }
+
+            for (const auto& set : raySets) {
+                auto result = trace(jobSystem, tree, set, runs);
+                fmt::print("{{\"benchmark\":\"bvh\",\"mesh\":\"{}\",\"threads\":{},"
+                           "\"triangles\":{},\"nodes\":{},\"depth\":{},\"buildMs\":{:.2f},"
+                           "\"buildSpeedup\":{:.2f},\"rays\":\"{}\",\"rayCount\":{},"
+                           "\"hitRate\":{:.3f},\"raysPerSecond\":{:.0f}}}\n",
+                           meshPath, threads, triangleCount, tree.nodes.size(), tree.depth,
+                           buildMs, singleThreadBuildMs / buildMs, set.kind, set.rays.size(),
+                           static_cast<double>(result.hits) / set.rays.size(),
+                           set.rays.size() / result.seconds);
+                std::fflush(stdout);
+            }
+        }
+    }
+}
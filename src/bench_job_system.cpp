@@ -0,0 +1,115 @@
+// scaling benchmark for job_system.hpp. runs the per frame scene prep from
+// scene_prep.hpp (animate, cull, pack transforms and build indirect commands)
+// on a big field of instanced meshes with 1, 2, ... N threads and prints one
+// json line per thread count.
+//
+//   --objects N      objects in the scene (default 1000000)
+//   --meshes N       how many different meshes they are spread over (default 8)
+//   --frames N       timed frames per thread count (default 100)
+//   --max-threads N  stop at N threads (default hardware_concurrency)
+
+#include "draw_indirect.hpp"
+#include "job_system.hpp"
+#include "scene_prep.hpp"
+
+#include <fmt/core.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+int main(int argc, char* argv[]) {
+    uint32_t objectCount = 1000000;
+    uint32_t meshCount = 8;
+    int frames = 100;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--objects") {
+            objectCount = static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10));
+        } else if (arg == "--meshes") {
+            meshCount = std::max(1u, static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10)));
+        } else if (arg == "--frames") {
+            frames = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--max-threads") {
+            maxThreads = std::max(1, std::atoi(nextValue()));
+        } else {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    // made up index ranges, the prep never looks at the geometry
+    std::vector<scenePrep::MeshInfo> meshes;
+    for (auto i = 0u; i < meshCount; ++i) {
+        meshes.push_back({i * 30000, 30000, 0, 1.0f});
+    }
+
+    // about half the field is in view from the camera below, so
+    // culling has real work to throw away
+    float fieldSize = std::sqrt(static_cast<float>(objectCount)) * 3.0f;
+    auto scene = scenePrep::makeScene(meshes, objectCount, fieldSize);
+
+    std::vector<glm::mat4> transforms(objectCount);
+    std::vector<DrawElementsIndirectCommand> commands(meshCount);
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, fieldSize);
+
+    double singleThreadMs = 0.0;
+    for (auto threads = 1u; threads <= maxThreads; ++threads) {
+        jobs::JobSystem jobSystem(threads);
+
+        auto prepare = [&](int frame) {
+            float time = static_cast<float>(frame) / 60.0f;
+            glm::mat4 view =
+                glm::lookAt(glm::vec3(std::sin(time * 0.2f) * fieldSize * 0.25f, fieldSize * 0.05f,
+                                      std::cos(time * 0.2f) * fieldSize * 0.25f),
+                            glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+            return scenePrep::prepareFrame(jobSystem, scene, projection * view, time,
+                                           transforms.data(), commands.data());
+        };
+
+        // warm up the workers and the caches
+        for (int frame = 0; frame < 5; ++frame) {
+            prepare(frame);
+        }
+
+        uint64_t visibleTotal = 0;
+        auto startTime = steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            visibleTotal += prepare(frame);
+        }
+        auto seconds = duration<double>(steady_clock::now() - startTime).count();
+        auto msPerFrame = seconds * 1000.0 / frames;
+        if (threads == 1) {
+            singleThreadMs = msPerFrame;
+        }
+
+        auto speedup = singleThreadMs / msPerFrame;
+        fmt::print("{{\"benchmark\":\"job_system_scene_prep\",\"threads\":{},\"objects\":{},"
+                   "\"meshes\":{},\"chunks\":{},\"frames\":{},\"msPerFrame\":{:.3f},"
+                   "\"objectsPerSecond\":{:.0f},\"averageVisible\":{},\"speedup\":{:.2f},"
+                   "\"efficiency\":{:.2f}}}\n",
+                   threads, objectCount, meshCount, scene.chunks.size(), frames, msPerFrame,
+                   static_cast<double>(objectCount) * frames / seconds, visibleTotal / frames,
+                   speedup, speedup / threads);
+        std::fflush(stdout);
+    }
+}
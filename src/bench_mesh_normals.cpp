@@ -0,0 +1,145 @@
+// scaling benchmark for mesh_normals.hpp. builds a torus as a MeshDataElements
+// (with a uv seam, so welding has something to do) and times adjacency,
+// normals and tangents with 1, 2, ... N threads, one json line per count.
+//
+//   --triangles N    roughly how many triangles (default 2000000)
+//   --sides N        segments around the tube. 5 puts a crease on every ring
+//                    edge, 32+ is smooth (default 5)
+//   --crease DEG     crease angle (default 60)
+//   --runs N         best of N per thread count (default 3)
+//   --max-threads N  stop at N threads (default hardware_concurrency)
+
+#include "job_system.hpp"
+#include "mesh_normals.hpp"
+#include "obj_loader.hpp"
+
+#include <fmt/core.h>
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+// rings x sides quads, with an extra column and row of vertices for the uv
+// seams. normals are left at zero for the generator to fill in
+objLoader::MeshDataElements makeTorus(uint32_t rings, uint32_t sides) {
+    objLoader::MeshDataElements meshData;
+    const float majorRadius = 1.0f;
+    const float minorRadius = 0.35f;
+    meshData.vertices.reserve(size_t(rings + 1) * (sides + 1));
+    for (auto r = 0u; r <= rings; ++r) {
+        float u = static_cast<float>(r) / rings;
+        // the seam vertices get exactly the same position as the first ones
+        float theta = (r == rings ? 0.f : u) * 6.2831853f;
+        for (auto s = 0u; s <= sides; ++s) {
+            float w = static_cast<float>(s) / sides;
+            float phi = (s == sides ? 0.f : w) * 6.2831853f;
+            float ring = majorRadius + minorRadius * std::cos(phi);
+            meshData.vertices.push_back({glm::vec3(ring * std::cos(theta),
+                                                   minorRadius * std::sin(phi),
+                                                   ring * std::sin(theta)),
+                                         glm::vec3(0.f), glm::vec2(u * 8.f, w)});
+        }
+    }
+
+    meshData.indices.reserve(size_t(rings) * sides * 6);
+    auto vertex = [sides](uint32_t r, uint32_t s) { return static_cast<int>(r * (sides + 1) + s); };
+    for (auto r = 0u; r < rings; ++r) {
+        for (auto s = 0u; s < sides; ++s) {
+            meshData.indices.insert(meshData.indices.end(),
+                                    {vertex(r, s), vertex(r, s + 1), vertex(r + 1, s + 1),
+                                     vertex(r, s), vertex(r + 1, s + 1), vertex(r + 1, s)});
+        }
+    }
+    meshData.groupInfos.push_back({"torus", 0, static_cast<uint32_t>(meshData.indices.size())});
+    return meshData;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t triangles = 2000000;
+    uint32_t sides = 5;
+    int runs = 3;
+    meshNormals::Settings settings;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--triangles") {
+            triangles = std::strtoull(nextValue(), nullptr, 10);
+        } else if (arg == "--sides") {
+            sides = std::max(3, std::atoi(nextValue()));
+        } else if (arg == "--crease") {
+            settings.creaseAngle = static_cast<float>(std::atof(nextValue()));
+        } else if (arg == "--runs") {
+            runs = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--max-threads") {
+            maxThreads = std::max(1, std::atoi(nextValue()));
+        } else {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    auto rings = static_cast<uint32_t>(std::max<uint64_t>(3, triangles / (2 * sides)));
+    const auto torus = makeTorus(rings, sides);
+
+    double singleThreadMs = 0.0;
+    for (auto threads = 1u; threads <= maxThreads; ++threads) {
+        jobs::JobSystem jobSystem(threads);
+
+        double bestAdjacency = 1e30, bestNormals = 1e30, bestTangents = 1e30, bestTotal = 1e30;
+        uint32_t splitVertices = 0;
+        size_t tangentSplitVertices = 0;
+        for (int run = 0; run < runs; ++run) {
+            // fresh copy every time, generateNormals adds vertices
+            auto meshData = torus;
+
+            auto startTime = steady_clock::now();
+            auto adjacency = meshNormals::buildAdjacency(jobSystem, meshData);
+            auto adjacencyTime = steady_clock::now();
+            splitVertices = meshNormals::generateNormals(jobSystem, meshData, adjacency, settings);
+            auto normalsTime = steady_clock::now();
+            auto verticesBeforeTangents = meshData.vertices.size();
+            auto tangents = meshNormals::generateTangents(jobSystem, meshData, adjacency);
+            auto endTime = steady_clock::now();
+            tangentSplitVertices = meshData.vertices.size() - verticesBeforeTangents;
+
+            auto ms = [](auto from, auto to) { return duration<double>(to - from).count() * 1e3; };
+            bestAdjacency = std::min(bestAdjacency, ms(startTime, adjacencyTime));
+            bestNormals = std::min(bestNormals, ms(adjacencyTime, normalsTime));
+            bestTangents = std::min(bestTangents, ms(normalsTime, endTime));
+            bestTotal = std::min(bestTotal, ms(startTime, endTime));
+        }
+        if (threads == 1) {
+            singleThreadMs = bestTotal;
+        }
+
+        auto triangleCount = torus.indices.size() / 3;
+        auto speedup = singleThreadMs / bestTotal;
+        fmt::print("{{\"benchmark\":\"mesh_normals\",\"threads\":{},\"triangles\":{},"
+                   "\"vertices\":{},\"splitVertices\":{},\"tangentSplitVertices\":{},"
+                   "\"creaseAngle\":{},"
+                   "\"adjacencyMs\":{:.2f},\"normalsMs\":{:.2f},\"tangentsMs\":{:.2f},"
+                   "\"totalMs\":{:.2f},\"trianglesPerSecond\":{:.0f},\"speedup\":{:.2f},"
+                   "\"efficiency\":{:.2f}}}\n",
+                   threads, triangleCount, torus.vertices.size(), splitVertices,
+                   tangentSplitVertices, settings.creaseAngle, bestAdjacency, bestNormals, bestTangents, bestTotal,
+                   triangleCount / (bestTotal / 1e3), speedup, speedup / threads);
+        std::fflush(stdout);
+    }
+}
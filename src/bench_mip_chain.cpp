@@ -0,0 +1,114 @@
+// scaling benchmark for mip_chain.hpp. makes a noisy test image and times the
+// whole chain with the box and kaiser filters on 1, 2, ... N threads, one json
+// line per count.
+//
+//   --size N         width and height of the image (default 2048)
+//   --channels N     1-4 (default 3)
+//   --linear         treat the colour as linear rather than srgb
+//   --runs N         best of N per thread count (default 3)
+//   --max-threads N  stop at N threads (default hardware_concurrency)
+
+#include "job_system.hpp"
+#include "mip_chain.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+// a gradient with a checker and some noise on top, so there's detail at every
+// level for the filters to work on
+std::vector<uint8_t> makeImage(int size, int channels) {
+    std::vector<uint8_t> pixels(size_t(size) * size * channels);
+    uint32_t state = 1;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            state = state * 1664525u + 1013904223u;
+            int noise = static_cast<int>(state >> 27) - 16;
+            bool dark = ((x / 16) + (y / 16)) % 2 == 0;
+            for (int c = 0; c < channels; ++c) {
+                int value = (dark ? 40 : 200) + (x + c * y) * 40 / size + noise;
+                pixels[(size_t(y) * size + x) * channels + c] =
+                    static_cast<uint8_t>(std::clamp(value, 0, 255));
+            }
+        }
+    }
+    return pixels;
+}
+
+int main(int argc, char* argv[]) {
+    int size = 2048;
+    int channels = 3;
+    bool srgb = true;
+    int runs = 3;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--size") {
+            size = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--channels") {
+            channels = std::clamp(std::atoi(nextValue()), 1, 4);
+        } else if (arg == "--linear") {
+            srgb = false;
+        } else if (arg == "--runs") {
+            runs = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--max-threads") {
+            maxThreads = std::max(1, std::atoi(nextValue()));
+        } else {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    const auto image = makeImage(size, channels);
+    const auto levels = mipChain::levelCount(size, size);
+
+    double singleThreadMs[2] = {0.0, 0.0};
+    for (auto threads = 1u; threads <= maxThreads; ++threads) {
+        jobs::JobSystem jobSystem(threads);
+
+        double bestMs[2] = {1e30, 1e30};
+        for (int filter = 0; filter < 2; ++filter) {
+            mipChain::Settings settings;
+            settings.filter = filter == 0 ? mipChain::Filter::Box : mipChain::Filter::Kaiser;
+            settings.srgb = srgb;
+            for (int run = 0; run < runs; ++run) {
+                auto startTime = steady_clock::now();
+                auto chain =
+                    mipChain::generate(jobSystem, image.data(), size, size, channels, settings);
+                auto ms = duration<double>(steady_clock::now() - startTime).count() * 1e3;
+                bestMs[filter] = std::min(bestMs[filter], ms);
+            }
+            if (threads == 1) {
+                singleThreadMs[filter] = bestMs[filter];
+            }
+        }
+
+        auto texels = static_cast<double>(size) * size;
+        fmt::print("{{\"benchmark\":\"mip_chain\",\"threads\":{},\"size\":{},\"channels\":{},"
+                   "\"srgb\":{},\"levels\":{},\"boxMs\":{:.2f},\"kaiserMs\":{:.2f},"
+                   "\"boxMegatexelsPerSecond\":{:.1f},\"kaiserMegatexelsPerSecond\":{:.1f},"
+                   "\"boxSpeedup\":{:.2f},\"kaiserSpeedup\":{:.2f}}}\n",
+                   threads, size, channels, srgb, levels, bestMs[0], bestMs[1],
+                   texels / (bestMs[0] * 1e3), texels / (bestMs[1] * 1e3),
+                   singleThreadMs[0] / bestMs[0], singleThreadMs[1] / bestMs[1]);
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,434 @@
+// benchmarks one of the obj loaders on synthetic meshes from obj_generator.hpp.
+//
+// the loader headers all define the same names so each one gets its own
+// executable. cmake builds this file once per loader with one of these set:
+//   BENCH_OBJ_LOADER, BENCH_OBJ_LOADER2, BENCH_OBJ_LOADER_ELEMENT_CPP,
+//   BENCH_OBJ_LOADER_SIMPLE, BENCH_OBJ_LOADER_SIMPLE_SPLIT,
+//   BENCH_OBJ_LOADER_SIMPLE_SPLIT_CPP, BENCH_FAST_OBJ
+//
+// results are written as one json object per line to stdout (loaders chat on
+// stderr). with no arguments a default matrix of meshes is run. pass any of
+//   --vertices N --faces N --quads --no-vt --no-vn --groups N --decimals N
+//   --messy-whitespace --seed N
+// to run a single configuration instead, and --repeat N / --dir PATH to
+// control the runs. peak rss is for the whole process so far, so run one
+// configuration per process when comparing memory. allocations counts every
+// operator new during a load (averaged over the runs).
+
+#include "obj_generator.hpp"
+#include "trace.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#if defined(BENCH_OBJ_LOADER)
+#include "obj_loader.hpp"
+constexpr const char* loaderName = "obj_loader";
+#elif defined(BENCH_OBJ_LOADER2)
+#include "obj_loader2.hpp"
+constexpr const char* loaderName = "obj_loader2";
+#elif defined(BENCH_OBJ_LOADER_ELEMENT_CPP)
+#include "obj_loader_element_cpp.hpp"
+constexpr const char* loaderName = "obj_loader_element_cpp";
+#elif defined(BENCH_OBJ_LOADER_SIMPLE)
+#include "obj_loader_simple.hpp"
+constexpr const char* loaderName = "obj_loader_simple";
+#elif defined(BENCH_OBJ_LOADER_SIMPLE_SPLIT)
+#include "obj_loader_simple_split.hpp"
+constexpr const char* loaderName = "obj_loader_simple_split";
+#elif defined(BENCH_OBJ_LOADER_SIMPLE_SPLIT_CPP)
+#include "obj_loader_simple_split_cpp.hpp"
+constexpr const char* loaderName = "obj_loader_simple_split_cpp";
+#elif defined(BENCH_FAST_OBJ)
+#define FAST_OBJ_IMPLEMENTATION
+#include "fast_obj.h"
+constexpr const char* loaderName = "fast_obj";
+#else
+#error "define one of the BENCH_* loader selections"
+#endif
+
+using namespace std::chrono;
+
+// count heap allocations so the arena and pre-sizing changes are measurable.
+// relaxed atomics are plenty, the loads are single threaded.
+//
+// every replaceable operator new/delete form is defined so nothing falls back to
+// the library's versions, and they all go through allocate/release below. those
+// two are kept out of line so gcc doesn't inline free() next to a new expression
+// and warn about a mismatch (-Wmismatched-new-delete)
+namespace allocationStats {
+std::atomic<uint64_t> count{0};
+std::atomic<uint64_t> bytes{0};
+
+#if defined(_MSC_VER)
+#define ALLOCATION_STATS_NOINLINE __declspec(noinline)
+#else
+#define ALLOCATION_STATS_NOINLINE __attribute__((noinline))
+#endif
+
+// returns nullptr on failure, the callers decide whether that throws
+ALLOCATION_STATS_NOINLINE void* allocate(size_t size, size_t alignment) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    alignment = std::max(alignment, sizeof(void*));
+#if defined(_WIN32)
+    return _aligned_malloc(size, alignment);
+#else
+    void* pointer = nullptr;
+    if (posix_memalign(&pointer, alignment, size) != 0) {
+        return nullptr;
+    }
+    return pointer;
+#endif
+}
+
+ALLOCATION_STATS_NOINLINE void release(void* pointer, size_t alignment) noexcept {
+#if defined(_WIN32)
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(pointer);
+        return;
+    }
+#else
+    (void)alignment;
+#endif
+    std::free(pointer);
+}
+
+void* allocateOrThrow(size_t size, size_t alignment) {
+    if (void* pointer = allocate(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+} // namespace allocationStats
+
+constexpr size_t defaultAlignment = alignof(std::max_align_t);
+
+void* operator new(size_t size) {
+    return allocationStats::allocateOrThrow(size, defaultAlignment);
+}
+void* operator new[](size_t size) {
+    return allocationStats::allocateOrThrow(size, defaultAlignment);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocationStats::allocate(size, defaultAlignment);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocationStats::allocate(size, defaultAlignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+void operator delete[](void* pointer) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+void operator delete(void* pointer, size_t) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+void operator delete[](void* pointer, size_t) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    allocationStats::release(pointer, defaultAlignment);
+}
+
+// pmr's new_delete_resource goes through the aligned versions
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocationStats::allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocationStats::allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocationStats::allocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocationStats::allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+void operator delete[](void* pointer, std::align_val_t alignment,
+                       const std::nothrow_t&) noexcept {
+    allocationStats::release(pointer, static_cast<size_t>(alignment));
+}
+
+struct LoaderFunction {
+    const char* name;
+    // returns how many triangles (or faces for fast_obj) came out
+    std::function<size_t(const std::string&)> load;
+};
+
+std::vector<LoaderFunction> loaderFunctions() {
+#if defined(BENCH_FAST_OBJ)
+    return {{"fast_obj_read", [](const std::string& filePath) -> size_t {
+                 fastObjMesh* mesh = fast_obj_read(filePath.c_str());
+                 size_t faceCount = mesh ? mesh->face_count : 0;
+                 if (mesh) {
+                     fast_obj_destroy(mesh);
+                 }
+                 return faceCount;
+             }}};
+#else
+    std::vector<LoaderFunction> functions{
+        {"readObjRaw",
+         [](const std::string& filePath) {
+             return objLoader::readObjRaw(filePath).faceIndices.size() / 3;
+         }},
+        {"readObjSplit", [](const std::string& filePath) {
+             return objLoader::readObjSplit(filePath).vertices.size() / 3;
+         }}};
+#if defined(BENCH_OBJ_LOADER) || defined(BENCH_OBJ_LOADER2) ||                              \
+    defined(BENCH_OBJ_LOADER_ELEMENT_CPP)
+    functions.push_back({"readObjElements", [](const std::string& filePath) {
+                             return objLoader::readObjElements(filePath).indices.size() / 3;
+                         }});
+#endif
+#if defined(BENCH_OBJ_LOADER)
+    // same thing with the arena and then the pre-scan switched off, for comparison
+    objLoader::LoadSettings heapSettings;
+    heapSettings.useArena = false;
+    objLoader::LoadSettings growSettings = heapSettings;
+    growSettings.preScan = false;
+    functions.push_back({"readObjSplitNoArena", [heapSettings](const std::string& filePath) {
+                             return objLoader::readObjSplit(filePath, heapSettings)
+                                        .vertices.size() /
+                                    3;
+                         }});
+    functions.push_back({"readObjElementsNoArena", [heapSettings](const std::string& filePath) {
+                             return objLoader::readObjElements(filePath, heapSettings)
+                                        .indices.size() /
+                                    3;
+                         }});
+    functions.push_back({"readObjElementsNoPreScan", [growSettings](const std::string& filePath) {
+                             return objLoader::readObjElements(filePath, growSettings)
+                                        .indices.size() /
+                                    3;
+                         }});
+#endif
+    return functions;
+#endif
+}
+
+long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+struct Options {
+    std::vector<objGenerator::GeneratorSettings> configurations;
+    int repeat = 3;
+    std::string directory = ".";
+};
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    objGenerator::GeneratorSettings settings;
+    bool custom = false;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--vertices") {
+            settings.vertexCount = static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10));
+            custom = true;
+        } else if (arg == "--faces") {
+            settings.faceCount = static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10));
+            custom = true;
+        } else if (arg == "--quads") {
+            settings.quads = true;
+            custom = true;
+        } else if (arg == "--no-vt") {
+            settings.textureCoords = false;
+            custom = true;
+        } else if (arg == "--no-vn") {
+            settings.normals = false;
+            custom = true;
+        } else if (arg == "--groups") {
+            settings.groupCount = static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10));
+            custom = true;
+        } else if (arg == "--decimals") {
+            settings.decimals = std::atoi(nextValue());
+            custom = true;
+        } else if (arg == "--messy-whitespace") {
+            settings.messyWhitespace = true;
+            custom = true;
+        } else if (arg == "--seed") {
+            settings.seed = static_cast<uint32_t>(std::strtoul(nextValue(), nullptr, 10));
+            custom = true;
+        } else if (arg == "--repeat") {
+            options.repeat = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--dir") {
+            options.directory = nextValue();
+        } else {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (custom) {
+        options.configurations.push_back(settings);
+        return options;
+    }
+
+    // default matrix. each one changes a single thing from the baseline
+    objGenerator::GeneratorSettings baseline;
+    baseline.vertexCount = 250000;
+    baseline.faceCount = 500000;
+    options.configurations.push_back(baseline);
+
+    auto quads = baseline;
+    quads.quads = true;
+    quads.faceCount /= 2;
+    options.configurations.push_back(quads);
+
+    auto positionsOnly = baseline;
+    positionsOnly.textureCoords = false;
+    positionsOnly.normals = false;
+    options.configurations.push_back(positionsOnly);
+
+    auto normalsOnly = baseline;
+    normalsOnly.textureCoords = false;
+    options.configurations.push_back(normalsOnly);
+
+    auto manyGroups = baseline;
+    manyGroups.groupCount = 1000;
+    options.configurations.push_back(manyGroups);
+
+    auto longLines = baseline;
+    longLines.decimals = 9;
+    options.configurations.push_back(longLines);
+
+    // outputCount should match the baseline's, the extra whitespace mustn't
+    // change the corner count of any face
+    auto messyWhitespace = baseline;
+    messyWhitespace.messyWhitespace = true;
+    options.configurations.push_back(messyWhitespace);
+
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    auto options = parseOptions(argc, argv);
+
+    // record the loader phases so we can report them per run
+    tracer::enable();
+
+    for (const auto& settings : options.configurations) {
+        auto filePath =
+            (std::filesystem::path(options.directory) / objGenerator::fileNameFor(settings))
+                .string();
+        if (!std::filesystem::exists(filePath)) {
+            fmt::print(stderr, "generating {}\n", filePath);
+            objGenerator::writeObj(filePath, settings);
+        }
+        auto fileBytes = std::filesystem::file_size(filePath);
+
+        for (const auto& function : loaderFunctions()) {
+            std::vector<double> times;
+            std::unordered_map<std::string, double> phases;
+            size_t outputCount = 0;
+            uint64_t allocations = 0;
+            uint64_t allocatedBytes = 0;
+
+            for (int run = 0; run < options.repeat; ++run) {
+                auto phasesBefore = tracer::totalsByName();
+                auto allocationsBefore = allocationStats::count.load();
+                auto bytesBefore = allocationStats::bytes.load();
+                auto startTime = steady_clock::now();
+
+                outputCount = function.load(filePath);
+
+                times.push_back(duration<double>(steady_clock::now() - startTime).count());
+                allocations += (allocationStats::count.load() - allocationsBefore) / options.repeat;
+                allocatedBytes += (allocationStats::bytes.load() - bytesBefore) / options.repeat;
+                for (const auto& [name, seconds] : tracer::totalsByName()) {
+                    phases[name] += (seconds - phasesBefore[name]) / options.repeat;
+                }
+            }
+
+            auto best = *std::min_element(times.begin(), times.end());
+            double mean = 0.0;
+            for (auto time : times) {
+                mean += time / static_cast<double>(times.size());
+            }
+
+            std::string phaseJson;
+            for (const auto& [name, seconds] : phases) {
+                phaseJson += fmt::format("{}\"{}\":{:.6f}", phaseJson.empty() ? "" : ",", name,
+                                         seconds);
+            }
+
+            fmt::print("{{\"loader\":\"{}\",\"function\":\"{}\",\"file\":\"{}\","
+                       "\"vertices\":{},\"faces\":{},\"quads\":{},\"textureCoords\":{},"
+                       "\"normals\":{},\"groups\":{},\"decimals\":{},\"messyWhitespace\":{},"
+                       "\"fileBytes\":{},\"runs\":{},\"bestSeconds\":{:.6f},\"meanSeconds\":{:.6f},"
+                       "\"mbPerSecond\":{:.2f},\"facesPerSecond\":{:.0f},\"outputCount\":{},"
+                       "\"allocations\":{},\"allocatedMb\":{:.2f},\"peakRssKb\":{},"
+                       "\"phases\":{{{}}}}}\n",
+                       loaderName, function.name, objGenerator::fileNameFor(settings),
+                       settings.vertexCount, settings.faceCount, settings.quads,
+                       settings.textureCoords, settings.normals, settings.groupCount,
+                       settings.decimals, settings.messyWhitespace, fileBytes, options.repeat,
+                       best, mean,
+                       static_cast<double>(fileBytes) / (1024.0 * 1024.0) / best,
+                       static_cast<double>(settings.faceCount) / best, outputCount, allocations,
+                       static_cast<double>(allocatedBytes) / (1024.0 * 1024.0), peakRssKb(),
+                       phaseJson);
+            std::fflush(stdout);
+        }
+    }
+}
@@ -0,0 +1,258 @@
+// renders chapter 19's frame (background triangle, then the mesh as one
+// indirect call per group into a texture array) with soft_raster.hpp, so it
+// can be looked at and timed without a gpu. runs with 1, 2, ... N threads,
+// prints one json line per count and writes the last frame out as a ppm.
+//
+//   bench_soft_raster [mesh.obj]    default tommy.obj
+//   --texture FILE      a texture array layer, repeat for more (default
+//                       chapter 19's body and clothes textures)
+//   --layers 0,0,0,1,1  texture layer per group (default chapter 19's)
+//   --shading MODE      normals, lit or textured (default textured)
+//   --size WxH          default 1280x640
+//   --frames N          frames per thread count (default 30)
+//   --time T            orbit time of the first frame in seconds (default 0)
+//   --output FILE       default soft_raster.ppm
+//   --max-threads N     stop at N threads (default hardware_concurrency)
+
+#include "draw_indirect.hpp"
+#include "framing.hpp"
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "soft_raster.hpp"
+
+#include <fmt/core.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+// every layer ends up the size of the first, like the gl texture array
+softRaster::TextureArray loadTextureArray(const std::vector<std::string>& filePaths) {
+    softRaster::TextureArray textures;
+    stbi_set_flip_vertically_on_load(true);
+    for (const auto& filePath : filePaths) {
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, 3);
+        if (!pixels) {
+            fmt::print(stderr, "texture {} failed to load\n", filePath);
+            return {};
+        }
+        if (textures.layers == 0) {
+            textures.width = width;
+            textures.height = height;
+        }
+        auto layerStart = textures.texels.size();
+        textures.texels.resize(layerStart + size_t(textures.width) * textures.height * 3);
+        for (auto y = 0; y < textures.height; ++y) {
+            for (auto x = 0; x < textures.width; ++x) {
+                auto sourceX = x * width / textures.width;
+                auto sourceY = y * height / textures.height;
+                for (auto c = 0; c < 3; ++c) {
+                    textures.texels[layerStart + (size_t(y) * textures.width + x) * 3 + c] =
+                        pixels[(size_t(sourceY) * width + sourceX) * 3 + c];
+                }
+            }
+        }
+        stbi_image_free(pixels);
+        ++textures.layers;
+    }
+    return textures;
+}
+
+int main(int argc, char* argv[]) {
+    std::string meshPath = "tommy.obj";
+    std::vector<std::string> texturePaths;
+    std::vector<float> layers = {0.f, 0.f, 0.f, 1.f, 1.f};
+    auto shading = softRaster::Shading::TexturedLit;
+    int width = 1280;
+    int height = 640;
+    int frames = 30;
+    float firstFrameTime = 0.f;
+    std::string outputPath = "soft_raster.ppm";
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        auto nextValue = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                fmt::print(stderr, "{} needs a value\n", arg);
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--texture") {
+            texturePaths.push_back(nextValue());
+        } else if (arg == "--layers") {
+            layers.clear();
+            char* end = nullptr;
+            for (const char* p = nextValue(); *p; p = end + 1) {
+                layers.push_back(std::strtof(p, &end));
+                if (*end != ',') {
+                    break;
+                }
+            }
+        } else if (arg == "--shading") {
+            auto mode = std::string(nextValue());
+            if (mode == "normals") {
+                shading = softRaster::Shading::Normals;
+            } else if (mode == "lit") {
+                shading = softRaster::Shading::Lit;
+            } else if (mode == "textured") {
+                shading = softRaster::Shading::TexturedLit;
+            } else {
+                fmt::print(stderr, "unknown shading {}\n", mode);
+                std::exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--size") {
+            if (std::sscanf(nextValue(), "%dx%d", &width, &height) != 2) {
+                fmt::print(stderr, "--size wants WxH\n");
+                std::exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--frames") {
+            frames = std::max(1, std::atoi(nextValue()));
+        } else if (arg == "--time") {
+            firstFrameTime = static_cast<float>(std::atof(nextValue()));
+        } else if (arg == "--output") {
+            outputPath = nextValue();
+        } else if (arg == "--max-threads") {
+            maxThreads = std::max(1, std::atoi(nextValue()));
+        } else if (arg.rfind("--", 0) == 0) {
+            fmt::print(stderr, "unknown argument {}\n", arg);
+            std::exit(EXIT_FAILURE);
+        } else {
+            meshPath = arg;
+        }
+    }
+    if (texturePaths.empty()) {
+        texturePaths = {"body_diffuse.jpg", "tankTops_pants_boots_diffuse.jpg"};
+    }
+
+    if (!std::filesystem::exists(meshPath)) {
+        fmt::print(stderr, "can't find {}\n", meshPath);
+        return EXIT_FAILURE;
+    }
+    auto meshData = objLoader::readObjElements(meshPath);
+    if (meshData.indices.empty()) {
+        fmt::print(stderr, "{} has no faces\n", meshPath);
+        return EXIT_FAILURE;
+    }
+
+    softRaster::TextureArray textures;
+    if (shading == softRaster::Shading::TexturedLit) {
+        textures = loadTextureArray(texturePaths);
+        if (textures.layers == 0) {
+            fmt::print(stderr, "no textures, shading untextured\n");
+            shading = softRaster::Shading::Lit;
+        }
+    }
+
+    // the same commands chapter 19 builds, one per group with the group
+    // index as baseInstance so it picks its texture layer
+    std::vector<DrawElementsIndirectCommand> meshDraws;
+    for (auto g = 0u; g < meshData.groupInfos.size(); ++g) {
+        const auto& group = meshData.groupInfos[g];
+        meshDraws.push_back({group.count, 1, group.startOffset, 0, g});
+    }
+
+    // clang-format off
+    const std::vector<vertex3D> backGroundVertices {{
+        //   position   |           normal        |  texCoord
+        {{-1.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {0.f, 0.f}},
+        {{ 3.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {3.f, 0.f}},
+        {{-1.f,  3.f, 0.999999f},  {0.80f, 0.82f, 0.80f}, {0.f, 3.f}}
+    }};
+    // clang-format on
+    const std::vector<int> backGroundIndices{0, 1, 2};
+    const std::vector<DrawElementsIndirectCommand> backGroundDraw{{3, 1, 0, 0, 0}};
+
+    softRaster::DrawState backGroundState;
+    backGroundState.mvp = glm::ortho(-1.f, 1.f, -1.f, 1.f, 1.f, -1.f);
+    backGroundState.shading = softRaster::Shading::Normals;
+
+    softRaster::DrawState meshState;
+    meshState.shading = shading;
+    meshState.textures = &textures;
+    meshState.textureIndices = layers;
+
+    auto camera = framing::frame(meshData.bounds, 40.0f,
+                                 static_cast<float>(width) / static_cast<float>(height));
+    auto projection = camera.projection();
+
+    auto frameHash = [](const softRaster::Renderer& renderer) {
+        uint64_t hash = 1469598103934665603ull;
+        for (auto y = 0; y < renderer.frameHeight(); ++y) {
+            for (auto x = 0; x < renderer.frameWidth(); ++x) {
+                hash = (hash ^ renderer.pixel(x, y)) * 1099511628211ull;
+            }
+        }
+        return hash;
+    };
+
+    uint64_t singleThreadHash = 0;
+    double singleThreadMs = 0.0;
+    for (auto threads = 1u; threads <= maxThreads; ++threads) {
+        jobs::JobSystem jobSystem(threads);
+        softRaster::Renderer renderer(jobSystem, width, height);
+
+        softRaster::Stats totals;
+        double overdraw = 0.0;
+        auto startTime = steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            renderer.resetStats();
+            renderer.clear(glm::vec4(0.f, 0.f, 0.f, 1.f), 1.0f);
+            renderer.drawElementsIndirect(backGroundVertices, backGroundIndices, backGroundDraw,
+                                          backGroundState);
+
+            // chapter 19's orbit at 60 frames a second
+            float currentTime = firstFrameTime + frame / 60.0f;
+            float elevation = 0.1f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.12f;
+            meshState.mvp = projection * camera.orbit(currentTime * 0.5f, elevation);
+            renderer.drawElementsIndirect(meshData.vertices, meshData.indices, meshDraws,
+                                          meshState);
+            totals.add(renderer.stats());
+            overdraw += renderer.overdraw();
+        }
+        auto seconds = duration<double>(steady_clock::now() - startTime).count();
+
+        auto hash = frameHash(renderer);
+        if (threads == 1) {
+            singleThreadHash = hash;
+            singleThreadMs = seconds * 1e3 / frames;
+        }
+        if (threads == maxThreads) {
+            renderer.writePpm(outputPath);
+        }
+
+        auto msPerFrame = seconds * 1e3 / frames;
+        fmt::print("{{\"benchmark\":\"soft_raster\",\"mesh\":\"{}\",\"threads\":{},"
+                   "\"width\":{},\"height\":{},\"frames\":{},\"msPerFrame\":{:.3f},"
+                   "\"vertexMs\":{:.3f},\"setupMs\":{:.3f},\"rasterMs\":{:.3f},"
+                   "\"trianglesPerFrame\":{},\"culledPerFrame\":{},\"clippedPerFrame\":{},"
+                   "\"tileBinsPerFrame\":{},\"fragmentsPerFrame\":{},\"trianglesPerSecond\":{:.0f},"
+                   "\"fragmentsPerSecond\":{:.0f},\"overdraw\":{:.3f},\"speedup\":{:.2f},"
+                   "\"matchesSingleThread\":{}}}\n",
+                   meshPath, threads, width, height, frames, msPerFrame,
+                   totals.vertexMs / frames, totals.setupMs / frames, totals.rasterMs / frames,
+                   totals.trianglesSubmitted / frames, totals.trianglesCulled / frames,
+                   totals.trianglesClipped / frames, totals.tileBins / frames,
+                   totals.fragmentsShaded / frames, totals.trianglesSubmitted / seconds,
+                   totals.fragmentsShaded / seconds, overdraw / frames,
+                   singleThreadMs / msPerFrame, hash == singleThreadHash ? "true" : "false");
+        std::fflush(stdout);
+    }
+}
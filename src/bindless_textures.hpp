@@ -0,0 +1,257 @@
+#pragma once
+
+// two ways of giving a multi draw a different texture per command.
+//
+// TextureSet with handles (ARB_bindless_texture): every texture keeps its own
+// size and format. each gets a 64 bit handle that is made resident once, and
+// the handles go in a storage buffer the shader indexes, so nothing is bound
+// per draw and nothing is bound per frame. without handles it's the same
+// textures bound one at a time, the way chapter 16 does it.
+//
+//  #extension GL_ARB_bindless_texture : require
+//  layout (std430, binding = 1) readonly buffer TextureHandles { sampler2D textures[]; };
+//  ... texture(textures[textureIndex], uv)
+//
+// TextureArray (the fallback, what chapters 17-19 do): every texture becomes
+// a layer of one GL_TEXTURE_2D_ARRAY, so every layer is the size of the
+// biggest texture and smaller ones are scaled up to fill it.
+//
+// both report the bytes they allocated so the two can be compared.
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace gl;
+
+namespace bindless {
+
+// tightly packed rows, bottom row first like stbi with flipping on
+struct Image {
+    std::vector<uint8_t> pixels;
+    int width = 0;
+    int height = 0;
+    int channels = 4;
+};
+
+inline bool supported() {
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; ++i) {
+        auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && std::strcmp(name, "GL_ARB_bindless_texture") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline GLsizei mipLevels(int width, int height) {
+    GLsizei levels = 1;
+    for (auto size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+// a full mip chain, about a third more than the top level
+inline size_t mipChainBytes(int width, int height, int bytesPerTexel) {
+    size_t bytes = 0;
+    for (auto level = 0; level < mipLevels(width, height); ++level) {
+        auto texels = size_t(std::max(width >> level, 1)) * std::max(height >> level, 1);
+        bytes += texels * bytesPerTexel;
+    }
+    return bytes;
+}
+
+namespace detail {
+
+// rgb8 is commonly padded to 4 bytes by the driver, but that's its business.
+// this is what was asked for
+inline GLenum internalFormat(int channels) {
+    switch (channels) {
+    case 1:
+        return GL_R8;
+    case 2:
+        return GL_RG8;
+    case 3:
+        return GL_RGB8;
+    default:
+        return GL_RGBA8;
+    }
+}
+
+inline GLenum pixelFormat(int channels) {
+    switch (channels) {
+    case 1:
+        return GL_RED;
+    case 2:
+        return GL_RG;
+    case 3:
+        return GL_RGB;
+    default:
+        return GL_RGBA;
+    }
+}
+
+inline void setSampling(GLuint texture) {
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+} // namespace detail
+
+// one texture per image at its own size and format. withHandles needs
+// supported() to be true
+class TextureSet {
+  public:
+    TextureSet(const std::vector<Image>& images, bool withHandles) {
+        textures.resize(images.size());
+        glCreateTextures(GL_TEXTURE_2D, static_cast<GLsizei>(textures.size()), textures.data());
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (auto i = 0u; i < images.size(); ++i) {
+            const auto& image = images[i];
+            auto texture = textures[i];
+            glTextureStorage2D(texture, mipLevels(image.width, image.height),
+                               detail::internalFormat(image.channels), image.width,
+                               image.height);
+            glTextureSubImage2D(texture, 0, 0, 0, image.width, image.height,
+                                detail::pixelFormat(image.channels), GL_UNSIGNED_BYTE,
+                                image.pixels.data());
+            detail::setSampling(texture);
+            // one and two channels are grey and grey + alpha, not red and red/green
+            if (image.channels <= 2) {
+                const GLint grey[] = {static_cast<GLint>(GL_RED), static_cast<GLint>(GL_RED),
+                                      static_cast<GLint>(GL_RED),
+                                      static_cast<GLint>(image.channels == 2 ? GL_GREEN : GL_ONE)};
+                glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, grey);
+            }
+            glGenerateTextureMipmap(texture);
+            allocatedBytes += mipChainBytes(image.width, image.height, image.channels);
+
+            if (withHandles) {
+                // the texture's parameters are frozen from here on
+                handles.push_back(glGetTextureHandleARB(texture));
+                glMakeTextureHandleResidentARB(handles.back());
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        if (!withHandles) {
+            return;
+        }
+        glCreateBuffers(1, &handleBuffer);
+        glNamedBufferStorage(handleBuffer, std::max<size_t>(handles.size(), 1) * sizeof(GLuint64),
+                             handles.data(), GL_NONE_BIT);
+    }
+
+    ~TextureSet() {
+        for (auto handle : handles) {
+            glMakeTextureHandleNonResidentARB(handle);
+        }
+        glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+        if (handleBuffer) {
+            glDeleteBuffers(1, &handleBuffer);
+        }
+    }
+
+    TextureSet(const TextureSet&) = delete;
+    TextureSet& operator=(const TextureSet&) = delete;
+
+    // the shader's handle array, sampler2D textures[] in a std430 block.
+    // only with handles
+    void bind(GLuint storageBinding) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, storageBinding, handleBuffer);
+    }
+
+    // for drawing without bindless, one glBindTextureUnit per draw
+    GLuint texture(size_t index) const {
+        return textures[index];
+    }
+
+    size_t bytes() const {
+        return allocatedBytes;
+    }
+
+  private:
+    std::vector<GLuint> textures;
+    std::vector<GLuint64> handles;
+    GLuint handleBuffer = 0;
+    size_t allocatedBytes = 0;
+};
+
+// every image as a layer of one rgba8 array the size of the biggest image.
+// smaller ones are stretched (nearest) to fill the layer so uvs still go 0-1
+class TextureArray {
+  public:
+    explicit TextureArray(const std::vector<Image>& images) {
+        for (const auto& image : images) {
+            width = std::max(width, image.width);
+            height = std::max(height, image.height);
+        }
+        auto layers = static_cast<GLsizei>(std::max<size_t>(images.size(), 1));
+        width = std::max(width, 1);
+        height = std::max(height, 1);
+
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureName);
+        glTextureStorage3D(textureName, mipLevels(width, height), GL_RGBA8, width, height, layers);
+
+        std::vector<uint8_t> layer(size_t(width) * height * 4);
+        for (auto i = 0u; i < images.size(); ++i) {
+            const auto& image = images[i];
+            for (auto y = 0; y < height; ++y) {
+                auto sourceY = size_t(y) * image.height / height;
+                for (auto x = 0; x < width; ++x) {
+                    auto sourceX = size_t(x) * image.width / width;
+                    const auto* source =
+                        &image.pixels[(sourceY * image.width + sourceX) * image.channels];
+                    auto* texel = &layer[(size_t(y) * width + x) * 4];
+                    // the same grey (+ alpha) TextureSet swizzles to
+                    texel[0] = source[0];
+                    texel[1] = image.channels > 2 ? source[1] : source[0];
+                    texel[2] = image.channels > 2 ? source[2] : source[0];
+                    texel[3] = image.channels == 4   ? source[3]
+                               : image.channels == 2 ? source[1]
+                                                     : 255;
+                }
+            }
+            glTextureSubImage3D(textureName, 0, 0, 0, i, width, height, 1, GL_RGBA,
+                                GL_UNSIGNED_BYTE, layer.data());
+        }
+        detail::setSampling(textureName);
+        glGenerateTextureMipmap(textureName);
+        allocatedBytes = mipChainBytes(width, height, 4) * layers;
+    }
+
+    ~TextureArray() {
+        glDeleteTextures(1, &textureName);
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    GLuint name() const {
+        return textureName;
+    }
+
+    size_t bytes() const {
+        return allocatedBytes;
+    }
+
+  private:
+    GLuint textureName = 0;
+    int width = 0;
+    int height = 0;
+    size_t allocatedBytes = 0;
+};
+
+} // namespace bindless
@@ -0,0 +1,262 @@
+#pragma once
+
+// axis aligned boxes and bounding spheres, plus the frustum tests that use
+// them. the min/max reductions are the hot part (they run over every position
+// of a mesh at load) so each has an avx2 and an sse2 version, falling back to
+// plain loops on anything else.
+//
+//  auto meshBounds = bounds::ofPositions(&positions[0].x, positions.size());
+//  auto planes = bounds::frustumPlanes(projection * view);
+//  if (bounds::visible(planes, meshBounds)) { ... }
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace bounds {
+
+struct Bounds {
+    // min > max while empty, so expanding just works
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    // sphere round the middle of the box, through its corners. looser than
+    // the tightest sphere but it comes for free once the box is known
+    glm::vec3 centre = glm::vec3(0.f);
+    float radius = 0.f;
+
+    bool empty() const {
+        return min.x > max.x;
+    }
+};
+
+inline Bounds fromMinMax(const glm::vec3& min, const glm::vec3& max) {
+    Bounds result;
+    result.min = min;
+    result.max = max;
+    if (!result.empty()) {
+        result.centre = (min + max) * 0.5f;
+        result.radius = glm::length(max - min) * 0.5f;
+    }
+    return result;
+}
+
+inline Bounds merge(const Bounds& a, const Bounds& b) {
+    return fromMinMax(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+// a contiguous array of xyz floats, like RawMeshData::positions
+inline Bounds ofPositions(const float* xyz, size_t count) {
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    size_t i = 0;
+
+#if defined(__AVX__) || defined(__AVX2__)
+    // 8 positions are 24 floats, exactly 3 registers. lane j of the three
+    // registers laid end to end always holds component j % 3
+    if (count >= 8) {
+        __m256 mins[3], maxs[3];
+        for (auto k = 0; k < 3; ++k) {
+            mins[k] = _mm256_set1_ps(FLT_MAX);
+            maxs[k] = _mm256_set1_ps(-FLT_MAX);
+        }
+        for (; i + 8 <= count; i += 8) {
+            const float* p = xyz + i * 3;
+            for (auto k = 0; k < 3; ++k) {
+                auto v = _mm256_loadu_ps(p + k * 8);
+                mins[k] = _mm256_min_ps(mins[k], v);
+                maxs[k] = _mm256_max_ps(maxs[k], v);
+            }
+        }
+        float lows[24], highs[24];
+        for (auto k = 0; k < 3; ++k) {
+            _mm256_storeu_ps(lows + k * 8, mins[k]);
+            _mm256_storeu_ps(highs + k * 8, maxs[k]);
+        }
+        for (auto j = 0; j < 24; ++j) {
+            min[j % 3] = std::min(min[j % 3], lows[j]);
+            max[j % 3] = std::max(max[j % 3], highs[j]);
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    // same again with 4 positions in 3 registers
+    if (count >= 4) {
+        __m128 mins[3], maxs[3];
+        for (auto k = 0; k < 3; ++k) {
+            mins[k] = _mm_set1_ps(FLT_MAX);
+            maxs[k] = _mm_set1_ps(-FLT_MAX);
+        }
+        for (; i + 4 <= count; i += 4) {
+            const float* p = xyz + i * 3;
+            for (auto k = 0; k < 3; ++k) {
+                auto v = _mm_loadu_ps(p + k * 4);
+                mins[k] = _mm_min_ps(mins[k], v);
+                maxs[k] = _mm_max_ps(maxs[k], v);
+            }
+        }
+        float lows[12], highs[12];
+        for (auto k = 0; k < 3; ++k) {
+            _mm_storeu_ps(lows + k * 4, mins[k]);
+            _mm_storeu_ps(highs + k * 4, maxs[k]);
+        }
+        for (auto j = 0; j < 12; ++j) {
+            min[j % 3] = std::min(min[j % 3], lows[j]);
+            max[j % 3] = std::max(max[j % 3], highs[j]);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        for (auto c = 0; c < 3; ++c) {
+            min[c] = std::min(min[c], xyz[i * 3 + c]);
+            max[c] = std::max(max[c], xyz[i * 3 + c]);
+        }
+    }
+    return fromMinMax(min, max);
+}
+
+// positions inside bigger vertices, stride floats apart, like the position of
+// a vertex3D. the simd versions read a fourth float after each position, so
+// they need stride >= 4
+inline Bounds ofVertices(const float* firstPosition, size_t count, size_t stride) {
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    size_t i = 0;
+
+#if defined(__AVX__) || defined(__AVX2__)
+    if (stride >= 4 && count >= 2) {
+        // two vertices per register, the fourth lane of each half is junk
+        auto lowest = _mm256_set1_ps(FLT_MAX);
+        auto highest = _mm256_set1_ps(-FLT_MAX);
+        for (; i + 2 <= count; i += 2) {
+            auto v = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(firstPosition + i * stride)),
+                _mm_loadu_ps(firstPosition + (i + 1) * stride), 1);
+            lowest = _mm256_min_ps(lowest, v);
+            highest = _mm256_max_ps(highest, v);
+        }
+        float lows[8], highs[8];
+        _mm256_storeu_ps(lows, lowest);
+        _mm256_storeu_ps(highs, highest);
+        for (auto c = 0; c < 3; ++c) {
+            min[c] = std::min(lows[c], lows[c + 4]);
+            max[c] = std::max(highs[c], highs[c + 4]);
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    if (stride >= 4 && count >= 1) {
+        auto lowest = _mm_set1_ps(FLT_MAX);
+        auto highest = _mm_set1_ps(-FLT_MAX);
+        for (; i < count; ++i) {
+            auto v = _mm_loadu_ps(firstPosition + i * stride);
+            lowest = _mm_min_ps(lowest, v);
+            highest = _mm_max_ps(highest, v);
+        }
+        float lows[4], highs[4];
+        _mm_storeu_ps(lows, lowest);
+        _mm_storeu_ps(highs, highest);
+        min = glm::vec3(lows[0], lows[1], lows[2]);
+        max = glm::vec3(highs[0], highs[1], highs[2]);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const float* p = firstPosition + i * stride;
+        min = glm::min(min, glm::vec3(p[0], p[1], p[2]));
+        max = glm::max(max, glm::vec3(p[0], p[1], p[2]));
+    }
+    return fromMinMax(min, max);
+}
+
+// the positions a range of an index buffer points at, ie. one group of a
+// MeshDataElements
+inline Bounds ofIndexedVertices(const float* firstPosition, size_t stride, const int* indices,
+                                size_t count) {
+    glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    // gather x, y and z for 8 indices at a time
+    if (count >= 8) {
+        const auto strides = _mm256_set1_epi32(static_cast<int>(stride));
+        __m256 lowest[3], highest[3];
+        for (auto c = 0; c < 3; ++c) {
+            lowest[c] = _mm256_set1_ps(FLT_MAX);
+            highest[c] = _mm256_set1_ps(-FLT_MAX);
+        }
+        for (; i + 8 <= count; i += 8) {
+            auto offsets = _mm256_mullo_epi32(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + i)), strides);
+            for (auto c = 0; c < 3; ++c) {
+                auto v = _mm256_i32gather_ps(firstPosition + c, offsets, 4);
+                lowest[c] = _mm256_min_ps(lowest[c], v);
+                highest[c] = _mm256_max_ps(highest[c], v);
+            }
+        }
+        float lows[8], highs[8];
+        for (auto c = 0; c < 3; ++c) {
+            _mm256_storeu_ps(lows, lowest[c]);
+            _mm256_storeu_ps(highs, highest[c]);
+            min[c] = *std::min_element(lows, lows + 8);
+            max[c] = *std::max_element(highs, highs + 8);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const float* p = firstPosition + static_cast<size_t>(indices[i]) * stride;
+        min = glm::min(min, glm::vec3(p[0], p[1], p[2]));
+        max = glm::max(max, glm::vec3(p[0], p[1], p[2]));
+    }
+    return fromMinMax(min, max);
+}
+
+// planes facing inwards, xyz normal and w distance
+inline std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& viewProjection) {
+    auto row = [&](int i) {
+        return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+                         viewProjection[3][i]);
+    };
+    std::array<glm::vec4, 6> planes{row(3) + row(0), row(3) - row(0), row(3) + row(1),
+                                    row(3) - row(1), row(3) + row(2), row(3) - row(2)};
+    for (auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+inline bool sphereVisible(const std::array<glm::vec4, 6>& planes, const glm::vec3& centre,
+                          float radius) {
+    for (const auto& plane : planes) {
+        if (glm::dot(glm::vec3(plane), centre) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// box against the frustum, testing the corner furthest along each plane's
+// normal. a bit tighter than the sphere
+inline bool visible(const std::array<glm::vec4, 6>& planes, const Bounds& box) {
+    if (box.empty()) {
+        return false;
+    }
+    for (const auto& plane : planes) {
+        glm::vec3 furthest(plane.x >= 0.f ? box.max.x : box.min.x,
+                           plane.y >= 0.f ? box.max.y : box.min.y,
+                           plane.z >= 0.f ? box.max.z : box.min.z);
+        if (glm::dot(glm::vec3(plane), furthest) + plane.w < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace bounds
@@ -0,0 +1,677 @@
+#pragma once
+
+// bounding volume hierarchy over the triangles of a MeshDataElements, for
+// ray queries on the cpu (mouse picking, visibility, baking).
+//
+//  auto tree = bvh::build(jobSystem, meshData);
+//  auto hit = bvh::intersect(tree, {origin, direction});
+//  if (hit.hit()) { meshData.indices[hit.triangle * 3] ... }
+//
+// the build is binned sah: at each node the triangle centroids are dropped
+// into a handful of bins per axis and the split with the lowest surface area
+// cost is taken. nodes above a size threshold hand one child to the job system
+// so the top few levels (where most of the work is) run in parallel.
+//
+// nodes are 32 bytes, two to a cache line, and siblings sit next to each
+// other so an inner node only needs the index of its first child. leaves
+// keep their triangles in one run, stored as structure of arrays so 8 (avx)
+// or 4 (sse) ray/triangle tests run at once.
+
+#include "bounds.hpp"
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "trace.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace bvh {
+
+struct Node {
+    glm::vec3 min;
+    // inner nodes: the left child, the right one is right after it.
+    // leaves: the first triangle
+    uint32_t leftOrFirst;
+    glm::vec3 max;
+    // triangles in a leaf, 0 for inner nodes
+    uint32_t count;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+};
+static_assert(sizeof(Node) == 32, "bvh nodes should pack two to a cache line");
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMax = FLT_MAX;
+};
+
+struct Hit {
+    float t = FLT_MAX;
+    // index into the mesh's triangles, so its corners are indices[triangle * 3 + 0..2]
+    uint32_t triangle = UINT32_MAX;
+    // barycentrics of corners 1 and 2
+    float u = 0.f;
+    float v = 0.f;
+
+    bool hit() const {
+        return triangle != UINT32_MAX;
+    }
+};
+
+struct BuildSettings {
+    int bins = 16;
+    uint32_t maxLeafSize = 8;
+    // cost of visiting a node relative to testing one triangle
+    float traversalCost = 1.0f;
+    // nodes with more triangles than this build one child as a job
+    uint32_t parallelThreshold = 16384;
+};
+
+struct Bvh {
+    std::vector<Node> nodes;
+    // leaf order -> triangle in the mesh
+    std::vector<uint32_t> triangleIds;
+    // corner 0 and the two edges from it, in leaf order, structure of arrays.
+    // padded with empty triangles so simd loads can run past the last leaf
+    std::array<std::vector<float>, 3> vertex0, edge1, edge2;
+    uint32_t depth = 0;
+};
+
+namespace detail {
+
+constexpr uint32_t maxDepth = 64;
+constexpr uint32_t simdPadding = 8;
+
+#if defined(__AVX__) || defined(__AVX2__)
+constexpr uint32_t leafWidth = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+constexpr uint32_t leafWidth = 4;
+#else
+constexpr uint32_t leafWidth = 1;
+#endif
+
+// leaf triangles are intersected leafWidth at a time
+inline float packets(uint32_t count) {
+    return static_cast<float>((count + leafWidth - 1) / leafWidth);
+}
+
+inline float halfArea(const glm::vec3& min, const glm::vec3& max) {
+    auto extent = glm::max(max - min, glm::vec3(0.f));
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+// the builder shuffles these rather than triangle ids, so every pass over a
+// node reads one run of memory instead of hopping round the mesh
+struct TriangleBox {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 centroid;
+    uint32_t triangle;
+};
+
+// what a node needs to know about its triangles before it can be split
+struct Extents {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    glm::vec3 centroidMin = glm::vec3(FLT_MAX);
+    glm::vec3 centroidMax = glm::vec3(-FLT_MAX);
+
+    void add(const TriangleBox& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+        centroidMin = glm::min(centroidMin, box.centroid);
+        centroidMax = glm::max(centroidMax, box.centroid);
+    }
+
+    void merge(const Extents& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+        centroidMin = glm::min(centroidMin, other.centroidMin);
+        centroidMax = glm::max(centroidMax, other.centroidMax);
+    }
+};
+
+struct Bin {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    uint32_t count = 0;
+};
+
+// a row of bins for each axis
+using Bins = std::array<std::array<Bin, 64>, 3>;
+
+struct Builder {
+    std::vector<TriangleBox>& boxes;
+    std::vector<Node>& nodes;
+    jobs::JobSystem& jobSystem;
+    const BuildSettings& settings;
+    std::atomic<uint32_t> nodeCount{1};
+    std::atomic<uint32_t> depth{0};
+
+    void makeLeaf(Node& node, uint32_t first, uint32_t count) {
+        node.leftOrFirst = first;
+        node.count = count;
+    }
+
+    Extents extentsOf(size_t first, size_t last) const {
+        Extents extents;
+        for (auto i = first; i < last; ++i) {
+            extents.add(boxes[i]);
+        }
+        return extents;
+    }
+
+    // one pass over the triangles fills the bins for all three axes
+    void binRange(Bins& bins, size_t first, size_t last, int binCount,
+                  const glm::vec3& centroidMin, const glm::vec3& scale) const {
+        for (auto i = first; i < last; ++i) {
+            const auto& box = boxes[i];
+            for (auto axis = 0; axis < 3; ++axis) {
+                auto b = std::min(binCount - 1, static_cast<int>((box.centroid[axis] -
+                                                                   centroidMin[axis]) *
+                                                                  scale[axis]));
+                auto& bin = bins[axis][b];
+                bin.min = glm::min(bin.min, box.min);
+                bin.max = glm::max(bin.max, box.max);
+                ++bin.count;
+            }
+        }
+    }
+
+    void build(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t level) {
+        auto& node = nodes[nodeIndex];
+        const int binCount = std::max(2, std::min(settings.bins, 64));
+        const uint32_t last = first + count;
+
+        // near the root one node is every triangle, so there's nothing for
+        // the other threads to do until it splits. share out the passes
+        // over the triangles instead, each chunk into its own partial result
+        const bool wide = count > settings.parallelThreshold * 4 && jobSystem.threadCount() > 1;
+        std::mutex mergeMutex;
+
+        Extents extents;
+        if (wide) {
+            jobSystem.parallelFor(count, settings.parallelThreshold, [&](size_t begin, size_t end) {
+                auto partial = extentsOf(first + begin, first + end);
+                std::lock_guard<std::mutex> lock(mergeMutex);
+                extents.merge(partial);
+            });
+        } else {
+            extents = extentsOf(first, last);
+        }
+        node.min = extents.min;
+        node.max = extents.max;
+
+        auto deepest = depth.load(std::memory_order_relaxed);
+        while (level > deepest && !depth.compare_exchange_weak(deepest, level)) {
+        }
+
+        if (count <= 2) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        const auto centroidMin = extents.centroidMin;
+        const auto extent = extents.centroidMax - extents.centroidMin;
+        glm::vec3 scale(0.f);
+        for (auto axis = 0; axis < 3; ++axis) {
+            if (extent[axis] > 0.f) {
+                scale[axis] = binCount / extent[axis];
+            }
+        }
+
+        Bins bins;
+        auto clear = [binCount](Bins& toClear) {
+            for (auto& row : toClear) {
+                std::fill(row.begin(), row.begin() + binCount, Bin{});
+            }
+        };
+        clear(bins);
+        if (wide) {
+            jobSystem.parallelFor(count, settings.parallelThreshold, [&](size_t begin, size_t end) {
+                Bins partial;
+                clear(partial);
+                binRange(partial, first + begin, first + end, binCount, centroidMin, scale);
+                std::lock_guard<std::mutex> lock(mergeMutex);
+                for (auto axis = 0; axis < 3; ++axis) {
+                    for (auto b = 0; b < binCount; ++b) {
+                        auto& bin = bins[axis][b];
+                        bin.min = glm::min(bin.min, partial[axis][b].min);
+                        bin.max = glm::max(bin.max, partial[axis][b].max);
+                        bin.count += partial[axis][b].count;
+                    }
+                }
+            });
+        } else {
+            binRange(bins, first, last, binCount, centroidMin, scale);
+        }
+
+        // triangles are tested a simd width at a time so that's what a leaf
+        // costs, not the triangle count
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestSplit = 0;
+        std::array<float, 64> rightCosts;
+        for (auto axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 0.f) {
+                continue;
+            }
+            const auto& axisBins = bins[axis];
+            // sweep from the right keeping area * cost for every split
+            glm::vec3 rightMin(FLT_MAX), rightMax(-FLT_MAX);
+            uint32_t rightCount = 0;
+            for (auto b = binCount - 1; b > 0; --b) {
+                rightMin = glm::min(rightMin, axisBins[b].min);
+                rightMax = glm::max(rightMax, axisBins[b].max);
+                rightCount += axisBins[b].count;
+                rightCosts[b] = rightCount ? halfArea(rightMin, rightMax) * packets(rightCount)
+                                           : 0.f;
+            }
+            // then from the left, splitting before bin b
+            glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX);
+            uint32_t leftCount = 0;
+            for (auto b = 1; b < binCount; ++b) {
+                leftMin = glm::min(leftMin, axisBins[b - 1].min);
+                leftMax = glm::max(leftMax, axisBins[b - 1].max);
+                leftCount += axisBins[b - 1].count;
+                if (leftCount == 0 || leftCount == count) {
+                    continue;
+                }
+                float cost = halfArea(leftMin, leftMax) * packets(leftCount) + rightCosts[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float parentArea = std::max(halfArea(extents.min, extents.max), FLT_MIN);
+        float splitCost = settings.traversalCost + bestCost / parentArea;
+        bool tooDeep = level >= maxDepth;
+        if ((bestAxis < 0 || splitCost >= packets(count) || tooDeep) &&
+            count <= settings.maxLeafSize) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        uint32_t middle;
+        if (bestAxis >= 0 && !tooDeep) {
+            auto* split = std::partition(
+                boxes.data() + first, boxes.data() + last, [&](const TriangleBox& box) {
+                    auto b = std::min(binCount - 1, static_cast<int>((box.centroid[bestAxis] -
+                                                                      centroidMin[bestAxis]) *
+                                                                     scale[bestAxis]));
+                    return b < bestSplit;
+                });
+            middle = static_cast<uint32_t>(split - boxes.data());
+        } else {
+            // sah would rather stop here (or every centroid is in one spot,
+            // or the tree is getting silly deep) but it's too many for a
+            // leaf. just halve it
+            middle = first + count / 2;
+            if (bestAxis >= 0) {
+                std::nth_element(boxes.data() + first, boxes.data() + middle,
+                                 boxes.data() + last,
+                                 [&](const TriangleBox& a, const TriangleBox& b) {
+                                     return a.centroid[bestAxis] < b.centroid[bestAxis];
+                                 });
+            }
+        }
+
+        auto children = nodeCount.fetch_add(2, std::memory_order_relaxed);
+        node.leftOrFirst = children;
+        node.count = 0;
+        auto leftCount = middle - first;
+        auto rightCount = count - leftCount;
+
+        if (count > settings.parallelThreshold) {
+            jobs::Counter counter;
+            jobSystem.run(counter, [this, children, first, leftCount, level] {
+                build(children, first, leftCount, level + 1);
+            });
+            build(children + 1, middle, rightCount, level + 1);
+            jobSystem.wait(counter);
+        } else {
+            build(children, first, leftCount, level + 1);
+            build(children + 1, middle, rightCount, level + 1);
+        }
+    }
+};
+
+} // namespace detail
+
+inline Bvh build(jobs::JobSystem& jobSystem, const objLoader::MeshDataElements& meshData,
+                 const BuildSettings& settings = {}) {
+    TRACE_SCOPE("bvh build");
+    Bvh tree;
+    const auto& vertices = meshData.vertices;
+    const auto& indices = meshData.indices;
+    auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+    auto corner = [&](uint32_t triangle, int k) -> const glm::vec3& {
+        return vertices[indices[triangle * 3 + k]].position;
+    };
+
+    std::vector<detail::TriangleBox> boxes(triangleCount);
+    jobSystem.parallelFor(triangleCount, 16384, [&](size_t first, size_t last) {
+        for (auto t = first; t < last; ++t) {
+            auto id = static_cast<uint32_t>(t);
+            auto min = glm::min(corner(id, 0), glm::min(corner(id, 1), corner(id, 2)));
+            auto max = glm::max(corner(id, 0), glm::max(corner(id, 1), corner(id, 2)));
+            boxes[t] = {min, max, (min + max) * 0.5f, id};
+        }
+    });
+
+    // a binary tree with at least one triangle per leaf can't have more
+    tree.nodes.resize(std::max(1u, triangleCount * 2));
+    tree.nodes[0] = {glm::vec3(FLT_MAX), 0, glm::vec3(-FLT_MAX), 0};
+
+    if (triangleCount > 0) {
+        TRACE_SCOPE("bvh nodes");
+        detail::Builder builder{boxes, tree.nodes, jobSystem, settings};
+        builder.build(0, 0, triangleCount, 0);
+        tree.nodes.resize(builder.nodeCount.load());
+        tree.depth = builder.depth.load();
+    } else {
+        tree.nodes.resize(1);
+    }
+    tree.triangleIds.resize(triangleCount);
+    tree.nodes.shrink_to_fit();
+
+    {
+        TRACE_SCOPE("bvh triangles");
+        auto padded = triangleCount + detail::simdPadding;
+        for (auto k = 0; k < 3; ++k) {
+            tree.vertex0[k].assign(padded, 0.f);
+            tree.edge1[k].assign(padded, 0.f);
+            tree.edge2[k].assign(padded, 0.f);
+        }
+        jobSystem.parallelFor(triangleCount, 16384, [&](size_t first, size_t last) {
+            for (auto i = first; i < last; ++i) {
+                auto id = boxes[i].triangle;
+                tree.triangleIds[i] = id;
+                auto e1 = corner(id, 1) - corner(id, 0);
+                auto e2 = corner(id, 2) - corner(id, 0);
+                for (auto k = 0; k < 3; ++k) {
+                    tree.vertex0[k][i] = corner(id, 0)[k];
+                    tree.edge1[k][i] = e1[k];
+                    tree.edge2[k][i] = e2[k];
+                }
+            }
+        });
+    }
+    return tree;
+}
+
+namespace detail {
+
+// entry distance into the box, or FLT_MAX if the ray misses it or only gets
+// there after tMax
+inline float intersectBox(const Node& node, const glm::vec3& origin,
+                          const glm::vec3& inverseDirection, float tMax) {
+    auto t0 = (node.min - origin) * inverseDirection;
+    auto t1 = (node.max - origin) * inverseDirection;
+    auto entries = glm::min(t0, t1);
+    auto exits = glm::max(t0, t1);
+    float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.f));
+    float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, tMax));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+constexpr float epsilon = 1e-9f;
+
+// moller trumbore on count triangles starting at first, both sides count.
+// keeps the nearest in hit
+inline void intersectLeaf(const Bvh& tree, uint32_t first, uint32_t count, const Ray& ray,
+                          Hit& hit) {
+    uint32_t i = 0;
+
+#if defined(__AVX__) || defined(__AVX2__)
+    const auto ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y),
+               oz = _mm256_set1_ps(ray.origin.z);
+    const auto dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y),
+               dz = _mm256_set1_ps(ray.direction.z);
+    const auto zero = _mm256_setzero_ps();
+    const auto one = _mm256_set1_ps(1.f);
+    const auto lanes = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    for (; i < count; i += 8) {
+        auto at = first + i;
+        auto load = [&](const std::vector<float>& v) { return _mm256_loadu_ps(v.data() + at); };
+        auto e1x = load(tree.edge1[0]), e1y = load(tree.edge1[1]), e1z = load(tree.edge1[2]);
+        auto e2x = load(tree.edge2[0]), e2y = load(tree.edge2[1]), e2z = load(tree.edge2[2]);
+
+        // p = d x e2
+        auto px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        auto py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        auto pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        auto det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)),
+                                 _mm256_mul_ps(e1z, pz));
+        auto inverseDet = _mm256_div_ps(one, det);
+
+        auto tx = _mm256_sub_ps(ox, load(tree.vertex0[0]));
+        auto ty = _mm256_sub_ps(oy, load(tree.vertex0[1]));
+        auto tz = _mm256_sub_ps(oz, load(tree.vertex0[2]));
+        auto u = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)),
+                          _mm256_mul_ps(tz, pz)),
+            inverseDet);
+
+        // q = tvec x e1
+        auto qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+        auto qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+        auto qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+        auto v = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)),
+                          _mm256_mul_ps(dz, qz)),
+            inverseDet);
+        auto t = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)),
+                          _mm256_mul_ps(e2z, qz)),
+            inverseDet);
+
+        auto absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.f), det);
+        auto mask = _mm256_cmp_ps(absDet, _mm256_set1_ps(epsilon), _CMP_GT_OQ);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(hit.t), _CMP_LT_OQ));
+        // lanes past the end of the leaf belong to the next one
+        auto remaining = _mm256_set1_ps(static_cast<float>(count - i));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lanes, remaining, _CMP_LT_OQ));
+
+        auto bits = _mm256_movemask_ps(mask);
+        if (bits) {
+            alignas(32) float ts[8], us[8], vs[8];
+            _mm256_store_ps(ts, t);
+            _mm256_store_ps(us, u);
+            _mm256_store_ps(vs, v);
+            for (; bits; bits &= bits - 1) {
+                auto lane = objLoader::detail::bitCount((bits & -bits) - 1);
+                if (ts[lane] < hit.t) {
+                    hit = {ts[lane], tree.triangleIds[at + lane], us[lane], vs[lane]};
+                }
+            }
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const auto ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y),
+               oz = _mm_set1_ps(ray.origin.z);
+    const auto dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y),
+               dz = _mm_set1_ps(ray.direction.z);
+    const auto zero = _mm_setzero_ps();
+    const auto one = _mm_set1_ps(1.f);
+    const auto lanes = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    for (; i < count; i += 4) {
+        auto at = first + i;
+        auto load = [&](const std::vector<float>& v) { return _mm_loadu_ps(v.data() + at); };
+        auto e1x = load(tree.edge1[0]), e1y = load(tree.edge1[1]), e1z = load(tree.edge1[2]);
+        auto e2x = load(tree.edge2[0]), e2y = load(tree.edge2[1]), e2z = load(tree.edge2[2]);
+
+        auto px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        auto py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        auto pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        auto det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                              _mm_mul_ps(e1z, pz));
+        auto inverseDet = _mm_div_ps(one, det);
+
+        auto tx = _mm_sub_ps(ox, load(tree.vertex0[0]));
+        auto ty = _mm_sub_ps(oy, load(tree.vertex0[1]));
+        auto tz = _mm_sub_ps(oz, load(tree.vertex0[2]));
+        auto u = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)),
+            inverseDet);
+
+        auto qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        auto qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        auto qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+        auto v = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+            inverseDet);
+        auto t = _mm_mul_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+            inverseDet);
+
+        auto absDet = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+        auto mask = _mm_cmpgt_ps(absDet, _mm_set1_ps(epsilon));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(lanes, _mm_set1_ps(static_cast<float>(count - i))));
+
+        auto bits = _mm_movemask_ps(mask);
+        if (bits) {
+            alignas(16) float ts[4], us[4], vs[4];
+            _mm_store_ps(ts, t);
+            _mm_store_ps(us, u);
+            _mm_store_ps(vs, v);
+            for (; bits; bits &= bits - 1) {
+                auto lane = objLoader::detail::bitCount((bits & -bits) - 1);
+                if (ts[lane] < hit.t) {
+                    hit = {ts[lane], tree.triangleIds[at + lane], us[lane], vs[lane]};
+                }
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        auto at = first + i;
+        glm::vec3 e1(tree.edge1[0][at], tree.edge1[1][at], tree.edge1[2][at]);
+        glm::vec3 e2(tree.edge2[0][at], tree.edge2[1][at], tree.edge2[2][at]);
+        glm::vec3 v0(tree.vertex0[0][at], tree.vertex0[1][at], tree.vertex0[2][at]);
+        auto p = glm::cross(ray.direction, e2);
+        float det = glm::dot(e1, p);
+        if (std::abs(det) <= epsilon) {
+            continue;
+        }
+        float inverseDet = 1.f / det;
+        auto tvec = ray.origin - v0;
+        float u = glm::dot(tvec, p) * inverseDet;
+        auto q = glm::cross(tvec, e1);
+        float v = glm::dot(ray.direction, q) * inverseDet;
+        float t = glm::dot(e2, q) * inverseDet;
+        if (u >= 0.f && v >= 0.f && u + v <= 1.f && t > 0.f && t < hit.t) {
+            hit = {t, tree.triangleIds[at], u, v};
+        }
+    }
+}
+
+} // namespace detail
+
+// nearest triangle along the ray, or a Hit with hit() false
+inline Hit intersect(const Bvh& tree, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tMax;
+    if (tree.triangleIds.empty()) {
+        return hit;
+    }
+
+    // 1/0 is inf, which the slab test copes with
+    glm::vec3 inverseDirection(1.f / ray.direction.x, 1.f / ray.direction.y,
+                               1.f / ray.direction.z);
+    if (detail::intersectBox(tree.nodes[0], ray.origin, inverseDirection, hit.t) == FLT_MAX) {
+        return hit;
+    }
+
+    std::array<uint32_t, detail::maxDepth * 2> stack;
+    uint32_t stackSize = 0;
+    uint32_t current = 0;
+    while (true) {
+        const auto& node = tree.nodes[current];
+        if (node.isLeaf()) {
+            detail::intersectLeaf(tree, node.leftOrFirst, node.count, ray, hit);
+        } else {
+            // nearer child first, the other one waits on the stack
+            auto left = node.leftOrFirst;
+            auto right = left + 1;
+            float leftT =
+                detail::intersectBox(tree.nodes[left], ray.origin, inverseDirection, hit.t);
+            float rightT =
+                detail::intersectBox(tree.nodes[right], ray.origin, inverseDirection, hit.t);
+            if (leftT > rightT) {
+                std::swap(leftT, rightT);
+                std::swap(left, right);
+            }
+            if (leftT != FLT_MAX) {
+                if (rightT != FLT_MAX) {
+                    stack[stackSize++] = right;
+                }
+                current = left;
+                continue;
+            }
+        }
+
+        // pop, skipping nodes that are now further away than the hit
+        bool found = false;
+        while (stackSize > 0) {
+            current = stack[--stackSize];
+            if (detail::intersectBox(tree.nodes[current], ray.origin, inverseDirection, hit.t) !=
+                FLT_MAX) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            break;
+        }
+    }
+
+    if (hit.triangle == UINT32_MAX) {
+        hit.t = FLT_MAX;
+    }
+    return hit;
+}
+
+// which group of the mesh a triangle belongs to, or -1
+inline int groupOf(const objLoader::MeshDataElements& meshData, uint32_t triangle) {
+    auto index = triangle * 3;
+    for (auto g = 0u; g < meshData.groupInfos.size(); ++g) {
+        const auto& group = meshData.groupInfos[g];
+        if (index >= group.startOffset && index < group.startOffset + group.count) {
+            return static_cast<int>(g);
+        }
+    }
+    return -1;
+}
+
+} // namespace bvh
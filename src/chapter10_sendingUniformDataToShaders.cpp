@@ -1,9 +1,12 @@
 #include "error_handling.hpp"
+#include "render_scale.hpp"
+#include <algorithm>
 #include <array>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
 #include <unordered_map>
 
 // this is really important to make sure that glbindings does not clash with
@@ -21,7 +24,33 @@
 using namespace gl;
 using namespace std::chrono;
 
-int main() {
+// usage: chapter10_sendingUniformDataToShaders [--scale S] [--checkerboard]
+//            [--target-ms MS] [--bench FRAMES]
+//
+// NEW! the effect can be shaded at a fraction of the window's resolution and
+// scaled up (--scale 0.5 shades a quarter of the pixels). --checkerboard
+// shades half of those each frame and fills in the rest from the frame
+// before. --target-ms picks the scale to keep the effect's gpu time near that.
+//
+// --bench hides the window and prints a json line per scale/checkerboard
+// combination with the time per frame.
+int main(int argc, char* argv[]) {
+
+    renderScale::Settings renderSettings;
+    int benchFrames = 0;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--scale" && i + 1 < argc) {
+            renderSettings.scale = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--checkerboard") {
+            renderSettings.checkerboard = true;
+        } else if (arg == "--target-ms" && i + 1 < argc) {
+            renderSettings.targetMs = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+    const bool benchmark = benchFrames > 0;
 
     auto startTime = system_clock::now();
     const int width = 800;
@@ -36,6 +65,10 @@ int main() {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
         /* Create a windowed mode window and its OpenGL context */
         auto windowPtr = glfwCreateWindow(width, height, "Chapter 9 - Full Screen Effects (Diy Shadertoy!)",
                                        nullptr, nullptr);
@@ -47,6 +80,9 @@ int main() {
         }
         glfwSetWindowPos(windowPtr, 160, 90);
         glfwMakeContextCurrent(windowPtr);
+        if (benchmark) {
+            glfwSwapInterval(0);
+        }
         glbinding::initialize(glfwGetProcAddress, false);
         return windowPtr;
     }();
@@ -93,8 +129,9 @@ int main() {
             gl_Position = vertices[gl_VertexID]; 
         }
     )",
-                                 R"(
+                                 (std::string(R"(
             #version 450 core
+    )") + renderScale::glsl + R"(
         // Protean clouds by nimitz (twitter: @stormoid)
     // https://www.shadertoy.com/view/3l23Rh
     // License Creative Commons Attribution-NonCommercial-ShareAlike 3.0 Unported License
@@ -118,13 +155,14 @@ int main() {
 
     */
 
-    vec4 fragCoord  = gl_FragCoord;
     out vec4 fragColor;
 
     uniform float iTime; // <-- is now externally set by c++ program
-    uniform vec2 iResolution; // <-- is now externally set by c++ program
-    
-    vec2 iMouse = vec2(960.f,0.f);
+    // NEW! iResolution comes from renderScale::glsl, the size actually shaded.
+    // the mouse was (960, 0) on the old fixed 800x400, so it's kept as that
+    // fraction of the resolution and the view doesn't change with the scale
+    const vec2 mouseFraction = vec2(960.f / 800.f, 0.f);
+    vec2 iMouse;
 
     mat2 rot(in float a){float c = cos(a), s = sin(a);return mat2(c,s,-s,c);}
     const mat3 m3 = mat3(0.33338, 0.56034, -0.71817, -0.87887, 0.32651, -0.15323, 0.15162, 0.69596, 0.61339)*1.93;
@@ -216,8 +254,10 @@ int main() {
 
     void main()
     {	
+        vec2 fragCoord = effectFragCoord();
+        iMouse = mouseFraction * iResolution.xy;
         vec2 q = fragCoord.xy/iResolution.xy;
-        vec2 p = (gl_FragCoord.xy - 0.5*iResolution.xy)/iResolution.y;
+        vec2 p = (fragCoord.xy - 0.5*iResolution.xy)/iResolution.y;
         bsMo = (iMouse.xy - 0.5*iResolution.xy)/iResolution.y;
         
         float time = iTime*3.;
@@ -248,7 +288,7 @@ int main() {
         
         fragColor = vec4( col, 1.0 );
     }
-    )");
+    )").c_str());
 
     GLuint vao;
     glCreateVertexArrays(1, &vao);
@@ -259,21 +299,82 @@ int main() {
 
 
     int timeUniformLocation = glGetUniformLocation(program, "iTime");
-    int resolutionUniformLocation = glGetUniformLocation(program, "iResolution");
-    glProgramUniform2f(program, resolutionUniformLocation, width, height);
-
-    while (!glfwWindowShouldClose(windowPtr)) {
-
 
-        // send time to shader
-        auto currentTime = duration<float>(system_clock::now() - startTime).count();
-        glProgramUniform1f(program, timeUniformLocation, currentTime);
-
-        // draw full screen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-
-        glfwSwapBuffers(windowPtr);
-        glfwPollEvents();
+    // scoped so the render targets are released before the context goes away
+    {
+        renderScale::ScaledRenderer scaled(renderSettings);
+
+        auto drawFrame = [&](float currentTime) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(windowPtr, &framebufferWidth, &framebufferHeight);
+
+            // NEW! binds the smaller target and sets iResolution to its size
+            // (which is also the window's now, rather than a fixed 800x400)
+            scaled.begin(program, framebufferWidth, framebufferHeight);
+
+            // send time to shader
+            glProgramUniform1f(program, timeUniformLocation, currentTime);
+
+            // draw full screen triangle
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            // fill in the checkerboard and scale up to the window
+            scaled.end();
+        };
+
+        if (benchmark) {
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            struct BenchMode {
+                float scale;
+                bool checkerboard;
+            };
+            for (auto mode : {BenchMode{1.f, false}, BenchMode{0.5f, false},
+                              BenchMode{1.f, true}, BenchMode{0.5f, true}}) {
+                renderScale::Settings settings;
+                settings.scale = mode.scale;
+                settings.checkerboard = mode.checkerboard;
+                scaled.setSettings(settings);
+
+                // a few frames first so shader compiles and target creation
+                // aren't timed
+                for (int frame = 0; frame < 3; ++frame) {
+                    drawFrame(0.f);
+                }
+                glFinish();
+
+                auto benchStart = steady_clock::now();
+                for (int frame = 0; frame < benchFrames; ++frame) {
+                    drawFrame(static_cast<float>(frame) / 60.0f);
+                    glfwSwapBuffers(windowPtr);
+                }
+                glFinish();
+                auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+                fmt::print("{{\"benchmark\":\"render_scale\",\"renderer\":\"{}\","
+                           "\"scale\":{:.2f},\"checkerboard\":{},\"width\":{},\"height\":{},"
+                           "\"shadedPixels\":{},\"frames\":{},\"seconds\":{:.6f},"
+                           "\"msPerFrame\":{:.3f}}}\n",
+                           renderer ? renderer : "unknown", mode.scale,
+                           mode.checkerboard ? "true" : "false", scaled.width(), scaled.height(),
+                           scaled.shadedPixels(), benchFrames, seconds,
+                           seconds * 1000.0 / benchFrames);
+            }
+        } else {
+            float reportedScale = 0.f;
+            while (!glfwWindowShouldClose(windowPtr)) {
+                auto currentTime = duration<float>(system_clock::now() - startTime).count();
+                drawFrame(currentTime);
+
+                if (scaled.scale() != reportedScale) {
+                    reportedScale = scaled.scale();
+                    fmt::print(stderr, "shading at {:.0f}% of the window, {:.2f} ms on the gpu\n",
+                               reportedScale * 100.f, scaled.gpuMs());
+                }
+
+                glfwSwapBuffers(windowPtr);
+                glfwPollEvents();
+            }
+        }
     }
 
     glfwTerminate();
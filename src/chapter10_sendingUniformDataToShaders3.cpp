@@ -1,9 +1,11 @@
 #include "error_handling.hpp"
+#include "render_scale.hpp"
 #include <array>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
 #include <unordered_map>
 
 // this is really important to make sure that glbindings does not clash with
@@ -21,7 +23,26 @@
 using namespace gl;
 using namespace std::chrono;
 
-int main() {
+// usage: chapter10_sendingUniformDataToShaders3 [--scale S] [--checkerboard]
+//            [--target-ms MS]
+//
+// NEW! the effect can be shaded at a fraction of the window's resolution and
+// scaled up (--scale 0.5 shades a quarter of the pixels). --checkerboard
+// shades half of those each frame and fills in the rest from the frame
+// before. --target-ms picks the scale to keep the effect's gpu time near that.
+int main(int argc, char* argv[]) {
+
+    renderScale::Settings renderSettings;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--scale" && i + 1 < argc) {
+            renderSettings.scale = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--checkerboard") {
+            renderSettings.checkerboard = true;
+        } else if (arg == "--target-ms" && i + 1 < argc) {
+            renderSettings.targetMs = static_cast<float>(std::atof(argv[++i]));
+        }
+    }
 
     auto startTime = system_clock::now();
     const int width = 1280;
@@ -84,18 +105,14 @@ int main() {
     auto program = createProgram(R"(
         #version 450 core
         layout (location = 0) in vec2 position;
-        layout (location = 1) in vec2 colours;
-
-        out vec2 fragCoord;
 
         void main(){
-            fragCoord = colours;
             gl_Position = vec4(position, 0.0f, 1.0f);
         }
     )",
-                                 R"(
+                                 (std::string(R"(
         #version 450 core
-
+    )") + renderScale::glsl + R"(
         // The MIT License
         // Copyright © 2013 Inigo Quilez
         // Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
@@ -126,11 +143,9 @@ int main() {
         // Smooth:       https://www.shadertoy.com/view/ldB3zc
         // Voronoise:    https://www.shadertoy.com/view/Xd23Dh
 
-        in vec2 fragCoord;
         out vec4 finalColor;
 
         uniform float iTime;
-        uniform vec2 iResolution;
 
         vec2 hash2( vec2 p )
         {
@@ -195,7 +210,7 @@ int main() {
 
         void main() {
 
-            vec2 p = fragCoord * vec2(iResolution.x/iResolution.y, 1);
+            vec2 p = effectFragCoord() / iResolution.y;
 
             vec3 c = voronoi( 8.0*p );
 
@@ -210,20 +225,20 @@ int main() {
 
             finalColor = vec4(col,1.0);
         }
-    )");
+    )").c_str());
 
+    // NEW! only a position. the fragment shader works out its pixel with
+    // effectFragCoord() (the uv that used to go with each corner was off by up
+    // to half a pixel in checkerboard mode)
     struct vertex2D {
         glm::vec2 position;
-        glm::vec2 colour;
     };
 
     // clang-format off
-    // interleaved data
     const std::array<vertex2D, 3> backGroundVertices {{
-        //   position   |   colour
-        {{-1.f, -1.f},  {0.0f, 0.0f}},
-        {{ 3.f, -1.f},  {2.0f, 0.0f}},
-        {{-1.f,  3.f},  {0.0f, 2.00f}}
+        {{-1.f, -1.f}},
+        {{ 3.f, -1.f}},
+        {{-1.f,  3.f}}
     }};
 
     // clang-format on
@@ -248,11 +263,6 @@ int main() {
                                   offsetof(vertex2D, position));
         glEnableVertexArrayAttrib(vao, 0);
 
-        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "colours"), /*buffs idx*/ 0);
-        glVertexArrayAttribFormat(vao, 1, glm::vec2::length(), GL_FLOAT, GL_FALSE,
-                                  offsetof(vertex2D, colour));
-        glEnableVertexArrayAttrib(vao, 1);
-
         // buffer to index mapping
         glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0, /*stride*/ sizeof(vertex2D));
 
@@ -267,25 +277,42 @@ int main() {
     glUseProgram(program);
 
     int timeUniformLocation = glGetUniformLocation(program, "iTime");
-    int resolutionUniformLocation = glGetUniformLocation(program, "iResolution");
-    glProgramUniform2f(program, resolutionUniformLocation, width, height);
 
-    while (!glfwWindowShouldClose(windowPtr)) {
+    // scoped so the render targets are released before the context goes away
+    {
+        renderScale::ScaledRenderer scaled(renderSettings);
+        float reportedScale = 0.f;
 
-        glClearBufferfv(GL_COLOR, 0, clearColour.data());
-        glClearBufferfv(GL_DEPTH, 0, clearDepth.data());
+        while (!glfwWindowShouldClose(windowPtr)) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(windowPtr, &framebufferWidth, &framebufferHeight);
 
-        // draw full screen triangle
-        glBindVertexArray(backGroundVao);
+            // NEW! binds the smaller target and sets iResolution to its size
+            scaled.begin(program, framebufferWidth, framebufferHeight);
 
-        // send time to shader
-        auto currentTime = duration<float>(system_clock::now() - startTime).count();
-        glProgramUniform1f(program, timeUniformLocation, currentTime);
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, clearDepth.data());
 
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+            // draw full screen triangle
+            glBindVertexArray(backGroundVao);
 
-        glfwSwapBuffers(windowPtr);
-        glfwPollEvents();
+            // send time to shader
+            auto currentTime = duration<float>(system_clock::now() - startTime).count();
+            glProgramUniform1f(program, timeUniformLocation, currentTime);
+
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            // fill in the checkerboard and scale up to the window
+            scaled.end();
+            if (scaled.scale() != reportedScale) {
+                reportedScale = scaled.scale();
+                fmt::print(stderr, "shading at {:.0f}% of the window, {:.2f} ms on the gpu\n",
+                           reportedScale * 100.f, scaled.gpuMs());
+            }
+
+            glfwSwapBuffers(windowPtr);
+            glfwPollEvents();
+        }
     }
 
     glfwTerminate();
@@ -1,12 +1,14 @@
 #include "error_handling.hpp"
 #include "obj_loader_simple_split_cpp.hpp"
 
+#include <algorithm>
 #include <array>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <filesystem>
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
 
 // this is really important to make sure that glbindings does not clash with
 // glfw's opengl includes. otherwise we get ambigous overloads.
@@ -66,8 +68,35 @@
 using namespace gl;
 using namespace std::chrono;
 
+// usage: chapter12_shaderTransforms3 [--depth-prepass] [--grid-plane] [--bench FRAMES]
+//
+// --depth-prepass draws the mesh's depth first (positions only, no colour) and
+// then shades it with GL_EQUAL, so the mesh's fragment shader only runs for
+// what ends up on screen.
+//
+// --grid-plane draws the grid as the ground plane itself rather than a full
+// screen triangle that writes gl_FragDepth, so the rasterizer's depth is the
+// plane's depth and early z can skip it behind the mesh.
+//
+// --bench hides the window and prints a json line for each grid with and
+// without the pre-pass, with the fragment shader invocations per frame
 int main(int argc, char *argv[]) {
 
+    bool depthPrepass = false;
+    bool gridPlane = false;
+    int benchFrames = 0;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--depth-prepass") {
+            depthPrepass = true;
+        } else if (arg == "--grid-plane") {
+            gridPlane = true;
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+    const bool benchmark = benchFrames > 0;
+
     auto startTime = system_clock::now();
 
     const int width = 1600;
@@ -88,8 +117,13 @@ int main(int argc, char *argv[]) {
         }
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
         glfwWindowHint(GLFW_DOUBLEBUFFER, true);
+        // 4.6 for GL_FRAGMENT_SHADER_INVOCATIONS queries
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
 
         /* Create a windowed mode window and its OpenGL context */
         auto windowPtr = glfwCreateWindow(
@@ -138,14 +172,15 @@ int main(int argc, char *argv[]) {
         return program;
     };
 
+    // no #version, that goes on the front along with GRID_ON_PLANE when the
+    // grid is drawn as the ground plane
     const char* fragmentShaderSourceGrid = R"(
-            #version 450 core
-
             in vec3 colour;
             out vec4 finalColor;
 
             uniform mat4 invModelViewProjection;
             uniform mat4 modelViewProjection;
+            uniform vec2 viewportSize;
 
             // halfspace
             float tracePlaneY(vec3 rp, vec3 rd)
@@ -248,7 +283,11 @@ int main(int argc, char *argv[]) {
 
             void main() {
 
+            #ifdef GRID_ON_PLANE
+                vec2 uv = gl_FragCoord.xy / viewportSize * 2.0 - 1.0;
+            #else
                 vec2 uv = (colour.xy - vec2(0.5f)) * 2.0;
+            #endif
 
                 Ray R = glup_primary_ray(invModelViewProjection, uv);
 
@@ -275,8 +314,11 @@ int main(int argc, char *argv[]) {
                 float depth2 = (((far-near) * clip_space_depth) + near + far) / 2.0;
 
 
-                // and return the result
+                // and return the result. on the plane the rasterizer already
+                // has this depth, and writing it would turn early z off
+            #ifndef GRID_ON_PLANE
                 gl_FragDepth =  clamp(depth2, 1e-05, 1.0-1e-05) ;
+            #endif
                 finalColor = vec4(vec3(1.0f), gt*spotlight);
 
 
@@ -311,9 +353,31 @@ int main(int argc, char *argv[]) {
             gl_Position = vertices[gl_VertexID];  
         }
     )",
-                                   fragmentShaderSourceGrid);
+                                   (std::string("#version 450 core\n") +
+                                    fragmentShaderSourceGrid).c_str());
+
+    // NEW! the same grid on a quad lying on y = 0. past 24 units the
+    // spotlight has faded it out completely, so that's as big as it needs to be
+    auto programGridPlane = createProgram(R"(
+        #version 450 core
+        out vec3 colour;
+
+        uniform mat4 modelViewProjection;
+
+        const vec2 corners[] = vec2[](vec2(-24.f, -24.f), vec2( 24.f, -24.f),
+                                      vec2( 24.f,  24.f), vec2(-24.f, -24.f),
+                                      vec2( 24.f,  24.f), vec2(-24.f,  24.f));
 
-    auto program = createProgram(R"(
+        void main(){
+            colour = vec3(0.0f);
+            gl_Position = modelViewProjection * vec4(corners[gl_VertexID].x, 0.0f,
+                                                     corners[gl_VertexID].y, 1.0f);
+        }
+    )",
+                                   (std::string("#version 450 core\n#define GRID_ON_PLANE\n") +
+                                    fragmentShaderSourceGrid).c_str());
+
+    const char* meshVertexShaderSource = R"(
             #version 450 core
             layout (location = 0) in vec3 position;
             layout (location = 1) in vec3 normal;
@@ -322,14 +386,27 @@ int main(int argc, char *argv[]) {
 
             uniform mat4 modelViewProjection;
 
+            // the depth pre-pass runs this too, and GL_EQUAL needs both to
+            // come up with exactly the same depth
+            invariant gl_Position;
+
             vec3 remappedColour = (normal + vec3(1.f)) / 2.f;
 
             void main(){
                 colour = remappedColour;
                 gl_Position = modelViewProjection * vec4(position, 1.0f);
             }
-        )",
-                                 fragmentShaderSource);
+        )";
+
+    auto program = createProgram(meshVertexShaderSource, fragmentShaderSource);
+
+    // NEW! depth only, the colour mask is off while it runs
+    auto programDepth = createProgram(meshVertexShaderSource, R"(
+        #version 450 core
+
+        void main() {
+        }
+        )");
 
     auto meshData = objLoader::readObjSplit(base+"/tommy.obj");
 
@@ -373,7 +450,26 @@ int main(int argc, char *argv[]) {
     glVertexArrayVertexBuffer(meshVao, 0, backGroundBuffer,
                               /*offset*/ 0,
                               /*stride*/ sizeof(vertex3D));
-    glBindVertexArray(meshVao);
+
+    // NEW! only the positions, tightly packed in their own buffer, for the
+    // pre-pass. it fetches 12 bytes a vertex instead of 32
+    std::vector<glm::vec3> positions(meshData.vertices.size());
+    for (auto i = 0u; i < positions.size(); ++i) {
+        positions[i] = meshData.vertices[i].position;
+    }
+    GLuint positionBuffer;
+    glCreateBuffers(1, &positionBuffer);
+    glNamedBufferStorage(positionBuffer, positions.size() * sizeof(glm::vec3), positions.data(),
+                         GL_DYNAMIC_STORAGE_BIT);
+
+    GLuint positionVao;
+    glCreateVertexArrays(1, &positionVao);
+    glEnableVertexArrayAttrib(positionVao, 0);
+    glVertexArrayAttribBinding(positionVao, 0, /*buffer index*/ 0);
+    glVertexArrayAttribFormat(positionVao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                              /*relative offset*/ 0);
+    glVertexArrayVertexBuffer(positionVao, 0, positionBuffer, /*offset*/ 0,
+                              /*stride*/ sizeof(glm::vec3));
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);  
@@ -392,13 +488,14 @@ int main(int argc, char *argv[]) {
     glClearDepth(1.0f);
 
     int mvpLocation = glGetUniformLocation(program, "modelViewProjection");
+    int mvpLocationDepth = glGetUniformLocation(programDepth, "modelViewProjection");
     int invMvpLocationBG = glGetUniformLocation(programBG, "invModelViewProjection");
     int mvpLocationBG = glGetUniformLocation(programBG, "modelViewProjection");
+    int invMvpLocationPlane = glGetUniformLocation(programGridPlane, "invModelViewProjection");
+    int mvpLocationPlane = glGetUniformLocation(programGridPlane, "modelViewProjection");
+    int viewportSizeLocationPlane = glGetUniformLocation(programGridPlane, "viewportSize");
 
-    while (!glfwWindowShouldClose(windowPtr)) {
-        auto renderStart = system_clock::now();
-        auto currentTime =
-            duration<float>(system_clock::now() - startTime).count();
+    auto drawFrame = [&](bool prepass, bool onPlane, float currentTime) {
         glm::mat4 view = glm::lookAt(
             glm::vec3(std::sin(currentTime * 0.5f) * 2,
                       (std::sin(currentTime * 0.64f) + 1.5f) / 2.0f,
@@ -413,28 +510,107 @@ int main(int argc, char *argv[]) {
         glClearBufferfv(GL_COLOR, 0, clearColour.data());
         glClearBufferfv(GL_DEPTH, 0, &clearDepth);
 
- 
-
-        glUseProgram(program);
-        
-
         glProgramUniformMatrix4fv(program, mvpLocation, 1, GL_FALSE,
                                   glm::value_ptr(mvp));
+
+        if (prepass) {
+            // depth only
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glBindVertexArray(positionVao);
+            glUseProgram(programDepth);
+            glProgramUniformMatrix4fv(programDepth, mvpLocationDepth, 1, GL_FALSE,
+                                      glm::value_ptr(mvp));
+            glDrawArrays(GL_TRIANGLES, 0, (gl::GLsizei)meshData.vertices.size());
+
+            // then shade only the fragments that won
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_EQUAL);
+        }
+
+        glBindVertexArray(meshVao);
+        glUseProgram(program);
         glDrawArrays(GL_TRIANGLES, 0, (gl::GLsizei)meshData.vertices.size());
 
+        if (prepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
 
-        glUseProgram(programBG);
-        glProgramUniformMatrix4fv(programBG, invMvpLocationBG, 1, GL_FALSE,
-                                  glm::value_ptr(mvpInv));
-        glProgramUniformMatrix4fv(programBG, mvpLocationBG, 1, GL_FALSE,
-                                  glm::value_ptr(mvp));
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (onPlane) {
+            // the grid is blended over what's in front of it, so it tests
+            // against the mesh but doesn't need to write depth
+            glDepthMask(GL_FALSE);
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(windowPtr, &framebufferWidth, &framebufferHeight);
+            glUseProgram(programGridPlane);
+            glProgramUniform2f(programGridPlane, viewportSizeLocationPlane,
+                               static_cast<float>(framebufferWidth),
+                               static_cast<float>(framebufferHeight));
+            glProgramUniformMatrix4fv(programGridPlane, invMvpLocationPlane, 1, GL_FALSE,
+                                      glm::value_ptr(mvpInv));
+            glProgramUniformMatrix4fv(programGridPlane, mvpLocationPlane, 1, GL_FALSE,
+                                      glm::value_ptr(mvp));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            // or the next clear won't clear depth
+            glDepthMask(GL_TRUE);
+        } else {
+            glUseProgram(programBG);
+            glProgramUniformMatrix4fv(programBG, invMvpLocationBG, 1, GL_FALSE,
+                                      glm::value_ptr(mvpInv));
+            glProgramUniformMatrix4fv(programBG, mvpLocationBG, 1, GL_FALSE,
+                                      glm::value_ptr(mvp));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    };
 
-        glfwSwapBuffers(windowPtr);
-        auto timeTaken =
-            duration<float>(system_clock::now() - renderStart).count();
-        // fmt::print(stderr, "render time: {}\n", timeTaken);
-        glfwPollEvents();
+    if (benchmark) {
+        auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+        GLuint fragmentQuery;
+        glCreateQueries(GL_FRAGMENT_SHADER_INVOCATIONS, 1, &fragmentQuery);
+
+        // both grids, each with and without the pre-pass, so each pair only
+        // differs by the pre-pass
+        for (bool onPlane : {false, true}) {
+            for (bool prepass : {false, true}) {
+                // a few frames first so shader compiles aren't timed
+                for (int frame = 0; frame < 3; ++frame) {
+                    drawFrame(prepass, onPlane, 0.f);
+                }
+                glFinish();
+
+                auto benchStart = steady_clock::now();
+                glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, fragmentQuery);
+                for (int frame = 0; frame < benchFrames; ++frame) {
+                    drawFrame(prepass, onPlane, static_cast<float>(frame) / 60.0f);
+                    glfwSwapBuffers(windowPtr);
+                }
+                glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+                glFinish();
+                auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+                GLuint64 invocations = 0;
+                glGetQueryObjectui64v(fragmentQuery, GL_QUERY_RESULT, &invocations);
+
+                fmt::print("{{\"benchmark\":\"depth_prepass\",\"renderer\":\"{}\","
+                           "\"grid\":\"{}\",\"prepass\":{},\"width\":{},\"height\":{},"
+                           "\"frames\":{},\"seconds\":{:.6f},\"msPerFrame\":{:.3f},"
+                           "\"fragmentInvocationsPerFrame\":{}}}\n",
+                           renderer ? renderer : "unknown", onPlane ? "plane" : "fullscreen",
+                           prepass, width, height, benchFrames, seconds,
+                           seconds * 1000.0 / benchFrames, invocations / benchFrames);
+            }
+        }
+        glDeleteQueries(1, &fragmentQuery);
+    } else {
+        while (!glfwWindowShouldClose(windowPtr)) {
+            auto currentTime =
+                duration<float>(system_clock::now() - startTime).count();
+            drawFrame(depthPrepass, gridPlane, currentTime);
+
+            glfwSwapBuffers(windowPtr);
+            glfwPollEvents();
+        }
     }
 
     glfwTerminate();
@@ -1,11 +1,13 @@
 #include "error_handling.hpp"
 #include "obj_loader.hpp"
+#include "srgb_output.hpp"
 
 #include <array>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <memory>
 
 // this is really important to make sure that glbindings does not clash with
 // glfw's opengl includes. otherwise we get ambigous overloads.
@@ -41,6 +43,9 @@ int main() {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 
+        // NEW! ask for a framebuffer that encodes to srgb when written to
+        glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
+
         /* Create a windowed mode window and its OpenGL context */
         auto window =
             glfwCreateWindow(1280, 720, "Chapter 15 - Basic Diffuse Lighting", nullptr, nullptr);
@@ -155,10 +160,11 @@ int main() {
 
     // clang-format off
     const std::vector<vertex3D> backGroundVertices {{
+        // colours are linear now, these are the old ones decoded from srgb
         //   position   |           normal        |  texCoord
-        {{-1.f, -1.f, 0.999999f},  {0.12f, 0.14f, 0.16f}, {0.f, 0.f}},
-        {{ 3.f, -1.f, 0.999999f},  {0.12f, 0.14f, 0.16f}, {3.f, 0.f}},
-        {{-1.f,  3.f, 0.999999f},  {0.80f, 0.80f, 0.82f}, {0.f, 3.f}}
+        {{-1.f, -1.f, 0.999999f},  {0.014f, 0.017f, 0.022f}, {0.f, 0.f}},
+        {{ 3.f, -1.f, 0.999999f},  {0.014f, 0.017f, 0.022f}, {3.f, 0.f}},
+        {{-1.f,  3.f, 0.999999f},  {0.604f, 0.604f, 0.638f}, {0.f, 3.f}}
     }};
     // clang-format on
 
@@ -230,7 +236,9 @@ int main() {
         glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        glTextureStorage2D(textureName, 1, GL_RGB8, texWidth, texHeight);
+        // NEW! the jpg is srgb. an srgb format means sampling decodes it to
+        // linear for the lighting, in the texture unit
+        glTextureStorage2D(textureName, 1, GL_SRGB8, texWidth, texHeight);
         glTextureSubImage2D(textureName, 0, 0, 0, texWidth, texHeight, GL_RGB, GL_UNSIGNED_BYTE,
                             pixels);
         glGenerateTextureMipmap(textureName);
@@ -261,9 +269,16 @@ int main() {
         0,
         textureName); // bind once. we will be using texture arrays in the future. maybe bindless?
 
+    // NEW! turns on GL_FRAMEBUFFER_SRGB and works out where to draw
+    auto output = std::make_unique<srgbOutput::Output>();
+
     while (!glfwWindowShouldClose(window)) {
         auto currentTime = duration<float>(system_clock::now() - startTime).count();
 
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        output->begin(framebufferWidth, framebufferHeight);
+
         glClearBufferfv(GL_COLOR, 0, clearColour.data());
         glClearBufferfv(GL_DEPTH, 0, &clearDepth);
 
@@ -293,9 +308,12 @@ int main() {
 
         glDrawElements(GL_TRIANGLES, meshData.indices.size(), GL_UNSIGNED_INT, 0);
 
+        output->end();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // its framebuffer (if it made one) goes before the context does
+    output.reset();
     glfwTerminate();
 }
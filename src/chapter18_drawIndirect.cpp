@@ -1,4 +1,5 @@
 #include "error_handling.hpp"
+#include "framing.hpp"
 #include "obj_loader.hpp"
 
 #include <array>
@@ -275,7 +276,9 @@ int main() {
     glm::mat4 projection;
     glm::mat4 mvp;
 
-    projection = glm::perspective(glm::radians(40.0f), 1280.f / 640.f, 0.1f, 100.0f);
+    // stands far enough back to see the whole mesh, whatever size it is
+    auto camera = framing::frame(meshData.bounds, 40.0f, 1280.f / 640.f);
+    projection = camera.projection();
 
     int mvpLocationVertex = glGetUniformLocation(vertexColourProgram, "MVP");
     int mvpLocationTexture = glGetUniformLocation(textureProgram, "MVP");
@@ -339,13 +342,8 @@ int main() {
         glBindVertexArray(meshVao);
         glUseProgram(textureProgram);
 
-        glm::mat4 view = glm::lookAt(
-            glm::vec3(std::sin(currentTime * 0.5f) * 2.5f,
-                      1.25f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.3f,
-                      std::cos(currentTime * 0.5f) * 2.5f), // Camera is at (4,3,3), in World Space
-            glm::vec3(0.f, 1.f, 0.f),                       // and looks at the origin
-            glm::vec3(0.f, 1.f, 0.f) // Head is up (set to 0,-1,0 to look upside-down)
-        );
+        float elevation = 0.1f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.12f;
+        glm::mat4 view = camera.orbit(currentTime * 0.5f, elevation);
         mvp = projection * view * model;
         glProgramUniformMatrix4fv(textureProgram, mvpLocationTexture, 1, GL_FALSE,
                                   glm::value_ptr(mvp));
@@ -1,11 +1,23 @@
 #include "error_handling.hpp"
+#include "framing.hpp"
+#include "job_system.hpp"
+#include "mesh_normals.hpp"
+#include "mesh_pool.hpp"
+#include "mip_chain.hpp"
 #include "obj_loader.hpp"
+#include "render_queue.hpp"
+#include "srgb_output.hpp"
+#include "texture_packer.hpp"
+#include "trace_gl.hpp"
 
 #include <array>
+#include <cctype>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <memory>
+#include <string>
 #include <unordered_map>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -28,7 +40,43 @@
 using namespace gl;
 using namespace std::chrono;
 
-int main() {
+int main(int argc, char* argv[]) {
+
+    // --smooth-normals [crease degrees] throws away the file's normals and
+    // makes new ones, for meshes that came without (or with bad) normals
+    //
+    // --mip-filter box|kaiser|gpu picks how the mip chains are made. box and
+    // kaiser are done on the cpu while decoding, gpu is glGenerateTextureMipmap
+    //
+    // --depth-prepass lays down the model's depth first so the texturing shader
+    // only runs once per pixel
+    bool smoothNormals = false;
+    bool depthPrepass = false;
+    meshNormals::Settings normalSettings;
+    bool cpuMips = true;
+    mipChain::Settings mipSettings;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--smooth-normals") {
+            smoothNormals = true;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) {
+                normalSettings.creaseAngle = static_cast<float>(std::atof(argv[++i]));
+            }
+        } else if (std::string(argv[i]) == "--mip-filter" && i + 1 < argc) {
+            auto filter = std::string(argv[++i]);
+            cpuMips = filter != "gpu";
+            mipSettings.filter =
+                filter == "kaiser" ? mipChain::Filter::Kaiser : mipChain::Filter::Box;
+        } else if (std::string(argv[i]) == "--depth-prepass") {
+            depthPrepass = true;
+        }
+    }
+
+    // set OPENGL_TUTORIAL_TRACE=trace.json to get a chrome/perfetto trace
+    tracer::startFromEnvironment();
+    tracer::setThreadName("main");
+
+    // one thread per core, this one included
+    jobs::JobSystem jobSystem;
 
     auto startTime = system_clock::now();
 
@@ -42,6 +90,9 @@ int main() {
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 
+        // NEW! ask for a framebuffer that encodes to srgb when written to
+        glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
+
         /* Create a windowed mode window and its OpenGL context */
         auto window =
             glfwCreateWindow(1920, 960, "Chapter 19 - MultiDrawIndirect buffers", nullptr, nullptr);
@@ -93,8 +144,11 @@ int main() {
             layout (location = 0) in vec3 aPosition;
             layout (location = 1) in vec3 aNormal;
             layout (location = 2) in vec2 aTexCoord;
-            layout (location = 3) in float aTextureIndex;
 
+            // which texture each draw uses, looked up by its base instance
+            layout (std430, binding = 3) readonly buffer DrawTextures {
+                int drawTextures[];
+            };
 
             layout (location = 0) out vec3 normal;
             layout (location = 1) out vec2 uv;
@@ -104,11 +158,15 @@ int main() {
 
             uniform mat4 MVP;
 
+            // the depth pre-pass uses this shader too, and GL_EQUAL needs
+            // both to come up with exactly the same depth
+            invariant gl_Position;
+
             void main(){
                 position = aPosition;
                 normal = aNormal;
                 uv = aTexCoord;
-                textureIndex = aTextureIndex;
+                textureIndex = float(drawTextures[gl_BaseInstance]);
 
                 gl_Position = MVP * vec4(aPosition, 1.0f);
             }
@@ -142,7 +200,32 @@ int main() {
             vec3 lightPosition = vec3(1,1,1);
             vec3 lightPosition2 = vec3(-2,0,0);
 
-            uniform sampler2DArray Texture;
+            // textures of different sizes live in different arrays. which
+            // array and layer each one is in comes from the packer's table
+            struct TextureSlot {
+                int array;
+                int layer;
+            };
+            layout (std430, binding = 2) readonly buffer TextureSlots {
+                TextureSlot slots[];
+            };
+            layout (binding = 0) uniform sampler2DArray Textures[8];
+
+            vec4 sampleTexture(int index, vec2 uv) {
+                TextureSlot slot = slots[index];
+                // derivatives out here, where every pixel of the quad runs
+                vec2 uvDx = dFdx(uv);
+                vec2 uvDy = dFdy(uv);
+                vec4 colour = vec4(0.0f);
+                // a loop rather than Textures[slot.array]. that index isn't
+                // guaranteed to be the same across a multi draw
+                for (int i = 0; i < 8; ++i) {
+                    if (i == slot.array) {
+                        colour = textureGrad(Textures[i], vec3(uv, slot.layer), uvDx, uvDy);
+                    }
+                }
+                return colour;
+            }
 
             void main() {
                 vec3 lightDirection = normalize(lightPosition - position);
@@ -151,7 +234,7 @@ int main() {
                 float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
                 float diffuseLighting2 = max(dot(normalize(normal), lightDirection2), 0);
 
-                vec4 textureSample = texture(Texture, vec3(uv, textureIndex));
+                vec4 textureSample = sampleTexture(int(textureIndex), uv);
                 finalColor = textureSample * (diffuseLighting + diffuseLighting2 * 0.5f);
             }
         )";
@@ -159,133 +242,141 @@ int main() {
     auto vertexColourProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceColour);
     auto textureProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceTexture);
 
+    // NEW! depth only. the colour mask is off, so it doesn't need to output anything
+    const char* fragmentShaderSourceDepth = R"(
+            #version 460 core
+
+            void main() {
+            }
+        )";
+    auto depthProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceDepth);
+
     // clang-format off
     const std::vector<vertex3D> backGroundVertices {{
+        // colours are linear now, these are the old ones decoded from srgb
         //   position   |           normal        |  texCoord
-        {{-1.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {0.f, 0.f}},
-        {{ 3.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {3.f, 0.f}},
-        {{-1.f,  3.f, 0.999999f},  {0.80f, 0.82f, 0.80f}, {0.f, 3.f}}
+        {{-1.f, -1.f, 0.999999f},  {0.010f, 0.019f, 0.017f}, {0.f, 0.f}},
+        {{ 3.f, -1.f, 0.999999f},  {0.010f, 0.019f, 0.017f}, {3.f, 0.f}},
+        {{-1.f,  3.f, 0.999999f},  {0.604f, 0.638f, 0.604f}, {0.f, 3.f}}
     }};
     // clang-format on
 
     auto meshData = objLoader::readObjElements(
         "tommy.obj");
 
+    if (smoothNormals) {
+        auto adjacency = meshNormals::buildAdjacency(jobSystem, meshData);
+        auto added = meshNormals::generateNormals(jobSystem, meshData, adjacency, normalSettings);
+        fmt::print("regenerated normals, {} vertices split along creases\n", added);
+    }
+
     for (const auto& group : meshData.groupInfos) {
         fmt::print("group name: {} with startOffset: {}, count: {}\n", group.name,
                    group.startOffset, group.count);
     }
 
-    // buffers
-    auto createBufferAndVao = [](const std::vector<vertex3D>& vertices,
-                                 const std::vector<int>& indices, GLuint program) -> GLuint {
-        // in core profile, at least 1 vao is needed
-        GLuint vao;
-        glCreateVertexArrays(1, &vao);
-
-        GLuint bufferObject;
-        glCreateBuffers(1, &bufferObject);
-
-        // upload immediately
-        glNamedBufferStorage(bufferObject, vertices.size() * sizeof(vertex3D), vertices.data(),
-                             GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
-
-        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aPosition"),
-                                   /*buffer index*/ 0);
-        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
-                                  offsetof(vertex3D, position));
-        glEnableVertexArrayAttrib(vao, 0);
-
-        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aNormal"), /*buffs idx*/ 0);
-        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
-                                  offsetof(vertex3D, normal));
-        glEnableVertexArrayAttrib(vao, 1);
-
-        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aTexCoord"), /*buffs idx*/ 0);
-        glVertexArrayAttribFormat(vao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
-                                  offsetof(vertex3D, texCoord));
-        glEnableVertexArrayAttrib(vao, 2);
-
-        // buffer to index mapping
-        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
-                                  /*stride in bytes*/ sizeof(vertex3D));
-
-        // NEW! element buffer
-        if (indices.size() > 0) {
-            GLuint elemementBufferObject;
-            glCreateBuffers(1, &elemementBufferObject);
-            glNamedBufferStorage(elemementBufferObject, indices.size() * sizeof(GLuint),
-                                 indices.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
-            glVertexArrayElementBuffer(vao, elemementBufferObject);
-        }
-        return vao;
-    };
-
-    auto backGroundVao = createBufferAndVao(backGroundVertices, {}, vertexColourProgram);
-    auto meshVao = createBufferAndVao(meshData.vertices, meshData.indices, textureProgram);
-
-    std::vector<GLfloat> textureIndices = {0.f, 0.f, 0.f, 1.f, 1.f};
-
-    // setup texture indices
-    {
-        GLuint bufferObject2;
-
-        // one buffer to be shared amonst vaos
-        glCreateBuffers(1, &bufferObject2);
-        glNamedBufferStorage(bufferObject2, textureIndices.size() * sizeof(GLfloat),
-                             textureIndices.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
-
-        glVertexArrayAttribFormat(meshVao, 3, 1, GL_FLOAT, GL_FALSE, 0);
-        glEnableVertexArrayAttrib(meshVao, 3);
-
-        glVertexArrayAttribBinding(meshVao, glGetAttribLocation(textureProgram, "aTextureIndex"),
-                                   /*buffer index*/ 1); // <-- new buffer
-        glVertexArrayVertexBuffer(meshVao, 1, bufferObject2, /*offset*/ 0, sizeof(GLfloat));
+    // NEW! no buffers or vao of their own. both meshes get a range of the
+    // pool's buffers and share its vao
+    auto meshes = std::make_unique<meshPool::MeshPool>();
+    auto backGroundMesh = meshes->add(backGroundVertices, {0, 1, 2});
+    auto mainMesh = [&] {
+        TRACE_SCOPE("buffer upload");
+        return meshes->add(meshData);
+    }();
 
-        // IMPORTANT!!! 1) otherwise shader is per vertex. 2) second arg is the BINDING POINT!
-        glVertexArrayBindingDivisor(meshVao, 1, 1);
-    }
+    // the texture for each draw, indexed by its base instance
+    std::vector<GLint> textureIndices = {0, 0, 0, 1, 1};
+    textureIndices.resize(std::max<size_t>(textureIndices.size(), meshData.groupInfos.size()), 0);
+    GLuint textureIndexBuffer;
+    glCreateBuffers(1, &textureIndexBuffer);
+    glNamedBufferStorage(textureIndexBuffer, textureIndices.size() * sizeof(GLint),
+                         textureIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, textureIndexBuffer);
 
     // texture
-    auto textureGenerator = [](const std::vector<std::string>& filePaths) -> GLuint {
+    // each file with the colour space its material gives it
+    using ColourSpace = objLoader::MaterialInfo::colourSpace;
+    struct TextureFile {
+        std::string path;
+        ColourSpace colourSpace;
+    };
+    auto textureGenerator = [&](const std::vector<TextureFile>& files) {
         stbi_set_flip_vertically_on_load(true);
 
-        // create gl texture array
-        GLuint textureName;
-        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureName);
-
-        const int hardCodedResolution = 1024;
-        // can have possibly 2048+ texture slices (have to be same format)
-        glTextureStorage3D(textureName, 1, GL_RGB8, hardCodedResolution, hardCodedResolution,
-                           (gl::GLsizei)filePaths.size());
-
-        // loop through all textures and put into a slice of the array
-        for (auto i = 0u; i < filePaths.size(); ++i) {
-            int texWidth, texHeight, texChannels;
-            stbi_uc* pixels =
-                stbi_load(filePaths[i].c_str(), &texWidth, &texHeight, &texChannels, 0);
-            if (!pixels) {
-                fmt::print(stderr, "texture {} failed to load\n", filePaths[0]);
-                return -1;
+        // decoding is the slow part and doesn't touch gl, so every file gets
+        // its own job. only the uploads have to happen on this thread
+        struct DecodedImage {
+            stbi_uc* pixels = nullptr;
+            int width = 0;
+            int height = 0;
+            int channels = 0;
+            std::vector<mipChain::Level> mips;
+        };
+        std::vector<DecodedImage> images(files.size());
+
+        auto decodeStart = steady_clock::now();
+        jobs::Counter decodeJobs;
+        for (auto i = 0u; i < files.size(); ++i) {
+            jobSystem.run(decodeJobs, [&, i] {
+                auto& image = images[i];
+                {
+                    TRACE_SCOPE("texture decode");
+                    image.pixels = stbi_load(files[i].path.c_str(), &image.width, &image.height,
+                                             &image.channels, 0);
+                }
+                // NEW! the rest of the chain straight after, while it's warm in
+                // cache. the rows are split over the other threads too
+                if (image.pixels && cpuMips) {
+                    TRACE_SCOPE("mip generation");
+                    auto settings = mipSettings;
+                    settings.srgb = files[i].colourSpace == ColourSpace::Srgb;
+                    image.mips = mipChain::generate(jobSystem, image.pixels, image.width,
+                                                    image.height, image.channels, settings);
+                }
+            });
+        }
+        jobSystem.wait(decodeJobs);
+        fmt::print("decoded {} textures{} in {:.1f} ms\n", files.size(),
+                   cpuMips ? " and their mips" : "",
+                   duration<double, std::milli>(steady_clock::now() - decodeStart).count());
+
+        // a texture that didn't load is left out and samples as black
+        std::vector<texturePacker::ImageView> views;
+        for (auto i = 0u; i < files.size(); ++i) {
+            if (!images[i].pixels) {
+                fmt::print(stderr, "texture {} failed to load\n", files[i].path);
             }
-
-            glTextureSubImage3D(textureName, 0, 0, 0, i, hardCodedResolution, hardCodedResolution,
-                                1, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-            stbi_image_free(pixels);
+            // NEW! srgb colour goes in an srgb format, so the shader gets
+            // linear values to light
+            views.push_back({images[i].pixels, images[i].width, images[i].height,
+                             images[i].channels, cpuMips ? &images[i].mips : nullptr,
+                             files[i].colourSpace == ColourSpace::Srgb});
         }
 
-        glTextureParameteri(textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTextureParameteri(textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glGenerateTextureMipmap(textureName);
-
-        return textureName;
+        // NEW! each texture at its own size, in an array with others the same
+        // size. 8 is the size of the shader's sampler array
+        std::unique_ptr<texturePacker::PackedTextures> packed;
+        {
+            TRACE_SCOPE("texture upload");
+            packed = std::make_unique<texturePacker::PackedTextures>(views, 8);
+        }
+        for (auto& image : images) {
+            stbi_image_free(image.pixels);
+        }
+        fmt::print("{} textures in {} arrays, {:.1f} MB\n", files.size(), packed->arrayCount(),
+                   packed->bytes() / (1024.0 * 1024.0));
+        return packed;
     };
 
-    auto textureArrayName =
-        textureGenerator({"body_diffuse.jpg", "tankTops_pants_boots_diffuse.jpg"});
+    // both are diffuse maps and there's no mtl, so they get what a material
+    // without a -colorspace option would say: srgb
+    const auto diffuse =
+        objLoader::MaterialInfo{}.colourSpaceOf(objLoader::MaterialInfo::mapType::Diffuse);
+    auto textures = textureGenerator(
+        {{"body_diffuse.jpg", diffuse}, {"tankTops_pants_boots_diffuse.jpg", diffuse}});
+
+    // turns on GL_FRAMEBUFFER_SRGB and works out where to draw
+    auto output = std::make_unique<srgbOutput::Output>();
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -299,83 +390,112 @@ int main() {
     glm::mat4 projection;
     glm::mat4 mvp;
 
-    projection = glm::perspective(glm::radians(40.0f), 1280.f / 640.f, 0.1f, 100.0f);
+    // stands far enough back to see the whole mesh, whatever size it is
+    auto camera = framing::frame(meshData.bounds, 40.0f, 1280.f / 640.f);
+    projection = camera.projection();
 
     int mvpLocationVertex = glGetUniformLocation(vertexColourProgram, "MVP");
     int mvpLocationTexture = glGetUniformLocation(textureProgram, "MVP");
 
     auto groups = meshData.groupInfos;
 
-    // only do this once now
-    glBindTextureUnit(0, textureArrayName);
-
-    struct DrawElementsIndirectCommand {
-        GLuint vertexCount;
-        GLuint instanceCount;
-        GLuint firstIndex;
-        GLint baseVertex;
-        GLuint baseInstance;
-    };
-
-    std::vector<DrawElementsIndirectCommand> allDraws = {
-        {groups[0].count, 1, groups[0].startOffset, 0, 0},
-        {groups[1].count, 1, groups[1].startOffset, 0, 1},
-        {groups[2].count, 1, groups[2].startOffset, 0, 2},
-        {groups[3].count, 1, groups[3].startOffset, 0, 3},
-        {groups[4].count, 1, groups[4].startOffset, 0, 4}};
-
-    auto createIndirectBuffer =
-        [](const std::vector<DrawElementsIndirectCommand>& commandBuffer) -> GLuint {
-        GLuint indirectBuffer;
-        glCreateBuffers(1, &indirectBuffer);
-
-        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
-        glNamedBufferStorage(indirectBuffer,
-                             (gl::GLsizei)(commandBuffer.size() * sizeof(DrawElementsIndirectCommand)),
-                             commandBuffer.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
-        return indirectBuffer;
-    };
+    // only do this once now. the arrays on units 0 and up, the table at 2
+    textures->bind(0, 2);
+
+    // a draw per group, already offset to where the pool put the mesh
+    std::vector<DrawElementsIndirectCommand> allDraws;
+    meshes->appendCommands(mainMesh, 0, allDraws);
+
+    // NEW! draws go through a queue that sorts them by state and batches
+    // them, rather than a pass per thing in the order the code is written
+    auto queue = std::make_unique<renderQueue::RenderQueue>(allDraws.size() * 2 + 1);
+    const auto backGroundDraw = renderQueue::Draw{
+        renderQueue::Pass::Background, vertexColourProgram,
+        meshes->vao(meshes->slot(backGroundMesh).page), 0, 0, 1.f,
+        meshes->command(backGroundMesh, 0)};
+    const auto meshVao = meshes->vao(meshes->slot(mainMesh).page);
+    const auto meshPositionVao = meshes->positionVao(meshes->slot(mainMesh).page);
+    if (depthPrepass) {
+        // the pre-pass has written the depth, the opaque pass only shades what
+        // matches it
+        queue->setPassState(renderQueue::Pass::Opaque, {true, false, GL_EQUAL});
+    }
+    int mvpLocationDepth = glGetUniformLocation(depthProgram, "MVP");
+    glProgramUniformMatrix4fv(vertexColourProgram, mvpLocationVertex, 1, GL_FALSE,
+                              glm::value_ptr(ortho));
+    renderQueue::FrameStats lastStats;
 
-    auto allCommands = createIndirectBuffer(allDraws);
-    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, allCommands);
+    // gpu timestamps. does nothing unless tracing was started above
+    tracer::GpuTimeline gpuTimeline;
 
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("frame");
+        gpuTimeline.beginFrame();
 
         auto currentTime = duration<float>(system_clock::now() - startTime).count();
 
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        output->begin(framebufferWidth, framebufferHeight);
+
         glClearBufferfv(GL_COLOR, 0, clearColour.data());
         glClearBufferfv(GL_DEPTH, 0, &clearDepth);
 
-        // bg
-        glBindVertexArray(backGroundVao);
-        glUseProgram(vertexColourProgram);
-
-        glProgramUniformMatrix4fv(vertexColourProgram, mvpLocationVertex, 1, GL_FALSE,
-                                  glm::value_ptr(ortho));
-
-        glDrawArrays(GL_TRIANGLES, 0, (gl::GLsizei)backGroundVertices.size());
-
-        // mesh
-        glBindVertexArray(meshVao);
-        glUseProgram(textureProgram);
-
-        glm::mat4 view = glm::lookAt(
-            glm::vec3(std::sin(currentTime * 0.5f) * 2.5f,
-                      1.25f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.3f,
-                      std::cos(currentTime * 0.5f) * 2.5f), // Camera is at (4,3,3), in World Space
-            glm::vec3(0.f, 1.f, 0.f),                       // and looks at the origin
-            glm::vec3(0.f, 1.f, 0.f) // Head is up (set to 0,-1,0 to look upside-down)
-        );
-        mvp = projection * view * model;
-        glProgramUniformMatrix4fv(textureProgram, mvpLocationTexture, 1, GL_FALSE,
-                                  glm::value_ptr(mvp));
+        {
+            TRACE_SCOPE("draws");
+            TRACE_GPU_SCOPE(gpuTimeline, "draws");
+
+            float elevation = 0.1f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.12f;
+            glm::mat4 view = camera.orbit(currentTime * 0.5f, elevation);
+            mvp = projection * view * model;
+            glProgramUniformMatrix4fv(textureProgram, mvpLocationTexture, 1, GL_FALSE,
+                                      glm::value_ptr(mvp));
+            glProgramUniformMatrix4fv(depthProgram, mvpLocationDepth, 1, GL_FALSE,
+                                      glm::value_ptr(mvp));
+
+            // groups outside the view just aren't submitted. the rest are
+            // opaque and sorted front to back by the middle of their bounds
+            auto planes = bounds::frustumPlanes(mvp);
+            for (auto i = 0u; i < allDraws.size(); ++i) {
+                const auto& drawBounds = i < groups.size() ? groups[i].bounds : meshData.bounds;
+                if (!bounds::visible(planes, drawBounds)) {
+                    continue;
+                }
+                float depth = (mvp * glm::vec4(drawBounds.centre, 1.0f)).w / camera.farPlane;
+                queue->submit({renderQueue::Pass::Opaque, textureProgram, meshVao, 0, 0, depth,
+                               allDraws[i]});
+                if (depthPrepass) {
+                    queue->submit({renderQueue::Pass::DepthPrepass, depthProgram,
+                                   meshPositionVao, 0, 0, depth, allDraws[i]});
+                }
+            }
+            // the background goes after, so depth testing skips everything
+            // behind the model
+            queue->submit(backGroundDraw);
+
+            auto stats = queue->flush();
+            if (stats.draws != lastStats.draws || stats.batches != lastStats.batches) {
+                fmt::print("render queue: {} draws in {} batches, {} binds skipped\n",
+                           stats.draws, stats.batches, stats.skippedBinds);
+                lastStats = stats;
+            }
+        }
 
-        // right before call bind buffer
-        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (gl::GLsizei)allDraws.size(), 0);
+        output->end();
 
-        glfwSwapBuffers(window);
+        {
+            TRACE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
     }
 
+    gpuTimeline.shutdown();
+    // textures go before the context does
+    textures.reset();
+    queue.reset();
+    meshes.reset();
+    glDeleteBuffers(1, &textureIndexBuffer);
+    output.reset();
     glfwTerminate();
 }
@@ -0,0 +1,439 @@
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+#include "obj_loader.hpp"
+#include "persistent_ring_buffer.hpp"
+
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <unordered_map>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+int main() {
+
+    auto startTime = system_clock::now();
+
+    const int width = 1920;
+    const int height = 960;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window = glfwCreateWindow(width, height, "Chapter 20 - Persistent Mapped Buffers",
+                                       nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // NEW! no more per program MVP uniform. everything that changes per frame
+    // comes out of one persistently mapped buffer:
+    //  - a uniform block with the camera, time and resolution
+    //  - a storage buffer with one model matrix per draw, picked with gl_DrawID
+    //  - the indirect commands themselves
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+            layout (location = 2) in vec2 aTexCoord;
+            layout (location = 3) in float aTextureIndex;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out vec2 uv;
+            layout (location = 2) out vec3 position;
+            layout (location = 3) out flat float textureIndex;
+
+            layout (std140, binding = 0) uniform FrameUniforms {
+                mat4 viewProjection;
+                vec4 timeAndResolution; // x = time, yz = resolution
+            };
+
+            layout (std430, binding = 1) readonly buffer DrawTransforms {
+                mat4 models[];
+            };
+
+            void main(){
+                mat4 model = models[gl_DrawID];
+                position = vec3(model * vec4(aPosition, 1.0f));
+                normal = mat3(model) * aNormal;
+                uv = aTexCoord;
+                textureIndex = aTextureIndex;
+
+                gl_Position = viewProjection * vec4(position, 1.0f);
+            }
+        )";
+
+    // bg doesn't move so it keeps a plain uniform that we set once
+    const char* vertexShaderSourceBackground = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+            layout (location = 2) in vec2 aTexCoord;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out vec2 uv;
+
+            uniform mat4 MVP;
+
+            void main(){
+                normal = aNormal;
+                uv = aTexCoord;
+                gl_Position = MVP * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    // for bg
+    const char* fragmentShaderSourceColour = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec2 uv;
+
+            out vec4 finalColor;
+
+            void main() {
+                finalColor = vec4(normal, 1.0f);
+            }
+        )";
+
+    // for texturing models
+    const char* fragmentShaderSourceTexture = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec2 uv;
+            layout (location = 2) in vec3 position;
+            layout (location = 3) in flat float textureIndex;
+
+            out vec4 finalColor;
+
+            vec3 lightPosition = vec3(1,1,1);
+            vec3 lightPosition2 = vec3(-2,0,0);
+
+            uniform sampler2DArray Texture;
+
+            void main() {
+                vec3 lightDirection = normalize(lightPosition - position);
+                vec3 lightDirection2 = normalize(lightPosition2 - position);
+
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                float diffuseLighting2 = max(dot(normalize(normal), lightDirection2), 0);
+
+                vec4 textureSample = texture(Texture, vec3(uv, textureIndex));
+                finalColor = textureSample * (diffuseLighting + diffuseLighting2 * 0.5f);
+            }
+        )";
+
+    auto vertexColourProgram =
+        createShaderProgram(vertexShaderSourceBackground, fragmentShaderSourceColour);
+    auto textureProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceTexture);
+
+    // clang-format off
+    const std::vector<vertex3D> backGroundVertices {{
+        //   position   |           normal        |  texCoord
+        {{-1.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {0.f, 0.f}},
+        {{ 3.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {3.f, 0.f}},
+        {{-1.f,  3.f, 0.999999f},  {0.80f, 0.82f, 0.80f}, {0.f, 3.f}}
+    }};
+    // clang-format on
+
+    auto meshData = objLoader::readObjElements("tommy.obj");
+
+    // buffers
+    auto createBufferAndVao = [](const std::vector<vertex3D>& vertices,
+                                 const std::vector<int>& indices, GLuint program) -> GLuint {
+        // in core profile, at least 1 vao is needed
+        GLuint vao;
+        glCreateVertexArrays(1, &vao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+
+        // upload immediately
+        glNamedBufferStorage(bufferObject, vertices.size() * sizeof(vertex3D), vertices.data(),
+                             GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aPosition"),
+                                   /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aNormal"), /*buffs idx*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayAttribBinding(vao, glGetAttribLocation(program, "aTexCoord"), /*buffs idx*/ 0);
+        glVertexArrayAttribFormat(vao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, texCoord));
+        glEnableVertexArrayAttrib(vao, 2);
+
+        // buffer to index mapping
+        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        if (indices.size() > 0) {
+            GLuint elemementBufferObject;
+            glCreateBuffers(1, &elemementBufferObject);
+            glNamedBufferStorage(elemementBufferObject, indices.size() * sizeof(GLuint),
+                                 indices.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
+            glVertexArrayElementBuffer(vao, elemementBufferObject);
+        }
+        return vao;
+    };
+
+    auto backGroundVao = createBufferAndVao(backGroundVertices, {}, vertexColourProgram);
+    auto meshVao = createBufferAndVao(meshData.vertices, meshData.indices, textureProgram);
+
+    std::vector<GLfloat> textureIndices = {0.f, 0.f, 0.f, 1.f, 1.f};
+
+    // setup texture indices
+    {
+        GLuint bufferObject2;
+
+        glCreateBuffers(1, &bufferObject2);
+        glNamedBufferStorage(bufferObject2, textureIndices.size() * sizeof(GLfloat),
+                             textureIndices.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribFormat(meshVao, 3, 1, GL_FLOAT, GL_FALSE, 0);
+        glEnableVertexArrayAttrib(meshVao, 3);
+
+        glVertexArrayAttribBinding(meshVao, glGetAttribLocation(textureProgram, "aTextureIndex"),
+                                   /*buffer index*/ 1);
+        glVertexArrayVertexBuffer(meshVao, 1, bufferObject2, /*offset*/ 0, sizeof(GLfloat));
+        glVertexArrayBindingDivisor(meshVao, 1, 1);
+    }
+
+    // texture. the array is sized from the first image instead of assuming
+    // 1024x1024, and stb is asked for exactly 3 channels so every upload reads
+    // width * height * 3 bytes, which is what stb handed back
+    auto textureGenerator = [](const std::vector<std::string>& filePaths) -> GLuint {
+        stbi_set_flip_vertically_on_load(true);
+
+        GLuint textureName = 0;
+        int arrayWidth = 0;
+        int arrayHeight = 0;
+        const int channels = 3;
+
+        // rows of rgb8 aren't 4 byte aligned unless the width happens to be
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (auto i = 0u; i < filePaths.size(); ++i) {
+            int texWidth, texHeight, texChannels;
+            stbi_uc* pixels =
+                stbi_load(filePaths[i].c_str(), &texWidth, &texHeight, &texChannels, channels);
+            if (!pixels) {
+                fmt::print(stderr, "texture {} failed to load\n", filePaths[i]);
+                return -1;
+            }
+
+            if (i == 0) {
+                arrayWidth = texWidth;
+                arrayHeight = texHeight;
+                glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureName);
+                glTextureStorage3D(textureName, 1, GL_RGB8, arrayWidth, arrayHeight,
+                                   (gl::GLsizei)filePaths.size());
+            } else if (texWidth != arrayWidth || texHeight != arrayHeight) {
+                // layers of an array all share one size
+                fmt::print(stderr, "texture {} is {}x{}, expected {}x{}. layer left empty\n",
+                           filePaths[i], texWidth, texHeight, arrayWidth, arrayHeight);
+                stbi_image_free(pixels);
+                continue;
+            }
+
+            glTextureSubImage3D(textureName, 0, 0, 0, i, texWidth, texHeight, 1, GL_RGB,
+                                GL_UNSIGNED_BYTE, pixels);
+            stbi_image_free(pixels);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glTextureParameteri(textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glGenerateTextureMipmap(textureName);
+
+        return textureName;
+    };
+
+    auto textureArrayName =
+        textureGenerator({"body_diffuse.jpg", "tankTops_pants_boots_diffuse.jpg"});
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    std::array<GLfloat, 4> clearColour{0.f, 0.f, 0.f, 1.f};
+    GLfloat clearDepth{1.0f};
+
+    glm::mat4 ortho = glm::ortho(-1.f, 1.f, -1.f, 1.f, 1.f, -1.f);
+    glm::mat4 projection = glm::perspective(
+        glm::radians(40.0f), static_cast<float>(width) / static_cast<float>(height), 0.1f, 100.0f);
+
+    // bg never changes so set it once, outside the loop
+    glProgramUniformMatrix4fv(vertexColourProgram,
+                              glGetUniformLocation(vertexColourProgram, "MVP"), 1, GL_FALSE,
+                              glm::value_ptr(ortho));
+
+    auto groups = meshData.groupInfos;
+
+    glBindTextureUnit(0, textureArrayName);
+
+    // matches the std140 block in the vertex shader
+    struct FrameUniforms {
+        glm::mat4 viewProjection;
+        glm::vec4 timeAndResolution;
+    };
+
+    std::vector<DrawElementsIndirectCommand> allDraws;
+    for (auto i = 0u; i < groups.size(); ++i) {
+        allDraws.push_back({groups[i].count, 1, groups[i].startOffset, 0, i});
+    }
+    std::vector<glm::mat4> drawTransforms(allDraws.size());
+
+    // scoped so the ring buffer releases its gl objects before the context goes away
+    {
+        // room for a frame's worth of everything plus alignment padding
+        const size_t bytesPerFrame = sizeof(FrameUniforms) +
+                                     drawTransforms.size() * sizeof(glm::mat4) +
+                                     allDraws.size() * sizeof(DrawElementsIndirectCommand) + 1024;
+        gpuStreaming::PersistentRingBuffer ringBuffer(bytesPerFrame);
+
+        // the ring is one buffer object so it can stay bound as the indirect
+        // buffer. each frame we just pass a different offset to the draw
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ringBuffer.buffer());
+
+        while (!glfwWindowShouldClose(window)) {
+
+            auto currentTime = duration<float>(system_clock::now() - startTime).count();
+
+            // only waits if the gpu is more than 2 frames behind
+            ringBuffer.beginFrame();
+
+            glm::mat4 view = glm::lookAt(
+                glm::vec3(std::sin(currentTime * 0.5f) * 2.5f,
+                          1.25f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.3f,
+                          std::cos(currentTime * 0.5f) * 2.5f),
+                glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+
+            FrameUniforms frameUniforms{projection * view,
+                                        {currentTime, static_cast<float>(width),
+                                         static_cast<float>(height), 0.f}};
+            auto frameAllocation =
+                ringBuffer.write(&frameUniforms, 1, ringBuffer.uniformAlignment());
+
+            // each group gets its own transform now. pull them apart a little so
+            // it is obvious they are separate draws
+            for (auto i = 0u; i < drawTransforms.size(); ++i) {
+                float explode =
+                    (std::sin(currentTime * 1.5f) + 1.0f) * 0.05f * static_cast<float>(i);
+                drawTransforms[i] = glm::translate(glm::mat4(1.0f), glm::vec3(0.f, explode, 0.f));
+            }
+            // however many transforms there are it's one memcpy
+            auto transformAllocation =
+                ringBuffer.write(drawTransforms, ringBuffer.storageAlignment());
+
+            // commands are streamed too, so they could change every frame
+            auto commandAllocation =
+                ringBuffer.write(allDraws, alignof(DrawElementsIndirectCommand));
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            // bg
+            glBindVertexArray(backGroundVao);
+            glUseProgram(vertexColourProgram);
+            glDrawArrays(GL_TRIANGLES, 0, (gl::GLsizei)backGroundVertices.size());
+
+            // mesh
+            glBindVertexArray(meshVao);
+            glUseProgram(textureProgram);
+
+            ringBuffer.bindRange(GL_UNIFORM_BUFFER, 0, frameAllocation);
+            ringBuffer.bindRange(GL_SHADER_STORAGE_BUFFER, 1, transformAllocation);
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        reinterpret_cast<const void*>(commandAllocation.offset),
+                                        (gl::GLsizei)allDraws.size(), 0);
+
+            // the gpu has everything it needs from this region now
+            ringBuffer.endFrame();
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        fmt::print("ring buffer stalls: {}\n", ringBuffer.stalls());
+    }
+
+    glfwTerminate();
+}
@@ -0,0 +1,318 @@
+#include "error_handling.hpp"
+#include "instancing.hpp"
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <limits>
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter21_instancing [mesh.obj] [--instances N] [--bench FRAMES]
+//
+// --bench hides the window, draws FRAMES frames as fast as it can and prints
+// one json line with instances/s and triangles/s. handy for stress testing a
+// driver, llvmpipe included (drop --instances for that, 100k toys is a lot of
+// triangles to do on the cpu).
+int main(int argc, char* argv[]) {
+
+    std::string meshPath = "rubberToy.obj";
+    uint32_t instanceCount = 100000;
+    int benchFrames = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--instances" && i + 1 < argc) {
+            instanceCount = static_cast<uint32_t>(std::max(1l, std::atol(argv[++i])));
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        } else {
+            meshPath = arg;
+        }
+    }
+    const bool benchmark = benchFrames > 0;
+
+    auto startTime = system_clock::now();
+
+    const int width = 1600;
+    const int height = 900;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // gl_BaseInstance needs 4.6 (or ARB_shader_draw_parameters)
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(width, height, "Chapter 21 - Instancing", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // NEW! the model matrix comes out of a storage buffer, one per instance.
+    // gl_InstanceID restarts at 0 for every command in the multi draw so we add
+    // gl_BaseInstance to find this command's slice of the buffer
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out vec3 position;
+            layout (location = 2) out flat vec3 tint;
+
+            layout (std430, binding = 0) readonly buffer InstanceTransforms {
+                mat4 instanceModels[];
+            };
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                uint instance = gl_BaseInstance + gl_InstanceID;
+                mat4 model = instanceModels[instance];
+
+                position = vec3(model * vec4(aPosition, 1.0f));
+                normal = mat3(model) * aNormal;
+
+                // a different colour per instance so you can tell them apart
+                tint = 0.5f + 0.5f * cos(vec3(0.0f, 2.1f, 4.2f) + float(instance) * 0.37f);
+
+                gl_Position = viewProjection * vec4(position, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSource = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec3 position;
+            layout (location = 2) in flat vec3 tint;
+
+            out vec4 finalColor;
+
+            vec3 lightDirection = normalize(vec3(1, 2, 1));
+
+            void main() {
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                finalColor = vec4(tint * (0.2f + diffuseLighting * 0.8f), 1.0f);
+            }
+        )";
+
+    auto program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    auto meshData = objLoader::readObjElements(meshPath);
+    if (meshData.indices.empty()) {
+        fmt::print(stderr, "{} has no faces\n", meshPath);
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+
+    // buffers. no texture index attribute this time, baseInstance is used
+    // for picking transforms so it can't double as the texture index
+    auto createBufferAndVao = [](const std::vector<vertex3D>& vertices,
+                                 const std::vector<int>& indices) -> GLuint {
+        GLuint vao;
+        glCreateVertexArrays(1, &vao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, vertices.size() * sizeof(vertex3D), vertices.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        GLuint elementBufferObject;
+        glCreateBuffers(1, &elementBufferObject);
+        glNamedBufferStorage(elementBufferObject, indices.size() * sizeof(GLuint), indices.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayElementBuffer(vao, elementBufferObject);
+        return vao;
+    };
+
+    auto meshVao = createBufferAndVao(meshData.vertices, meshData.indices);
+
+    // space the copies out by the size of the mesh so they don't overlap
+    glm::vec3 minimum(std::numeric_limits<float>::max());
+    glm::vec3 maximum(std::numeric_limits<float>::lowest());
+    for (const auto& vertex : meshData.vertices) {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    const glm::vec3 extent = maximum - minimum;
+    const float spacing = std::max({extent.x, extent.z, 0.001f}) * 1.5f;
+    const float gridWidth = std::ceil(std::sqrt(static_cast<float>(instanceCount))) * spacing;
+
+    // one command per group, each drawing every instance
+    auto allDraws = instancing::instancedDraws(meshData.groupInfos, instanceCount);
+
+    uint64_t trianglesPerFrame = 0;
+    for (const auto& draw : allDraws) {
+        trianglesPerFrame += static_cast<uint64_t>(draw.vertexCount / 3) * draw.instanceCount;
+    }
+    fmt::print(stderr, "{} instances of {}, {} draws, {} triangles per frame\n", instanceCount,
+               meshPath, allDraws.size(), trianglesPerFrame);
+
+    GLuint indirectBuffer;
+    glCreateBuffers(1, &indirectBuffer);
+    glNamedBufferStorage(indirectBuffer, allDraws.size() * sizeof(DrawElementsIndirectCommand),
+                         allDraws.data(), GL_DYNAMIC_STORAGE_BIT);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+    GLfloat clearDepth{1.0f};
+
+    glm::mat4 projection = glm::perspective(glm::radians(50.0f),
+                                            static_cast<float>(width) / static_cast<float>(height),
+                                            spacing * 0.05f, gridWidth * 4.0f);
+
+    auto viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+
+    // scoped so the instance buffer is released before the context goes away
+    {
+        instancing::InstanceBuffer instances(
+            instancing::gridTransforms(instanceCount, spacing, /*seed*/ 1));
+
+        // the multi draw below is the same every frame, so bind everything once
+        glBindVertexArray(meshVao);
+        glUseProgram(program);
+        instances.bind(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+        auto drawFrame = [&](float currentTime) {
+            // fly around the field of copies
+            float radius = gridWidth * 0.75f;
+            glm::mat4 view = glm::lookAt(glm::vec3(std::sin(currentTime * 0.2f) * radius,
+                                                   gridWidth * 0.35f + extent.y,
+                                                   std::cos(currentTime * 0.2f) * radius),
+                                         glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+            glm::mat4 viewProjection = projection * view;
+            glProgramUniformMatrix4fv(program, viewProjectionLocation, 1, GL_FALSE,
+                                      glm::value_ptr(viewProjection));
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            // every copy of every group in one call
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                        (gl::GLsizei)allDraws.size(), 0);
+        };
+
+        if (benchmark) {
+            // a few frames first so shader compiles and uploads aren't timed
+            for (int frame = 0; frame < 3; ++frame) {
+                drawFrame(0.f);
+            }
+            glFinish();
+
+            auto benchStart = steady_clock::now();
+            for (int frame = 0; frame < benchFrames; ++frame) {
+                drawFrame(static_cast<float>(frame) / 60.0f);
+                glfwSwapBuffers(window);
+            }
+            glFinish();
+            auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            fmt::print("{{\"benchmark\":\"instancing\",\"renderer\":\"{}\",\"mesh\":\"{}\","
+                       "\"instances\":{},\"draws\":{},\"frames\":{},\"seconds\":{:.6f},"
+                       "\"msPerFrame\":{:.3f},\"instancesPerSecond\":{:.0f},"
+                       "\"trianglesPerSecond\":{:.0f}}}\n",
+                       renderer ? renderer : "unknown", meshPath, instanceCount, allDraws.size(),
+                       benchFrames, seconds, seconds * 1000.0 / benchFrames,
+                       static_cast<double>(instanceCount) * benchFrames / seconds,
+                       static_cast<double>(trianglesPerFrame) * benchFrames / seconds);
+        } else {
+            while (!glfwWindowShouldClose(window)) {
+                auto currentTime = duration<float>(system_clock::now() - startTime).count();
+                drawFrame(currentTime);
+
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+    }
+
+    glfwTerminate();
+}
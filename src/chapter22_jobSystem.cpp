@@ -0,0 +1,339 @@
+#include "error_handling.hpp"
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "persistent_ring_buffer.hpp"
+#include "scene_prep.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter22_jobSystem [mesh.obj ...] [--objects N] [--threads N]
+//
+// every frame the objects are animated, culled and packed into draws by the
+// job system, straight into the persistently mapped ring buffer from chapter
+// 20. the main thread only waits for that and issues one multi draw.
+int main(int argc, char* argv[]) {
+
+    tracer::startFromEnvironment();
+    tracer::setThreadName("main");
+
+    std::vector<std::string> meshPaths;
+    uint32_t objectCount = 100000;
+    unsigned threadCount = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--objects" && i + 1 < argc) {
+            objectCount = static_cast<uint32_t>(std::max(1l, std::atol(argv[++i])));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threadCount = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else {
+            meshPaths.push_back(arg);
+        }
+    }
+    if (meshPaths.empty()) {
+        meshPaths.push_back("rubberToy.obj");
+    }
+
+    // NEW! a pool of worker threads. 0 means one per core
+    jobs::JobSystem jobSystem(threadCount);
+
+    auto startTime = system_clock::now();
+
+    const int width = 1600;
+    const int height = 900;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(width, height, "Chapter 22 - Job System", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // same as chapter 21, except the transforms are only the visible objects
+    // and get rewritten every frame
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out flat vec3 tint;
+
+            layout (std430, binding = 0) readonly buffer InstanceTransforms {
+                mat4 instanceModels[];
+            };
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                mat4 model = instanceModels[gl_BaseInstance + gl_InstanceID];
+
+                normal = mat3(model) * aNormal;
+                // colour by mesh so you can tell the draws apart
+                tint = 0.5f + 0.5f * cos(vec3(0.0f, 2.1f, 4.2f) + float(gl_DrawID) * 1.3f);
+
+                gl_Position = viewProjection * model * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSource = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in flat vec3 tint;
+
+            out vec4 finalColor;
+
+            vec3 lightDirection = normalize(vec3(1, 2, 1));
+
+            void main() {
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                finalColor = vec4(tint * (0.2f + diffuseLighting * 0.8f), 1.0f);
+            }
+        )";
+
+    auto program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    // loading is a job per file as well. each loader run is independent
+    std::vector<objLoader::MeshDataElements> meshDatas(meshPaths.size());
+    {
+        TRACE_SCOPE("load meshes");
+        jobs::Counter loadJobs;
+        for (auto i = 0u; i < meshPaths.size(); ++i) {
+            jobSystem.run(loadJobs,
+                          [&, i] { meshDatas[i] = objLoader::readObjElements(meshPaths[i]); });
+        }
+        jobSystem.wait(loadJobs);
+    }
+
+    // all the meshes go in one vertex and one index buffer, so one vao and one
+    // multi draw covers them. baseVertex and firstIndex say where each one is
+    std::vector<vertex3D> allVertices;
+    std::vector<int> allIndices;
+    std::vector<scenePrep::MeshInfo> meshes;
+    for (auto i = 0u; i < meshDatas.size(); ++i) {
+        const auto& meshData = meshDatas[i];
+        if (meshData.indices.empty()) {
+            fmt::print(stderr, "{} has no faces, skipping it\n", meshPaths[i]);
+            continue;
+        }
+
+        float radius = 0.0f;
+        for (const auto& vertex : meshData.vertices) {
+            radius = std::max(radius, glm::length(vertex.position));
+        }
+
+        meshes.push_back({static_cast<uint32_t>(allIndices.size()),
+                          static_cast<uint32_t>(meshData.indices.size()),
+                          static_cast<int32_t>(allVertices.size()), radius});
+        allVertices.insert(allVertices.end(), meshData.vertices.begin(), meshData.vertices.end());
+        allIndices.insert(allIndices.end(), meshData.indices.begin(), meshData.indices.end());
+    }
+    if (meshes.empty()) {
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+
+    GLuint meshVao;
+    {
+        glCreateVertexArrays(1, &meshVao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, allVertices.size() * sizeof(vertex3D),
+                             allVertices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(meshVao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(meshVao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(meshVao, 0);
+
+        glVertexArrayAttribBinding(meshVao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(meshVao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(meshVao, 1);
+
+        glVertexArrayVertexBuffer(meshVao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        GLuint elementBufferObject;
+        glCreateBuffers(1, &elementBufferObject);
+        glNamedBufferStorage(elementBufferObject, allIndices.size() * sizeof(GLuint),
+                             allIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayElementBuffer(meshVao, elementBufferObject);
+    }
+
+    float largestRadius = 0.0f;
+    for (const auto& mesh : meshes) {
+        largestRadius = std::max(largestRadius, mesh.boundingRadius);
+    }
+    const float fieldSize = std::sqrt(static_cast<float>(objectCount)) * largestRadius * 3.0f;
+    auto scene = scenePrep::makeScene(meshes, objectCount, fieldSize);
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+    GLfloat clearDepth{1.0f};
+
+    glm::mat4 projection = glm::perspective(glm::radians(50.0f),
+                                            static_cast<float>(width) / static_cast<float>(height),
+                                            largestRadius * 0.1f, fieldSize * 1.5f);
+
+    auto viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+
+    glBindVertexArray(meshVao);
+    glUseProgram(program);
+
+    // scoped so the ring buffer releases its gl objects before the context goes away
+    {
+        // worst case everything is visible
+        const size_t bytesPerFrame = objectCount * sizeof(glm::mat4) +
+                                     meshes.size() * sizeof(DrawElementsIndirectCommand) + 1024;
+        gpuStreaming::PersistentRingBuffer ringBuffer(bytesPerFrame);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ringBuffer.buffer());
+
+        double prepSeconds = 0.0;
+        uint32_t visible = 0;
+        int framesSinceTitle = 0;
+        auto titleTime = steady_clock::now();
+
+        while (!glfwWindowShouldClose(window)) {
+            TRACE_SCOPE("frame");
+
+            auto currentTime = duration<float>(system_clock::now() - startTime).count();
+
+            ringBuffer.beginFrame();
+
+            float radius = fieldSize * 0.3f;
+            glm::mat4 view = glm::lookAt(glm::vec3(std::sin(currentTime * 0.1f) * radius,
+                                                   fieldSize * 0.08f,
+                                                   std::cos(currentTime * 0.1f) * radius),
+                                         glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+            glm::mat4 viewProjection = projection * view;
+
+            // the jobs write straight into mapped memory so there is no copy
+            // and no upload call afterwards
+            auto transformAllocation = ringBuffer.allocate(objectCount * sizeof(glm::mat4),
+                                                           ringBuffer.storageAlignment());
+            auto commandAllocation =
+                ringBuffer.allocate(meshes.size() * sizeof(DrawElementsIndirectCommand),
+                                    alignof(DrawElementsIndirectCommand));
+
+            auto prepStart = steady_clock::now();
+            visible = scenePrep::prepareFrame(
+                jobSystem, scene, viewProjection, currentTime,
+                static_cast<glm::mat4*>(transformAllocation.data),
+                static_cast<DrawElementsIndirectCommand*>(commandAllocation.data));
+            prepSeconds += duration<double>(steady_clock::now() - prepStart).count();
+
+            glProgramUniformMatrix4fv(program, viewProjectionLocation, 1, GL_FALSE,
+                                      glm::value_ptr(viewProjection));
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            ringBuffer.bindRange(GL_SHADER_STORAGE_BUFFER, 0, transformAllocation);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        reinterpret_cast<const void*>(commandAllocation.offset),
+                                        (gl::GLsizei)meshes.size(), 0);
+
+            ringBuffer.endFrame();
+
+            {
+                TRACE_SCOPE("swap");
+                glfwSwapBuffers(window);
+            }
+            glfwPollEvents();
+
+            // stats in the title bar once a second
+            ++framesSinceTitle;
+            auto sinceTitle = duration<double>(steady_clock::now() - titleTime).count();
+            if (sinceTitle > 1.0) {
+                auto title = fmt::format(
+                    "Chapter 22 - Job System | {} threads | {:.1f} fps | prep {:.2f} ms | "
+                    "{} / {} visible",
+                    jobSystem.threadCount(), framesSinceTitle / sinceTitle,
+                    prepSeconds * 1000.0 / framesSinceTitle, visible, objectCount);
+                glfwSetWindowTitle(window, title.c_str());
+                framesSinceTitle = 0;
+                prepSeconds = 0.0;
+                titleTime = steady_clock::now();
+            }
+        }
+    }
+
+    glfwTerminate();
+}
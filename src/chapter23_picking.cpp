@@ -0,0 +1,287 @@
+#include "bvh.hpp"
+#include "error_handling.hpp"
+#include "framing.hpp"
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter23_picking [mesh.obj]
+//
+// left click on the mesh to pick it. the ray from the cursor goes through a
+// bvh built on the cpu, the group under it is highlighted and the triangle
+// hit gets a brighter tint. space pauses the camera.
+int main(int argc, char* argv[]) {
+
+    std::string meshPath = argc > 1 ? argv[1] : "tommy.obj";
+
+    jobs::JobSystem jobSystem;
+
+    auto startTime = system_clock::now();
+
+    const int width = 1280;
+    const int height = 720;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window = glfwCreateWindow(width, height, "Chapter 23 - Picking", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    const char* vertexShaderSource = R"(
+            #version 450 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+
+            layout (location = 0) out vec3 normal;
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                normal = aNormal;
+                gl_Position = viewProjection * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    // NEW! gl_PrimitiveID counts triangles from the start of the draw, and we
+    // draw a group at a time, so the picked triangle is relative to its group
+    const char* fragmentShaderSource = R"(
+            #version 450 core
+
+            layout (location = 0) in vec3 normal;
+
+            out vec4 finalColor;
+
+            uniform bool groupPicked;
+            uniform int pickedTriangle;
+
+            vec3 lightDirection = normalize(vec3(1, 2, 1));
+
+            void main() {
+                vec3 colour = vec3(0.7f);
+                if (groupPicked) {
+                    colour = gl_PrimitiveID == pickedTriangle ? vec3(1.0f, 0.9f, 0.2f)
+                                                              : vec3(0.9f, 0.35f, 0.2f);
+                }
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                finalColor = vec4(colour * (0.2f + diffuseLighting * 0.8f), 1.0f);
+            }
+        )";
+
+    auto program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    auto meshData = objLoader::readObjElements(meshPath);
+    if (meshData.indices.empty()) {
+        fmt::print(stderr, "{} has no faces\n", meshPath);
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+
+    // NEW! the hierarchy the picking rays go through. it only needs building
+    // once, the mesh doesn't move
+    auto buildStart = steady_clock::now();
+    auto tree = bvh::build(jobSystem, meshData);
+    fmt::print(stderr, "bvh over {} triangles: {} nodes, depth {}, built in {:.2f}ms\n",
+               meshData.indices.size() / 3, tree.nodes.size(), tree.depth,
+               duration<double>(steady_clock::now() - buildStart).count() * 1e3);
+
+    auto createBufferAndVao = [](const std::vector<vertex3D>& vertices,
+                                 const std::vector<int>& indices) -> GLuint {
+        GLuint vao;
+        glCreateVertexArrays(1, &vao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, vertices.size() * sizeof(vertex3D), vertices.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        GLuint elementBufferObject;
+        glCreateBuffers(1, &elementBufferObject);
+        glNamedBufferStorage(elementBufferObject, indices.size() * sizeof(GLuint), indices.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayElementBuffer(vao, elementBufferObject);
+        return vao;
+    };
+
+    auto meshVao = createBufferAndVao(meshData.vertices, meshData.indices);
+
+    glEnable(GL_DEPTH_TEST);
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+    GLfloat clearDepth{1.0f};
+
+    auto camera = framing::frame(meshData.bounds, 40.0f,
+                                 static_cast<float>(width) / static_cast<float>(height));
+    glm::mat4 projection = camera.projection();
+
+    auto viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+    auto groupPickedLocation = glGetUniformLocation(program, "groupPicked");
+    auto pickedTriangleLocation = glGetUniformLocation(program, "pickedTriangle");
+
+    int pickedGroup = -1;
+    int pickedTriangle = -1;
+    bool paused = false;
+    bool spaceWasDown = false;
+    bool buttonWasDown = false;
+    float cameraTime = 0.f;
+    float lastTime = 0.f;
+
+    glBindVertexArray(meshVao);
+    glUseProgram(program);
+
+    while (!glfwWindowShouldClose(window)) {
+        auto currentTime = duration<float>(system_clock::now() - startTime).count();
+        if (!paused) {
+            cameraTime += currentTime - lastTime;
+        }
+        lastTime = currentTime;
+
+        glm::mat4 view = camera.orbit(cameraTime * 0.3f, 0.25f);
+        glm::mat4 viewProjection = projection * view;
+
+        // NEW! a click turns the cursor into a ray. the cursor is in window
+        // coordinates, flip y and scale to -1..1, then push the points on the
+        // near and far planes back through the inverse view projection
+        bool buttonDown = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (buttonDown && !buttonWasDown) {
+            double cursorX, cursorY;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            int windowWidth, windowHeight;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+
+            glm::vec2 ndc(2.0f * static_cast<float>(cursorX) / windowWidth - 1.0f,
+                          1.0f - 2.0f * static_cast<float>(cursorY) / windowHeight);
+            auto inverseViewProjection = glm::inverse(viewProjection);
+            auto nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+            auto farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+            auto origin = glm::vec3(nearPoint) / nearPoint.w;
+            auto target = glm::vec3(farPoint) / farPoint.w;
+
+            auto pickStart = steady_clock::now();
+            auto hit = bvh::intersect(tree, {origin, glm::normalize(target - origin)});
+            auto pickMicroseconds = duration<double>(steady_clock::now() - pickStart).count() * 1e6;
+
+            if (hit.hit()) {
+                pickedGroup = bvh::groupOf(meshData, hit.triangle);
+                const auto& group = meshData.groupInfos[pickedGroup];
+                pickedTriangle = static_cast<int>(hit.triangle - group.startOffset / 3);
+                fmt::print("picked {} triangle {} at distance {:.3f} ({:.1f}us)\n", group.name,
+                           hit.triangle, hit.t, pickMicroseconds);
+            } else {
+                pickedGroup = -1;
+                pickedTriangle = -1;
+                fmt::print("missed ({:.1f}us)\n", pickMicroseconds);
+            }
+        }
+        buttonWasDown = buttonDown;
+
+        bool spaceDown = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+        if (spaceDown && !spaceWasDown) {
+            paused = !paused;
+        }
+        spaceWasDown = spaceDown;
+
+        glProgramUniformMatrix4fv(program, viewProjectionLocation, 1, GL_FALSE,
+                                  glm::value_ptr(viewProjection));
+        glProgramUniform1i(program, pickedTriangleLocation, pickedTriangle);
+
+        glClearBufferfv(GL_COLOR, 0, clearColour.data());
+        glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+        // a draw per group so the picked one can be told apart
+        for (auto g = 0u; g < meshData.groupInfos.size(); ++g) {
+            const auto& group = meshData.groupInfos[g];
+            glProgramUniform1i(program, groupPickedLocation, static_cast<int>(g) == pickedGroup);
+            glDrawElements(GL_TRIANGLES, group.count, GL_UNSIGNED_INT,
+                           (void*)(group.startOffset * sizeof(GLuint)));
+        }
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    glfwTerminate();
+}
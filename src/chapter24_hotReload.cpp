@@ -0,0 +1,360 @@
+#include "asset_watcher.hpp"
+#include "error_handling.hpp"
+#include "framing.hpp"
+#include "hot_reload.hpp"
+#include "obj_loader.hpp"
+#include "trace_gl.hpp"
+
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <filesystem>
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter24_hotReload [mesh.obj] [--material file.mtl] [--texture file ...]
+//
+// chapter 19's scene, but leave it running and edit the files. a saved obj is
+// re-read and only the parts of the buffers that changed are uploaded, a saved
+// texture replaces its own layer of the array, and a material file that points
+// a map_Kd somewhere else swaps that layer over to the new file.
+int main(int argc, char* argv[]) {
+
+    std::string meshPath = "tommy.obj";
+    std::string materialPath;
+    std::vector<std::string> texturePaths;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--material" && i + 1 < argc) {
+            materialPath = argv[++i];
+        } else if (arg == "--texture" && i + 1 < argc) {
+            texturePaths.push_back(argv[++i]);
+        } else {
+            meshPath = arg;
+        }
+    }
+    if (texturePaths.empty()) {
+        texturePaths = {"body_diffuse.jpg", "tankTops_pants_boots_diffuse.jpg"};
+    }
+
+    // set OPENGL_TUTORIAL_TRACE=trace.json to get a chrome/perfetto trace
+    tracer::startFromEnvironment();
+    tracer::setThreadName("main");
+
+    auto startTime = system_clock::now();
+
+    auto window = []() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window = glfwCreateWindow(1920, 960, "Chapter 24 - Hot Reload", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+            layout (location = 2) in vec2 aTexCoord;
+            layout (location = 3) in float aTextureIndex;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out vec2 uv;
+            layout (location = 2) out vec3 position;
+            layout (location = 3) out flat float textureIndex;
+
+            uniform mat4 MVP;
+
+            void main(){
+                position = aPosition;
+                normal = aNormal;
+                uv = aTexCoord;
+                textureIndex = aTextureIndex;
+
+                gl_Position = MVP * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSource = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec2 uv;
+            layout (location = 2) in vec3 position;
+            layout (location = 3) in flat float textureIndex;
+
+            out vec4 finalColor;
+
+            vec3 lightPosition = vec3(1,1,1);
+            vec3 lightPosition2 = vec3(-2,0,0);
+
+            uniform sampler2DArray Texture;
+
+            void main() {
+                vec3 lightDirection = normalize(lightPosition - position);
+                vec3 lightDirection2 = normalize(lightPosition2 - position);
+
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                float diffuseLighting2 = max(dot(normalize(normal), lightDirection2), 0);
+
+                vec4 textureSample = texture(Texture, vec3(uv, textureIndex));
+                finalColor = textureSample * (diffuseLighting + diffuseLighting2 * 0.5f);
+            }
+        )";
+
+    auto program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    auto meshData = objLoader::readObjElements(meshPath);
+    if (meshData.indices.empty()) {
+        fmt::print(stderr, "{} has no faces\n", meshPath);
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+
+    // a block so the buffers and textures are deleted while the context is
+    // still around
+    {
+        // NEW! the buffers keep spare room, so a reload that adds a bit of
+        // geometry still patches in place
+        hotReload::GpuBuffer vertexBuffer;
+        hotReload::GpuBuffer elementBuffer;
+        hotReload::GpuBuffer indirectBuffer;
+        hotReload::GpuBuffer textureIndexBuffer;
+
+        // chapter 19's layers. groups past the end use the first layer
+        std::vector<GLfloat> textureIndices = {0.f, 0.f, 0.f, 1.f, 1.f};
+        textureIndices.resize(std::max(textureIndices.size(), meshData.groupInfos.size()), 0.f);
+        auto commands = hotReload::commandsFor(meshData.groupInfos);
+
+        vertexBuffer.upload(meshData.vertices);
+        elementBuffer.upload(meshData.indices);
+        indirectBuffer.upload(commands);
+        textureIndexBuffer.upload(textureIndices);
+
+        GLuint vao;
+        glCreateVertexArrays(1, &vao);
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayAttribBinding(vao, 2, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, texCoord));
+        glEnableVertexArrayAttrib(vao, 2);
+
+        glVertexArrayAttribBinding(vao, 3, /*buffer index*/ 1);
+        glVertexArrayAttribFormat(vao, 3, 1, GL_FLOAT, GL_FALSE, 0);
+        glEnableVertexArrayAttrib(vao, 3);
+        glVertexArrayBindingDivisor(vao, 1, 1);
+
+        // called again whenever a reload had to replace a buffer
+        auto bindBuffers = [&]() {
+            glVertexArrayVertexBuffer(vao, 0, vertexBuffer.name(), 0, sizeof(vertex3D));
+            glVertexArrayVertexBuffer(vao, 1, textureIndexBuffer.name(), 0, sizeof(GLfloat));
+            glVertexArrayElementBuffer(vao, elementBuffer.name());
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer.name());
+        };
+        bindBuffers();
+
+        hotReload::TextureLayers textures(texturePaths);
+        glBindTextureUnit(0, textures.name());
+
+        // NEW! everything the scene was built from
+        assetWatcher::Watcher watcher;
+        watcher.watch(meshPath);
+        for (const auto& filePath : textures.files()) {
+            watcher.watch(filePath);
+        }
+        auto materials = objLoader::MapMaterialNameToInfo{};
+        if (!materialPath.empty()) {
+            materials = objLoader::parseMaterialFile(materialPath);
+            watcher.watch(materialPath);
+        }
+
+        auto reloadMesh = [&]() {
+            TRACE_SCOPE("mesh reload");
+            if (!std::filesystem::exists(meshPath)) {
+                return;
+            }
+            auto reloadStart = steady_clock::now();
+            auto newMeshData = objLoader::readObjElements(meshPath);
+            if (newMeshData.indices.empty()) {
+                // half saved or broken, keep drawing the old one
+                fmt::print(stderr, "{} has no faces, keeping the old mesh\n", meshPath);
+                return;
+            }
+            auto parseMs = duration<double>(steady_clock::now() - reloadStart).count() * 1e3;
+
+            auto newCommands = hotReload::commandsFor(newMeshData.groupInfos);
+            auto newTextureIndices = textureIndices;
+            newTextureIndices.resize(std::max(textureIndices.size(), newMeshData.groupInfos.size()),
+                                     0.f);
+
+            auto vertexStats = vertexBuffer.update(meshData.vertices, newMeshData.vertices);
+            auto indexStats = elementBuffer.update(meshData.indices, newMeshData.indices);
+            auto commandStats = indirectBuffer.update(commands, newCommands);
+            auto textureIndexStats = textureIndexBuffer.update(textureIndices, newTextureIndices);
+            if (vertexStats.reallocated || indexStats.reallocated || commandStats.reallocated ||
+                textureIndexStats.reallocated) {
+                bindBuffers();
+            }
+
+            fmt::print("reloaded {} in {:.1f}ms (parse {:.1f}ms): {} vertex ranges ({} bytes), {} "
+                       "index ranges ({} bytes), {} groups{}\n",
+                       meshPath, duration<double>(steady_clock::now() - reloadStart).count() * 1e3,
+                       parseMs, vertexStats.ranges, vertexStats.bytes, indexStats.ranges,
+                       indexStats.bytes, newMeshData.groupInfos.size(),
+                       vertexStats.reallocated || indexStats.reallocated ? ", grew buffers" : "");
+
+            meshData = std::move(newMeshData);
+            commands = std::move(newCommands);
+            textureIndices = std::move(newTextureIndices);
+        };
+
+        auto reloadTexture = [&](int layer, const std::string& filePath) {
+            auto reloadStart = steady_clock::now();
+            if (textures.reloadLayer(layer, filePath)) {
+                fmt::print("reloaded {} into layer {} in {:.1f}ms\n", filePath, layer,
+                           duration<double>(steady_clock::now() - reloadStart).count() * 1e3);
+            }
+        };
+
+        auto reloadMaterials = [&]() {
+            auto newMaterials = objLoader::parseMaterialFile(materialPath);
+            auto changes = hotReload::changedDiffuseMaps(materials, newMaterials);
+            for (const auto& [oldMap, newMap] : changes) {
+                auto layer = textures.layerOf(oldMap);
+                if (layer < 0) {
+                    continue;
+                }
+                watcher.unwatch(oldMap);
+                watcher.watch(newMap);
+                reloadTexture(layer, newMap);
+            }
+            materials = std::move(newMaterials);
+        };
+
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+
+        std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+        GLfloat clearDepth{1.0f};
+
+        // framed once. a reload can change the size but the camera jumping about
+        // while editing is worse than the mesh not quite fitting
+        auto camera = framing::frame(meshData.bounds, 40.0f, 1920.f / 960.f);
+        glm::mat4 projection = camera.projection();
+
+        int mvpLocation = glGetUniformLocation(program, "MVP");
+
+        glBindVertexArray(vao);
+        glUseProgram(program);
+
+        while (!glfwWindowShouldClose(window)) {
+            TRACE_SCOPE("frame");
+
+            for (const auto& filePath : watcher.poll()) {
+                if (filePath == meshPath) {
+                    reloadMesh();
+                } else if (filePath == materialPath) {
+                    reloadMaterials();
+                } else if (auto layer = textures.layerOf(filePath); layer >= 0) {
+                    reloadTexture(layer, filePath);
+                }
+            }
+
+            auto currentTime = duration<float>(system_clock::now() - startTime).count();
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            float elevation = 0.1f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.12f;
+            glm::mat4 mvp = projection * camera.orbit(currentTime * 0.5f, elevation);
+            glProgramUniformMatrix4fv(program, mvpLocation, 1, GL_FALSE, glm::value_ptr(mvp));
+
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                        (gl::GLsizei)commands.size(), 0);
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+    }
+
+    glfwTerminate();
+}
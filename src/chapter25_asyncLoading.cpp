@@ -0,0 +1,426 @@
+#include "async_loader.hpp"
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+#include "framing.hpp"
+#include "obj_loader.hpp"
+#include "trace_gl.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter25_asyncLoading [mesh.obj ...]
+//
+// the window is up and drawing straight away. the meshes and textures load on
+// another thread and another (shared) context, and pop in as they arrive.
+// meshes are drawn untextured until the texture array is in.
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> meshPaths;
+    for (int i = 1; i < argc; ++i) {
+        meshPaths.push_back(argv[i]);
+    }
+    if (meshPaths.empty()) {
+        meshPaths.push_back("tommy.obj");
+    }
+
+    // set OPENGL_TUTORIAL_TRACE=trace.json to get a chrome/perfetto trace
+    tracer::startFromEnvironment();
+    tracer::setThreadName("main");
+
+    auto startTime = system_clock::now();
+    auto launchTime = steady_clock::now();
+
+    auto window = []() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(1920, 960, "Chapter 25 - Async Loading", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+            layout (location = 2) in vec2 aTexCoord;
+            layout (location = 3) in float aTextureIndex;
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out vec2 uv;
+            layout (location = 2) out vec3 position;
+            layout (location = 3) out flat float textureIndex;
+
+            uniform mat4 MVP;
+            uniform mat4 model;
+
+            void main(){
+                position = vec3(model * vec4(aPosition, 1.0f));
+                normal = mat3(model) * aNormal;
+                uv = aTexCoord;
+                textureIndex = aTextureIndex;
+
+                gl_Position = MVP * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    // for bg
+    const char* fragmentShaderSourceColour = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec2 uv;
+
+            out vec4 finalColor;
+
+            void main() {
+                finalColor = vec4(normal, 1.0f);
+            }
+        )";
+
+    // NEW! textured is off until the texture array is resident
+    const char* fragmentShaderSourceTexture = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in vec2 uv;
+            layout (location = 2) in vec3 position;
+            layout (location = 3) in flat float textureIndex;
+
+            out vec4 finalColor;
+
+            vec3 lightPosition = vec3(1,1,1);
+            vec3 lightPosition2 = vec3(-2,0,0);
+
+            uniform sampler2DArray Texture;
+            uniform bool textured;
+
+            void main() {
+                vec3 lightDirection = normalize(lightPosition - position);
+                vec3 lightDirection2 = normalize(lightPosition2 - position);
+
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                float diffuseLighting2 = max(dot(normalize(normal), lightDirection2), 0);
+
+                vec4 textureSample = textured ? texture(Texture, vec3(uv, textureIndex))
+                                              : vec4(0.6f, 0.6f, 0.6f, 1.0f);
+                finalColor = textureSample * (diffuseLighting + diffuseLighting2 * 0.5f);
+            }
+        )";
+
+    auto vertexColourProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceColour);
+    auto textureProgram = createShaderProgram(vertexShaderSource, fragmentShaderSourceTexture);
+
+    // clang-format off
+    const std::vector<vertex3D> backGroundVertices {{
+        //   position   |           normal        |  texCoord
+        {{-1.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {0.f, 0.f}},
+        {{ 3.f, -1.f, 0.999999f},  {0.10f, 0.15f, 0.14f}, {3.f, 0.f}},
+        {{-1.f,  3.f, 0.999999f},  {0.80f, 0.82f, 0.80f}, {0.f, 3.f}}
+    }};
+    // clang-format on
+
+    // the background is tiny, so it's made here like before
+    auto backGroundVao = [&]() {
+        GLuint vao;
+        glCreateVertexArrays(1, &vao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, backGroundVertices.size() * sizeof(vertex3D),
+                             backGroundVertices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+        return vao;
+    }();
+
+    // chapter 19's layers, shared by every mesh. groups past the end use the
+    // first layer
+    std::vector<GLfloat> textureIndices = {0.f, 0.f, 0.f, 1.f, 1.f};
+    textureIndices.resize(64, 0.f);
+    GLuint textureIndexBuffer;
+    glCreateBuffers(1, &textureIndexBuffer);
+    glNamedBufferStorage(textureIndexBuffer, textureIndices.size() * sizeof(GLfloat),
+                         textureIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+    // what the render thread keeps for a mesh once it's resident
+    struct ResidentMesh {
+        asyncLoading::Handle handle = 0;
+        GLuint vao = 0;
+        GLuint indirectBuffer = 0;
+        GLsizei drawCount = 0;
+        bounds::Bounds bounds;
+        glm::mat4 model = glm::mat4(1.0f);
+    };
+    std::vector<ResidentMesh> residentMeshes;
+
+    // NEW! vaos aren't shared between contexts, so the buffers the loader
+    // made get wrapped in one here
+    auto makeResident = [&](asyncLoading::Handle handle, const asyncLoading::MeshResource& mesh) {
+        ResidentMesh resident;
+        resident.handle = handle;
+        glCreateVertexArrays(1, &resident.vao);
+        auto vao = resident.vao;
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayAttribBinding(vao, 2, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, texCoord));
+        glEnableVertexArrayAttrib(vao, 2);
+
+        glVertexArrayVertexBuffer(vao, 0, mesh.vertexBuffer, 0, sizeof(vertex3D));
+        glVertexArrayElementBuffer(vao, mesh.elementBuffer);
+
+        glVertexArrayAttribBinding(vao, 3, /*buffer index*/ 1);
+        glVertexArrayAttribFormat(vao, 3, 1, GL_FLOAT, GL_FALSE, 0);
+        glEnableVertexArrayAttrib(vao, 3);
+        glVertexArrayVertexBuffer(vao, 1, textureIndexBuffer, 0, sizeof(GLfloat));
+        glVertexArrayBindingDivisor(vao, 1, 1);
+
+        // one command per group, baseInstance picks its texture layer
+        std::vector<DrawElementsIndirectCommand> commands;
+        for (auto g = 0u; g < mesh.groupInfos.size() && g < textureIndices.size(); ++g) {
+            const auto& group = mesh.groupInfos[g];
+            commands.push_back({group.count, 1, group.startOffset, 0, g});
+        }
+        glCreateBuffers(1, &resident.indirectBuffer);
+        glNamedBufferStorage(resident.indirectBuffer,
+                             commands.size() * sizeof(DrawElementsIndirectCommand),
+                             commands.data(), GL_DYNAMIC_STORAGE_BIT);
+        resident.drawCount = static_cast<GLsizei>(commands.size());
+        resident.bounds = mesh.bounds;
+        residentMeshes.push_back(resident);
+    };
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    std::array<GLfloat, 4> clearColour{0.f, 0.f, 0.f, 1.f};
+    GLfloat clearDepth{1.0f};
+
+    glm::mat4 ortho = glm::ortho(-1.f, 1.f, -1.f, 1.f, 1.f, -1.f);
+
+    // a unit sphere until there's something to look at
+    auto camera = framing::frame(bounds::fromMinMax(glm::vec3(-1.f), glm::vec3(1.f)), 40.0f,
+                                 1920.f / 960.f);
+    glm::mat4 projection = camera.projection();
+
+    // meshes sit side by side in the order they were asked for, spaced by
+    // the biggest one, and the camera backs off to fit them all
+    auto layoutMeshes = [&]() {
+        float spacing = 0.f;
+        for (const auto& mesh : residentMeshes) {
+            spacing = std::max(spacing, mesh.bounds.radius * 2.2f);
+        }
+        bounds::Bounds sceneBounds;
+        for (auto i = 0u; i < residentMeshes.size(); ++i) {
+            auto& mesh = residentMeshes[i];
+            auto offset = glm::vec3(spacing * i, 0.f, 0.f) - mesh.bounds.centre;
+            mesh.model = glm::translate(glm::mat4(1.0f), offset);
+            auto placed = bounds::fromMinMax(mesh.bounds.min + offset, mesh.bounds.max + offset);
+            sceneBounds = bounds::merge(sceneBounds, placed);
+        }
+        camera = framing::frame(sceneBounds, 40.0f, 1920.f / 960.f);
+        projection = camera.projection();
+    };
+
+    int mvpLocationVertex = glGetUniformLocation(vertexColourProgram, "MVP");
+    int mvpLocationTexture = glGetUniformLocation(textureProgram, "MVP");
+    int modelLocationTexture = glGetUniformLocation(textureProgram, "model");
+    int texturedLocation = glGetUniformLocation(textureProgram, "textured");
+    glProgramUniform1i(textureProgram, texturedLocation, 0);
+
+    // gpu timestamps. does nothing unless tracing was started above
+    tracer::GpuTimeline gpuTimeline;
+
+    // a block so the loader (and the shared context) goes before glfw does
+    {
+        // NEW! nothing is read yet, this just queues it all up
+        asyncLoading::Loader loader(window);
+        std::vector<asyncLoading::Handle> meshHandles;
+        for (const auto& meshPath : meshPaths) {
+            meshHandles.push_back(loader.loadMesh(meshPath));
+        }
+        auto textureHandle =
+            loader.loadTextureArray({"body_diffuse.jpg", "tankTops_pants_boots_diffuse.jpg"});
+
+        bool firstFrame = true;
+        while (!glfwWindowShouldClose(window)) {
+            TRACE_SCOPE("frame");
+            gpuTimeline.beginFrame();
+
+            // NEW! picks up whatever finished since last frame, never waits
+            for (auto handle : loader.poll()) {
+                auto timings = loader.timings(handle);
+                if (auto* mesh = loader.mesh(handle)) {
+                    makeResident(handle, *mesh);
+                    // in the order they were asked for, so the layout doesn't
+                    // shuffle as they come in
+                    std::sort(residentMeshes.begin(), residentMeshes.end(),
+                              [](const auto& a, const auto& b) { return a.handle < b.handle; });
+                    layoutMeshes();
+                    fmt::print("{} resident after {:.1f}ms (parsed {:.1f}ms, uploaded {:.1f}ms)\n",
+                               mesh->filePath, timings.residentMs, timings.decodeMs,
+                               timings.uploadMs);
+                } else if (auto* textures = loader.textures(handle)) {
+                    glBindTextureUnit(0, textures->texture);
+                    glProgramUniform1i(textureProgram, texturedLocation, 1);
+                    fmt::print("textures resident after {:.1f}ms (decoded {:.1f}ms, uploaded "
+                               "{:.1f}ms)\n",
+                               timings.residentMs, timings.decodeMs, timings.uploadMs);
+                } else {
+                    fmt::print(stderr, "{} failed to load\n",
+                               handle == textureHandle ? "texture array" : "a mesh");
+                }
+            }
+
+            auto currentTime = duration<float>(system_clock::now() - startTime).count();
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+            // bg
+            {
+                TRACE_SCOPE("background pass");
+                TRACE_GPU_SCOPE(gpuTimeline, "background pass");
+                glBindVertexArray(backGroundVao);
+                glUseProgram(vertexColourProgram);
+
+                glProgramUniformMatrix4fv(vertexColourProgram, mvpLocationVertex, 1, GL_FALSE,
+                                          glm::value_ptr(ortho));
+
+                glDrawArrays(GL_TRIANGLES, 0, (gl::GLsizei)backGroundVertices.size());
+            }
+
+            // meshes, whichever are in
+            {
+                TRACE_SCOPE("mesh pass");
+                TRACE_GPU_SCOPE(gpuTimeline, "mesh pass");
+                glUseProgram(textureProgram);
+
+                float elevation = 0.1f + ((std::sin(currentTime * 0.32f) + 1.0f) / 2.0f) * 0.12f;
+                glm::mat4 viewProjection =
+                    projection * camera.orbit(currentTime * 0.5f, elevation);
+
+                for (const auto& mesh : residentMeshes) {
+                    glm::mat4 mvp = viewProjection * mesh.model;
+                    glProgramUniformMatrix4fv(textureProgram, mvpLocationTexture, 1, GL_FALSE,
+                                              glm::value_ptr(mvp));
+                    glProgramUniformMatrix4fv(textureProgram, modelLocationTexture, 1, GL_FALSE,
+                                              glm::value_ptr(mesh.model));
+                    glBindVertexArray(mesh.vao);
+                    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mesh.indirectBuffer);
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                                mesh.drawCount, 0);
+                }
+            }
+
+            {
+                TRACE_SCOPE("swap");
+                glfwSwapBuffers(window);
+            }
+            glfwPollEvents();
+
+            if (firstFrame) {
+                firstFrame = false;
+                fmt::print("first frame after {:.1f}ms\n",
+                           duration<double>(steady_clock::now() - launchTime).count() * 1e3);
+            }
+        }
+    }
+
+    gpuTimeline.shutdown();
+    glfwTerminate();
+}
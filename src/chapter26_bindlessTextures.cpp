@@ -0,0 +1,463 @@
+#include "bindless_textures.hpp"
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter26_bindlessTextures [image ...] [--textures N] [--force-array] [--bench FRAMES]
+//
+// a wall of quads, each with its own texture, in a mix of sizes (64 up to
+// 1024) and channel counts. they can be drawn three ways, switch with 1/2/3:
+//  1. bind per draw: a glBindTextureUnit and a draw call per quad
+//  2. texture array: one multi draw, every texture scaled up to the biggest
+//  3. bindless: one multi draw, textures at their own size, no binds at all
+// bindless needs ARB_bindless_texture. without it (or with --force-array) the
+// array is the default.
+//
+// --bench hides the window and prints a json line per way with the time per
+// frame, binds and draw calls per frame and the texture memory each needs.
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> imagePaths;
+    int generatedCount = 30;
+    bool forceArray = false;
+    int benchFrames = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--textures" && i + 1 < argc) {
+            generatedCount = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--force-array") {
+            forceArray = true;
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        } else {
+            imagePaths.push_back(arg);
+        }
+    }
+    const bool benchmark = benchFrames > 0;
+
+    auto startTime = system_clock::now();
+
+    const int width = 1600;
+    const int height = 900;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // gl_BaseInstance needs 4.6 (or ARB_shader_draw_parameters)
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(width, height, "Chapter 26 - Bindless Textures", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    // NEW! check before compiling anything that asks for the extension
+    const bool bindlessSupported = bindless::supported() && !forceArray;
+    fmt::print(stderr, "ARB_bindless_texture {}\n",
+               bindless::supported() ? (forceArray ? "available but not used" : "available")
+                                     : "not available, using texture arrays");
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // every quad is the same 4 vertices. which quad (and texture) this is
+    // comes from the base instance of its draw
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 2) in vec2 aTexCoord;
+
+            layout (location = 0) out vec2 uv;
+            layout (location = 1) out flat int textureIndex;
+
+            uniform mat4 viewProjection;
+            uniform int columns;
+
+            void main(){
+                int index = gl_BaseInstance + gl_InstanceID;
+                vec2 cell = vec2(index % columns, -(index / columns));
+                uv = aTexCoord;
+                textureIndex = index;
+                gl_Position = viewProjection * vec4(aPosition.xy * 0.45f + cell, 0.0f, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSourcePerDraw = R"(
+            #version 460 core
+            layout (location = 0) in vec2 uv;
+
+            out vec4 finalColor;
+
+            uniform sampler2D Texture;
+
+            void main() {
+                finalColor = texture(Texture, uv);
+            }
+        )";
+
+    const char* fragmentShaderSourceArray = R"(
+            #version 460 core
+            layout (location = 0) in vec2 uv;
+            layout (location = 1) in flat int textureIndex;
+
+            out vec4 finalColor;
+
+            uniform sampler2DArray Textures;
+
+            void main() {
+                finalColor = texture(Textures, vec3(uv, textureIndex));
+            }
+        )";
+
+    // NEW! samplers straight out of a storage buffer. textureIndex is the
+    // same for the whole draw, which is what bindless wants
+    const char* fragmentShaderSourceBindless = R"(
+            #version 460 core
+            #extension GL_ARB_bindless_texture : require
+            layout (location = 0) in vec2 uv;
+            layout (location = 1) in flat int textureIndex;
+
+            out vec4 finalColor;
+
+            layout (std430, binding = 1) readonly buffer TextureHandles {
+                sampler2D textures[];
+            };
+
+            void main() {
+                finalColor = texture(textures[textureIndex], uv);
+            }
+        )";
+
+    enum Path { PerDraw, Array, Bindless, PathCount };
+    const char* pathNames[PathCount] = {"bind per draw", "texture array", "bindless"};
+
+    std::array<GLuint, PathCount> programs{};
+    programs[PerDraw] = createShaderProgram(vertexShaderSource, fragmentShaderSourcePerDraw);
+    programs[Array] = createShaderProgram(vertexShaderSource, fragmentShaderSourceArray);
+    if (bindlessSupported) {
+        programs[Bindless] = createShaderProgram(vertexShaderSource, fragmentShaderSourceBindless);
+    }
+
+    // images from disk keep their own channel count
+    std::vector<bindless::Image> images;
+    stbi_set_flip_vertically_on_load(true);
+    for (const auto& imagePath : imagePaths) {
+        bindless::Image image;
+        auto* pixels =
+            stbi_load(imagePath.c_str(), &image.width, &image.height, &image.channels, 0);
+        if (!pixels) {
+            fmt::print(stderr, "texture {} failed to load\n", imagePath);
+            continue;
+        }
+        image.pixels.assign(pixels, pixels + size_t(image.width) * image.height * image.channels);
+        stbi_image_free(pixels);
+        images.push_back(std::move(image));
+    }
+
+    // and made up ones in a spread of sizes, shapes and formats
+    {
+        const std::array<glm::ivec2, 7> sizes{{{64, 64},
+                                               {128, 128},
+                                               {256, 256},
+                                               {512, 512},
+                                               {1024, 1024},
+                                               {1024, 256},
+                                               {128, 512}}};
+        const std::array<int, 3> channelCounts{4, 3, 1};
+        for (int i = 0; i < generatedCount; ++i) {
+            bindless::Image image;
+            image.width = sizes[i % sizes.size()].x;
+            image.height = sizes[i % sizes.size()].y;
+            image.channels = channelCounts[i % channelCounts.size()];
+            image.pixels.resize(size_t(image.width) * image.height * image.channels);
+
+            // a checker over a gradient, tinted per texture. 8 squares across
+            // whatever the size, so you can see the mips
+            glm::vec3 tint = glm::cos(glm::vec3(0.0f, 2.1f, 4.2f) + i * 0.9f) * 0.5f + 0.5f;
+            for (int y = 0; y < image.height; ++y) {
+                for (int x = 0; x < image.width; ++x) {
+                    bool dark = ((x * 8 / image.width) + (y * 8 / image.height)) % 2 == 0;
+                    float shade = (dark ? 0.35f : 0.9f) * (0.6f + 0.4f * y / image.height);
+                    auto* texel = &image.pixels[(size_t(y) * image.width + x) * image.channels];
+                    for (int c = 0; c < image.channels; ++c) {
+                        float value = c < 3 ? shade * (image.channels == 1 ? 1.0f : tint[c]) : 1.f;
+                        texel[c] = static_cast<uint8_t>(value * 255.f);
+                    }
+                }
+            }
+            images.push_back(std::move(image));
+        }
+    }
+    if (images.empty()) {
+        fmt::print(stderr, "no textures to draw\n");
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+    const auto textureCount = static_cast<GLsizei>(images.size());
+    const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(textureCount))));
+    const int rows = (textureCount + columns - 1) / columns;
+
+    // a unit quad
+    // clang-format off
+    const std::vector<vertex3D> quadVertices {{
+        //   position      |     normal     |  texCoord
+        {{-1.f, -1.f, 0.f},  {0.f, 0.f, 1.f}, {0.f, 0.f}},
+        {{ 1.f, -1.f, 0.f},  {0.f, 0.f, 1.f}, {1.f, 0.f}},
+        {{ 1.f,  1.f, 0.f},  {0.f, 0.f, 1.f}, {1.f, 1.f}},
+        {{-1.f,  1.f, 0.f},  {0.f, 0.f, 1.f}, {0.f, 1.f}}
+    }};
+    // clang-format on
+    const std::vector<GLuint> quadIndices{0, 1, 2, 0, 2, 3};
+
+    GLuint quadVao;
+    {
+        glCreateVertexArrays(1, &quadVao);
+
+        GLuint bufferObject;
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, quadVertices.size() * sizeof(vertex3D),
+                             quadVertices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(quadVao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(quadVao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(quadVao, 0);
+
+        glVertexArrayAttribBinding(quadVao, 2, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(quadVao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, texCoord));
+        glEnableVertexArrayAttrib(quadVao, 2);
+
+        glVertexArrayVertexBuffer(quadVao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        GLuint elementBufferObject;
+        glCreateBuffers(1, &elementBufferObject);
+        glNamedBufferStorage(elementBufferObject, quadIndices.size() * sizeof(GLuint),
+                             quadIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayElementBuffer(quadVao, elementBufferObject);
+    }
+
+    // one command per quad. baseInstance is the quad's index, which is also
+    // its texture's index
+    std::vector<DrawElementsIndirectCommand> commands;
+    for (GLsizei i = 0; i < textureCount; ++i) {
+        commands.push_back({static_cast<uint32_t>(quadIndices.size()), 1, 0, 0,
+                            static_cast<uint32_t>(i)});
+    }
+    GLuint indirectBuffer;
+    glCreateBuffers(1, &indirectBuffer);
+    glNamedBufferStorage(indirectBuffer, commands.size() * sizeof(DrawElementsIndirectCommand),
+                         commands.data(), GL_DYNAMIC_STORAGE_BIT);
+
+    for (auto program : programs) {
+        if (program) {
+            glProgramUniform1i(program, glGetUniformLocation(program, "columns"), columns);
+        }
+    }
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+
+    // scoped so the textures are released before the context goes away
+    {
+        // with handles the textures can still be bound the old way, so the
+        // per draw path shares them rather than making a second copy
+        bindless::TextureSet textureSet(images, bindlessSupported);
+        bindless::TextureArray textureArray(images);
+        images.clear();
+
+        fmt::print(stderr,
+                   "{} textures, {:.1f} MB at their own sizes, {:.1f} MB as an array\n",
+                   textureCount, textureSet.bytes() / (1024.0 * 1024.0),
+                   textureArray.bytes() / (1024.0 * 1024.0));
+
+        glBindVertexArray(quadVao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+        struct FrameCounts {
+            int drawCalls = 0;
+            int textureBinds = 0;
+        };
+
+        auto drawFrame = [&](Path path, float currentTime) -> FrameCounts {
+            // drift in and out so the quads go through a few mip levels
+            float zoom = 1.0f + 0.6f * std::sin(currentTime * 0.5f);
+            glm::vec2 centre((columns - 1) * 0.5f, -(rows - 1) * 0.5f);
+            const float aspect = static_cast<float>(width) / static_cast<float>(height);
+            float halfHeight = std::max<float>(rows, columns / aspect) * 0.5f * zoom;
+            glm::vec2 halfSize(halfHeight * aspect, halfHeight);
+            glm::mat4 viewProjection = glm::ortho(centre.x - halfSize.x, centre.x + halfSize.x,
+                                                  centre.y - halfSize.y, centre.y + halfSize.y);
+
+            auto program = programs[path];
+            glUseProgram(program);
+            glProgramUniformMatrix4fv(program, glGetUniformLocation(program, "viewProjection"), 1,
+                                      GL_FALSE, glm::value_ptr(viewProjection));
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+
+            FrameCounts counts;
+            switch (path) {
+            case PerDraw:
+                // the old way, a bind and a draw for every texture
+                for (GLsizei i = 0; i < textureCount; ++i) {
+                    glBindTextureUnit(0, textureSet.texture(i));
+                    glDrawElementsInstancedBaseInstance(
+                        GL_TRIANGLES, static_cast<GLsizei>(quadIndices.size()), GL_UNSIGNED_INT,
+                        nullptr, 1, static_cast<GLuint>(i));
+                }
+                counts = {textureCount, textureCount};
+                break;
+            case Array:
+                glBindTextureUnit(0, textureArray.name());
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, textureCount,
+                                            0);
+                counts = {1, 1};
+                break;
+            default:
+                // the handles were made resident up front, nothing to bind
+                textureSet.bind(1);
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, textureCount,
+                                            0);
+                counts = {1, 0};
+                break;
+            }
+            return counts;
+        };
+
+        auto pathBytes = [&](Path path) {
+            return path == Array ? textureArray.bytes() : textureSet.bytes();
+        };
+
+        if (benchmark) {
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            for (int path = 0; path < PathCount; ++path) {
+                if (!programs[path]) {
+                    continue;
+                }
+                // a few frames first so shader compiles and uploads aren't timed
+                FrameCounts counts;
+                for (int frame = 0; frame < 3; ++frame) {
+                    counts = drawFrame(Path(path), 0.f);
+                }
+                glFinish();
+
+                auto benchStart = steady_clock::now();
+                for (int frame = 0; frame < benchFrames; ++frame) {
+                    drawFrame(Path(path), static_cast<float>(frame) / 60.0f);
+                    glfwSwapBuffers(window);
+                }
+                glFinish();
+                auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+                fmt::print("{{\"benchmark\":\"textures\",\"renderer\":\"{}\",\"path\":\"{}\","
+                           "\"textures\":{},\"frames\":{},\"seconds\":{:.6f},"
+                           "\"msPerFrame\":{:.3f},\"drawCalls\":{},\"textureBinds\":{},"
+                           "\"textureBytes\":{}}}\n",
+                           renderer ? renderer : "unknown", pathNames[path], textureCount,
+                           benchFrames, seconds, seconds * 1000.0 / benchFrames, counts.drawCalls,
+                           counts.textureBinds, pathBytes(Path(path)));
+            }
+        } else {
+            Path path = programs[Bindless] ? Bindless : Array;
+            fmt::print(stderr, "drawing with {}\n", pathNames[path]);
+            while (!glfwWindowShouldClose(window)) {
+                // 1, 2 and 3 switch between the ways of drawing
+                for (int key = 0; key < PathCount; ++key) {
+                    if (glfwGetKey(window, GLFW_KEY_1 + key) == GLFW_PRESS && path != key) {
+                        if (!programs[key]) {
+                            continue;
+                        }
+                        path = Path(key);
+                        fmt::print(stderr, "drawing with {}\n", pathNames[path]);
+                    }
+                }
+
+                auto currentTime = duration<float>(system_clock::now() - startTime).count();
+                drawFrame(path, currentTime);
+
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+    }
+
+    glfwTerminate();
+}
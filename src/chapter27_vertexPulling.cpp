@@ -0,0 +1,419 @@
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+#include "framing.hpp"
+#include "obj_loader.hpp"
+#include "vertex_pulling.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
+#include <vector>
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter27_vertexPulling [mesh.obj ...] [--grid N] [--bench FRAMES]
+//
+// a grid of N x N objects, each one of the loaded meshes. they can be drawn
+// two ways, switch with 1/2:
+//  1. vertex pulling: every mesh in one buffer, one vao with no attributes and
+//     one multi draw for the lot
+//  2. attributes: a vao per mesh like chapter 8, bound before each draw
+//
+// --bench hides the window and prints a json line per way with the time per
+// frame and the draw calls and vao binds it took.
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> meshPaths;
+    int gridSize = 12;
+    int benchFrames = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--grid" && i + 1 < argc) {
+            gridSize = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        } else {
+            meshPaths.push_back(arg);
+        }
+    }
+    if (meshPaths.empty()) {
+        meshPaths = {"rubberToy.obj", "tommy.obj"};
+    }
+    const bool benchmark = benchFrames > 0;
+
+    auto startTime = system_clock::now();
+
+    const int width = 1600;
+    const int height = 900;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // gl_BaseInstance needs 4.6 (or ARB_shader_draw_parameters)
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(width, height, "Chapter 27 - Vertex Pulling", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // NEW! no inputs. the vertex comes out of the storage buffer by
+    // gl_VertexID, which already has the command's baseVertex added, and the
+    // object by the command's baseInstance
+    const std::string vertexShaderSourcePulling = std::string(R"(
+            #version 460 core
+        )") + vertexPulling::glsl + R"(
+            struct Object {
+                mat4 model;
+                vec4 tint;
+            };
+
+            layout (std430, binding = 1) readonly buffer Objects {
+                Object objects[];
+            };
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out flat vec3 tint;
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                PulledVertex vertex = pullVertex(gl_VertexID);
+                Object object = objects[gl_BaseInstance + gl_InstanceID];
+
+                normal = mat3(object.model) * vertex.normal;
+                tint = object.tint.rgb;
+                gl_Position = viewProjection * object.model * vec4(vertex.position, 1.0f);
+            }
+        )";
+
+    // the same with the vao feeding the attributes
+    const char* vertexShaderSourceAttributes = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+
+            struct Object {
+                mat4 model;
+                vec4 tint;
+            };
+
+            layout (std430, binding = 1) readonly buffer Objects {
+                Object objects[];
+            };
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out flat vec3 tint;
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                Object object = objects[gl_BaseInstance + gl_InstanceID];
+
+                normal = mat3(object.model) * aNormal;
+                tint = object.tint.rgb;
+                gl_Position = viewProjection * object.model * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSource = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in flat vec3 tint;
+
+            out vec4 finalColor;
+
+            vec3 lightDirection = normalize(vec3(1, 2, 1));
+
+            void main() {
+                float diffuseLighting = max(dot(normalize(normal), lightDirection), 0);
+                finalColor = vec4(tint * (0.2f + diffuseLighting * 0.8f), 1.0f);
+            }
+        )";
+
+    enum Path { Pulling, Attributes, PathCount };
+    const char* pathNames[PathCount] = {"vertex pulling", "attributes"};
+
+    std::array<GLuint, PathCount> programs{};
+    programs[Pulling] =
+        createShaderProgram(vertexShaderSourcePulling.c_str(), fragmentShaderSource);
+    programs[Attributes] = createShaderProgram(vertexShaderSourceAttributes, fragmentShaderSource);
+
+    std::vector<objLoader::MeshDataElements> meshDatas;
+    for (const auto& meshPath : meshPaths) {
+        auto meshData = objLoader::readObjElements(meshPath);
+        if (meshData.indices.empty()) {
+            fmt::print(stderr, "{} has no faces, skipping it\n", meshPath);
+            continue;
+        }
+        meshDatas.push_back(std::move(meshData));
+    }
+    if (meshDatas.empty()) {
+        fmt::print(stderr, "no meshes to draw\n");
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+    const auto meshCount = meshDatas.size();
+
+    // the meshes take turns round the grid, each scaled to fit its cell
+    struct Object {
+        glm::mat4 model;
+        glm::vec4 tint;
+    };
+    std::vector<Object> objects;
+    std::vector<size_t> objectMeshes;
+    for (int y = 0; y < gridSize; ++y) {
+        for (int x = 0; x < gridSize; ++x) {
+            auto index = objects.size();
+            auto mesh = index % meshCount;
+            const auto& meshBounds = meshDatas[mesh].bounds;
+            float scale = 0.45f / std::max(meshBounds.radius, 1e-4f);
+
+            glm::vec3 cell(x - (gridSize - 1) * 0.5f, 0.f, y - (gridSize - 1) * 0.5f);
+            auto model = glm::translate(glm::mat4(1.0f), cell);
+            model = glm::scale(model, glm::vec3(scale));
+            model = glm::translate(model, -meshBounds.centre);
+
+            glm::vec3 tint = glm::cos(glm::vec3(0.0f, 2.1f, 4.2f) + index * 1.3f) * 0.5f + 0.5f;
+            objects.push_back({model, glm::vec4(tint, 1.0f)});
+            objectMeshes.push_back(mesh);
+        }
+    }
+    const auto objectCount = static_cast<GLsizei>(objects.size());
+
+    GLuint objectBuffer;
+    glCreateBuffers(1, &objectBuffer);
+    glNamedBufferStorage(objectBuffer, objects.size() * sizeof(Object), objects.data(),
+                         GL_DYNAMIC_STORAGE_BIT);
+
+    // the chapter 8 way, a vao with its own buffers per mesh
+    std::vector<GLuint> meshVaos(meshCount);
+    std::vector<GLuint> meshBuffers(meshCount * 2);
+    glCreateVertexArrays(static_cast<GLsizei>(meshCount), meshVaos.data());
+    glCreateBuffers(static_cast<GLsizei>(meshBuffers.size()), meshBuffers.data());
+    for (auto i = 0u; i < meshCount; ++i) {
+        const auto& meshData = meshDatas[i];
+        auto vao = meshVaos[i];
+        auto bufferObject = meshBuffers[i * 2];
+        auto elementBufferObject = meshBuffers[i * 2 + 1];
+
+        glNamedBufferStorage(bufferObject, meshData.vertices.size() * sizeof(vertex3D),
+                             meshData.vertices.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayVertexBuffer(vao, 0, bufferObject, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+
+        glNamedBufferStorage(elementBufferObject, meshData.indices.size() * sizeof(int),
+                             meshData.indices.data(), GL_DYNAMIC_STORAGE_BIT);
+        glVertexArrayElementBuffer(vao, elementBufferObject);
+    }
+
+    // a camera that takes in the whole grid
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    const float halfGrid = gridSize * 0.5f;
+    const auto gridBounds = bounds::fromMinMax(glm::vec3(-halfGrid, -0.5f, -halfGrid),
+                                               glm::vec3(halfGrid, 0.5f, halfGrid));
+    const auto gridFraming = framing::frame(gridBounds, 40.0f, aspect, 0.8f);
+    const auto projection = gridFraming.projection();
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+    glEnable(GL_DEPTH_TEST);
+
+    // scoped so the mesh buffer is released before the context goes away
+    {
+        // NEW! every mesh in one buffer and a command per object. the
+        // commands never change, so they're written once
+        std::vector<const objLoader::MeshDataElements*> meshPointers;
+        for (const auto& meshData : meshDatas) {
+            meshPointers.push_back(&meshData);
+        }
+        vertexPulling::MeshBuffer meshBuffer(meshPointers);
+
+        std::vector<DrawElementsIndirectCommand> commands;
+        for (GLsizei i = 0; i < objectCount; ++i) {
+            commands.push_back(meshBuffer.command(objectMeshes[i], static_cast<uint32_t>(i)));
+        }
+        GLuint indirectBuffer;
+        glCreateBuffers(1, &indirectBuffer);
+        glNamedBufferStorage(indirectBuffer,
+                             commands.size() * sizeof(DrawElementsIndirectCommand),
+                             commands.data(), GL_DYNAMIC_STORAGE_BIT);
+
+        fmt::print(stderr, "{} meshes, {} objects, {:.1f} MB of mesh data in one buffer\n",
+                   meshCount, objectCount, meshBuffer.bytes() / (1024.0 * 1024.0));
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, objectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+        struct FrameCounts {
+            int drawCalls = 0;
+            int vaoBinds = 0;
+        };
+
+        auto drawFrame = [&](Path path, float currentTime) -> FrameCounts {
+            glm::mat4 viewProjection = projection * gridFraming.orbit(currentTime * 0.3f, 0.6f);
+
+            auto program = programs[path];
+            glUseProgram(program);
+            glProgramUniformMatrix4fv(program, glGetUniformLocation(program, "viewProjection"), 1,
+                                      GL_FALSE, glm::value_ptr(viewProjection));
+
+            glClearBufferfv(GL_COLOR, 0, clearColour.data());
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            FrameCounts counts;
+            if (path == Pulling) {
+                // one vao, one draw, however many meshes there are
+                meshBuffer.bind();
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, objectCount,
+                                            0);
+                counts = {1, 1};
+            } else {
+                for (GLsizei i = 0; i < objectCount; ++i) {
+                    auto mesh = objectMeshes[i];
+                    glBindVertexArray(meshVaos[mesh]);
+                    glDrawElementsInstancedBaseInstance(
+                        GL_TRIANGLES, static_cast<GLsizei>(meshDatas[mesh].indices.size()),
+                        GL_UNSIGNED_INT, nullptr, 1, static_cast<GLuint>(i));
+                }
+                counts = {objectCount, objectCount};
+            }
+            return counts;
+        };
+
+        if (benchmark) {
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            for (int path = 0; path < PathCount; ++path) {
+                // a few frames first so shader compiles and uploads aren't timed
+                FrameCounts counts;
+                for (int frame = 0; frame < 3; ++frame) {
+                    counts = drawFrame(Path(path), 0.f);
+                }
+                glFinish();
+
+                auto benchStart = steady_clock::now();
+                for (int frame = 0; frame < benchFrames; ++frame) {
+                    drawFrame(Path(path), static_cast<float>(frame) / 60.0f);
+                    glfwSwapBuffers(window);
+                }
+                glFinish();
+                auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+                fmt::print("{{\"benchmark\":\"vertex_pulling\",\"renderer\":\"{}\","
+                           "\"path\":\"{}\",\"meshes\":{},\"objects\":{},\"frames\":{},"
+                           "\"seconds\":{:.6f},\"msPerFrame\":{:.3f},\"drawCalls\":{},"
+                           "\"vaoBinds\":{}}}\n",
+                           renderer ? renderer : "unknown", pathNames[path], meshCount,
+                           objectCount, benchFrames, seconds, seconds * 1000.0 / benchFrames,
+                           counts.drawCalls, counts.vaoBinds);
+            }
+        } else {
+            Path path = Pulling;
+            fmt::print(stderr, "drawing with {}\n", pathNames[path]);
+            while (!glfwWindowShouldClose(window)) {
+                // 1 and 2 switch between the ways of drawing
+                for (int key = 0; key < PathCount; ++key) {
+                    if (glfwGetKey(window, GLFW_KEY_1 + key) == GLFW_PRESS && path != key) {
+                        path = Path(key);
+                        fmt::print(stderr, "drawing with {}\n", pathNames[path]);
+                    }
+                }
+
+                auto currentTime = duration<float>(system_clock::now() - startTime).count();
+                drawFrame(path, currentTime);
+
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+
+        glDeleteBuffers(1, &indirectBuffer);
+    }
+
+    glDeleteVertexArrays(static_cast<GLsizei>(meshVaos.size()), meshVaos.data());
+    glDeleteBuffers(static_cast<GLsizei>(meshBuffers.size()), meshBuffers.data());
+    glDeleteBuffers(1, &objectBuffer);
+
+    glfwTerminate();
+}
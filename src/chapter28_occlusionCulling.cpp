@@ -0,0 +1,528 @@
+#include "bounds.hpp"
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+#include "hiz_culling.hpp"
+#include "mesh_pool.hpp"
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>     // current time
+#include <cmath>      // sin & cos
+#include <cstdlib>    // for std::exit()
+#include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <random>
+#include <string>
+#include <vector>
+
+// this is really important to make sure that glbindings does not clash with
+// glfw's opengl includes. otherwise we get ambigous overloads.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/glbinding.h>
+
+#include <glbinding-aux/debug.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace gl;
+using namespace std::chrono;
+
+// usage: chapter28_occlusionCulling [mesh.obj ...] [--rooms N] [--bench FRAMES]
+//
+// an N x N floor of rooms with a doorway in each inner wall and 16 objects in
+// every room, walked through at head height. from inside a room the walls
+// hide nearly everything, which frustum culling alone can't know. switch how
+// the draws are culled with 1/2/3:
+//  1. hi-z, two phase: against last frame's depth, then what that hid
+//     against this frame's
+//  2. hi-z, early pass only: the late pass still runs to count what it would
+//     have drawn, but nothing it finds is drawn (watch things pop in)
+//  3. frustum only
+//
+// --bench hides the window and prints a json line per mode with the time per
+// frame and how many draws were drawn and rejected per frame.
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> meshPaths;
+    int roomCount = 12;
+    int benchFrames = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--rooms" && i + 1 < argc) {
+            roomCount = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchFrames = std::max(1, std::atoi(argv[++i]));
+        } else {
+            meshPaths.push_back(arg);
+        }
+    }
+    if (meshPaths.empty()) {
+        meshPaths = {"rubberToy.obj"};
+    }
+    const bool benchmark = benchFrames > 0;
+
+    auto startTime = system_clock::now();
+
+    const int width = 1600;
+    const int height = 900;
+
+    auto window = [&]() {
+        if (!glfwInit()) {
+            fmt::print("glfw didnt initialize!\n");
+            std::exit(EXIT_FAILURE);
+        }
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // gl_BaseInstance needs 4.6 (or ARB_shader_draw_parameters)
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+
+        if (benchmark) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
+
+        /* Create a windowed mode window and its OpenGL context */
+        auto window =
+            glfwCreateWindow(width, height, "Chapter 28 - Occlusion Culling", nullptr, nullptr);
+
+        if (!window) {
+            fmt::print("window doesn't exist\n");
+            glfwTerminate();
+            std::exit(EXIT_FAILURE);
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        glbinding::initialize(glfwGetProcAddress, false);
+        return window;
+    }();
+
+    // debugging
+    {
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(errorHandler::MessageCallback, 0);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageControl(GL_DEBUG_SOURCE_API, GL_DEBUG_TYPE_OTHER,
+                              GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, false);
+    }
+
+    auto createShaderProgram = [](const char* vertexShaderSource,
+                                  const char* fragmentShaderSource) -> GLuint {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fragmentShaderSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+
+        glLinkProgram(program);
+        return program;
+    };
+
+    // every draw is one object, found by the command's baseInstance. the
+    // culler only ever changes instanceCount, so that stays put
+    const char* vertexShaderSource = R"(
+            #version 460 core
+            layout (location = 0) in vec3 aPosition;
+            layout (location = 1) in vec3 aNormal;
+
+            struct Object {
+                mat4 model;
+                vec4 tint;
+            };
+
+            layout (std430, binding = 1) readonly buffer Objects {
+                Object objects[];
+            };
+
+            layout (location = 0) out vec3 normal;
+            layout (location = 1) out flat vec3 tint;
+
+            uniform mat4 viewProjection;
+
+            void main(){
+                Object object = objects[gl_BaseInstance + gl_InstanceID];
+
+                normal = mat3(object.model) * aNormal;
+                tint = object.tint.rgb;
+                gl_Position = viewProjection * object.model * vec4(aPosition, 1.0f);
+            }
+        )";
+
+    const char* fragmentShaderSource = R"(
+            #version 460 core
+
+            layout (location = 0) in vec3 normal;
+            layout (location = 1) in flat vec3 tint;
+
+            out vec4 finalColor;
+
+            vec3 lightDirection = normalize(vec3(1, 2, 1));
+
+            void main() {
+                float diffuseLighting = abs(dot(normalize(normal), lightDirection));
+                finalColor = vec4(tint * (0.3f + diffuseLighting * 0.7f), 1.0f);
+            }
+        )";
+
+    auto program = createShaderProgram(vertexShaderSource, fragmentShaderSource);
+
+    std::vector<objLoader::MeshDataElements> meshDatas;
+    for (const auto& meshPath : meshPaths) {
+        auto meshData = objLoader::readObjElements(meshPath);
+        if (meshData.indices.empty()) {
+            fmt::print(stderr, "{} has no faces, skipping it\n", meshPath);
+            continue;
+        }
+        meshDatas.push_back(std::move(meshData));
+    }
+    if (meshDatas.empty()) {
+        fmt::print(stderr, "no meshes to draw\n");
+        glfwTerminate();
+        std::exit(EXIT_FAILURE);
+    }
+
+    // a unit cube, scaled into walls and the floor
+    std::vector<vertex3D> boxVertices;
+    std::vector<int> boxIndices;
+    for (int axis = 0; axis < 3; ++axis) {
+        for (float side : {-1.f, 1.f}) {
+            glm::vec3 normal(0.f);
+            normal[axis] = side;
+            glm::vec3 u(0.f), v(0.f);
+            u[(axis + 1) % 3] = 1.f;
+            v[(axis + 2) % 3] = 1.f;
+            auto first = static_cast<int>(boxVertices.size());
+            for (auto corner : {glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(1, 1),
+                                glm::vec2(-1, 1)}) {
+                auto position = (normal + u * corner.x + v * corner.y) * 0.5f;
+                boxVertices.push_back({position, normal, corner * 0.5f + 0.5f});
+            }
+            // wound counter clockwise seen from outside whichever way the face points
+            std::array<int, 6> quad = side > 0 ? std::array<int, 6>{0, 1, 2, 0, 2, 3}
+                                               : std::array<int, 6>{0, 2, 1, 0, 3, 2};
+            for (auto index : quad) {
+                boxIndices.push_back(first + index);
+            }
+        }
+    }
+    const auto boxBounds = bounds::fromMinMax(glm::vec3(-0.5f), glm::vec3(0.5f));
+
+    struct Object {
+        glm::mat4 model;
+        glm::vec4 tint;
+    };
+    std::vector<Object> objects;
+    // index into meshDatas, or -1 for the box
+    std::vector<int> objectMeshes;
+    std::vector<hizCulling::DrawBounds> objectBounds;
+
+    auto addObject = [&](int mesh, const glm::mat4& model, const glm::vec3& tint) {
+        const auto& meshBounds = mesh < 0 ? boxBounds : meshDatas[mesh].bounds;
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+        for (int corner = 0; corner < 8; ++corner) {
+            glm::vec3 pick(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+            auto world = glm::vec3(model * glm::vec4(glm::mix(meshBounds.min, meshBounds.max,
+                                                              pick), 1.f));
+            min = glm::min(min, world);
+            max = glm::max(max, world);
+        }
+        objects.push_back({model, glm::vec4(tint, 1.f)});
+        objectMeshes.push_back(mesh);
+        objectBounds.push_back(hizCulling::fromBounds(bounds::fromMinMax(min, max)));
+    };
+    auto addBox = [&](const glm::vec3& min, const glm::vec3& max, const glm::vec3& tint) {
+        auto model = glm::translate(glm::mat4(1.0f), (min + max) * 0.5f);
+        addObject(-1, glm::scale(model, max - min), tint);
+    };
+
+    // the building. rooms are roomSize across, inner walls have a doorway in
+    // the middle so you can see a few rooms down a line but not round corners
+    const float roomSize = 8.f;
+    const float wallHeight = 3.f;
+    const float wallThickness = 0.2f;
+    const float doorWidth = 1.6f;
+    const float halfBuilding = roomCount * roomSize * 0.5f;
+    const glm::vec3 wallTint(0.55f, 0.52f, 0.48f);
+
+    addBox(glm::vec3(-halfBuilding, -0.1f, -halfBuilding),
+           glm::vec3(halfBuilding, 0.f, halfBuilding), glm::vec3(0.25f, 0.22f, 0.2f));
+    for (int line = 0; line <= roomCount; ++line) {
+        float across = line * roomSize - halfBuilding;
+        bool outside = line == 0 || line == roomCount;
+        for (int room = 0; room < roomCount; ++room) {
+            float start = room * roomSize - halfBuilding;
+            float end = start + roomSize;
+            float centre = (start + end) * 0.5f;
+            // [start, end] along the wall, split round the door on inner walls
+            std::vector<std::array<float, 2>> pieces;
+            if (outside) {
+                pieces = {{start, end}};
+            } else {
+                pieces = {{start, centre - doorWidth * 0.5f}, {centre + doorWidth * 0.5f, end}};
+            }
+            for (const auto& piece : pieces) {
+                // walls along x then walls along z
+                addBox(glm::vec3(piece[0], 0.f, across - wallThickness * 0.5f),
+                       glm::vec3(piece[1], wallHeight, across + wallThickness * 0.5f), wallTint);
+                addBox(glm::vec3(across - wallThickness * 0.5f, 0.f, piece[0]),
+                       glm::vec3(across + wallThickness * 0.5f, wallHeight, piece[1]), wallTint);
+            }
+        }
+    }
+
+    // 4 x 4 objects per room, clear of the line through the doorways
+    std::mt19937 random(28);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    for (int roomZ = 0; roomZ < roomCount; ++roomZ) {
+        for (int roomX = 0; roomX < roomCount; ++roomX) {
+            for (int spot = 0; spot < 16; ++spot) {
+                auto mesh = static_cast<int>(objects.size() % meshDatas.size());
+                const auto& meshBounds = meshDatas[mesh].bounds;
+                float scale = (0.35f + unit(random) * 0.2f) / std::max(meshBounds.radius, 1e-4f);
+
+                glm::vec3 position((roomX + (spot % 4 + 1) / 5.f) * roomSize - halfBuilding, 0.f,
+                                   (roomZ + (spot / 4 + 1) / 5.f) * roomSize - halfBuilding);
+                auto model = glm::translate(glm::mat4(1.0f), position);
+                model = glm::rotate(model, unit(random) * 6.2832f, glm::vec3(0.f, 1.f, 0.f));
+                model = glm::scale(model, glm::vec3(scale));
+                // standing on the floor
+                model = glm::translate(model, -glm::vec3(meshBounds.centre.x, meshBounds.min.y,
+                                                         meshBounds.centre.z));
+
+                auto index = static_cast<float>(objects.size());
+                glm::vec3 tint = glm::cos(glm::vec3(0.0f, 2.1f, 4.2f) + index * 1.3f) * 0.5f + 0.5f;
+                addObject(mesh, model, tint);
+            }
+        }
+    }
+    const auto objectCount = objects.size();
+
+    GLuint objectBuffer;
+    glCreateBuffers(1, &objectBuffer);
+    glNamedBufferStorage(objectBuffer, objects.size() * sizeof(Object), objects.data(),
+                         GL_DYNAMIC_STORAGE_BIT);
+
+    // walking up and down the middle column of rooms through the doorways,
+    // looking from side to side
+    const float aspect = static_cast<float>(width) / static_cast<float>(height);
+    const auto projection =
+        glm::perspective(glm::radians(60.0f), aspect, 0.05f, halfBuilding * 3.f);
+    const float walkX = ((roomCount / 2) + 0.5f) * roomSize - halfBuilding;
+    auto viewAt = [&](float time) {
+        float walk = std::sin(time * 0.08f);
+        float heading = (std::cos(time * 0.08f) >= 0.f ? 0.f : 3.1416f) +
+                        0.7f * std::sin(time * 0.5f);
+        glm::vec3 eye(walkX, 1.7f, walk * (halfBuilding - roomSize * 0.5f));
+        glm::vec3 forward(std::sin(heading), -0.05f, std::cos(heading));
+        return glm::lookAt(eye, eye + forward, glm::vec3(0.f, 1.f, 0.f));
+    };
+
+    enum Mode { TwoPhase, EarlyOnly, FrustumOnly, ModeCount };
+    const char* modeNames[ModeCount] = {"hi-z two phase", "hi-z early only", "frustum only"};
+
+    std::array<GLfloat, 4> clearColour{0.10f, 0.12f, 0.14f, 1.f};
+    glEnable(GL_DEPTH_TEST);
+
+    // scoped so the pool, culler and render targets are released before the
+    // context goes away
+    {
+        // sized so everything lands in one page, so one vao and one multi
+        // draw covers every object
+        meshPool::PoolSettings poolSettings;
+        poolSettings.verticesPerPage = static_cast<uint32_t>(boxVertices.size());
+        poolSettings.indicesPerPage = static_cast<uint32_t>(boxIndices.size());
+        for (const auto& meshData : meshDatas) {
+            poolSettings.verticesPerPage += static_cast<uint32_t>(meshData.vertices.size());
+            poolSettings.indicesPerPage += static_cast<uint32_t>(meshData.indices.size());
+        }
+        meshPool::MeshPool meshes(poolSettings);
+        auto boxMesh = meshes.add(boxVertices, boxIndices);
+        std::vector<meshPool::MeshId> meshIds;
+        for (const auto& meshData : meshDatas) {
+            meshIds.push_back(meshes.add(meshData));
+        }
+
+        std::vector<DrawElementsIndirectCommand> commands;
+        for (auto i = 0u; i < objectCount; ++i) {
+            auto mesh = objectMeshes[i] < 0 ? boxMesh : meshIds[objectMeshes[i]];
+            commands.push_back(meshes.command(mesh, i));
+        }
+
+        // NEW! the culler gets every command and its box once. from then on
+        // which ones draw is decided on the gpu each frame
+        hizCulling::Culler culler(commands, objectBounds);
+        fmt::print(stderr, "{} rooms, {} draws\n", roomCount * roomCount, culler.draws());
+
+        // the depth has to be a texture the pyramid can be built from, so the
+        // scene goes into our own framebuffer and is blitted to the window
+        GLuint framebuffer = 0;
+        std::array<GLuint, 2> targets{};
+        int targetWidth = 0;
+        int targetHeight = 0;
+        auto resizeTargets = [&](int newWidth, int newHeight) {
+            if (newWidth == targetWidth && newHeight == targetHeight) {
+                return;
+            }
+            targetWidth = newWidth;
+            targetHeight = newHeight;
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(static_cast<GLsizei>(targets.size()), targets.data());
+
+            glCreateTextures(GL_TEXTURE_2D, static_cast<GLsizei>(targets.size()), targets.data());
+            glTextureStorage2D(targets[0], 1, GL_RGBA8, targetWidth, targetHeight);
+            glTextureStorage2D(targets[1], 1, GL_DEPTH_COMPONENT32F, targetWidth, targetHeight);
+            glCreateFramebuffers(1, &framebuffer);
+            glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, targets[0], 0);
+            glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, targets[1], 0);
+            if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) !=
+                GL_FRAMEBUFFER_COMPLETE) {
+                fmt::print(stderr, "occlusion culling framebuffer is incomplete\n");
+            }
+            culler.resize(targetWidth, targetHeight);
+        };
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, objectBuffer);
+
+        auto drawFrame = [&](Mode mode, float currentTime) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            resizeTargets(std::max(framebufferWidth, 1), std::max(framebufferHeight, 1));
+
+            glm::mat4 viewProjection = projection * viewAt(currentTime);
+            glProgramUniformMatrix4fv(program, glGetUniformLocation(program, "viewProjection"), 1,
+                                      GL_FALSE, glm::value_ptr(viewProjection));
+
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, targetWidth, targetHeight);
+            glClearNamedFramebufferfv(framebuffer, GL_COLOR, 0, clearColour.data());
+            GLfloat farDepth = 1.f;
+            glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &farDepth);
+
+            // NEW! 1. what last frame's depth doesn't hide
+            culler.cullEarly(viewProjection, mode != FrustumOnly);
+            glUseProgram(program);
+            meshes.bindPage(0);
+            culler.drawEarly();
+
+            // 2. this frame's depth so far into the pyramid, 3. retest what
+            // step 1 hid against it. frustum only has nothing to retest
+            if (mode != FrustumOnly) {
+                culler.buildPyramid(targets[1]);
+            }
+            culler.cullLate(viewProjection);
+            if (mode == TwoPhase) {
+                glUseProgram(program);
+                meshes.bindPage(0);
+                culler.drawLate();
+            }
+
+            glBlitNamedFramebuffer(framebuffer, 0, 0, 0, targetWidth, targetHeight, 0, 0,
+                                   targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        };
+
+        if (benchmark) {
+            auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+            for (int mode = 0; mode < ModeCount; ++mode) {
+                // a few frames first so shader compiles aren't timed and the
+                // counts read back are this mode's
+                for (int frame = 0; frame < 8; ++frame) {
+                    drawFrame(Mode(mode), 0.f);
+                    culler.stats();
+                }
+                glFinish();
+
+                // only frames whose counts had come back are averaged
+                hizCulling::FrameStats total;
+                int sampledFrames = 0;
+                auto benchStart = steady_clock::now();
+                for (int frame = 0; frame < benchFrames; ++frame) {
+                    drawFrame(Mode(mode), static_cast<float>(frame) / 60.0f);
+                    glfwSwapBuffers(window);
+                    auto stats = culler.stats();
+                    if (!stats.fresh) {
+                        continue;
+                    }
+                    ++sampledFrames;
+                    total.frustumRejected += stats.frustumRejected;
+                    total.occlusionRejected += stats.occlusionRejected;
+                    total.drawnEarly += stats.drawnEarly;
+                    total.drawnLate += stats.drawnLate;
+                }
+                glFinish();
+                auto seconds = duration<double>(steady_clock::now() - benchStart).count();
+
+                // late draws are the ones that would pop without the late
+                // pass. in early only mode they were counted but not drawn
+                auto perFrame = [&](uint32_t count) {
+                    return double(count) / std::max(sampledFrames, 1);
+                };
+                auto drawn = total.drawnEarly + (mode == TwoPhase ? total.drawnLate : 0);
+                fmt::print("{{\"benchmark\":\"hiz_culling\",\"renderer\":\"{}\","
+                           "\"mode\":\"{}\",\"draws\":{},\"frames\":{},\"seconds\":{:.6f},"
+                           "\"msPerFrame\":{:.3f},\"drawnPerFrame\":{:.1f},"
+                           "\"frustumRejectedPerFrame\":{:.1f},"
+                           "\"occlusionRejectedPerFrame\":{:.1f},\"lateDrawsPerFrame\":{:.1f}}}\n",
+                           renderer ? renderer : "unknown", modeNames[mode], culler.draws(),
+                           benchFrames, seconds, seconds * 1000.0 / benchFrames, perFrame(drawn),
+                           perFrame(total.frustumRejected), perFrame(total.occlusionRejected),
+                           perFrame(total.drawnLate));
+            }
+        } else {
+            Mode mode = TwoPhase;
+            fmt::print(stderr, "culling with {}\n", modeNames[mode]);
+            auto lastReport = steady_clock::now();
+            while (!glfwWindowShouldClose(window)) {
+                // 1, 2 and 3 switch between the ways of culling
+                for (int key = 0; key < ModeCount; ++key) {
+                    if (glfwGetKey(window, GLFW_KEY_1 + key) == GLFW_PRESS && mode != key) {
+                        mode = Mode(key);
+                        fmt::print(stderr, "culling with {}\n", modeNames[mode]);
+                    }
+                }
+
+                auto currentTime = duration<float>(system_clock::now() - startTime).count();
+                drawFrame(mode, currentTime);
+
+                // a few frames old (or the last ones again if the gpu is
+                // behind), but it never waits for the gpu
+                auto stats = culler.stats();
+                if (steady_clock::now() - lastReport > seconds(1)) {
+                    lastReport = steady_clock::now();
+                    fmt::print(stderr,
+                               "{} draws: {} rejected ({} frustum, {} occlusion), {} drawn "
+                               "early, {} late\n",
+                               stats.draws, stats.rejected(), stats.frustumRejected,
+                               stats.occlusionRejected, stats.drawnEarly, stats.drawnLate);
+                }
+
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+            }
+        }
+
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(static_cast<GLsizei>(targets.size()), targets.data());
+    }
+
+    glDeleteBuffers(1, &objectBuffer);
+    glDeleteProgram(program);
+
+    glfwTerminate();
+}
@@ -1,9 +1,11 @@
 #include "error_handling.hpp"
+#include "render_scale.hpp"
 #include <array>
 #include <chrono>     // current time
 #include <cmath>      // sin & cos
 #include <cstdlib>    // for std::exit()
 #include <fmt/core.h> // for fmt::print(). implements c++20 std::format
+#include <string>
 #include <unordered_map>
 
 // this is really important to make sure that glbindings does not clash with
@@ -21,7 +23,25 @@
 using namespace gl;
 using namespace std::chrono;
 
-int main() {
+// usage: chapter9_fullScreenEffectsShaderToy [--scale S] [--checkerboard] [--target-ms MS]
+//
+// NEW! the effect can be shaded at a fraction of the window's resolution and
+// scaled up (--scale 0.5 shades a quarter of the pixels). --checkerboard
+// shades half of those each frame and fills in the rest from the frame
+// before. --target-ms picks the scale to keep the effect's gpu time near that.
+int main(int argc, char* argv[]) {
+
+    renderScale::Settings renderSettings;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = std::string(argv[i]);
+        if (arg == "--scale" && i + 1 < argc) {
+            renderSettings.scale = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--checkerboard") {
+            renderSettings.checkerboard = true;
+        } else if (arg == "--target-ms" && i + 1 < argc) {
+            renderSettings.targetMs = static_cast<float>(std::atof(argv[++i]));
+        }
+    }
 
     auto startTime = system_clock::now();
     const int width = 800;
@@ -93,8 +113,9 @@ int main() {
             gl_Position = vertices[gl_VertexID]; 
         }
     )",
-                                 R"(
+                                 (std::string(R"(
             #version 450 core
+    )") + renderScale::glsl + R"(
         // Protean clouds by nimitz (twitter: @stormoid)
     // https://www.shadertoy.com/view/3l23Rh
     // License Creative Commons Attribution-NonCommercial-ShareAlike 3.0 Unported License
@@ -117,12 +138,14 @@ int main() {
         the fog is evaluated as the difference of the fog integral at each rendered step.
 
     */
-        vec4 fragCoord  = gl_FragCoord;
         out vec4 fragColor;
 
          float iTime = 4.0f;
-        vec2 iResolution = vec2(800,400);
-        vec2 iMouse = vec2(960.f,0.f);
+        // NEW! iResolution comes from renderScale::glsl, the size actually shaded.
+        // the mouse was (960, 0) on the old fixed 800x400, so it's kept as that
+        // fraction of the resolution and the view doesn't change with the scale
+        const vec2 mouseFraction = vec2(960.f / 800.f, 0.f);
+        vec2 iMouse;
     mat2 rot(in float a){float c = cos(a), s = sin(a);return mat2(c,s,-s,c);}
     const mat3 m3 = mat3(0.33338, 0.56034, -0.71817, -0.87887, 0.32651, -0.15323, 0.15162, 0.69596, 0.61339)*1.93;
     float mag2(vec2 p){return dot(p,p);}
@@ -213,8 +236,10 @@ int main() {
 
     void main()
     {	
+        vec2 fragCoord = effectFragCoord();
+        iMouse = mouseFraction * iResolution.xy;
         vec2 q = fragCoord.xy/iResolution.xy;
-        vec2 p = (gl_FragCoord.xy - 0.5*iResolution.xy)/iResolution.y;
+        vec2 p = (fragCoord.xy - 0.5*iResolution.xy)/iResolution.y;
         bsMo = (iMouse.xy - 0.5*iResolution.xy)/iResolution.y;
         
         float time = iTime*3.;
@@ -245,7 +270,7 @@ int main() {
         
         fragColor = vec4( col, 1.0 );
     }
-    )");
+    )").c_str());
 
    
     glUseProgram(program);
@@ -255,13 +280,33 @@ int main() {
     glBindVertexArray(vao);
 
 
-    while (!glfwWindowShouldClose(windowPtr)) {
-
-        // draw full screen triangle
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+    // scoped so the render targets are released before the context goes away
+    {
+        renderScale::ScaledRenderer scaled(renderSettings);
+        float reportedScale = 0.f;
+
+        while (!glfwWindowShouldClose(windowPtr)) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(windowPtr, &framebufferWidth, &framebufferHeight);
+
+            // NEW! binds the smaller target and sets iResolution to its size
+            scaled.begin(program, framebufferWidth, framebufferHeight);
+
+            // draw full screen triangle
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            // fill in the checkerboard and scale up to the window
+            scaled.end();
+            if (scaled.scale() != reportedScale) {
+                reportedScale = scaled.scale();
+                fmt::print(stderr, "shading at {:.0f}% of {}x{}, {:.2f} ms on the gpu\n",
+                           reportedScale * 100.f, framebufferWidth, framebufferHeight,
+                           scaled.gpuMs());
+            }
 
-        glfwSwapBuffers(windowPtr);
-        glfwPollEvents();
+            glfwSwapBuffers(windowPtr);
+            glfwPollEvents();
+        }
     }
 
     glfwTerminate();
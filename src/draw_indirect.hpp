@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// layout glMultiDrawElementsIndirect expects for each command. chapters 18 and
+// 19 define this inline. the shared headers use this one
+struct DrawElementsIndirectCommand {
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20,
+              "indirect commands must be tightly packed");
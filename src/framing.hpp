@@ -0,0 +1,68 @@
+#pragma once
+
+// a camera that fits whatever was loaded. give it the mesh's bounds and it
+// works out how far back to stand and where to put the near and far planes,
+// so a 2cm part and a 2km scan both fill the screen and neither gets clipped.
+//
+//  auto framing = framing::frame(meshData.bounds, 40.0f, 1280.f / 640.f);
+//  auto projection = framing.projection();
+//  auto view = framing.orbit(time * 0.5f, 0.3f);
+
+#include "bounds.hpp"
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace framing {
+
+struct Framing {
+    glm::vec3 target = glm::vec3(0.f);
+    // from target to the eye
+    float distance = 1.f;
+    float nearPlane = 0.1f;
+    float farPlane = 100.f;
+    float verticalFov = glm::radians(40.0f);
+    float aspect = 1.f;
+
+    glm::mat4 projection() const {
+        return glm::perspective(verticalFov, aspect, nearPlane, farPlane);
+    }
+
+    // circling the target at the framed distance. angle is around y,
+    // elevation up from the horizon, both in radians
+    glm::mat4 orbit(float angle, float elevation) const {
+        glm::vec3 offset(std::sin(angle) * std::cos(elevation), std::sin(elevation),
+                         std::cos(angle) * std::cos(elevation));
+        return glm::lookAt(target + offset * distance, target, glm::vec3(0.f, 1.f, 0.f));
+    }
+};
+
+// margin > 1 leaves a border round the mesh
+inline Framing frame(const bounds::Bounds& meshBounds, float verticalFovDegrees, float aspect,
+                     float margin = 1.1f) {
+    Framing result;
+    result.verticalFov = glm::radians(verticalFovDegrees);
+    result.aspect = aspect;
+    if (meshBounds.empty()) {
+        return result;
+    }
+
+    // the sphere has to fit in the narrower of the two fovs
+    float halfVertical = result.verticalFov * 0.5f;
+    float halfHorizontal = std::atan(std::tan(halfVertical) * aspect);
+    float halfFov = std::min(halfVertical, halfHorizontal);
+
+    float radius = std::max(meshBounds.radius, 1e-4f) * margin;
+    result.target = meshBounds.centre;
+    result.distance = radius / std::sin(halfFov);
+    // the sphere stays between these from anywhere on the orbit. the near
+    // plane is kept a sensible fraction of the far one for depth precision
+    result.farPlane = result.distance + radius;
+    result.nearPlane = std::max(result.distance - radius, result.farPlane * 0.001f);
+    return result;
+}
+
+} // namespace framing
@@ -0,0 +1,508 @@
+#pragma once
+
+// occlusion culling on the gpu against a hierarchical z (hi-z) pyramid. the
+// pyramid is a mip chain of the depth buffer where each texel holds the
+// farthest depth of the texels under it, so a box's screen rectangle can be
+// checked with at most 4 reads from the level where it's about a texel wide:
+// if the box's nearest point is behind the farthest depth there, something
+// already drawn hides all of it.
+//
+// the draws are commands that exist up front (like chapter 19's) plus a world
+// space box each. a compute shader tests every box and writes the result into
+// a copy of the commands as the instanceCount, 0 or the original, so the cpu
+// never finds out what was culled and one glMultiDrawElementsIndirect still
+// draws the lot.
+//
+// testing against last frame's depth alone would hide things that have just
+// come out from behind something (they pop in a frame late), so each frame
+// culls twice:
+//  1. early: everything against the frustum and last frame's pyramid. what
+//     passes is drawn. what the pyramid hid is remembered
+//  2. the pyramid is rebuilt from the depth the early draws left
+//  3. late: only the draws the early pass hid, against the new pyramid. the
+//     ones that turn out visible after all are drawn now
+// the late pyramid is only missing what the late pass draws, so it's kept for
+// the next frame's early pass.
+//
+//  hizCulling::Culler culler(commands, boxes);
+//  culler.resize(width, height);
+//  culler.cullEarly(viewProjection);
+//  glUseProgram(program); glBindVertexArray(vao); culler.drawEarly();
+//  culler.buildPyramid(depthTexture);
+//  culler.cullLate(viewProjection);
+//  glUseProgram(program); glBindVertexArray(vao); culler.drawLate();
+//
+// the compute passes use storage bindings 4 to 6, texture unit 4 and image
+// units 0 and 1, and leave the indirect buffer bound. the depth has to be in a
+// texture (the default framebuffer's can't be read) with glDepthRange 0 to 1.
+
+#include "bounds.hpp"
+#include "draw_indirect.hpp"
+#include "error_handling.hpp"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+using namespace gl;
+
+namespace hizCulling {
+
+// everything a draw draws, in world space. matches DrawBounds in the shader
+struct DrawBounds {
+    glm::vec4 min;
+    glm::vec4 max;
+};
+
+inline DrawBounds fromBounds(const bounds::Bounds& box) {
+    return {glm::vec4(box.min, 1.f), glm::vec4(box.max, 1.f)};
+}
+
+// what a frame did with its draws. the first four match Stats in the shader
+struct FrameStats {
+    uint32_t frustumRejected = 0;
+    // hidden in both passes
+    uint32_t occlusionRejected = 0;
+    uint32_t drawnEarly = 0;
+    // hidden by last frame's depth but not this frame's. without the late
+    // pass these would have popped in a frame late
+    uint32_t drawnLate = 0;
+    uint32_t draws = 0;
+    // false when the gpu hadn't finished a newer frame yet and these are the
+    // same counts stats() returned last time
+    bool fresh = false;
+
+    uint32_t rejected() const {
+        return frustumRejected + occlusionRejected;
+    }
+};
+
+// max of everything under each texel. level 0 is a copy of the depth texture,
+// the rest read the level above through an image. an odd sized level above
+// has its last row/column folded into the texel next to it
+constexpr const char* pyramidSource = R"(
+    #version 460 core
+    layout (local_size_x = 8, local_size_y = 8) in;
+
+    layout (binding = 4) uniform sampler2D depth;
+    layout (r32f, binding = 0) uniform readonly image2D above;
+    layout (r32f, binding = 1) uniform writeonly image2D level;
+
+    uniform bool fromDepth;
+
+    float load(ivec2 texel) {
+        return fromDepth ? texelFetch(depth, texel, 0).r : imageLoad(above, texel).r;
+    }
+
+    void main() {
+        ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+        ivec2 size = imageSize(level);
+        if (any(greaterThanEqual(texel, size))) {
+            return;
+        }
+        ivec2 sourceSize = fromDepth ? textureSize(depth, 0) : imageSize(above);
+        ivec2 first = texel * sourceSize / size;
+        ivec2 last = min(((texel + 1) * sourceSize + size - 1) / size, sourceSize);
+
+        float farthest = 0.0f;
+        for (int y = first.y; y < last.y; ++y) {
+            for (int x = first.x; x < last.x; ++x) {
+                farthest = max(farthest, load(ivec2(x, y)));
+            }
+        }
+        imageStore(level, texel, vec4(farthest));
+    }
+)";
+
+// one invocation per draw. commands holds the originals, then the early
+// pass's copies, then the late pass's
+constexpr const char* cullSource = R"(
+    #version 460 core
+    layout (local_size_x = 64) in;
+
+    struct DrawBounds {
+        vec4 min;
+        vec4 max;
+    };
+
+    struct DrawCommand {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout (std430, binding = 4) readonly buffer Bounds {
+        DrawBounds bounds[];
+    };
+
+    layout (std430, binding = 5) buffer Commands {
+        DrawCommand commands[];
+    };
+
+    // x frustum rejected, y occlusion rejected, z drawn early, w drawn late.
+    // then a flag per draw the early pass hid, for the late pass
+    layout (std430, binding = 6) buffer State {
+        uvec4 stats;
+        uint hiddenEarly[];
+    };
+
+    layout (binding = 4) uniform sampler2D pyramid;
+
+    uniform mat4 viewProjection;
+    uniform vec4 frustumPlanes[6];
+    uniform uint drawCount;
+    uniform bool late;
+    uniform bool occlusion;
+
+    bool inFrustum(DrawBounds box) {
+        for (int i = 0; i < 6; ++i) {
+            vec4 plane = frustumPlanes[i];
+            vec3 furthest = mix(box.min.xyz, box.max.xyz, greaterThanEqual(plane.xyz, vec3(0)));
+            if (dot(plane.xyz, furthest) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool occluded(DrawBounds box) {
+        vec2 minUv = vec2(1.0f);
+        vec2 maxUv = vec2(0.0f);
+        float nearest = 1.0f;
+        for (int corner = 0; corner < 8; ++corner) {
+            vec3 pick = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+            vec4 clip = viewProjection * vec4(mix(box.min.xyz, box.max.xyz, pick), 1.0f);
+            // a corner in front of the near plane means the camera is in or
+            // right up against the box
+            if (clip.w <= 0.0f || clip.z < -clip.w) {
+                return false;
+            }
+            vec3 ndc = clip.xyz / clip.w;
+            minUv = min(minUv, ndc.xy * 0.5f + 0.5f);
+            maxUv = max(maxUv, ndc.xy * 0.5f + 0.5f);
+            nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        minUv = clamp(minUv, 0.0f, 1.0f);
+        maxUv = clamp(maxUv, 0.0f, 1.0f);
+
+        // the level where the rectangle is at most a texel across, so it
+        // touches 2x2 texels at most
+        vec2 pixels = (maxUv - minUv) * vec2(textureSize(pyramid, 0));
+        int level = int(ceil(log2(max(max(pixels.x, pixels.y), 1.0f))));
+        level = clamp(level, 0, textureQueryLevels(pyramid) - 1);
+
+        ivec2 levelSize = textureSize(pyramid, level);
+        ivec2 first = clamp(ivec2(minUv * vec2(levelSize)), ivec2(0), levelSize - 1);
+        ivec2 last = clamp(ivec2(maxUv * vec2(levelSize)), ivec2(0), levelSize - 1);
+        float farthest = 0.0f;
+        for (int y = first.y; y <= last.y; ++y) {
+            for (int x = first.x; x <= last.x; ++x) {
+                farthest = max(farthest, texelFetch(pyramid, ivec2(x, y), level).r);
+            }
+        }
+        return nearest > farthest;
+    }
+
+    void main() {
+        uint i = gl_GlobalInvocationID.x;
+        if (i >= drawCount) {
+            return;
+        }
+        DrawBounds box = bounds[i];
+        uint instances = commands[i].instanceCount;
+
+        if (late) {
+            uint lateCommand = drawCount * 2 + i;
+            if (hiddenEarly[i] == 0) {
+                commands[lateCommand].instanceCount = 0;
+                return;
+            }
+            bool hidden = occluded(box);
+            commands[lateCommand].instanceCount = hidden ? 0 : instances;
+            atomicAdd(hidden ? stats.y : stats.w, 1);
+            return;
+        }
+
+        uint earlyCommand = drawCount + i;
+        if (!inFrustum(box)) {
+            commands[earlyCommand].instanceCount = 0;
+            hiddenEarly[i] = 0;
+            atomicAdd(stats.x, 1);
+            return;
+        }
+        bool hidden = occlusion && occluded(box);
+        commands[earlyCommand].instanceCount = hidden ? 0 : instances;
+        hiddenEarly[i] = hidden ? 1 : 0;
+        if (!hidden) {
+            atomicAdd(stats.z, 1);
+        }
+    }
+)";
+
+inline GLuint createComputeProgram(const char* source, const char* name) {
+    auto shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    errorHandler::checkShader(shader, name);
+
+    auto program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    return program;
+}
+
+class Culler {
+  public:
+    Culler(const std::vector<DrawElementsIndirectCommand>& commands,
+           const std::vector<DrawBounds>& bounds)
+        : drawCount(static_cast<uint32_t>(std::min(commands.size(), bounds.size()))) {
+        if (commands.size() != bounds.size()) {
+            fmt::print(stderr, "hi-z culling: {} commands but {} boxes, using the first {}\n",
+                       commands.size(), bounds.size(), drawCount);
+        }
+        pyramidProgram = createComputeProgram(pyramidSource, "Hi-Z pyramid");
+        cullProgram = createComputeProgram(cullSource, "Hi-Z cull");
+        fromDepthLocation = glGetUniformLocation(pyramidProgram, "fromDepth");
+        viewProjectionLocation = glGetUniformLocation(cullProgram, "viewProjection");
+        frustumPlanesLocation = glGetUniformLocation(cullProgram, "frustumPlanes");
+        drawCountLocation = glGetUniformLocation(cullProgram, "drawCount");
+        lateLocation = glGetUniformLocation(cullProgram, "late");
+        occlusionLocation = glGetUniformLocation(cullProgram, "occlusion");
+        glProgramUniform1ui(cullProgram, drawCountLocation, drawCount);
+
+        // the originals three times over, the early and late copies get
+        // their instanceCount overwritten every frame
+        std::vector<DrawElementsIndirectCommand> copies;
+        for (int copy = 0; copy < 3; ++copy) {
+            copies.insert(copies.end(), commands.begin(), commands.begin() + drawCount);
+        }
+        std::array<GLuint, 3> buffers{};
+        glCreateBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+        boundsBuffer = buffers[0];
+        commandBuffer = buffers[1];
+        stateBuffer = buffers[2];
+        glNamedBufferStorage(boundsBuffer, std::max<size_t>(drawCount, 1) * sizeof(DrawBounds),
+                             bounds.data(), GL_DYNAMIC_STORAGE_BIT);
+        glNamedBufferStorage(commandBuffer,
+                             std::max<size_t>(copies.size(), 1) *
+                                 sizeof(DrawElementsIndirectCommand),
+                             copies.data(), GL_DYNAMIC_STORAGE_BIT);
+        std::vector<uint32_t> state(statsCount + drawCount, 0u);
+        glNamedBufferStorage(stateBuffer, state.size() * sizeof(uint32_t), state.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+
+        // the counts are copied out each frame into a slot of a mapped
+        // buffer and read a few frames later, so reading them never waits
+        glCreateBuffers(1, &readbackBuffer);
+        auto readbackBytes = readbackFrames * statsCount * sizeof(uint32_t);
+        glNamedBufferStorage(readbackBuffer, readbackBytes, nullptr,
+                             GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        readback = static_cast<const uint32_t*>(
+            glMapNamedBufferRange(readbackBuffer, 0, readbackBytes,
+                                  GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+        if (!readback) {
+            fmt::print(stderr, "hi-z culling: failed to map the stats buffer\n");
+        }
+    }
+
+    ~Culler() {
+        for (auto fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+        glUnmapNamedBuffer(readbackBuffer);
+        std::array<GLuint, 4> buffers{boundsBuffer, commandBuffer, stateBuffer, readbackBuffer};
+        glDeleteBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
+        glDeleteTextures(1, &pyramid);
+        glDeleteProgram(pyramidProgram);
+        glDeleteProgram(cullProgram);
+    }
+
+    Culler(const Culler&) = delete;
+    Culler& operator=(const Culler&) = delete;
+
+    // the depth buffer's size. the pyramid starts out at the far plane, so
+    // nothing is hidden until a frame has been drawn into it
+    void resize(int width, int height) {
+        if (width == pyramidWidth && height == pyramidHeight) {
+            return;
+        }
+        glDeleteTextures(1, &pyramid);
+        pyramidWidth = std::max(width, 1);
+        pyramidHeight = std::max(height, 1);
+        pyramidLevels = 1;
+        for (auto size = std::max(pyramidWidth, pyramidHeight); size > 1; size /= 2) {
+            ++pyramidLevels;
+        }
+        glCreateTextures(GL_TEXTURE_2D, 1, &pyramid);
+        glTextureStorage2D(pyramid, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+        glTextureParameteri(pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteri(pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        float farPlane = 1.f;
+        for (auto level = 0; level < pyramidLevels; ++level) {
+            glClearTexImage(pyramid, level, GL_RED, GL_FLOAT, &farPlane);
+        }
+    }
+
+    // phase 1. frustum and last frame's pyramid. occlusion off leaves just
+    // the frustum test, to compare against
+    void cullEarly(const glm::mat4& viewProjection, bool occlusion = true) {
+        uint32_t zero = 0;
+        glClearNamedBufferSubData(stateBuffer, GL_R32UI, 0, statsCount * sizeof(uint32_t),
+                                  GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        auto planes = bounds::frustumPlanes(viewProjection);
+        glProgramUniform4fv(cullProgram, frustumPlanesLocation, 6, glm::value_ptr(planes[0]));
+        glProgramUniform1i(cullProgram, occlusionLocation, occlusion && pyramid ? 1 : 0);
+        dispatchCull(viewProjection, false);
+    }
+
+    // phase 3. the draws the early pass hid, against the pyramid built since
+    void cullLate(const glm::mat4& viewProjection) {
+        dispatchCull(viewProjection, true);
+
+        // the counts for this frame are done, copy them out for stats()
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        readbackSlot = (readbackSlot + 1) % readbackFrames;
+        glCopyNamedBufferSubData(stateBuffer, readbackBuffer, 0,
+                                 readbackSlot * statsCount * sizeof(uint32_t),
+                                 statsCount * sizeof(uint32_t));
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+        if (fences[readbackSlot]) {
+            glDeleteSync(fences[readbackSlot]);
+        }
+        fences[readbackSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+    }
+
+    // phase 2. max depth mip chain of depthTexture, which has to be the size
+    // given to resize()
+    void buildPyramid(GLuint depthTexture) {
+        if (!pyramid) {
+            return;
+        }
+        glUseProgram(pyramidProgram);
+        glBindTextureUnit(4, depthTexture);
+        for (auto level = 0; level < pyramidLevels; ++level) {
+            glProgramUniform1i(pyramidProgram, fromDepthLocation, level == 0 ? 1 : 0);
+            if (level > 0) {
+                glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            }
+            glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            auto levelWidth = std::max(pyramidWidth >> level, 1);
+            auto levelHeight = std::max(pyramidHeight >> level, 1);
+            glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    // the caller binds the program and the vao the commands were made for
+    void drawEarly() const {
+        draw(1);
+    }
+
+    void drawLate() const {
+        draw(2);
+    }
+
+    // the counts from a few frames ago, 0s until there are any. never waits:
+    // if the gpu hasn't got to the oldest frame's copy yet the last counts
+    // come back again with fresh false
+    FrameStats stats() {
+        lastStats.draws = drawCount;
+        lastStats.fresh = false;
+        // the oldest slot, the next one cullLate writes
+        auto slot = (readbackSlot + 1) % readbackFrames;
+        auto& fence = fences[slot];
+        if (!readback || !fence) {
+            return lastStats;
+        }
+        auto wait = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (wait != GL_ALREADY_SIGNALED && wait != GL_CONDITION_SATISFIED) {
+            return lastStats;
+        }
+        // read once, so the same frame isn't counted twice
+        glDeleteSync(fence);
+        fence = nullptr;
+
+        const auto* counts = readback + slot * statsCount;
+        lastStats.frustumRejected = counts[0];
+        lastStats.occlusionRejected = counts[1];
+        lastStats.drawnEarly = counts[2];
+        lastStats.drawnLate = counts[3];
+        lastStats.fresh = true;
+        return lastStats;
+    }
+
+    GLuint pyramidTexture() const {
+        return pyramid;
+    }
+
+    uint32_t draws() const {
+        return drawCount;
+    }
+
+  private:
+    static constexpr size_t statsCount = 4;
+    static constexpr size_t readbackFrames = 4;
+
+    void dispatchCull(const glm::mat4& viewProjection, bool late) {
+        glProgramUniformMatrix4fv(cullProgram, viewProjectionLocation, 1, GL_FALSE,
+                                  glm::value_ptr(viewProjection));
+        glProgramUniform1i(cullProgram, lateLocation, late ? 1 : 0);
+        glUseProgram(cullProgram);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, stateBuffer);
+        glBindTextureUnit(4, pyramid);
+        glDispatchCompute((drawCount + 63) / 64, 1, 1);
+        // the commands are read by the draw, the flags by the next dispatch
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void draw(size_t copy) const {
+        if (!drawCount) {
+            return;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        auto offset = copy * drawCount * sizeof(DrawElementsIndirectCommand);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    reinterpret_cast<const void*>(offset),
+                                    static_cast<GLsizei>(drawCount), 0);
+    }
+
+    uint32_t drawCount = 0;
+    GLuint pyramidProgram = 0;
+    GLuint cullProgram = 0;
+    GLint fromDepthLocation = -1;
+    GLint viewProjectionLocation = -1;
+    GLint frustumPlanesLocation = -1;
+    GLint drawCountLocation = -1;
+    GLint lateLocation = -1;
+    GLint occlusionLocation = -1;
+    GLuint boundsBuffer = 0;
+    GLuint commandBuffer = 0;
+    GLuint stateBuffer = 0;
+    GLuint readbackBuffer = 0;
+    const uint32_t* readback = nullptr;
+    std::array<GLsync, readbackFrames> fences{};
+    size_t readbackSlot = 0;
+    FrameStats lastStats;
+    GLuint pyramid = 0;
+    int pyramidWidth = 0;
+    int pyramidHeight = 0;
+    GLsizei pyramidLevels = 0;
+};
+
+} // namespace hizCulling
@@ -0,0 +1,331 @@
+#pragma once
+
+// the other half of asset_watcher.hpp: getting a changed asset onto the gpu
+// without rebuilding everything.
+//
+// a re-read mesh is compared against the one already uploaded and only the
+// runs of vertices/indices that differ are sent with glNamedBufferSubData.
+// readObjElements orders vertices by their obj indices, so moving a few
+// points in an editor changes a few vertices, and appending geometry adds to
+// the end. buffers are allocated with spare room and only replaced when a
+// reload no longer fits.
+//
+// texture arrays reload a single layer at a time.
+//
+//  hotReload::GpuBuffer vertexBuffer;
+//  vertexBuffer.upload(meshData.vertices);
+//  ...file changed
+//  auto newMeshData = objLoader::readObjElements(filePath);
+//  auto stats = vertexBuffer.update(meshData.vertices, newMeshData.vertices);
+//  if (stats.reallocated) { glVertexArrayVertexBuffer(vao, 0, vertexBuffer.name(), ...); }
+
+#include "draw_indirect.hpp"
+#include "obj_loader.hpp"
+#include "trace.hpp"
+
+#include "stb_image.h"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace gl;
+
+namespace hotReload {
+
+// elements [begin, begin + count)
+struct Range {
+    size_t begin = 0;
+    size_t count = 0;
+};
+
+// runs of elements that differ between before and after, plus anything past
+// the end of before. runs closer than mergeGap elements are joined because
+// one bigger upload is cheaper than two calls. shrinking adds nothing, the
+// draws just stop reading the end
+template <typename T>
+std::vector<Range> changedRanges(const std::vector<T>& before, const std::vector<T>& after,
+                                 size_t mergeGap = 64) {
+    std::vector<Range> ranges;
+    auto addChanged = [&](size_t begin, size_t end) {
+        if (!ranges.empty() && begin - (ranges.back().begin + ranges.back().count) <= mergeGap) {
+            ranges.back().count = end - ranges.back().begin;
+        } else {
+            ranges.push_back({begin, end - begin});
+        }
+    };
+
+    // whole blocks compare with one memcmp, most of a small edit is equal
+    constexpr size_t blockSize = 256;
+    auto common = std::min(before.size(), after.size());
+    for (size_t block = 0; block < common; block += blockSize) {
+        auto blockEnd = std::min(block + blockSize, common);
+        if (std::memcmp(&before[block], &after[block], (blockEnd - block) * sizeof(T)) == 0) {
+            continue;
+        }
+        for (auto i = block; i < blockEnd;) {
+            if (std::memcmp(&before[i], &after[i], sizeof(T)) == 0) {
+                ++i;
+                continue;
+            }
+            auto runEnd = i + 1;
+            while (runEnd < blockEnd &&
+                   std::memcmp(&before[runEnd], &after[runEnd], sizeof(T)) != 0) {
+                ++runEnd;
+            }
+            addChanged(i, runEnd);
+            i = runEnd;
+        }
+    }
+    if (after.size() > common) {
+        addChanged(common, after.size());
+    }
+    return ranges;
+}
+
+// one command per group, baseInstance is the group index (what chapter 19
+// uses to look up the texture layer)
+inline std::vector<DrawElementsIndirectCommand>
+commandsFor(const std::vector<objLoader::groupInfo>& groups) {
+    std::vector<DrawElementsIndirectCommand> commands;
+    commands.reserve(groups.size());
+    for (auto g = 0u; g < groups.size(); ++g) {
+        commands.push_back({groups[g].count, 1, groups[g].startOffset, 0, g});
+    }
+    return commands;
+}
+
+// materials whose diffuse map now points at a different file, as (old, new)
+// paths. a material that is new or lost its map isn't a swap, so isn't listed
+inline std::vector<std::pair<std::string, std::string>>
+changedDiffuseMaps(const objLoader::MapMaterialNameToInfo& before,
+                   const objLoader::MapMaterialNameToInfo& after) {
+    using objLoader::MaterialInfo;
+    std::vector<std::pair<std::string, std::string>> changes;
+    for (const auto& [name, material] : after) {
+        auto oldMaterial = before.find(name);
+        if (oldMaterial == before.end()) {
+            continue;
+        }
+        auto oldMap = oldMaterial->second.mapTypeToFilePath.find(MaterialInfo::mapType::Diffuse);
+        auto newMap = material.mapTypeToFilePath.find(MaterialInfo::mapType::Diffuse);
+        if (oldMap != oldMaterial->second.mapTypeToFilePath.end() &&
+            newMap != material.mapTypeToFilePath.end() && oldMap->second != newMap->second) {
+            changes.emplace_back(oldMap->second, newMap->second);
+        }
+    }
+    return changes;
+}
+
+struct UpdateStats {
+    size_t ranges = 0;
+    size_t bytes = 0;
+    // the buffer name changed, anything pointing at the old one (vao
+    // bindings, indirect binding) has to be pointed at the new one
+    bool reallocated = false;
+};
+
+// immutable storage can't grow, so the buffer is made bigger than it needs to
+// be and only replaced when an update doesn't fit
+class GpuBuffer {
+  public:
+    GpuBuffer() = default;
+    ~GpuBuffer() {
+        release();
+    }
+
+    GpuBuffer(const GpuBuffer&) = delete;
+    GpuBuffer& operator=(const GpuBuffer&) = delete;
+
+    template <typename T> void upload(const std::vector<T>& data) {
+        allocate(data.size() * sizeof(T), data.data());
+    }
+
+    template <typename T>
+    UpdateStats update(const std::vector<T>& before, const std::vector<T>& after,
+                       size_t mergeGap = 64) {
+        TRACE_SCOPE("buffer patch");
+        auto size = after.size() * sizeof(T);
+        if (size > capacity) {
+            allocate(size, after.data());
+            return {1, size, true};
+        }
+
+        UpdateStats stats;
+        for (const auto& range : changedRanges(before, after, mergeGap)) {
+            glNamedBufferSubData(bufferName, range.begin * sizeof(T), range.count * sizeof(T),
+                                 &after[range.begin]);
+            ++stats.ranges;
+            stats.bytes += range.count * sizeof(T);
+        }
+        return stats;
+    }
+
+    GLuint name() const {
+        return bufferName;
+    }
+
+  private:
+    void allocate(size_t size, const void* data) {
+        release();
+        // half again so a few more appends fit in place
+        capacity = std::max<size_t>(size + size / 2, 256);
+        glCreateBuffers(1, &bufferName);
+        glNamedBufferStorage(bufferName, capacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        if (size > 0) {
+            glNamedBufferSubData(bufferName, 0, size, data);
+        }
+    }
+
+    void release() {
+        if (bufferName) {
+            glDeleteBuffers(1, &bufferName);
+            bufferName = 0;
+            capacity = 0;
+        }
+    }
+
+    GLuint bufferName = 0;
+    size_t capacity = 0;
+};
+
+// a GL_TEXTURE_2D_ARRAY with one file per layer. every layer is the size of
+// the first file, others are resampled to fit
+class TextureLayers {
+  public:
+    explicit TextureLayers(std::vector<std::string> filePaths) : layerFiles(std::move(filePaths)) {
+        stbi_set_flip_vertically_on_load(true);
+        for (auto layer = 0u; layer < layerFiles.size(); ++layer) {
+            auto image = decode(layerFiles[layer]);
+            if (image.pixels.empty()) {
+                continue;
+            }
+            if (!textureName) {
+                width = image.width;
+                height = image.height;
+                glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &textureName);
+                glTextureStorage3D(textureName, mipLevels(), GL_RGB8, width, height,
+                                   static_cast<GLsizei>(layerFiles.size()));
+                glTextureParameteri(textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTextureParameteri(textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+            store(layer, image);
+        }
+        if (textureName) {
+            glGenerateTextureMipmap(textureName);
+        }
+    }
+
+    ~TextureLayers() {
+        if (textureName) {
+            glDeleteTextures(1, &textureName);
+        }
+    }
+
+    TextureLayers(const TextureLayers&) = delete;
+    TextureLayers& operator=(const TextureLayers&) = delete;
+
+    // -1 if no layer was loaded from filePath
+    int layerOf(const std::string& filePath) const {
+        auto it = std::find(layerFiles.begin(), layerFiles.end(), filePath);
+        return it == layerFiles.end() ? -1 : static_cast<int>(it - layerFiles.begin());
+    }
+
+    // decodes filePath into layer, leaving the others alone. the layer keeps
+    // its old contents if the file doesn't load
+    bool reloadLayer(int layer, const std::string& filePath) {
+        TRACE_SCOPE("texture layer reload");
+        if (!textureName || layer < 0 || layer >= static_cast<int>(layerFiles.size())) {
+            return false;
+        }
+        stbi_set_flip_vertically_on_load(true);
+        auto image = decode(filePath);
+        if (image.pixels.empty()) {
+            return false;
+        }
+        store(layer, image);
+        layerFiles[layer] = filePath;
+        // regenerates every layer's mips. gl has no per layer version, and it
+        // runs on the gpu so it's still far cheaper than the decode
+        glGenerateTextureMipmap(textureName);
+        return true;
+    }
+
+    GLuint name() const {
+        return textureName;
+    }
+
+    const std::vector<std::string>& files() const {
+        return layerFiles;
+    }
+
+  private:
+    struct Image {
+        std::vector<stbi_uc> pixels;
+        int width = 0;
+        int height = 0;
+    };
+
+    static Image decode(const std::string& filePath) {
+        TRACE_SCOPE("texture decode");
+        Image image;
+        int channels;
+        auto* pixels = stbi_load(filePath.c_str(), &image.width, &image.height, &channels, 3);
+        if (!pixels) {
+            fmt::print(stderr, "texture {} failed to load\n", filePath);
+            return image;
+        }
+        image.pixels.assign(pixels, pixels + size_t(image.width) * image.height * 3);
+        stbi_image_free(pixels);
+        return image;
+    }
+
+    GLsizei mipLevels() const {
+        GLsizei levels = 1;
+        for (auto size = std::max(width, height); size > 1; size /= 2) {
+            ++levels;
+        }
+        return levels;
+    }
+
+    void store(int layer, const Image& image) {
+        TRACE_SCOPE("texture upload");
+        const auto* pixels = image.pixels.data();
+        std::vector<stbi_uc> resampled;
+        if (image.width != width || image.height != height) {
+            fmt::print(stderr, "resampling {}x{} layer {} to {}x{}\n", image.width, image.height,
+                       layer, width, height);
+            resampled.resize(size_t(width) * height * 3);
+            for (auto y = 0; y < height; ++y) {
+                auto sourceRow = size_t(y) * image.height / height;
+                for (auto x = 0; x < width; ++x) {
+                    auto sourceX = size_t(x) * image.width / width;
+                    std::memcpy(&resampled[(size_t(y) * width + x) * 3],
+                                &image.pixels[(sourceRow * image.width + sourceX) * 3], 3);
+                }
+            }
+            pixels = resampled.data();
+        }
+        // rows of rgb8 aren't 4 byte aligned for odd widths
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage3D(textureName, 0, 0, 0, layer, width, height, 1, GL_RGB,
+                            GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    std::vector<std::string> layerFiles;
+    GLuint textureName = 0;
+    int width = 0;
+    int height = 0;
+};
+
+} // namespace hotReload
@@ -0,0 +1,126 @@
+#pragma once
+
+// draw one mesh many times with a single glMultiDrawElementsIndirect. every
+// group of the mesh gets a command with instanceCount copies, and the copies
+// read their model matrix out of a storage buffer with
+//
+//  mat4 model = instanceModels[gl_BaseInstance + gl_InstanceID];
+//
+// gl_InstanceID always starts at 0 for each command, so baseInstance is what
+// lets several meshes (or several batches of the same mesh) share one buffer
+// of transforms.
+
+#include "draw_indirect.hpp"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace gl;
+
+namespace instancing {
+
+// one command per group, all drawing the same range of instances
+template <typename Groups>
+std::vector<DrawElementsIndirectCommand>
+instancedDraws(const Groups& groups, uint32_t instanceCount, uint32_t baseInstance = 0) {
+    std::vector<DrawElementsIndirectCommand> draws;
+    draws.reserve(groups.size());
+    for (const auto& group : groups) {
+        if (group.count == 0) {
+            continue;
+        }
+        draws.push_back({group.count, instanceCount, group.startOffset, 0, baseInstance});
+    }
+    return draws;
+}
+
+// cheap integer hash so every instance gets its own rotation and scale
+// without dragging <random> in
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// lays count copies out on a square grid on the xz plane, centred on the
+// origin, spacing units apart, each spun around y and scaled a little
+inline std::vector<glm::mat4> gridTransforms(uint32_t count, float spacing, uint32_t seed = 1) {
+    std::vector<glm::mat4> transforms(count);
+    auto columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    float halfWidth = static_cast<float>(columns - 1) * spacing * 0.5f;
+
+    for (auto i = 0u; i < count; ++i) {
+        auto random = hash(i ^ (seed * 0x9e3779b9u));
+        float angle = static_cast<float>(random & 0xffff) / 65535.0f * 6.2831853f;
+        float scale = 0.8f + static_cast<float>(random >> 24) / 255.0f * 0.4f;
+
+        glm::vec3 position(static_cast<float>(i % columns) * spacing - halfWidth, 0.f,
+                           static_cast<float>(i / columns) * spacing - halfWidth);
+
+        auto transform = glm::translate(glm::mat4(1.0f), position);
+        transform = glm::rotate(transform, angle, glm::vec3(0.f, 1.f, 0.f));
+        transforms[i] = glm::scale(transform, glm::vec3(scale));
+    }
+    return transforms;
+}
+
+// owns the storage buffer the instances read their transforms from
+class InstanceBuffer {
+  public:
+    explicit InstanceBuffer(const std::vector<glm::mat4>& transforms)
+        : instanceCount(static_cast<uint32_t>(transforms.size())) {
+        glCreateBuffers(1, &bufferName);
+        // dynamic so the transforms can be rewritten with update()
+        glNamedBufferStorage(bufferName, transforms.size() * sizeof(glm::mat4), transforms.data(),
+                             GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    ~InstanceBuffer() {
+        if (bufferName) {
+            glDeleteBuffers(1, &bufferName);
+        }
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // overwrite transforms starting at firstInstance
+    void update(const std::vector<glm::mat4>& transforms, uint32_t firstInstance = 0) {
+        if (firstInstance + transforms.size() > instanceCount) {
+            fmt::print(stderr, "instance buffer holds {} transforms, tried to write {} at {}\n",
+                       instanceCount, transforms.size(), firstInstance);
+            return;
+        }
+        glNamedBufferSubData(bufferName, firstInstance * sizeof(glm::mat4),
+                             transforms.size() * sizeof(glm::mat4), transforms.data());
+    }
+
+    void bind(GLuint index) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, bufferName);
+    }
+
+    GLuint buffer() const {
+        return bufferName;
+    }
+
+    uint32_t size() const {
+        return instanceCount;
+    }
+
+  private:
+    GLuint bufferName = 0;
+    uint32_t instanceCount = 0;
+};
+
+} // namespace instancing
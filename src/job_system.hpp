@@ -0,0 +1,355 @@
+#pragma once
+
+// a small work stealing job system.
+//
+// every thread (the one that creates the system plus threadCount - 1 workers)
+// owns a fixed size deque of jobs. a thread pushes and pops its own jobs at the
+// bottom of its deque, and when it runs dry it steals from the top of someone
+// else's. push/pop/steal are the lock free chase-lev deque so there is no
+// global queue and no lock on the hot path. the only lock is the one idle
+// workers sleep on, and submitters only touch it when somebody is asleep.
+//
+//  jobs::JobSystem jobSystem;
+//  jobs::Counter counter;
+//  jobSystem.run(counter, [&] { decodeTexture(0); });
+//  jobSystem.run(counter, [&] { decodeTexture(1); });
+//  jobSystem.wait(counter); // runs jobs itself while it waits
+//
+//  jobSystem.parallelFor(objectCount, 1024, [&](size_t begin, size_t end) { ... });
+//
+// jobs should be submitted from threads belonging to the system. anything else
+// (a glfw callback thread, another system's worker) just runs the job inline.
+
+#include "trace.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+
+// tracks a batch of jobs. wait() on it until they have all finished
+class Counter {
+  public:
+    bool done() const {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+  private:
+    friend class JobSystem;
+    std::atomic<uint32_t> pending{0};
+};
+
+struct Job {
+    std::function<void()> work;
+    Counter* counter = nullptr;
+    // set while the job is queued or running so its slot isn't handed out again
+    std::atomic<bool> inUse{false};
+};
+
+// chase-lev work stealing deque of job pointers. only the owning thread may
+// push and pop, any thread may steal
+class WorkStealingQueue {
+  public:
+    static constexpr int64_t capacity = 4096;
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    bool push(Job* job) {
+        auto b = bottom.load(std::memory_order_relaxed);
+        auto t = top.load(std::memory_order_acquire);
+        if (b - t >= capacity) {
+            return false;
+        }
+        jobs[b & mask].store(job, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* pop() {
+        auto b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        Job* job = jobs[b & mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // last one left. race any thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal() {
+        auto t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return nullptr;
+        }
+        Job* job = jobs[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            // someone else got it
+            return nullptr;
+        }
+        return job;
+    }
+
+  private:
+    static constexpr int64_t mask = capacity - 1;
+
+    // top and bottom on their own cache lines, thieves hammer top
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Job*> jobs[capacity];
+};
+
+class JobSystem {
+  public:
+    // threadCount includes the calling thread. 0 means one per hardware thread
+    explicit JobSystem(unsigned threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (auto i = 0u; i < threadCount; ++i) {
+            threadStates.push_back(std::make_unique<ThreadState>());
+        }
+
+        // the creating thread is thread 0. it only runs jobs inside wait()
+        currentSystem() = this;
+        currentIndex() = 0;
+
+        for (auto i = 1u; i < threadCount; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running.store(false, std::memory_order_release);
+        }
+        sleepCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (currentSystem() == this) {
+            currentSystem() = nullptr;
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned threadCount() const {
+        return static_cast<unsigned>(threadStates.size());
+    }
+
+    // queue work on the calling thread's deque. counter is bumped now and
+    // dropped when the work has run
+    void run(Counter& counter, std::function<void()> work) {
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+        if (currentSystem() != this) {
+            work();
+            counter.pending.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        auto& state = *threadStates[currentIndex()];
+        Job* job = allocate(state);
+        if (!job) {
+            // every slot is still in flight. doing it now is always correct
+            work();
+            counter.pending.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        job->work = std::move(work);
+        job->counter = &counter;
+
+        if (!state.queue.push(job)) {
+            execute(job);
+            return;
+        }
+        wakeSleepers();
+    }
+
+    // helps out with queued jobs until everything on counter has finished
+    void wait(Counter& counter) {
+        if (currentSystem() != this) {
+            // jobs from outside ran inline so there is nothing to wait for
+            return;
+        }
+        auto index = currentIndex();
+        while (!counter.done()) {
+            if (Job* job = findJob(index)) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // splits [0, count) into chunks of at least grain items and calls
+    // func(begin, end) on each, returning when they have all run
+    template <typename Func> void parallelFor(size_t count, size_t grain, Func&& func) {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        // a few chunks per thread leaves room for stealing to even things out
+        auto chunkCount = std::min((count + grain - 1) / grain, size_t(threadCount()) * 4);
+        auto chunkSize = (count + chunkCount - 1) / chunkCount;
+
+        Counter counter;
+        for (size_t begin = 0; begin < count; begin += chunkSize) {
+            auto end = std::min(begin + chunkSize, count);
+            run(counter, [&func, begin, end] { func(begin, end); });
+        }
+        wait(counter);
+    }
+
+  private:
+    struct ThreadState {
+        WorkStealingQueue queue;
+        // ring of job slots. a slot is reused once its job has finished
+        std::vector<Job> jobPool = std::vector<Job>(WorkStealingQueue::capacity);
+        size_t nextJob = 0;
+        uint32_t stealSeed = 0;
+    };
+
+    // per thread: which system this thread belongs to and its slot in it
+    static JobSystem*& currentSystem() {
+        static thread_local JobSystem* system = nullptr;
+        return system;
+    }
+
+    static unsigned& currentIndex() {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    Job* allocate(ThreadState& state) {
+        for (auto attempt = 0; attempt < 8; ++attempt) {
+            Job& job = state.jobPool[state.nextJob++ % state.jobPool.size()];
+            if (!job.inUse.load(std::memory_order_acquire)) {
+                job.inUse.store(true, std::memory_order_relaxed);
+                return &job;
+            }
+        }
+        return nullptr;
+    }
+
+    void execute(Job* job) {
+        job->work();
+        job->work = nullptr;
+        auto counter = job->counter;
+        job->inUse.store(false, std::memory_order_release);
+        counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    Job* findJob(unsigned index) {
+        auto& state = *threadStates[index];
+        if (Job* job = state.queue.pop()) {
+            return job;
+        }
+        // start at a different victim each time so thieves spread out
+        auto count = threadCount();
+        state.stealSeed = state.stealSeed * 1664525u + 1013904223u;
+        auto start = state.stealSeed % count;
+        for (auto i = 0u; i < count; ++i) {
+            auto victim = (start + i) % count;
+            if (victim == index) {
+                continue;
+            }
+            if (Job* job = threadStates[victim]->queue.steal()) {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void wakeSleepers() {
+        // pairs with the fetch_add in workerLoop. either we see the sleeper or
+        // it sees our job
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) > 0) {
+            // take the lock so a worker can't miss the wake between checking
+            // for work and going to sleep
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            ++wakeGeneration;
+            sleepCondition.notify_all();
+        }
+    }
+
+    void workerLoop(unsigned index) {
+        currentSystem() = this;
+        currentIndex() = index;
+        threadStates[index]->stealSeed = index * 2654435761u;
+        tracer::setThreadName(fmt::format("job worker {}", index));
+
+        int idleSpins = 0;
+        while (running.load(std::memory_order_acquire)) {
+            if (Job* job = findJob(index)) {
+                execute(job);
+                idleSpins = 0;
+                continue;
+            }
+            // spin for a bit first, sleeping costs a lot more than a yield
+            if (++idleSpins < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            auto generation = wakeGeneration;
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            // a push could have landed after our last look but before the
+            // submitter saw us as sleeping, so look once more before dozing off
+            if (Job* job = findJob(index)) {
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+                lock.unlock();
+                execute(job);
+                idleSpins = 0;
+                continue;
+            }
+            // the timeout is only a backstop
+            sleepCondition.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                return generation != wakeGeneration || !running.load(std::memory_order_acquire);
+            });
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            idleSpins = 0;
+        }
+    }
+
+    std::vector<std::unique_ptr<ThreadState>> threadStates;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running{true};
+
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> sleeping{0};
+    uint64_t wakeGeneration = 0;
+};
+
+} // namespace jobs
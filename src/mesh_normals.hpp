@@ -0,0 +1,670 @@
+#pragma once
+
+// smooth normals and tangents for indexed meshes (MeshDataElements), split
+// into jobs so it keeps up with multi million triangle scans.
+//
+//  auto adjacency = meshNormals::buildAdjacency(jobSystem, meshData);
+//  meshNormals::generateNormals(jobSystem, meshData, adjacency, {});
+//  auto tangents = meshNormals::generateTangents(jobSystem, meshData, adjacency);
+//
+// the vertices of a MeshDataElements are already split wherever the uv or
+// normal changes, so the first step is welding them back together by
+// position. after that every position knows which corners (slots of the
+// index buffer) touch it, and each position can be worked on by one job
+// without any atomics:
+//  1. (jobs) each chunk of triangles counts the corners per position into
+//     its own array, only as wide as the range of positions it touches
+//  2. (jobs) the chunk counts are reduced into offsets, and each chunk's
+//     count turned into its own write cursor
+//  3. (jobs) each chunk scatters its corners into the adjacency list
+//  4. (jobs) each position adds up the weighted normals of its corners'
+//     faces, leaving out faces past the crease angle, and writes the result
+//     into the vertices it owns. corners that end up needing a different
+//     normal than their vertex get a new vertex, appended to the end
+//
+// tangents follow mikktspace: the per face tangent is projected onto the
+// plane of the vertex normal before being angle weighted and summed, and w
+// holds the handedness, so bitangent = w * cross(normal, tangent). a vertex
+// shared by faces of both handedness (mirrored uvs that weren't split in the
+// file) is split the same way creases are, so each half sums only its own
+// side. mikktspace also keeps apart faces that only meet at a vertex through
+// other groups, which isn't done here, so results can differ from it there.
+
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "trace.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace meshNormals {
+
+enum class Weighting {
+    // bigger faces pull harder. cheap, good on even meshes
+    Area,
+    // by the angle of the face at the corner, so how finely a flat area is
+    // tessellated doesn't change its pull
+    Angle,
+    AreaAngle
+};
+
+struct Settings {
+    Weighting weighting = Weighting::AreaAngle;
+    // faces meeting at more than this many degrees keep a hard edge between
+    // them. 180 smooths everything
+    float creaseAngle = 60.0f;
+};
+
+// which corners (slots in the index buffer) touch each welded position.
+// corners[offsets[p]] .. corners[offsets[p + 1]] for position p
+struct Adjacency {
+    // welded position of every vertex. the id is the lowest vertex index with
+    // that position, so ids keep the locality of the file and unused ids just
+    // have no corners
+    std::vector<uint32_t> positionIds;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+
+    uint32_t positionCount() const {
+        return static_cast<uint32_t>(offsets.size() - 1);
+    }
+};
+
+namespace detail {
+
+// sorts chunks as jobs then merges them pairwise, each round of merges also
+// as jobs
+template <typename Iterator, typename Less>
+void parallelSort(jobs::JobSystem& jobSystem, Iterator begin, Iterator end, Less less) {
+    auto count = static_cast<size_t>(end - begin);
+    auto chunkCount =
+        std::max<size_t>(1, std::min<size_t>(jobSystem.threadCount() * 4, count / 4096));
+    std::vector<size_t> bounds(chunkCount + 1);
+    for (auto i = 0u; i <= chunkCount; ++i) {
+        bounds[i] = count * i / chunkCount;
+    }
+
+    jobSystem.parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+        for (auto c = first; c < last; ++c) {
+            std::sort(begin + bounds[c], begin + bounds[c + 1], less);
+        }
+    });
+    for (size_t width = 1; width < chunkCount; width *= 2) {
+        auto pairs = (chunkCount + width * 2 - 1) / (width * 2);
+        jobSystem.parallelFor(pairs, 1, [&](size_t first, size_t last) {
+            for (auto p = first; p < last; ++p) {
+                auto left = p * width * 2;
+                auto middle = std::min(left + width, chunkCount);
+                auto right = std::min(left + width * 2, chunkCount);
+                std::inplace_merge(begin + bounds[left], begin + bounds[middle],
+                                   begin + bounds[right], less);
+            }
+        });
+    }
+}
+
+inline float cornerAngle(const glm::vec3& corner, const glm::vec3& a, const glm::vec3& b) {
+    auto edge0 = a - corner;
+    auto edge1 = b - corner;
+    auto lengths = glm::length(edge0) * glm::length(edge1);
+    if (lengths <= 0.f) {
+        return 0.f;
+    }
+    return std::acos(std::clamp(glm::dot(edge0, edge1) / lengths, -1.f, 1.f));
+}
+
+// any unit vector at right angles to n
+inline glm::vec3 perpendicular(const glm::vec3& n) {
+    auto axis = std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+    auto result = glm::cross(n, axis);
+    auto length = glm::length(result);
+    // a zero normal, nothing to be perpendicular to
+    return length > 0.f ? result / length : glm::vec3(1.f, 0.f, 0.f);
+}
+
+// exclusive prefix sum of values into offsets (one longer than values)
+inline void prefixSum(const std::vector<uint32_t>& values, std::vector<uint32_t>& offsets) {
+    offsets.resize(values.size() + 1);
+    offsets[0] = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        offsets[i + 1] = offsets[i] + values[i];
+    }
+}
+
+// triangles per chunk for the passes that keep per chunk state
+inline size_t chunkCountFor(jobs::JobSystem& jobSystem, size_t triangleCount) {
+    return std::max<size_t>(1, std::min<size_t>(jobSystem.threadCount(), triangleCount / 16384));
+}
+
+} // namespace detail
+
+// welded position ids, see Adjacency::positionIds. positions with a nan or
+// inf in them (a malformed file) aren't welded, each one is its own id. nan
+// would break the sort's ordering and never compare equal to itself
+inline std::vector<uint32_t> weldPositions(jobs::JobSystem& jobSystem,
+                                           const std::vector<vertex3D>& vertices) {
+    TRACE_SCOPE("weld positions");
+    std::vector<uint32_t> positionIds(vertices.size());
+    std::vector<uint32_t> order;
+    order.reserve(vertices.size());
+    for (uint32_t i = 0; i < static_cast<uint32_t>(vertices.size()); ++i) {
+        const auto& position = vertices[i].position;
+        if (std::isfinite(position.x) && std::isfinite(position.y) && std::isfinite(position.z)) {
+            order.push_back(i);
+        } else {
+            positionIds[i] = i;
+        }
+    }
+
+    detail::parallelSort(jobSystem, order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const auto& pa = vertices[a].position;
+        const auto& pb = vertices[b].position;
+        if (pa.x != pb.x) {
+            return pa.x < pb.x;
+        }
+        if (pa.y != pb.y) {
+            return pa.y < pb.y;
+        }
+        if (pa.z != pb.z) {
+            return pa.z < pb.z;
+        }
+        // lowest index first so it becomes the id
+        return a < b;
+    });
+
+    for (size_t i = 0; i < order.size();) {
+        auto id = order[i];
+        positionIds[id] = id;
+        auto j = i + 1;
+        while (j < order.size() && vertices[order[j]].position == vertices[id].position) {
+            positionIds[order[j++]] = id;
+        }
+        i = j;
+    }
+    return positionIds;
+}
+
+inline Adjacency buildAdjacency(jobs::JobSystem& jobSystem,
+                                const objLoader::MeshDataElements& meshData) {
+    TRACE_SCOPE("build adjacency");
+    Adjacency adjacency;
+    adjacency.positionIds = weldPositions(jobSystem, meshData.vertices);
+    const auto& positionIds = adjacency.positionIds;
+    const auto& indices = meshData.indices;
+    const auto cornerCount = indices.size();
+    const auto positionCount = meshData.vertices.size();
+
+    // per chunk counts, covering only ids [first, first + counts.size())
+    struct ChunkCounts {
+        uint32_t first = 0;
+        std::vector<uint32_t> counts;
+    };
+    auto chunkCount = detail::chunkCountFor(jobSystem, cornerCount / 3);
+    std::vector<ChunkCounts> chunks(chunkCount);
+    auto chunkBegin = [&](size_t c) { return cornerCount * c / chunkCount; };
+
+    {
+        TRACE_SCOPE("count corners");
+        jobSystem.parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+            for (auto c = first; c < last; ++c) {
+                auto begin = chunkBegin(c);
+                auto end = chunkBegin(c + 1);
+                if (begin == end) {
+                    continue;
+                }
+                uint32_t low = UINT32_MAX;
+                uint32_t high = 0;
+                for (auto i = begin; i < end; ++i) {
+                    auto id = positionIds[indices[i]];
+                    low = std::min(low, id);
+                    high = std::max(high, id);
+                }
+                auto& chunk = chunks[c];
+                chunk.first = low;
+                chunk.counts.assign(high - low + 1, 0);
+                for (auto i = begin; i < end; ++i) {
+                    ++chunk.counts[positionIds[indices[i]] - low];
+                }
+            }
+        });
+    }
+
+    {
+        TRACE_SCOPE("reduce counts");
+        std::vector<uint32_t> totals(positionCount, 0);
+        constexpr size_t idsPerJob = 65536;
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            for (const auto& chunk : chunks) {
+                auto begin = std::max<size_t>(first, chunk.first);
+                auto end = std::min<size_t>(last, chunk.first + chunk.counts.size());
+                for (auto id = begin; id < end; ++id) {
+                    totals[id] += chunk.counts[id - chunk.first];
+                }
+            }
+        });
+        detail::prefixSum(totals, adjacency.offsets);
+
+        // counts become each chunk's write cursor. chunks are walked in order
+        // so corners stay sorted within a position
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            for (auto id = first; id < last; ++id) {
+                totals[id] = adjacency.offsets[id];
+            }
+            for (auto& chunk : chunks) {
+                auto begin = std::max<size_t>(first, chunk.first);
+                auto end = std::min<size_t>(last, chunk.first + chunk.counts.size());
+                for (auto id = begin; id < end; ++id) {
+                    auto& slot = chunk.counts[id - chunk.first];
+                    auto count = slot;
+                    slot = totals[id];
+                    totals[id] += count;
+                }
+            }
+        });
+    }
+
+    {
+        TRACE_SCOPE("scatter corners");
+        adjacency.corners.resize(cornerCount);
+        jobSystem.parallelFor(chunkCount, 1, [&](size_t first, size_t last) {
+            for (auto c = first; c < last; ++c) {
+                auto& chunk = chunks[c];
+                for (auto i = chunkBegin(c); i < chunkBegin(c + 1); ++i) {
+                    auto& cursor = chunk.counts[positionIds[indices[i]] - chunk.first];
+                    adjacency.corners[cursor++] = static_cast<uint32_t>(i);
+                }
+            }
+        });
+    }
+    return adjacency;
+}
+
+namespace detail {
+
+struct FaceData {
+    // unit face normals, one per triangle
+    std::vector<glm::vec3> normals;
+    // how much each corner's face counts towards its position's normal
+    std::vector<float> weights;
+};
+
+inline FaceData faceData(jobs::JobSystem& jobSystem, const objLoader::MeshDataElements& meshData,
+                         Weighting weighting) {
+    TRACE_SCOPE("face normals");
+    FaceData faces;
+    auto triangleCount = meshData.indices.size() / 3;
+    faces.normals.resize(triangleCount);
+    faces.weights.resize(triangleCount * 3);
+
+    jobSystem.parallelFor(triangleCount, 4096, [&](size_t first, size_t last) {
+        for (auto t = first; t < last; ++t) {
+            const glm::vec3* p[3];
+            for (auto k = 0; k < 3; ++k) {
+                p[k] = &meshData.vertices[meshData.indices[t * 3 + k]].position;
+            }
+            auto normal = glm::cross(*p[1] - *p[0], *p[2] - *p[0]);
+            // twice the area
+            auto area = glm::length(normal);
+            faces.normals[t] = area > 0.f ? normal / area : glm::vec3(0.f);
+
+            for (auto k = 0; k < 3; ++k) {
+                float weight = area;
+                if (weighting != Weighting::Area) {
+                    auto angle = cornerAngle(*p[k], *p[(k + 1) % 3], *p[(k + 2) % 3]);
+                    weight = weighting == Weighting::Angle ? angle : angle * area;
+                }
+                faces.weights[t * 3 + k] = area > 0.f ? weight : 0.f;
+            }
+        }
+    });
+    return faces;
+}
+
+// a normal handed out to the corners of one vertex. extraSlot 0 means it went
+// on the vertex itself, n on the nth extra vertex of the position
+struct VertexNormal {
+    int vertex;
+    glm::vec3 normal;
+    uint32_t extraSlot;
+};
+
+// works out the normal of every corner touching position id and calls
+// emit(corner, vertexNormal, firstUse) for each. a vertex whose corners end
+// up with different normals (because of a crease) needs extra vertices
+template <typename Emit>
+void resolvePosition(uint32_t id, const Adjacency& adjacency,
+                     const objLoader::MeshDataElements& meshData, const FaceData& faces,
+                     float cosCrease, std::vector<VertexNormal>& seen, Emit&& emit) {
+    const auto* begin = adjacency.corners.data() + adjacency.offsets[id];
+    const auto* end = adjacency.corners.data() + adjacency.offsets[id + 1];
+    if (begin == end) {
+        return;
+    }
+
+    auto normalise = [](const glm::vec3& sum, const glm::vec3& fallback) {
+        auto length = glm::length(sum);
+        return length > 0.f ? sum / length : fallback;
+    };
+
+    // no creases, one sum for everybody
+    glm::vec3 smooth(0.f);
+    if (cosCrease <= -1.f) {
+        for (auto* c = begin; c != end; ++c) {
+            smooth += faces.normals[*c / 3] * faces.weights[*c];
+        }
+        smooth = normalise(smooth, glm::vec3(0.f, 1.f, 0.f));
+    }
+
+    seen.clear();
+    uint32_t extraSlots = 0;
+    for (auto* c = begin; c != end; ++c) {
+        auto vertex = meshData.indices[*c];
+        glm::vec3 normal = smooth;
+        if (cosCrease > -1.f) {
+            // only the faces within the crease angle of this one
+            const auto& faceNormal = faces.normals[*c / 3];
+            glm::vec3 sum(0.f);
+            for (auto* other = begin; other != end; ++other) {
+                const auto& otherNormal = faces.normals[*other / 3];
+                if (glm::dot(faceNormal, otherNormal) >= cosCrease) {
+                    sum += otherNormal * faces.weights[*other];
+                }
+            }
+            normal = normalise(sum, faceNormal);
+        }
+
+        // the same vertex with (near enough) the same normal shares it
+        const VertexNormal* match = nullptr;
+        bool vertexSeen = false;
+        for (const auto& entry : seen) {
+            if (entry.vertex != vertex) {
+                continue;
+            }
+            vertexSeen = true;
+            if (glm::dot(entry.normal, normal) > 0.9999f) {
+                match = &entry;
+                break;
+            }
+        }
+        if (match) {
+            emit(*c, *match, false);
+        } else {
+            seen.push_back({vertex, normal, vertexSeen ? ++extraSlots : 0u});
+            emit(*c, seen.back(), true);
+        }
+    }
+}
+
+// a vertex and the handedness its corners were given, extraSlot as for
+// VertexNormal
+struct VertexHandedness {
+    int vertex;
+    float handedness;
+    uint32_t extraSlot;
+};
+
+// works out which handedness every corner touching position id belongs to
+// and calls emit(corner, vertexHandedness, firstUse). the first handedness a
+// vertex sees keeps the vertex, the other one needs an extra vertex. faces
+// with no usable tangent contribute nothing, so they never cause a split
+template <typename Emit>
+void resolveHandedness(uint32_t id, const Adjacency& adjacency, const std::vector<int>& indices,
+                       const std::vector<glm::vec4>& faceTangents,
+                       std::vector<VertexHandedness>& seen, Emit&& emit) {
+    seen.clear();
+    uint32_t extraSlots = 0;
+    for (auto i = adjacency.offsets[id]; i < adjacency.offsets[id + 1]; ++i) {
+        auto corner = adjacency.corners[i];
+        const auto& faceTangent = faceTangents[corner / 3];
+        if (glm::vec3(faceTangent) == glm::vec3(0.f)) {
+            continue;
+        }
+        auto vertex = indices[corner];
+
+        const VertexHandedness* match = nullptr;
+        bool vertexSeen = false;
+        for (const auto& entry : seen) {
+            if (entry.vertex != vertex) {
+                continue;
+            }
+            vertexSeen = true;
+            if (entry.handedness == faceTangent.w) {
+                match = &entry;
+                break;
+            }
+        }
+        if (match) {
+            emit(corner, *match, false);
+        } else {
+            seen.push_back({vertex, faceTangent.w, vertexSeen ? ++extraSlots : 0u});
+            emit(corner, seen.back(), true);
+        }
+    }
+}
+
+} // namespace detail
+
+// replaces the normals of meshData. returns how many vertices were added
+// where a crease split a vertex's corners. new vertices go on the end so the
+// group ranges of the indices stay valid, and adjacency is kept up to date
+inline uint32_t generateNormals(jobs::JobSystem& jobSystem, objLoader::MeshDataElements& meshData,
+                                Adjacency& adjacency, const Settings& settings = {}) {
+    TRACE_SCOPE("generate normals");
+    auto faces = detail::faceData(jobSystem, meshData, settings.weighting);
+    float cosCrease = settings.creaseAngle >= 180.f
+                          ? -1.f
+                          : std::cos(glm::radians(std::max(settings.creaseAngle, 0.f)));
+
+    const auto positionCount = adjacency.positionCount();
+    const auto vertexCount = static_cast<uint32_t>(meshData.vertices.size());
+    std::vector<uint32_t> extraCounts(positionCount, 0);
+    constexpr size_t idsPerJob = 4096;
+
+    {
+        TRACE_SCOPE("resolve normals");
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            std::vector<detail::VertexNormal> seen;
+            for (auto id = first; id < last; ++id) {
+                detail::resolvePosition(
+                    static_cast<uint32_t>(id), adjacency, meshData, faces, cosCrease, seen,
+                    [&](uint32_t, const detail::VertexNormal& entry, bool firstUse) {
+                        if (!firstUse) {
+                            return;
+                        }
+                        if (entry.extraSlot == 0) {
+                            meshData.vertices[entry.vertex].normal = entry.normal;
+                        } else {
+                            extraCounts[id] = std::max(extraCounts[id], entry.extraSlot);
+                        }
+                    });
+            }
+        });
+    }
+
+    std::vector<uint32_t> extraOffsets;
+    detail::prefixSum(extraCounts, extraOffsets);
+    auto extraTotal = extraOffsets.back();
+    if (extraTotal == 0) {
+        return 0;
+    }
+
+    {
+        // second pass only over the positions that split. redoing their sums
+        // is cheaper than keeping every corner's normal around
+        TRACE_SCOPE("split creases");
+        meshData.vertices.resize(vertexCount + extraTotal);
+        adjacency.positionIds.resize(vertexCount + extraTotal);
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            std::vector<detail::VertexNormal> seen;
+            for (auto id = first; id < last; ++id) {
+                if (extraCounts[id] == 0) {
+                    continue;
+                }
+                detail::resolvePosition(
+                    static_cast<uint32_t>(id), adjacency, meshData, faces, cosCrease, seen,
+                    [&](uint32_t corner, const detail::VertexNormal& entry, bool firstUse) {
+                        if (entry.extraSlot == 0) {
+                            return;
+                        }
+                        auto newVertex = vertexCount + extraOffsets[id] + entry.extraSlot - 1;
+                        if (firstUse) {
+                            meshData.vertices[newVertex] = meshData.vertices[entry.vertex];
+                            meshData.vertices[newVertex].normal = entry.normal;
+                            adjacency.positionIds[newVertex] = static_cast<uint32_t>(id);
+                        }
+                        meshData.indices[corner] = static_cast<int>(newVertex);
+                    });
+            }
+        });
+    }
+    return extraTotal;
+}
+
+// one tangent per vertex, xyz the tangent and w the handedness. uses the
+// normals already in meshData, so run generateNormals first if they need it.
+// vertices whose faces disagree on handedness are split, the new ones going
+// on the end like generateNormals' (so the returned vector can be longer
+// than the vertex count was), and adjacency is kept up to date
+inline std::vector<glm::vec4> generateTangents(jobs::JobSystem& jobSystem,
+                                               objLoader::MeshDataElements& meshData,
+                                               Adjacency& adjacency) {
+    TRACE_SCOPE("generate tangents");
+    auto triangleCount = meshData.indices.size() / 3;
+    const auto positionCount = adjacency.positionCount();
+    const auto vertexCount = static_cast<uint32_t>(meshData.vertices.size());
+    constexpr size_t idsPerJob = 4096;
+
+    // unit tangent along +u per face, w is +1 if the uvs keep the winding
+    std::vector<glm::vec4> faceTangents(triangleCount);
+    jobSystem.parallelFor(triangleCount, 4096, [&](size_t first, size_t last) {
+        const auto& vertices = meshData.vertices;
+        const auto& indices = meshData.indices;
+        for (auto t = first; t < last; ++t) {
+            const auto& v0 = vertices[indices[t * 3]];
+            const auto& v1 = vertices[indices[t * 3 + 1]];
+            const auto& v2 = vertices[indices[t * 3 + 2]];
+            auto edge1 = v1.position - v0.position;
+            auto edge2 = v2.position - v0.position;
+            auto uv1 = v1.texCoord - v0.texCoord;
+            auto uv2 = v2.texCoord - v0.texCoord;
+
+            float signedUvArea = uv1.x * uv2.y - uv1.y * uv2.x;
+            float orientation = signedUvArea > 0.f ? 1.f : -1.f;
+            auto tangent = (edge1 * uv2.y - edge2 * uv1.y) * orientation;
+            auto length = glm::length(tangent);
+            // no uvs or a degenerate mapping. contributes nothing
+            faceTangents[t] = signedUvArea != 0.f && length > 0.f
+                                  ? glm::vec4(tangent / length, orientation)
+                                  : glm::vec4(0.f, 0.f, 0.f, orientation);
+        }
+    });
+
+    // split the vertices that see both handedness, counting first so the
+    // new vertices can go straight into their final slots
+    std::vector<uint32_t> extraCounts(positionCount, 0);
+    {
+        TRACE_SCOPE("resolve handedness");
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            std::vector<detail::VertexHandedness> seen;
+            for (auto id = first; id < last; ++id) {
+                detail::resolveHandedness(
+                    static_cast<uint32_t>(id), adjacency, meshData.indices, faceTangents, seen,
+                    [&](uint32_t, const detail::VertexHandedness& entry, bool firstUse) {
+                        if (firstUse && entry.extraSlot != 0) {
+                            extraCounts[id] = std::max(extraCounts[id], entry.extraSlot);
+                        }
+                    });
+            }
+        });
+    }
+
+    std::vector<uint32_t> extraOffsets;
+    detail::prefixSum(extraCounts, extraOffsets);
+    if (auto extraTotal = extraOffsets.back(); extraTotal != 0) {
+        TRACE_SCOPE("split handedness");
+        meshData.vertices.resize(vertexCount + extraTotal);
+        adjacency.positionIds.resize(vertexCount + extraTotal);
+        jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+            std::vector<detail::VertexHandedness> seen;
+            for (auto id = first; id < last; ++id) {
+                if (extraCounts[id] == 0) {
+                    continue;
+                }
+                detail::resolveHandedness(
+                    static_cast<uint32_t>(id), adjacency, meshData.indices, faceTangents, seen,
+                    [&](uint32_t corner, const detail::VertexHandedness& entry, bool firstUse) {
+                        if (entry.extraSlot == 0) {
+                            return;
+                        }
+                        auto newVertex = vertexCount + extraOffsets[id] + entry.extraSlot - 1;
+                        if (firstUse) {
+                            meshData.vertices[newVertex] = meshData.vertices[entry.vertex];
+                            adjacency.positionIds[newVertex] = static_cast<uint32_t>(id);
+                        }
+                        meshData.indices[corner] = static_cast<int>(newVertex);
+                    });
+            }
+        });
+    }
+
+    const auto& vertices = meshData.vertices;
+    const auto& indices = meshData.indices;
+
+    // a vertex's corners all belong to its position, so whoever has the
+    // position owns the sums
+    std::vector<glm::vec4> tangents(vertices.size(), glm::vec4(0.f));
+    jobSystem.parallelFor(positionCount, idsPerJob, [&](size_t first, size_t last) {
+        for (auto id = first; id < last; ++id) {
+            for (auto i = adjacency.offsets[id]; i < adjacency.offsets[id + 1]; ++i) {
+                auto corner = adjacency.corners[i];
+                auto triangle = corner / 3;
+                auto vertex = indices[corner];
+                const auto& normal = vertices[vertex].normal;
+                const auto& faceTangent = faceTangents[triangle];
+
+                auto project = [&](const glm::vec3& v) { return v - normal * glm::dot(normal, v); };
+                auto tangent = project(glm::vec3(faceTangent));
+                auto length = glm::length(tangent);
+                if (length <= 0.f) {
+                    continue;
+                }
+
+                // angle at the corner, measured in the tangent plane
+                const auto& position = vertices[vertex].position;
+                auto next = vertices[indices[triangle * 3 + (corner + 1) % 3]].position;
+                auto previous = vertices[indices[triangle * 3 + (corner + 2) % 3]].position;
+                float angle = detail::cornerAngle(glm::vec3(0.f), project(next - position),
+                                                  project(previous - position));
+
+                tangents[vertex] += glm::vec4(tangent / length * angle, faceTangent.w * angle);
+            }
+        }
+    });
+
+    jobSystem.parallelFor(vertices.size(), 16384, [&](size_t first, size_t last) {
+        for (auto v = first; v < last; ++v) {
+            const auto& normal = vertices[v].normal;
+            auto tangent = glm::vec3(tangents[v]);
+            tangent -= normal * glm::dot(normal, tangent);
+            auto length = glm::length(tangent);
+            tangent = length > 0.f ? tangent / length : detail::perpendicular(normal);
+            tangents[v] = glm::vec4(tangent, tangents[v].w < 0.f ? -1.f : 1.f);
+        }
+    });
+    return tangents;
+}
+
+// everything in one go for a freshly loaded mesh
+inline std::vector<glm::vec4> generateNormalsAndTangents(jobs::JobSystem& jobSystem,
+                                                         objLoader::MeshDataElements& meshData,
+                                                         const Settings& settings = {}) {
+    auto adjacency = buildAdjacency(jobSystem, meshData);
+    generateNormals(jobSystem, meshData, adjacency, settings);
+    return generateTangents(jobSystem, meshData, adjacency);
+}
+
+} // namespace meshNormals
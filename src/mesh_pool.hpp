@@ -0,0 +1,392 @@
+#pragma once
+
+// one place for every mesh's vertices and indices. instead of a vertex buffer,
+// an element buffer and a vao per mesh (thousands of buffer objects for a big
+// scene), the pool makes a few big immutable buffers up front and hands each
+// mesh a range of them. a mesh is then just a baseVertex and a firstIndex, so
+// every mesh in a page can go in one indirect buffer and one multi draw, and
+// adding or removing a mesh is a glNamedBufferSubData and some bookkeeping
+// rather than creating and deleting buffers.
+//
+// the ranges come from a first fit free list per buffer. freed ranges merge
+// with their neighbours, so load/unload churn doesn't leave the buffers in
+// crumbs. a mesh that fits in no page gets a new page (at least the default
+// size), and each page has its own vao, so draw per page:
+//
+//  meshPool::MeshPool pool;
+//  auto id = pool.add(meshData);
+//  pool.appendCommands(id, baseInstance, commands);
+//  pool.bindPage(pool.slot(id).page);
+//  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commandCount, 0);
+//  ...
+//  pool.remove(id);
+//
+// the vao has position, normal and texCoord at locations 0, 1 and 2. each
+// page also keeps a second copy of just the positions, tightly packed, with a
+// vao of its own for depth only passes. that costs 12 more bytes a vertex but
+// a depth pass then fetches 12 bytes a vertex instead of pulling in 32 byte
+// vertices to use 12 of them.
+
+#include "draw_indirect.hpp"
+#include "obj_loader.hpp"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+using namespace gl;
+
+namespace meshPool {
+
+// hands out ranges of [0, capacity). counts are in elements, not bytes
+class FreeList {
+  public:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    explicit FreeList(uint32_t capacity) : capacity(capacity) {
+        if (capacity) {
+            ranges.push_back({0, capacity});
+        }
+    }
+
+    // the offset of count free elements, or none
+    uint32_t allocate(uint32_t count) {
+        if (count == 0) {
+            return 0;
+        }
+        for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+            if (it->count < count) {
+                continue;
+            }
+            auto offset = it->offset;
+            it->offset += count;
+            it->count -= count;
+            if (it->count == 0) {
+                ranges.erase(it);
+            }
+            return offset;
+        }
+        return none;
+    }
+
+    void release(uint32_t offset, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+        // ranges stay sorted by offset so neighbours are next to each other
+        auto next = std::lower_bound(
+            ranges.begin(), ranges.end(), offset,
+            [](const Range& range, uint32_t value) { return range.offset < value; });
+        bool joinsPrevious = next != ranges.begin() &&
+                             std::prev(next)->offset + std::prev(next)->count == offset;
+        bool joinsNext = next != ranges.end() && offset + count == next->offset;
+
+        if (joinsPrevious && joinsNext) {
+            std::prev(next)->count += count + next->count;
+            ranges.erase(next);
+        } else if (joinsPrevious) {
+            std::prev(next)->count += count;
+        } else if (joinsNext) {
+            next->offset = offset;
+            next->count += count;
+        } else {
+            ranges.insert(next, {offset, count});
+        }
+    }
+
+    uint32_t freeCount() const {
+        uint32_t total = 0;
+        for (const auto& range : ranges) {
+            total += range.count;
+        }
+        return total;
+    }
+
+    uint32_t size() const {
+        return capacity;
+    }
+
+    // how many pieces the free space is in. 1 means no fragmentation
+    size_t freeRanges() const {
+        return ranges.size();
+    }
+
+  private:
+    struct Range {
+        uint32_t offset;
+        uint32_t count;
+    };
+    std::vector<Range> ranges;
+    uint32_t capacity = 0;
+};
+
+struct PoolSettings {
+    // 32MB of vertices and 16MB of indices per page
+    uint32_t verticesPerPage = 1u << 20;
+    uint32_t indicesPerPage = 4u << 20;
+};
+
+// where a mesh lives. baseVertex and firstIndex go straight into a command
+struct MeshSlot {
+    uint32_t page = 0;
+    int32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // relative to firstIndex, from the mesh's groupInfos
+    std::vector<objLoader::groupInfo> groups;
+    bool live = false;
+};
+
+using MeshId = uint32_t;
+
+class MeshPool {
+  public:
+    explicit MeshPool(const PoolSettings& settings = {}) : settings(settings) {}
+
+    ~MeshPool() {
+        for (auto& page : pages) {
+            glDeleteVertexArrays(1, &page->vao);
+            glDeleteVertexArrays(1, &page->positionVao);
+            glDeleteBuffers(1, &page->vertexBuffer);
+            glDeleteBuffers(1, &page->positionBuffer);
+            glDeleteBuffers(1, &page->indexBuffer);
+        }
+    }
+
+    MeshPool(const MeshPool&) = delete;
+    MeshPool& operator=(const MeshPool&) = delete;
+
+    MeshId add(const objLoader::MeshDataElements& meshData) {
+        return add(meshData.vertices, meshData.indices, meshData.groupInfos);
+    }
+
+    MeshId add(const std::vector<vertex3D>& vertices, const std::vector<int>& indices,
+               const std::vector<objLoader::groupInfo>& groups = {}) {
+        auto vertexCount = static_cast<uint32_t>(vertices.size());
+        auto indexCount = static_cast<uint32_t>(indices.size());
+
+        MeshSlot slot;
+        uint32_t vertexOffset = FreeList::none;
+        uint32_t indexOffset = FreeList::none;
+        for (auto p = 0u; p < pages.size() && indexOffset == FreeList::none; ++p) {
+            vertexOffset = pages[p]->vertices.allocate(vertexCount);
+            if (vertexOffset == FreeList::none) {
+                continue;
+            }
+            indexOffset = pages[p]->indices.allocate(indexCount);
+            if (indexOffset == FreeList::none) {
+                pages[p]->vertices.release(vertexOffset, vertexCount);
+                vertexOffset = FreeList::none;
+                continue;
+            }
+            slot.page = p;
+        }
+        if (indexOffset == FreeList::none) {
+            slot.page = addPage(std::max(vertexCount, settings.verticesPerPage),
+                                std::max(indexCount, settings.indicesPerPage));
+            vertexOffset = pages[slot.page]->vertices.allocate(vertexCount);
+            indexOffset = pages[slot.page]->indices.allocate(indexCount);
+        }
+
+        const auto& page = *pages[slot.page];
+        static_assert(sizeof(int) == sizeof(GLuint), "indices are uploaded as they are");
+        if (vertexCount) {
+            glNamedBufferSubData(page.vertexBuffer, size_t(vertexOffset) * sizeof(vertex3D),
+                                 vertices.size() * sizeof(vertex3D), vertices.data());
+
+            std::vector<glm::vec3> positions(vertices.size());
+            std::transform(vertices.begin(), vertices.end(), positions.begin(),
+                           [](const vertex3D& vertex) { return vertex.position; });
+            glNamedBufferSubData(page.positionBuffer, size_t(vertexOffset) * sizeof(glm::vec3),
+                                 positions.size() * sizeof(glm::vec3), positions.data());
+        }
+        if (indexCount) {
+            glNamedBufferSubData(page.indexBuffer, size_t(indexOffset) * sizeof(GLuint),
+                                 indices.size() * sizeof(GLuint), indices.data());
+        }
+
+        slot.baseVertex = static_cast<int32_t>(vertexOffset);
+        slot.vertexCount = vertexCount;
+        slot.firstIndex = indexOffset;
+        slot.indexCount = indexCount;
+        slot.groups = groups;
+        slot.live = true;
+
+        // reuse the id of a removed mesh if there is one
+        auto free = std::find_if(slots.begin(), slots.end(),
+                                 [](const MeshSlot& s) { return !s.live; });
+        if (free != slots.end()) {
+            *free = std::move(slot);
+            return static_cast<MeshId>(free - slots.begin());
+        }
+        slots.push_back(std::move(slot));
+        return static_cast<MeshId>(slots.size() - 1);
+    }
+
+    // the ranges go back to the free lists. draws already recorded for this
+    // mesh must not be used after this
+    void remove(MeshId id) {
+        auto& slot = slots[id];
+        if (!slot.live) {
+            return;
+        }
+        auto& page = *pages[slot.page];
+        page.vertices.release(static_cast<uint32_t>(slot.baseVertex), slot.vertexCount);
+        page.indices.release(slot.firstIndex, slot.indexCount);
+        slot = MeshSlot{};
+    }
+
+    const MeshSlot& slot(MeshId id) const {
+        return slots[id];
+    }
+
+    // the whole mesh as one draw
+    DrawElementsIndirectCommand command(MeshId id, uint32_t baseInstance,
+                                        uint32_t instanceCount = 1) const {
+        const auto& meshSlot = slots[id];
+        return {meshSlot.indexCount, instanceCount, meshSlot.firstIndex, meshSlot.baseVertex,
+                baseInstance};
+    }
+
+    // a draw per group (or one for the whole mesh if it has none), with
+    // baseInstance counting up from firstBaseInstance. returns how many
+    size_t appendCommands(MeshId id, uint32_t firstBaseInstance,
+                          std::vector<DrawElementsIndirectCommand>& commands) const {
+        const auto& meshSlot = slots[id];
+        if (meshSlot.groups.empty()) {
+            commands.push_back(command(id, firstBaseInstance));
+            return 1;
+        }
+        for (auto g = 0u; g < meshSlot.groups.size(); ++g) {
+            const auto& group = meshSlot.groups[g];
+            commands.push_back({group.count, 1, meshSlot.firstIndex + group.startOffset,
+                                meshSlot.baseVertex, firstBaseInstance + g});
+        }
+        return meshSlot.groups.size();
+    }
+
+    void bindPage(uint32_t page) const {
+        glBindVertexArray(pages[page]->vao);
+    }
+
+    GLuint vao(uint32_t page) const {
+        return pages[page]->vao;
+    }
+
+    // positions only, from the tightly packed copy. same baseVertex and
+    // firstIndex as the full vao, so the same commands work with either
+    GLuint positionVao(uint32_t page) const {
+        return pages[page]->positionVao;
+    }
+
+    size_t pageCount() const {
+        return pages.size();
+    }
+
+    // what was allocated on the gpu, whether it's in use or not
+    size_t bytes() const {
+        size_t total = 0;
+        for (const auto& page : pages) {
+            total += size_t(page->vertices.size()) * bytesPerVertex +
+                     size_t(page->indices.size()) * sizeof(GLuint);
+        }
+        return total;
+    }
+
+    // of that, what meshes are using
+    size_t usedBytes() const {
+        size_t total = 0;
+        for (const auto& page : pages) {
+            total += size_t(page->vertices.size() - page->vertices.freeCount()) * bytesPerVertex +
+                     size_t(page->indices.size() - page->indices.freeCount()) * sizeof(GLuint);
+        }
+        return total;
+    }
+
+  private:
+    // the full vertex plus its position again in the position only buffer
+    static constexpr size_t bytesPerVertex = sizeof(vertex3D) + sizeof(glm::vec3);
+
+    struct Page {
+        Page(uint32_t vertexCapacity, uint32_t indexCapacity)
+            : vertices(vertexCapacity), indices(indexCapacity) {}
+
+        GLuint vertexBuffer = 0;
+        GLuint positionBuffer = 0;
+        GLuint indexBuffer = 0;
+        GLuint vao = 0;
+        GLuint positionVao = 0;
+        FreeList vertices;
+        FreeList indices;
+    };
+
+    uint32_t addPage(uint32_t vertexCapacity, uint32_t indexCapacity) {
+        auto page = std::make_unique<Page>(vertexCapacity, indexCapacity);
+
+        // immutable storage, written with glNamedBufferSubData as meshes come
+        // and go
+        glCreateBuffers(1, &page->vertexBuffer);
+        glNamedBufferStorage(page->vertexBuffer,
+                             std::max<size_t>(size_t(vertexCapacity) * sizeof(vertex3D), 1),
+                             nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &page->positionBuffer);
+        glNamedBufferStorage(page->positionBuffer,
+                             std::max<size_t>(size_t(vertexCapacity) * sizeof(glm::vec3), 1),
+                             nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &page->indexBuffer);
+        glNamedBufferStorage(page->indexBuffer,
+                             std::max<size_t>(size_t(indexCapacity) * sizeof(GLuint), 1), nullptr,
+                             GL_DYNAMIC_STORAGE_BIT);
+
+        glCreateVertexArrays(1, &page->vao);
+        auto vao = page->vao;
+        glVertexArrayAttribBinding(vao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, position));
+        glEnableVertexArrayAttrib(vao, 0);
+
+        glVertexArrayAttribBinding(vao, 1, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 1, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, normal));
+        glEnableVertexArrayAttrib(vao, 1);
+
+        glVertexArrayAttribBinding(vao, 2, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(vao, 2, glm::vec2::length(), GL_FLOAT, GL_FALSE,
+                                  offsetof(vertex3D, texCoord));
+        glEnableVertexArrayAttrib(vao, 2);
+
+        glVertexArrayVertexBuffer(vao, 0, page->vertexBuffer, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(vertex3D));
+        glVertexArrayElementBuffer(vao, page->indexBuffer);
+
+        glCreateVertexArrays(1, &page->positionVao);
+        glVertexArrayAttribBinding(page->positionVao, 0, /*buffer index*/ 0);
+        glVertexArrayAttribFormat(page->positionVao, 0, glm::vec3::length(), GL_FLOAT, GL_FALSE,
+                                  /*relative offset*/ 0);
+        glEnableVertexArrayAttrib(page->positionVao, 0);
+        glVertexArrayVertexBuffer(page->positionVao, 0, page->positionBuffer, /*offset*/ 0,
+                                  /*stride in bytes*/ sizeof(glm::vec3));
+        glVertexArrayElementBuffer(page->positionVao, page->indexBuffer);
+
+        if (!pages.empty()) {
+            fmt::print(stderr, "mesh pool: page {} added ({} vertices, {} indices)\n",
+                       pages.size(), vertexCapacity, indexCapacity);
+        }
+        pages.push_back(std::move(page));
+        return static_cast<uint32_t>(pages.size() - 1);
+    }
+
+    PoolSettings settings;
+    std::vector<std::unique_ptr<Page>> pages;
+    std::vector<MeshSlot> slots;
+};
+
+} // namespace meshPool
@@ -0,0 +1,335 @@
+#pragma once
+
+// mip chains made on the cpu, so they can be built in the decode jobs and
+// uploaded with the image instead of leaving it to glGenerateTextureMipmap
+// (whose filter is whatever the driver feels like, and on llvmpipe is slow
+// and single threaded).
+//
+// colour is filtered in linear space. an srgb texel of 0.5 is about 0.21 of
+// the light of 1.0, so averaging the encoded values darkens every edge
+// between light and dark and whole textures get darker down the chain. texels
+// are decoded to linear floats once, each level is made from the one above it
+// in float, and only the output is encoded back to 8 bits. alpha is always
+// linear and isn't premultiplied.
+//
+// the filter is separable, a row pass then a column pass, and each pass runs
+// over rows with parallelFor. a texel is 4 floats, one sse register.
+//
+//  mipChain::Settings settings;
+//  settings.filter = mipChain::Filter::Kaiser;
+//  auto levels = mipChain::generate(jobSystem, pixels, width, height, channels, settings);
+//  // levels[0] is level 1, half the size of pixels, down to 1x1
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace mipChain {
+
+enum class Filter {
+    // the average of the texels each output covers. cheap, a little soft
+    Box,
+    // kaiser windowed sinc over 3 output texels each side. sharper, keeps
+    // detail further down the chain, can ring a little on hard edges
+    Kaiser
+};
+
+struct Settings {
+    Filter filter = Filter::Box;
+    // the colour channels hold srgb values. off for normal maps, masks etc.
+    bool srgb = true;
+    // the texture repeats, so the filter wraps round the edges rather than
+    // clamping. what every sampler in the chapters uses
+    bool wrap = true;
+};
+
+// one level, tightly packed, same channel count as the source
+struct Level {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+inline int levelCount(int width, int height) {
+    int levels = 1;
+    for (auto size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+namespace detail {
+
+inline const std::array<float, 256>& srgbToLinear() {
+    static const auto table = [] {
+        std::array<float, 256> values;
+        for (auto i = 0; i < 256; ++i) {
+            float c = i / 255.f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+// 4096 steps of linear is finer than 8 bits of srgb everywhere but the very
+// darkest values, where the step is still under one output level
+inline const std::array<uint8_t, 4096>& linearToSrgb() {
+    static const auto table = [] {
+        std::array<uint8_t, 4096> values;
+        for (auto i = 0; i < 4096; ++i) {
+            float c = i / 4095.f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+            values[i] = static_cast<uint8_t>(std::clamp(s, 0.f, 1.f) * 255.f + 0.5f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+// for each output texel, taps source texels and their weights
+struct Taps {
+    int perOutput = 0;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+inline double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+inline Taps makeTaps(int sourceSize, int outputSize, Filter filter, bool wrap) {
+    // width of the filter either side of the output texel's centre, in
+    // output texels
+    const double radius = filter == Filter::Box ? 0.5 : 3.0;
+    const double alpha = 4.0;
+    const double pi = 3.14159265358979323846;
+    const double scale = static_cast<double>(sourceSize) / outputSize;
+
+    Taps taps;
+    taps.perOutput = static_cast<int>(std::ceil(2.0 * radius * scale)) + 2;
+    taps.index.resize(size_t(outputSize) * taps.perOutput);
+    taps.weight.resize(taps.index.size());
+
+    for (int out = 0; out < outputSize; ++out) {
+        const double centre = (out + 0.5) * scale;
+        const int first = static_cast<int>(std::floor(centre - radius * scale));
+        double total = 0.0;
+        for (int k = 0; k < taps.perOutput; ++k) {
+            const int source = first + k;
+            double weight = 0.0;
+            if (filter == Filter::Box) {
+                // how much of source texel [source, source + 1) the output covers
+                double low = std::max<double>(source, centre - 0.5 * scale);
+                double high = std::min<double>(source + 1, centre + 0.5 * scale);
+                weight = std::max(high - low, 0.0);
+            } else {
+                double t = (source + 0.5 - centre) / scale;
+                if (std::abs(t) < radius) {
+                    double x = t / radius;
+                    double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+                    weight = sinc * besselI0(alpha * std::sqrt(1.0 - x * x)) / besselI0(alpha);
+                }
+            }
+            int wrapped = wrap ? ((source % sourceSize) + sourceSize) % sourceSize
+                               : std::clamp(source, 0, sourceSize - 1);
+            taps.index[size_t(out) * taps.perOutput + k] = wrapped;
+            taps.weight[size_t(out) * taps.perOutput + k] = static_cast<float>(weight);
+            total += weight;
+        }
+        for (int k = 0; k < taps.perOutput; ++k) {
+            taps.weight[size_t(out) * taps.perOutput + k] /= static_cast<float>(total);
+        }
+    }
+
+    // the window is rounded out to whole texels, so the first and last taps
+    // are often zero for every output. a 2:1 box is 2 taps, not 4
+    int firstUsed = taps.perOutput, lastUsed = -1;
+    for (size_t i = 0; i < taps.weight.size(); ++i) {
+        if (taps.weight[i] != 0.f) {
+            int k = static_cast<int>(i % taps.perOutput);
+            firstUsed = std::min(firstUsed, k);
+            lastUsed = std::max(lastUsed, k);
+        }
+    }
+    if (firstUsed > 0 || lastUsed < taps.perOutput - 1) {
+        Taps trimmed;
+        trimmed.perOutput = lastUsed - firstUsed + 1;
+        for (int out = 0; out < outputSize; ++out) {
+            auto from = size_t(out) * taps.perOutput + firstUsed;
+            trimmed.index.insert(trimmed.index.end(), taps.index.begin() + from,
+                                 taps.index.begin() + from + trimmed.perOutput);
+            trimmed.weight.insert(trimmed.weight.end(), taps.weight.begin() + from,
+                                  taps.weight.begin() + from + trimmed.perOutput);
+        }
+        return trimmed;
+    }
+    return taps;
+}
+
+// out[i] += weight * in[i] over count floats
+inline void accumulate(float* out, const float* in, float weight, size_t count) {
+    size_t i = 0;
+#if defined(__AVX__) || defined(__AVX2__)
+    auto w8 = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        auto sum = _mm256_mul_ps(w8, _mm256_loadu_ps(in + i));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), sum));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    auto w4 = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4) {
+        auto sum = _mm_mul_ps(w4, _mm_loadu_ps(in + i));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), sum));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] += weight * in[i];
+    }
+}
+
+// one row of rgba float texels filtered across into outputWidth texels
+inline void filterRow(float* out, const float* in, const Taps& taps, int outputWidth) {
+    for (int x = 0; x < outputWidth; ++x) {
+        const int* index = &taps.index[size_t(x) * taps.perOutput];
+        const float* weight = &taps.weight[size_t(x) * taps.perOutput];
+#if defined(__SSE2__) || defined(_M_X64)
+        auto sum = _mm_setzero_ps();
+        for (int k = 0; k < taps.perOutput; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[k]),
+                                             _mm_loadu_ps(in + size_t(index[k]) * 4)));
+        }
+        _mm_storeu_ps(out + size_t(x) * 4, sum);
+#else
+        float sum[4] = {0.f, 0.f, 0.f, 0.f};
+        for (int k = 0; k < taps.perOutput; ++k) {
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += weight[k] * in[size_t(index[k]) * 4 + c];
+            }
+        }
+        std::copy(sum, sum + 4, out + size_t(x) * 4);
+#endif
+    }
+}
+
+} // namespace detail
+
+// levels 1 down to 1x1 of a tightly packed 8 bit image with 1-4 channels.
+// with 2 or 4 channels the last one is alpha
+inline std::vector<Level> generate(jobs::JobSystem& jobSystem, const uint8_t* pixels, int width,
+                                   int height, int channels, const Settings& settings = {}) {
+    std::vector<Level> levels;
+    if (!pixels || width <= 0 || height <= 0 || (width == 1 && height == 1)) {
+        return levels;
+    }
+    const int colourChannels = channels == 2 || channels == 4 ? channels - 1 : channels;
+    const auto& toLinear = detail::srgbToLinear();
+    const auto& toSrgb = detail::linearToSrgb();
+    constexpr size_t rowGrain = 16;
+
+    // a row of the 8 bit source as rgba floats, colour in linear. only the
+    // first row pass reads the source, so it's converted a row at a time there
+    // rather than all up front
+    std::array<float, 256> unorm;
+    for (auto i = 0; i < 256; ++i) {
+        unorm[i] = i / 255.f;
+    }
+    std::array<const float*, 4> channelTable;
+    for (int c = 0; c < 4; ++c) {
+        channelTable[c] = c < colourChannels && settings.srgb ? toLinear.data() : unorm.data();
+    }
+    auto decodeRow = [&](float* out, size_t y) {
+        const auto* texel = pixels + y * width * channels;
+        for (int x = 0; x < width; ++x, texel += channels, out += 4) {
+            out[0] = out[1] = out[2] = out[3] = 0.f;
+            for (int c = 0; c < channels; ++c) {
+                out[c] = channelTable[c][texel[c]];
+            }
+        }
+    };
+
+    std::vector<float> source, across, output;
+    int sourceWidth = width, sourceHeight = height;
+    while (sourceWidth > 1 || sourceHeight > 1) {
+        const int outputWidth = std::max(sourceWidth / 2, 1);
+        const int outputHeight = std::max(sourceHeight / 2, 1);
+        auto columnTaps =
+            detail::makeTaps(sourceWidth, outputWidth, settings.filter, settings.wrap);
+        auto rowTaps =
+            detail::makeTaps(sourceHeight, outputHeight, settings.filter, settings.wrap);
+
+        // every source row filtered across to the new width
+        across.resize(size_t(outputWidth) * sourceHeight * 4);
+        const bool fromPixels = levels.empty();
+        jobSystem.parallelFor(sourceHeight, rowGrain, [&](size_t begin, size_t end) {
+            std::vector<float> decoded(fromPixels ? size_t(sourceWidth) * 4 : 0);
+            for (auto y = begin; y < end; ++y) {
+                const float* row = source.data();
+                if (fromPixels) {
+                    decodeRow(decoded.data(), y);
+                    row = decoded.data();
+                } else {
+                    row += y * sourceWidth * 4;
+                }
+                detail::filterRow(&across[y * outputWidth * 4], row, columnTaps, outputWidth);
+            }
+        });
+
+        // then down, each output row a weighted sum of whole rows of that
+        Level level;
+        level.width = outputWidth;
+        level.height = outputHeight;
+        level.pixels.resize(size_t(outputWidth) * outputHeight * channels);
+        output.assign(size_t(outputWidth) * outputHeight * 4, 0.f);
+        const size_t rowFloats = size_t(outputWidth) * 4;
+        jobSystem.parallelFor(outputHeight, rowGrain, [&](size_t begin, size_t end) {
+            for (auto y = begin; y < end; ++y) {
+                float* row = &output[y * rowFloats];
+                for (int k = 0; k < rowTaps.perOutput; ++k) {
+                    auto tap = y * rowTaps.perOutput + k;
+                    detail::accumulate(row, &across[size_t(rowTaps.index[tap]) * rowFloats],
+                                       rowTaps.weight[tap], rowFloats);
+                }
+                // kaiser's negative lobes can overshoot, so clamp on the way out
+                auto* out = &level.pixels[y * outputWidth * channels];
+                for (int x = 0; x < outputWidth; ++x) {
+                    for (int c = 0; c < channels; ++c) {
+                        float value = std::clamp(row[x * 4 + c], 0.f, 1.f);
+                        row[x * 4 + c] = value;
+                        out[x * channels + c] =
+                            c < colourChannels && settings.srgb
+                                ? toSrgb[static_cast<int>(value * 4095.f + 0.5f)]
+                                : static_cast<uint8_t>(value * 255.f + 0.5f);
+                    }
+                }
+            }
+        });
+        levels.push_back(std::move(level));
+
+        std::swap(source, output);
+        sourceWidth = outputWidth;
+        sourceHeight = outputHeight;
+    }
+    return levels;
+}
+
+} // namespace mipChain
@@ -0,0 +1,191 @@
+#pragma once
+
+// writes synthetic obj files for benchmarking the loaders. the output only
+// depends on the settings (we use our own rng rather than <random>'s
+// distributions which differ between standard libraries), so the same
+// settings give byte identical files on every machine.
+//
+// the mesh is a wavy grid. faces walk the grid cells in order and wrap around
+// when there are more faces than cells, so vertex sharing looks like a real
+// scanned/sculpted mesh rather than random soup.
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace objGenerator {
+
+struct GeneratorSettings {
+    uint32_t vertexCount = 100000;
+    uint32_t faceCount = 200000;
+    bool quads = false;
+    bool textureCoords = true;
+    bool normals = true;
+    uint32_t groupCount = 5;
+    // digits after the decimal point for v/vt/vn. controls the line length
+    int decimals = 6;
+    // doubled separators, tabs and trailing whitespace on the face lines, the
+    // way hand edited and exported files have them. the triangles are the same
+    bool messyWhitespace = false;
+    uint32_t seed = 1;
+};
+
+// name that encodes every setting so files can be cached between runs
+inline std::string fileNameFor(const GeneratorSettings& settings) {
+    return fmt::format("synthetic_v{}_f{}_{}{}{}_g{}_d{}{}_s{}.obj", settings.vertexCount,
+                       settings.faceCount, settings.quads ? "quad" : "tri",
+                       settings.textureCoords ? "_vt" : "", settings.normals ? "_vn" : "",
+                       settings.groupCount, settings.decimals,
+                       settings.messyWhitespace ? "_ws" : "", settings.seed);
+}
+
+// xorshift32. small, fast and the same everywhere
+struct Random {
+    explicit Random(uint32_t seed) : state(seed ? seed : 0x9e3779b9u) {
+    }
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // [-1, 1)
+    float signedUnit() {
+        return static_cast<float>(next() >> 8) * (2.0f / 16777216.0f) - 1.0f;
+    }
+
+    uint32_t state;
+};
+
+struct GeneratorResult {
+    uint64_t fileBytes = 0;
+    // triangles after quads are split. what a loader should end up with
+    uint64_t triangleCount = 0;
+};
+
+inline GeneratorResult writeObj(const std::string& filePath, const GeneratorSettings& settings) {
+    GeneratorResult result;
+
+    FILE* fp = fopen(filePath.c_str(), "w");
+    if (!fp) {
+        fmt::print(stderr, "Error opening file {}\n", filePath);
+        return result;
+    }
+
+    Random random(settings.seed);
+
+    // lay the vertices out on a roughly square grid
+    const uint32_t vertexCount = std::max(settings.vertexCount, 4u);
+    const uint32_t columns =
+        std::max(2u, static_cast<uint32_t>(std::sqrt(static_cast<double>(vertexCount))));
+    const uint32_t rows = std::max(2u, vertexCount / columns);
+    const uint32_t gridVertexCount = columns * rows;
+    const float jitter = 0.25f / static_cast<float>(columns);
+
+    fmt::print(fp, "# synthetic obj generated by obj_generator.hpp\n");
+    fmt::print(fp, "# vertices {} faces {} {}\n", gridVertexCount, settings.faceCount,
+               settings.quads ? "quads" : "tris");
+
+    for (auto i = 0u; i < gridVertexCount; ++i) {
+        float u = static_cast<float>(i % columns) / static_cast<float>(columns - 1);
+        float v = static_cast<float>(i / columns) / static_cast<float>(rows - 1);
+        float x = u * 2.0f - 1.0f + random.signedUnit() * jitter;
+        float z = v * 2.0f - 1.0f + random.signedUnit() * jitter;
+        float y = 0.1f * std::sin(x * 7.0f) * std::cos(z * 5.0f);
+        fmt::print(fp, "v {:.{}f} {:.{}f} {:.{}f}\n", x, settings.decimals, y, settings.decimals,
+                   z, settings.decimals);
+    }
+
+    if (settings.textureCoords) {
+        for (auto i = 0u; i < gridVertexCount; ++i) {
+            float u = static_cast<float>(i % columns) / static_cast<float>(columns - 1);
+            float v = static_cast<float>(i / columns) / static_cast<float>(rows - 1);
+            fmt::print(fp, "vt {:.{}f} {:.{}f}\n", u, settings.decimals, v, settings.decimals);
+        }
+    }
+
+    if (settings.normals) {
+        for (auto i = 0u; i < gridVertexCount; ++i) {
+            float nx = random.signedUnit() * 0.2f;
+            float nz = random.signedUnit() * 0.2f;
+            float length = std::sqrt(nx * nx + 1.0f + nz * nz);
+            fmt::print(fp, "vn {:.{}f} {:.{}f} {:.{}f}\n", nx / length, settings.decimals,
+                       1.0f / length, settings.decimals, nz / length, settings.decimals);
+        }
+    }
+
+    // one face corner in whichever layout the settings ask for. indices are 1
+    // based and we use the same index for v, vt and vn
+    auto writeCorner = [&](uint32_t index) {
+        if (settings.messyWhitespace) {
+            // an extra space or tab in front of some of the corners
+            const char* separators[] = {"", "", " ", "\t"};
+            fmt::print(fp, "{}", separators[random.next() % 4]);
+        }
+        if (settings.textureCoords && settings.normals) {
+            fmt::print(fp, " {0}/{0}/{0}", index);
+        } else if (settings.textureCoords) {
+            fmt::print(fp, " {0}/{0}", index);
+        } else if (settings.normals) {
+            fmt::print(fp, " {0}//{0}", index);
+        } else {
+            fmt::print(fp, " {}", index);
+        }
+    };
+
+    const uint32_t cellCount = (columns - 1) * (rows - 1);
+    const uint32_t groupCount = std::max(settings.groupCount, 1u);
+    const uint32_t facesPerGroup = (settings.faceCount + groupCount - 1) / groupCount;
+    // with tris each cell gives two faces
+    const uint32_t facesPerCell = settings.quads ? 1 : 2;
+
+    for (auto face = 0u; face < settings.faceCount; ++face) {
+        if (face % facesPerGroup == 0) {
+            auto group = face / facesPerGroup;
+            fmt::print(fp, "g group{}\nusemtl material{}\n", group, group);
+        }
+
+        uint32_t cell = (face / facesPerCell) % cellCount;
+        uint32_t column = cell % (columns - 1);
+        uint32_t row = cell / (columns - 1);
+        uint32_t a = row * columns + column + 1;
+        uint32_t b = a + 1;
+        uint32_t c = a + columns + 1;
+        uint32_t d = a + columns;
+
+        fmt::print(fp, "f");
+        if (settings.quads) {
+            writeCorner(a);
+            writeCorner(b);
+            writeCorner(c);
+            writeCorner(d);
+            result.triangleCount += 2;
+        } else if (face % 2 == 0) {
+            writeCorner(a);
+            writeCorner(b);
+            writeCorner(c);
+            result.triangleCount += 1;
+        } else {
+            writeCorner(a);
+            writeCorner(c);
+            writeCorner(d);
+            result.triangleCount += 1;
+        }
+        if (settings.messyWhitespace && face % 3 == 0) {
+            fmt::print(fp, " \t ");
+        }
+        fmt::print(fp, "\n");
+    }
+
+    result.fileBytes = static_cast<uint64_t>(ftell(fp));
+    fclose(fp);
+    return result;
+}
+
+} // namespace objGenerator
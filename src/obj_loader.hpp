@@ -1,5 +1,8 @@
 #pragma once
 
+#include "bounds.hpp"
+#include "trace.hpp"
+
 #include "glm/glm.hpp"
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
@@ -20,15 +23,24 @@
 #include <cstring>
 
 #include <fstream>
+#include <memory>
+#include <memory_resource>
 //#include <iostream>
 //#include <omp.h>
 //#include <pystring.h>
 //#include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <map>
 #include <unordered_map>
 
 #include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 struct vertex3D {
     glm::vec3 position;
     glm::vec3 normal;
@@ -119,21 +131,54 @@ struct MaterialInfo {
 
     enum class mapType { Diffuse, Normal, Specular };
 
+    // what a map's texels mean. colour is authored in srgb and wants an srgb
+    // texture format so sampling returns linear values. normals and specular
+    // amounts are data and must be left alone
+    enum class colourSpace { Srgb, Linear };
+
     std::map<mapType, std::string> mapTypeToFilePath;
+    // only the maps whose line said so, see colourSpaceOf
+    std::map<mapType, colourSpace> mapTypeToColourSpace;
+
+    colourSpace colourSpaceOf(mapType type) const {
+        auto it = mapTypeToColourSpace.find(type);
+        if (it != mapTypeToColourSpace.end()) {
+            return it->second;
+        }
+        return type == mapType::Diffuse ? colourSpace::Srgb : colourSpace::Linear;
+    }
 };
 
+// map lines can have options before the file name. the one looked at is
+// "-colorspace srgb|linear" (not in the original spec but some exporters write
+// it), anything else stays part of the name like before
+inline void addMap(MaterialInfo& material, MaterialInfo::mapType type, std::string rest) {
+    const std::string option = "-colorspace ";
+    while (rest.compare(0, option.size(), option) == 0) {
+        rest.erase(0, option.size());
+        auto valueEnd = rest.find(' ');
+        auto value = rest.substr(0, valueEnd);
+        for (auto& c : value) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        material.mapTypeToColourSpace[type] = value == "linear" || value == "raw"
+                                                  ? MaterialInfo::colourSpace::Linear
+                                                  : MaterialInfo::colourSpace::Srgb;
+        rest.erase(0, valueEnd == std::string::npos ? rest.size() : valueEnd + 1);
+    }
+    material.mapTypeToFilePath.insert({type, rest});
+}
+
 using MapMaterialNameToInfo = std::unordered_map<std::string, MaterialInfo>;
 
 MapMaterialNameToInfo parseMaterialFile(const std::string filePath) {
+    TRACE_SCOPE("material parse");
 
     std::ios_base::sync_with_stdio(false);
-    using namespace std::chrono;
-    auto startTime = system_clock::now();
 
     MapMaterialNameToInfo mapMaterialNameToInfo;
 
     char line[128];
-    size_t line_buf_size = 0;
     size_t line_size;
     char* end;
     uint16_t key;
@@ -223,18 +268,15 @@ MapMaterialNameToInfo parseMaterialFile(const std::string filePath) {
         case textureMap: {
             switch (line[5]) {
             case 'u': { // bump
-                currentMaterial.mapTypeToFilePath.insert(
-                    {MaterialInfo::mapType::Normal, {&line[9], line_size - 10}});
+                addMap(currentMaterial, MaterialInfo::mapType::Normal, {&line[9], line_size - 10});
                 break;
             }
             case 'd': { // diffuse
-                currentMaterial.mapTypeToFilePath.insert(
-                    {MaterialInfo::mapType::Diffuse, {&line[7], line_size - 8}});
+                addMap(currentMaterial, MaterialInfo::mapType::Diffuse, {&line[7], line_size - 8});
                 break;
             }
             case 's': { // specular
-                currentMaterial.mapTypeToFilePath.insert(
-                    {MaterialInfo::mapType::Specular, {&line[7], line_size - 8}});
+                addMap(currentMaterial, MaterialInfo::mapType::Specular, {&line[7], line_size - 8});
                 break;
             }
             default: {
@@ -256,24 +298,102 @@ MapMaterialNameToInfo parseMaterialFile(const std::string filePath) {
 // add groups
 struct groupInfo {
     std::string name;
-    uint32_t startOffset;
-    uint32_t count;
+    uint32_t startOffset = 0;
+    uint32_t count = 0;
+    // filled in by readObjSplit/readObjElements
+    bounds::Bounds bounds = {};
+};
+
+// the parser's version of groupInfo. the name is a range of
+// RawMeshData::groupNames so it lives in the arena with everything else, and
+// only becomes a std::string when the result is built
+struct rawGroupInfo {
+    uint32_t nameOffset = 0;
+    uint32_t nameLength = 0;
+    uint32_t startOffset = 0;
+    uint32_t count = 0;
 };
 
+// how many of each record type a file has. cheap to get compared to parsing
+// and lets us size things before the real pass
+struct LineCounts {
+    size_t positions = 0;
+    size_t normals = 0;
+    size_t textureCoords = 0;
+    size_t faces = 0;
+    size_t groups = 0;
+
+    size_t triangles = 0;
+    size_t quads = 0;
+    // anything with more than 4 corners
+    size_t polygons = 0;
+    // entries faceIndices ends up with once every face is split into triangles
+    size_t triangulatedCorners = 0;
+};
+
+// the raw data is only ever a stepping stone to MeshDataSplit/MeshDataElements
+// so it can live in an arena (see LoaderArena). by default it uses the normal
+// heap like a plain std::vector
 struct RawMeshData {
 
-    RawMeshData() : positions(1), normals(1), textureCoords(1) {
+    explicit RawMeshData(std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+                         const LineCounts* counts = nullptr)
+        : positions(resource), normals(resource), textureCoords(resource), faceIndices(resource),
+          groupNames(resource), groupInfos(resource) {
+        // with counts every vector is allocated once at its final size
+        if (counts) {
+            positions.reserve(counts->positions + 1);
+            normals.reserve(counts->normals + 1);
+            textureCoords.reserve(counts->textureCoords + 1);
+            faceIndices.reserve(counts->triangulatedCorners);
+            groupNames.reserve((counts->groups + 1) * averageGroupNameLength);
+            groupInfos.reserve(counts->groups + 1);
+        }
+        positions.emplace_back();
+        normals.emplace_back();
+        textureCoords.emplace_back();
     }
     // dummy value at 0. removes the need for subtracting 1 from obj file
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> textureCoords;
+    std::pmr::vector<glm::vec3> positions;
+    std::pmr::vector<glm::vec3> normals;
+    std::pmr::vector<glm::vec2> textureCoords;
     // store the obj face info interleaved for now. makes finding unique verts
     // easier
-    std::vector<glm::ivec3> faceIndices;
+    std::pmr::vector<glm::ivec3> faceIndices;
 
-    // add groups.
-    std::vector<groupInfo> groupInfos;
+    // add groups. names are stored back to back, see rawGroupInfo
+    static constexpr size_t averageGroupNameLength = 16;
+    std::pmr::vector<char> groupNames;
+    std::pmr::vector<rawGroupInfo> groupInfos;
+
+    std::string_view groupName(const rawGroupInfo& group) const {
+        return {groupNames.data() + group.nameOffset, group.nameLength};
+    }
+
+    void addGroup(std::string_view name, uint32_t startOffset) {
+        rawGroupInfo group;
+        group.nameOffset = static_cast<uint32_t>(groupNames.size());
+        group.nameLength = static_cast<uint32_t>(name.size());
+        group.startOffset = startOffset;
+        groupNames.insert(groupNames.end(), name.begin(), name.end());
+        groupInfos.push_back(group);
+    }
+
+    void removeLastGroup() {
+        groupNames.resize(groupInfos.back().nameOffset);
+        groupInfos.pop_back();
+    }
+
+    // the heap copy that goes into MeshDataSplit/MeshDataElements, which
+    // outlive the arena
+    std::vector<groupInfo> copyGroupInfos() const {
+        std::vector<groupInfo> copies;
+        copies.reserve(groupInfos.size());
+        for (const auto& group : groupInfos) {
+            copies.push_back({std::string(groupName(group)), group.startOffset, group.count, {}});
+        }
+        return copies;
+    }
 };
 
 struct MeshDataSplit {
@@ -282,14 +402,464 @@ struct MeshDataSplit {
     // an int which is the start index into the faceIndices of where groups
     // start to get the range, use the last(-1) offset
     std::vector<groupInfo> groupInfos;
+    // every position in the file
+    bounds::Bounds bounds;
 };
 
 struct MeshDataElements : MeshDataSplit {
     std::vector<int> indices;
 };
 
-// only supports tris and quads
-RawMeshData readObjRaw(const std::string& filePath, const std::string& materialFilePath) {
+enum class MissingNormals { Keep, Flat, Smooth };
+
+struct LoadSettings {
+    // count the records first so every vector is allocated once at its final
+    // size instead of doubling its way there
+    bool preScan = true;
+    // put every temporary (raw data, tracking arrays) in one arena sized up
+    // front, so a load is a handful of heap allocations instead of hundreds.
+    // needs the pre-scan
+    bool useArena = true;
+    // what to do about faces that don't reference a normal (v or v/vt
+    // layouts, common for scans). smooth shares one area weighted normal per
+    // position, flat gives every triangle its own
+    MissingNormals missingNormals = MissingNormals::Smooth;
+};
+
+namespace detail {
+
+inline uint32_t bitCount(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_popcount(x));
+#else
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return (((x + (x >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+#endif
+}
+
+// space and tab split a line into tokens. the pre-scan and the line parser
+// both use this so they agree on how many corners a face has
+inline bool isSeparator(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// token ends at a separator, the \r of a crlf file, the newline or the nulled
+// out separator
+inline bool endOfToken(char c) {
+    return static_cast<unsigned char>(c) <= ' ';
+}
+
+// a face corner starts with its position index, which parseIndex reads. the
+// pre-scan and the face parser both use this so a stray token like a trailing
+// comment isn't counted by one and skipped by the other
+inline bool startsCorner(char c) {
+    return static_cast<unsigned>(c - '0') < 10u || c == '-' || c == '+';
+}
+
+// "f\t1 2 3" is the same line as "f 1 2 3"
+inline uint32_t lineKey(char first, char second) {
+    return packCharsToIntKey(first, isSeparator(second) ? ' ' : second);
+}
+
+// corners on one face line, ie. tokens after the 'f'. a corner is counted
+// wherever a startsCorner character follows a separator, so doubled and
+// trailing separators don't add any
+inline size_t countFaceCorners(const char* begin, const char* end) {
+    size_t corners = 0;
+    bool previousWasSeparator = false;
+    // skip the 'f'
+    auto c = begin + 1;
+
+#if defined(__SSE2__) || defined(_M_X64)
+    // 16 bytes at a time. build bit masks of the separators and of the bytes
+    // startsCorner accepts (digits are c - '0' <= 9, unsigned), and the corners
+    // are the accepted bytes whose lower neighbour is a separator
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i minus = _mm_set1_epi8('-');
+    const __m128i plus = _mm_set1_epi8('+');
+    uint32_t carry = 0;
+    for (; c + 16 <= end; c += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c));
+        __m128i separator = _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab));
+        __m128i digitValue = _mm_sub_epi8(chunk, zero);
+        __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(digitValue, nine), digitValue);
+        __m128i sign = _mm_or_si128(_mm_cmpeq_epi8(chunk, minus), _mm_cmpeq_epi8(chunk, plus));
+        auto separatorMask = static_cast<uint32_t>(_mm_movemask_epi8(separator));
+        auto cornerMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(digit, sign)));
+        corners += bitCount(cornerMask & ((separatorMask << 1) | carry) & 0xffffu);
+        carry = separatorMask >> 15;
+    }
+    previousWasSeparator = carry != 0;
+#endif
+
+    for (; c < end; ++c) {
+        corners += previousWasSeparator && startsCorner(*c);
+        previousWasSeparator = isSeparator(*c);
+    }
+    return corners;
+}
+
+inline void countLine(LineCounts& counts, const char* begin, const char* end) {
+    if (end - begin < 2) {
+        return;
+    }
+    switch (lineKey(begin[0], begin[1])) {
+    case v: ++counts.positions; break;
+    case vn: ++counts.normals; break;
+    case vt: ++counts.textureCoords; break;
+    case g: ++counts.groups; break;
+    case f: {
+        ++counts.faces;
+        auto corners = countFaceCorners(begin, end);
+        if (corners == 3) {
+            ++counts.triangles;
+        } else if (corners == 4) {
+            ++counts.quads;
+        } else if (corners > 4) {
+            ++counts.polygons;
+        }
+        if (corners >= 3) {
+            counts.triangulatedCorners += (corners - 2) * 3;
+        }
+        break;
+    }
+    default: {
+    }
+    }
+}
+
+// obj indices are 1 based, or negative to count back from the last element
+// read so far. count is the size of the (dummy padded) array at this point in
+// the file, so -1 resolves to count - 1, the most recent one. 0 means the
+// corner didn't have that attribute and stays 0, the dummy
+inline int resolveIndex(int index, size_t count) {
+    return index < 0 ? static_cast<int>(count) + index : index;
+}
+
+// the four ways an obj face corner can be written
+enum class FaceFormat {
+    Position,              // f 1 2 3
+    PositionTexCoord,      // f 1/1 2/2 3/3
+    PositionNormal,        // f 1//1 2//2 3//3
+    PositionTexCoordNormal // f 1/1/1 2/2/2 3/3/3
+};
+
+template <FaceFormat format> using FaceFormatTag = std::integral_constant<FaceFormat, format>;
+
+inline FaceFormat detectFaceFormat(const char* token) {
+    while (*token != '/' && !endOfToken(*token)) {
+        ++token;
+    }
+    if (*token != '/') {
+        return FaceFormat::Position;
+    }
+    if (token[1] == '/') {
+        return FaceFormat::PositionNormal;
+    }
+    ++token;
+    while (*token != '/' && !endOfToken(*token)) {
+        ++token;
+    }
+    return *token == '/' ? FaceFormat::PositionTexCoordNormal : FaceFormat::PositionTexCoord;
+}
+
+// strtol without the locale, whitespace skipping and errno. indices are plain
+// decimal with an optional sign. leaves p on the first character after it
+inline int parseIndex(const char*& p) {
+    bool negative = *p == '-';
+    p += negative || *p == '+';
+    int value = 0;
+    while (static_cast<unsigned>(*p - '0') < 10u) {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    return negative ? -value : value;
+}
+
+// missing attributes stay 0, the dummy. slashes are only stepped over if
+// they are there so a corner that doesn't match the face's layout can't read
+// into the next token
+template <FaceFormat format> glm::ivec3 parseCorner(const char* p) {
+    glm::ivec3 corner(0);
+    corner.x = parseIndex(p);
+    if constexpr (format == FaceFormat::PositionTexCoord ||
+                  format == FaceFormat::PositionTexCoordNormal) {
+        p += *p == '/';
+        corner.y = parseIndex(p);
+    }
+    if constexpr (format == FaceFormat::PositionNormal) {
+        p += *p == '/';
+        p += *p == '/';
+        corner.z = parseIndex(p);
+    }
+    if constexpr (format == FaceFormat::PositionTexCoordNormal) {
+        p += *p == '/';
+        corner.z = parseIndex(p);
+    }
+    return corner;
+}
+
+inline bool hasRelativeIndex(const glm::ivec3& corner) {
+    return (corner.x | corner.y | corner.z) < 0;
+}
+
+inline float cross2D(const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// whether the quad a b c d is split into a b c / a c d. that's only right if
+// b and d are on opposite sides of a-c, ie. both halves wind the same way.
+// otherwise the quad is concave at a or c and b-d is the diagonal inside it.
+// bad indices keep the a-c split, there's no geometry to go on
+template <typename Positions>
+bool splitQuadAlongFirstDiagonal(const glm::ivec3& a, const glm::ivec3& b, const glm::ivec3& c,
+                                 const glm::ivec3& d, const Positions& positions) {
+    auto valid = [&positions](const glm::ivec3& corner) {
+        return corner.x > 0 && static_cast<size_t>(corner.x) < positions.size();
+    };
+    if (!(valid(a) && valid(b) && valid(c) && valid(d))) {
+        return true;
+    }
+    const auto& origin = positions[a.x];
+    auto diagonal = positions[c.x] - origin;
+    auto first = glm::cross(positions[b.x] - origin, diagonal);
+    auto second = glm::cross(diagonal, positions[d.x] - origin);
+    return !(glm::dot(first, second) < 0.f);
+}
+
+// splits a polygon of (position, texcoord, normal) corners into triangles and
+// appends them to out. convex polygons are fanned from the first corner,
+// concave ones are ear clipped in the plane they mostly lie in. scratch is
+// reused between faces so this doesn't allocate per face
+template <typename Corners, typename Positions, typename Output, typename Scratch>
+void triangulatePolygon(const Corners& polygon, const Positions& positions, Output& out,
+                        Scratch& scratch) {
+    const auto n = polygon.size();
+    if (n < 3) {
+        return;
+    }
+    auto fan = [&](size_t first) {
+        for (auto i = first + 1; i + 1 < n; ++i) {
+            out.push_back(polygon[0]);
+            out.push_back(polygon[i]);
+            out.push_back(polygon[i + 1]);
+        }
+    };
+    if (n == 3) {
+        fan(0);
+        return;
+    }
+
+    for (const auto& corner : polygon) {
+        if (corner.x <= 0 || static_cast<size_t>(corner.x) >= positions.size()) {
+            // bad index, no geometry to go on. fan keeps the corner order
+            fan(0);
+            return;
+        }
+    }
+
+    // newell's method gives a normal that is robust for non planar polygons
+    glm::vec3 normal(0.f);
+    for (auto i = 0u; i < n; ++i) {
+        const auto& current = positions[polygon[i].x];
+        const auto& next = positions[polygon[(i + 1) % n].x];
+        normal.x += (current.y - next.y) * (current.z + next.z);
+        normal.y += (current.z - next.z) * (current.x + next.x);
+        normal.z += (current.x - next.x) * (current.y + next.y);
+    }
+
+    // drop the axis the normal points along the most and work in 2d
+    auto absNormal = glm::abs(normal);
+    int u = 0, w = 1;
+    if (absNormal.x >= absNormal.y && absNormal.x >= absNormal.z) {
+        u = 1;
+        w = 2;
+    } else if (absNormal.y >= absNormal.z) {
+        u = 2;
+        w = 0;
+    }
+
+    auto& projected = scratch.projected;
+    projected.clear();
+    for (const auto& corner : polygon) {
+        const auto& position = positions[corner.x];
+        projected.emplace_back(position[u], position[w]);
+    }
+
+    float area = 0.f;
+    for (auto i = 0u; i < n; ++i) {
+        const auto& a = projected[i];
+        const auto& b = projected[(i + 1) % n];
+        area += a.x * b.y - b.x * a.y;
+    }
+    const float orientation = area >= 0.f ? 1.f : -1.f;
+
+    bool convex = true;
+    for (auto i = 0u; i < n && convex; ++i) {
+        convex = cross2D(projected[i], projected[(i + 1) % n], projected[(i + 2) % n]) *
+                     orientation >=
+                 0.f;
+    }
+    if (convex) {
+        fan(0);
+        return;
+    }
+
+    // ear clipping. O(n^2) but concave faces are rare and small
+    auto& remaining = scratch.remaining;
+    remaining.resize(n);
+    for (auto i = 0u; i < n; ++i) {
+        remaining[i] = static_cast<uint32_t>(i);
+    }
+
+    // points on an edge count as inside. a reflex corner sitting exactly on
+    // the diagonal would otherwise let the ear cut across it
+    auto insideTriangle = [](const glm::vec2& p, const glm::vec2& a, const glm::vec2& b,
+                             const glm::vec2& c, float orientation) {
+        return cross2D(a, b, p) * orientation >= 0.f && cross2D(b, c, p) * orientation >= 0.f &&
+               cross2D(c, a, p) * orientation >= 0.f;
+    };
+
+    size_t guard = n * n;
+    size_t i = 0;
+    while (remaining.size() > 3 && guard-- > 0) {
+        auto count = remaining.size();
+        auto previous = remaining[(i + count - 1) % count];
+        auto current = remaining[i % count];
+        auto next = remaining[(i + 1) % count];
+        const auto& a = projected[previous];
+        const auto& b = projected[current];
+        const auto& c = projected[next];
+
+        bool isEar = cross2D(a, b, c) * orientation > 0.f;
+        for (auto k = 0u; k < count && isEar; ++k) {
+            auto other = remaining[k];
+            // corners that share a position with the ear's don't block it
+            const auto& point = projected[other];
+            if (other != previous && other != current && other != next && point != a &&
+                point != b && point != c) {
+                isEar = !insideTriangle(point, a, b, c, orientation);
+            }
+        }
+
+        if (isEar) {
+            out.push_back(polygon[previous]);
+            out.push_back(polygon[current]);
+            out.push_back(polygon[next]);
+            remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>(i % count));
+        } else {
+            ++i;
+        }
+    }
+
+    // whatever is left (the last triangle, or a degenerate polygon that
+    // clipping gave up on) gets fanned so the triangle count is always n - 2
+    for (auto k = 1u; k + 1 < remaining.size(); ++k) {
+        out.push_back(polygon[remaining[0]]);
+        out.push_back(polygon[remaining[k]]);
+        out.push_back(polygon[remaining[k + 1]]);
+    }
+}
+
+} // namespace detail
+
+// memchr hops from line to line (it's vectorised in every libc we care about)
+// so only face lines get looked at byte by byte, to count their corners
+inline LineCounts countLines(const std::string& filePath) {
+    TRACE_SCOPE("line count");
+    LineCounts counts;
+
+    FILE* fp = fopen(filePath.c_str(), "rb");
+    if (!fp) {
+        return counts;
+    }
+
+    constexpr size_t blockSize = 1 << 20;
+    auto block = std::make_unique<char[]>(blockSize);
+
+    // bytes at the front of block left over from a line the last read cut in half
+    size_t carried = 0;
+    while (true) {
+        size_t bytesRead = fread(block.get() + carried, 1, blockSize - carried, fp);
+        const char* data = block.get();
+        const char* dataEnd = data + carried + bytesRead;
+
+        if (bytesRead == 0) {
+            // last line without a newline
+            detail::countLine(counts, data, dataEnd);
+            break;
+        }
+
+        const char* lineStart = data;
+        while (auto newline = static_cast<const char*>(
+                   std::memchr(lineStart, '\n', static_cast<size_t>(dataEnd - lineStart)))) {
+            detail::countLine(counts, lineStart, newline);
+            lineStart = newline + 1;
+        }
+
+        carried = static_cast<size_t>(dataEnd - lineStart);
+        if (carried == blockSize) {
+            // a single line bigger than the block. nothing in an obj is that
+            // long, count what we have and move on
+            detail::countLine(counts, data, dataEnd);
+            carried = 0;
+        }
+        std::memmove(block.get(), lineStart, carried);
+    }
+    fclose(fp);
+    return counts;
+}
+
+// one block of memory for all of a load's temporaries. everything is bump
+// allocated out of it and freed in one go when the arena goes away. if the
+// estimate is short it falls back to the heap rather than failing
+class LoaderArena {
+  public:
+    explicit LoaderArena(size_t bytes)
+        : buffer(std::make_unique<std::byte[]>(bytes)),
+          resource(buffer.get(), bytes, std::pmr::new_delete_resource()) {
+    }
+
+    std::pmr::memory_resource* get() {
+        return &resource;
+    }
+
+    // room for the raw data of a file with these counts plus the two
+    // tracking arrays readObjElements needs
+    static size_t bytesFor(const LineCounts& counts) {
+        size_t corners = counts.triangulatedCorners;
+        // no normals in the file, room for making some (one per position
+        // when smooth, one per triangle when flat)
+        size_t generatedNormals =
+            counts.normals == 0 ? std::max(counts.positions, corners / 3) : 0;
+        // each vector can waste up to an alignment's worth
+        constexpr size_t slack = 16 * alignof(std::max_align_t);
+        return (counts.positions + 1) * sizeof(glm::vec3) +
+               (counts.normals + 1 + generatedNormals) * sizeof(glm::vec3) +
+               (counts.textureCoords + 1) * sizeof(glm::vec2) + corners * sizeof(glm::ivec3) +
+               (counts.groups + 1) * (sizeof(rawGroupInfo) + RawMeshData::averageGroupNameLength) +
+               corners * 2 * sizeof(int) + 64 * sizeof(int) + slack;
+    }
+
+  private:
+    std::unique_ptr<std::byte[]> buffer;
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+// each face is read by a loop specialised for its layout (v, v/vt, v//vn or
+// v/vt/vn). tris and quads take a fast path (quads split along whichever
+// diagonal is inside them), anything bigger is triangulated
+// (fanned if convex, ear clipped if not). negative indices count back from
+// the latest v/vt/vn. attributes a face doesn't have are left as 0, see
+// generateMissingNormals. if arena is given the result is allocated out of it.
+// counts (from countLines) are used to reserve everything up front
+RawMeshData readObjRaw(const std::string& filePath, const std::string& materialFilePath,
+                       LoaderArena* arena = nullptr, const LineCounts* counts = nullptr) {
+    TRACE_SCOPE("readObjRaw");
 
     std::ios_base::sync_with_stdio(false);
 
@@ -319,9 +889,11 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
     }
 
     fmt::print(stderr, "starting obj loader\n");
-    RawMeshData meshData;
+    RawMeshData meshData(arena ? arena->get() : std::pmr::get_default_resource(), counts);
 
-    char line[128];
+    // n-gon face lines get long, so more room than the other loaders
+    constexpr int maxLineLength = 4096;
+    char line[maxLineLength];
     size_t line_buf_size = 0;
     size_t line_size;
 
@@ -331,7 +903,85 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
     }
 
     // for storing where spaces and slashes go
-    std::vector<int> spacePositions(8);
+    std::pmr::vector<int> spacePositions(meshData.positions.get_allocator());
+    spacePositions.reserve(64);
+
+    // corners of the current n-gon and the triangulation's working space
+    std::pmr::vector<glm::ivec3> polygon(meshData.positions.get_allocator());
+    polygon.reserve(64);
+    struct {
+        std::pmr::vector<glm::vec2> projected;
+        std::pmr::vector<uint32_t> remaining;
+    } triangulationScratch{std::pmr::vector<glm::vec2>(meshData.positions.get_allocator()),
+                           std::pmr::vector<uint32_t>(meshData.positions.get_allocator())};
+
+    // relative indices are rare, so one predictable branch per face decides
+    // whether any corner needs fixing up
+    auto resolveCorner = [&meshData](const glm::ivec3& corner) {
+        return glm::ivec3(detail::resolveIndex(corner.x, meshData.positions.size()),
+                          detail::resolveIndex(corner.y, meshData.textureCoords.size()),
+                          detail::resolveIndex(corner.z, meshData.normals.size()));
+    };
+
+    // one copy of this per face layout, so the corner parsing has no
+    // branches on which attributes are there
+    auto readFace = [&](auto formatTag) {
+        constexpr auto format = decltype(formatTag)::value;
+
+        // spacePositions only holds the corners here, see the f case
+        if (spacePositions.size() != 3 && spacePositions.size() != 4) {
+            // n-gon. collect the corners and triangulate
+            polygon.clear();
+            for (auto position : spacePositions) {
+                polygon.push_back(resolveCorner(detail::parseCorner<format>(&line[position])));
+            }
+            detail::triangulatePolygon(polygon, meshData.positions, meshData.faceIndices,
+                                       triangulationScratch);
+            return;
+        }
+
+        // fast path for tris and quads
+        auto corner0 = detail::parseCorner<format>(&line[spacePositions[0]]);
+        auto corner1 = detail::parseCorner<format>(&line[spacePositions[1]]);
+        auto corner2 = detail::parseCorner<format>(&line[spacePositions[2]]);
+        if (detail::hasRelativeIndex(corner0) | detail::hasRelativeIndex(corner1) |
+            detail::hasRelativeIndex(corner2)) {
+            corner0 = resolveCorner(corner0);
+            corner1 = resolveCorner(corner1);
+            corner2 = resolveCorner(corner2);
+        }
+
+        if (spacePositions.size() == 3) {
+            meshData.faceIndices.push_back(corner0);
+            meshData.faceIndices.push_back(corner1);
+            meshData.faceIndices.push_back(corner2);
+            return;
+        }
+
+        auto corner3 = detail::parseCorner<format>(&line[spacePositions[3]]);
+        if (detail::hasRelativeIndex(corner3)) {
+            corner3 = resolveCorner(corner3);
+        }
+
+        // split along 0-2 unless the quad is concave there, then 1-3 is the
+        // diagonal that stays inside it
+        if (detail::splitQuadAlongFirstDiagonal(corner0, corner1, corner2, corner3,
+                                                meshData.positions)) {
+            meshData.faceIndices.push_back(corner0);
+            meshData.faceIndices.push_back(corner1);
+            meshData.faceIndices.push_back(corner2);
+            meshData.faceIndices.push_back(corner0);
+            meshData.faceIndices.push_back(corner2);
+            meshData.faceIndices.push_back(corner3);
+        } else {
+            meshData.faceIndices.push_back(corner0);
+            meshData.faceIndices.push_back(corner1);
+            meshData.faceIndices.push_back(corner3);
+            meshData.faceIndices.push_back(corner1);
+            meshData.faceIndices.push_back(corner2);
+            meshData.faceIndices.push_back(corner3);
+        }
+    };
 
     char* end;
     int startPos = 0;
@@ -343,22 +993,23 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
     bool groupJustAdded = false;
     uint16_t key;
 
-    while (fgets(line, 128, fp)) {
+    tracer::Scope lineParseScope("line parse");
+    while (fgets(line, maxLineLength, fp)) {
         { // setup
             line_size = strlen(line);
             spacePositions.clear();
-            key = packCharsToIntKey(line[0], line[1]);
+            key = detail::lineKey(line[0], line[1]);
         }
 
         // remove last group if it wasn't a face group
         if (groupJustAdded && !(key == f || key == material)) {
-            meshData.groupInfos.pop_back();
+            meshData.removeLastGroup();
         }
         groupJustAdded = false;
         {
-            // spaces after the first will always be after 3
+            // separators after the first will always be after 3
             for (auto i = 0u; i < line_size; ++i) {
-                if (line[i] == ' ') {
+                if (detail::isSeparator(line[i])) {
                     line[i] = '\0';
                     spacePositions.push_back(i + 1);
                 }
@@ -391,53 +1042,57 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
             break;
         }
         case f: {
-            // is face
-
-            int a = std::strtol(&line[spacePositions[0]], &end, 10);
-            int b = std::strtol(end + (*end == '/'), &end, 10);
-            int c = std::strtol(end + (*end == '/'), &end, 10);
-            meshData.faceIndices.emplace_back(a, b, c);
-
-            int d = std::strtol(&line[spacePositions[1]], &end, 10);
-            int e = std::strtol(end + (*end == '/'), &end, 10);
-            int f = std::strtol(end + (*end == '/'), &end, 10);
-
-            meshData.faceIndices.emplace_back(d, e, f);
-
-            int g = std::strtol(&line[spacePositions[2]], &end, 10);
-            int h = std::strtol(end + (*end == '/'), &end, 10);
-            int i = std::strtol(end + (*end == '/'), &end, 10);
-
-            meshData.faceIndices.emplace_back(g, h, i);
-
-            if (spacePositions.size() == 5) {
-                // face 0
-                meshData.faceIndices.emplace_back(a, b, c);
-                // face 2
-                meshData.faceIndices.emplace_back(g, h, i);
-
-                // reuse def as those temps aren't needed
-                d = std::strtol(&line[spacePositions[3]], &end, 10);
-                e = std::strtol(end + (*end == '/'), &end, 10);
-                f = std::strtol(end + (*end == '/'), &end, 10);
-
-                meshData.faceIndices.emplace_back(d, e, f);
+            // is face. drop the tokens that aren't corners (the empty ones
+            // between doubled separators, the line end) so the count matches
+            // countFaceCorners
+            spacePositions.erase(std::remove_if(spacePositions.begin(), spacePositions.end(),
+                                                [&line](int position) {
+                                                    return !detail::startsCorner(line[position]);
+                                                }),
+                                 spacePositions.end());
+            if (spacePositions.empty()) {
+                break;
+            }
+            // the first corner decides the layout for the whole face, files
+            // don't mix them within one
+            using detail::FaceFormat;
+            using detail::FaceFormatTag;
+            switch (detail::detectFaceFormat(&line[spacePositions[0]])) {
+            case FaceFormat::Position:
+                readFace(FaceFormatTag<FaceFormat::Position>{});
+                break;
+            case FaceFormat::PositionTexCoord:
+                readFace(FaceFormatTag<FaceFormat::PositionTexCoord>{});
+                break;
+            case FaceFormat::PositionNormal:
+                readFace(FaceFormatTag<FaceFormat::PositionNormal>{});
+                break;
+            case FaceFormat::PositionTexCoordNormal:
+                readFace(FaceFormatTag<FaceFormat::PositionTexCoordNormal>{});
+                break;
             }
-
             break;
         }
 
         case g: {                // add groups
             if (line_size > 3) { // its a face group with a name as 'g' 'space'
                                  // '\n' is 3 characters
-                size_t pos = spacePositions[0];
-                size_t count = spacePositions[1] - spacePositions[0];
-                meshData.groupInfos.push_back(
-                    {{&line[pos], count - 1}, static_cast<uint32_t>(meshData.faceIndices.size())});
+                // the name is the first token, without the \r of a crlf file
+                const char* name = &line[spacePositions[0]];
+                size_t length = 0;
+                while (!detail::endOfToken(name[length])) {
+                    ++length;
+                }
+                meshData.addGroup({name, length},
+                                  static_cast<uint32_t>(meshData.faceIndices.size()));
 
             } else {
-                meshData.groupInfos.push_back({fmt::format("group{}", ++groupCount),
-                                               static_cast<uint32_t>(meshData.faceIndices.size())});
+                char generatedName[32];
+                auto nameEnd = fmt::format_to_n(generatedName, sizeof(generatedName), "group{}",
+                                                ++groupCount)
+                                   .out;
+                meshData.addGroup({generatedName, static_cast<size_t>(nameEnd - generatedName)},
+                                  static_cast<uint32_t>(meshData.faceIndices.size()));
             }
             groupJustAdded = true;
             break;
@@ -451,12 +1106,21 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
         }
     }
 
+    lineParseScope.end();
+
     // fix up groups
-    for (auto it = meshData.groupInfos.begin(); it != meshData.groupInfos.end() - 1; ++it) {
-        (*it).count = (*std::next(it)).startOffset - (*it).startOffset;
+    {
+        TRACE_SCOPE("group fixup");
+        // scans usually have no g lines at all, one group for the lot
+        if (meshData.groupInfos.empty()) {
+            meshData.addGroup("group0", 0);
+        }
+        for (auto it = meshData.groupInfos.begin(); it != meshData.groupInfos.end() - 1; ++it) {
+            (*it).count = (*std::next(it)).startOffset - (*it).startOffset;
+        }
+        meshData.groupInfos.back().count =
+            static_cast<int>(meshData.faceIndices.size() - meshData.groupInfos.back().startOffset);
     }
-    meshData.groupInfos.back().count =
-        static_cast<int>(meshData.faceIndices.size() - meshData.groupInfos.back().startOffset);
 
     fmt::print(stderr, "finished mesh read\n");
 
@@ -467,19 +1131,134 @@ RawMeshData readObjRaw(const std::string& filePath, const std::string& materialF
     return meshData;
 }
 
+// gives every corner that has no normal (index 0, the dummy) a generated one.
+// smooth sums the unnormalised face normals, so bigger triangles count for
+// more, into one normal per position. flat appends one per triangle, and the
+// dedup in readObjElements then splits the shared positions apart
+inline void generateMissingNormals(RawMeshData& meshData, MissingNormals mode) {
+    if (mode == MissingNormals::Keep) {
+        return;
+    }
+    TRACE_SCOPE("generate normals");
+    auto& corners = meshData.faceIndices;
+    const auto& positions = meshData.positions;
+    const auto existing = meshData.normals.size();
+
+    auto missing = [existing](const glm::ivec3& corner) {
+        return corner.z <= 0 || static_cast<size_t>(corner.z) >= existing;
+    };
+    auto validPosition = [&positions](const glm::ivec3& corner) {
+        return corner.x > 0 && static_cast<size_t>(corner.x) < positions.size();
+    };
+    auto faceNormal = [&](size_t first) {
+        if (!validPosition(corners[first]) || !validPosition(corners[first + 1]) ||
+            !validPosition(corners[first + 2])) {
+            return glm::vec3(0.f);
+        }
+        const auto& p0 = positions[corners[first].x];
+        return glm::cross(positions[corners[first + 1].x] - p0,
+                          positions[corners[first + 2].x] - p0);
+    };
+
+    // files without any vn skip the search, every triangle needs them
+    size_t missingTriangles = 0;
+    if (existing > 1) {
+        for (size_t t = 0; t + 2 < corners.size(); t += 3) {
+            missingTriangles += missing(corners[t]) || missing(corners[t + 1]) ||
+                                missing(corners[t + 2]);
+        }
+    } else {
+        missingTriangles = corners.size() / 3;
+    }
+    if (missingTriangles == 0) {
+        return;
+    }
+
+    if (mode == MissingNormals::Flat) {
+        meshData.normals.reserve(existing + missingTriangles);
+        for (size_t t = 0; t + 2 < corners.size(); t += 3) {
+            if (!missing(corners[t]) && !missing(corners[t + 1]) && !missing(corners[t + 2])) {
+                continue;
+            }
+            auto normal = faceNormal(t);
+            auto length = glm::length(normal);
+            auto index = static_cast<int>(meshData.normals.size());
+            meshData.normals.push_back(length > 0.f ? normal / length : glm::vec3(0.f, 1.f, 0.f));
+            for (auto c = t; c < t + 3; ++c) {
+                if (missing(corners[c])) {
+                    corners[c].z = index;
+                }
+            }
+        }
+        fmt::print(stderr, "generated {} flat normals\n", meshData.normals.size() - existing);
+        return;
+    }
+
+    // smooth. normal for position p lives at existing + p, index 0 included
+    // so the offset is the same for every corner
+    meshData.normals.resize(existing + positions.size(), glm::vec3(0.f));
+    auto* accumulated = meshData.normals.data() + existing;
+    for (size_t t = 0; t + 2 < corners.size(); t += 3) {
+        if (!missing(corners[t]) && !missing(corners[t + 1]) && !missing(corners[t + 2])) {
+            continue;
+        }
+        auto normal = faceNormal(t);
+        for (auto c = t; c < t + 3; ++c) {
+            if (validPosition(corners[c])) {
+                accumulated[corners[c].x] += normal;
+            }
+        }
+    }
+    for (size_t p = 0; p < positions.size(); ++p) {
+        auto length = glm::length(accumulated[p]);
+        accumulated[p] = length > 0.f ? accumulated[p] / length : glm::vec3(0.f, 1.f, 0.f);
+    }
+    for (auto& corner : corners) {
+        if (missing(corner) && validPosition(corner)) {
+            corner.z = static_cast<int>(existing) + corner.x;
+        }
+    }
+    fmt::print(stderr, "generated {} smooth normals\n", positions.size() - 1);
+}
+
 // backward compatibility! in ep 20
 RawMeshData readObjRaw(const std::string& filePath) {
+    auto counts = countLines(filePath);
+    auto meshData = readObjRaw(filePath, {}, nullptr, &counts);
+    generateMissingNormals(meshData, LoadSettings{}.missingNormals);
+    return meshData;
+}
 
-    return readObjRaw(filePath, {});
+// counts the lines, sizes an arena from them and reads into it. the arena has
+// to outlive the returned data
+inline RawMeshData readObjRawInto(std::unique_ptr<LoaderArena>& arena, const std::string& filePath,
+                                  const LoadSettings& settings) {
+    if (!settings.preScan && !settings.useArena) {
+        auto meshData = readObjRaw(filePath, {});
+        generateMissingNormals(meshData, settings.missingNormals);
+        return meshData;
+    }
+    auto counts = countLines(filePath);
+    fmt::print(stderr, "pre-scan: {} v {} vn {} vt {} f ({} tris {} quads {} polygons)\n",
+               counts.positions, counts.normals, counts.textureCoords, counts.faces,
+               counts.triangles, counts.quads, counts.polygons);
+    if (settings.useArena) {
+        arena = std::make_unique<LoaderArena>(LoaderArena::bytesFor(counts));
+    }
+    auto meshData = readObjRaw(filePath, {}, arena.get(), &counts);
+    generateMissingNormals(meshData, settings.missingNormals);
+    return meshData;
 }
 
 // for feeding into drawArrays as seperate triangles. hard to misuses as the
 // type indicates the usage
-MeshDataSplit readObjSplit(const std::string& filePath) {
-    auto rawMeshData = readObjRaw(filePath);
+MeshDataSplit readObjSplit(const std::string& filePath, const LoadSettings& settings = {}) {
+    TRACE_SCOPE("readObjSplit");
+    std::unique_ptr<LoaderArena> arena;
+    auto rawMeshData = readObjRawInto(arena, filePath, settings);
 
     MeshDataSplit meshData;
-    meshData.groupInfos = std::move(rawMeshData.groupInfos);
+    meshData.groupInfos = rawMeshData.copyGroupInfos();
 
     meshData.vertices.resize(rawMeshData.faceIndices.size());
     if (rawMeshData.textureCoords.size() == 0) {
@@ -497,39 +1276,77 @@ MeshDataSplit readObjSplit(const std::string& filePath) {
                                 rawMeshData.textureCoords[rawMeshData.faceIndices[i].y]};
     }
 
-        fmt::print("size {}", meshData.vertices.size());
+        fmt::print(stderr, "size {}\n", meshData.vertices.size());
+
+    {
+        TRACE_SCOPE("bounds");
+        meshData.bounds = bounds::ofPositions(&rawMeshData.positions.data()[1].x,
+                                              rawMeshData.positions.size() - 1);
+        // each group's vertices are a contiguous run
+        for (auto& group : meshData.groupInfos) {
+            if (group.count == 0) {
+                continue;
+            }
+            group.bounds = bounds::ofVertices(&meshData.vertices[group.startOffset].position.x,
+                                              group.count, sizeof(vertex3D) / sizeof(float));
+        }
+    }
 
     return meshData;
 }
 
+// group bounds for indexed data. the group's indices can point anywhere in
+// the vertices so this gathers through them
+inline void groupBoundsFromIndices(MeshDataElements& meshData) {
+    if (meshData.vertices.empty()) {
+        return;
+    }
+    for (auto& group : meshData.groupInfos) {
+        group.bounds = bounds::ofIndexedVertices(&meshData.vertices[0].position.x,
+                                                 sizeof(vertex3D) / sizeof(float),
+                                                 meshData.indices.data() + group.startOffset,
+                                                 group.count);
+    }
+}
+
 // for feeding into drawArrayElements
-MeshDataElements readObjElements(const std::string& filePath) {
+MeshDataElements readObjElements(const std::string& filePath, const LoadSettings& settings = {}) {
+    TRACE_SCOPE("readObjElements");
     using namespace std::chrono;
 
-    auto rawMeshData = readObjRaw(filePath);
+    std::unique_ptr<LoaderArena> arena;
+    auto rawMeshData = readObjRawInto(arena, filePath, settings);
     auto startTime = system_clock::now();
 
     MeshDataElements meshData;
 
     // add groups
-    meshData.groupInfos = std::move(rawMeshData.groupInfos);
+    meshData.groupInfos = rawMeshData.copyGroupInfos();
     meshData.indices.resize(rawMeshData.faceIndices.size());
-    std::vector<int> trackingIds(rawMeshData.faceIndices.size());
+
+    // temporaries share the raw data's arena (or the heap without one)
+    auto temporaries = rawMeshData.positions.get_allocator();
+    std::pmr::vector<int> trackingIds(rawMeshData.faceIndices.size(), temporaries);
 
     // for building offsets of unique ranges
-    std::vector<int> trackingUniqueIds(rawMeshData.faceIndices.size());
+    std::pmr::vector<int> trackingUniqueIds(rawMeshData.faceIndices.size(), temporaries);
     std::iota(trackingIds.begin(), trackingIds.end(), 0);
     std::iota(trackingUniqueIds.begin(), trackingUniqueIds.end(), 0);
 
-    std::sort(trackingIds.begin(), trackingIds.end(), [&rawMeshData](int a, int b) {
-        return rawMeshData.faceIndices[a] < rawMeshData.faceIndices[b];
-    });
+    {
+        TRACE_SCOPE("dedup sort");
+        std::sort(trackingIds.begin(), trackingIds.end(), [&rawMeshData](int a, int b) {
+            return rawMeshData.faceIndices[a] < rawMeshData.faceIndices[b];
+        });
+    }
 
+    tracer::Scope uniqueScope("unique");
     auto uniqueEndIt = std::unique(trackingUniqueIds.begin(), trackingUniqueIds.end(),
                                    [&trackingIds, &rawMeshData](int a, int b) {
                                        return rawMeshData.faceIndices[trackingIds[a]] ==
                                               rawMeshData.faceIndices[trackingIds[b]];
                                    });
+    uniqueScope.end();
 
     // how many unique vertices
     auto count = std::distance(trackingUniqueIds.begin(), uniqueEndIt);
@@ -538,6 +1355,7 @@ MeshDataElements readObjElements(const std::string& filePath) {
 
     fmt::print(stderr, "unique point count is {}\n", count);
 
+    tracer::Scope scatterScope("scatter");
     std::atomic<int> k{0};
 //#pragma omp parallel for
     for (auto i = 1ll; i <= count; ++i) {
@@ -556,6 +1374,14 @@ MeshDataElements readObjElements(const std::string& filePath) {
     for (auto j = trackingUniqueIds[count - 1]; j < rawMeshData.faceIndices.size(); ++j) {
         meshData.indices[trackingIds[j]] = static_cast<int>(count - 1);
     }
+    scatterScope.end();
+
+    {
+        TRACE_SCOPE("bounds");
+        meshData.bounds = bounds::ofPositions(&rawMeshData.positions.data()[1].x,
+                                              rawMeshData.positions.size() - 1);
+        groupBoundsFromIndices(meshData);
+    }
 
     auto timeTaken = duration<float>(system_clock::now() - startTime).count();
     fmt::print(stderr, "indexing time taken {}\n", timeTaken);
@@ -572,7 +1398,7 @@ MeshDataElements readObjElementsMap(const std::string& filePath) {
     MeshDataElements meshData;
     std::unordered_map<vertex3D, uint32_t> uniqueVertices;
     // add groups
-    meshData.groupInfos = std::move(rawMeshData.groupInfos);
+    meshData.groupInfos = rawMeshData.copyGroupInfos();
 
     //#pragma omp parallel for
     for (auto i = 0u; i < rawMeshData.faceIndices.size(); ++i) {
@@ -591,6 +1417,10 @@ MeshDataElements readObjElementsMap(const std::string& filePath) {
 
     fmt::print(stderr, "total unique count {}\n", uniqueVertices.size());
 
+    meshData.bounds = bounds::ofPositions(&rawMeshData.positions.data()[1].x,
+                                          rawMeshData.positions.size() - 1);
+    groupBoundsFromIndices(meshData);
+
     auto timeTaken = duration<float>(system_clock::now() - startTime).count();
     fmt::print(stderr, "indexing map time taken {}\n", timeTaken);
 
@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <numeric>
+#include <atomic>
 
 //#include "ska_sort.hpp"
 //#include <boost/sort/sort.hpp>
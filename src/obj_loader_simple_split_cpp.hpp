@@ -198,7 +198,7 @@ MeshDataSplit readObjSplit(const std::string& filePath) {
             rawMeshData.textureCoords[rawMeshData.faceIndices[i].y]};
     }
 
-    fmt::print("size {}", meshData.vertices.size());
+    fmt::print(stderr, "size {}\n", meshData.vertices.size());
 
     return meshData;
 }
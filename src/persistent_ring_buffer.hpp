@@ -0,0 +1,175 @@
+#pragma once
+
+// a persistently mapped buffer split into frameCount regions (3 by default).
+// each frame we bump-allocate out of one region and write straight into the
+// mapped pointer, then drop a fence. before a region is reused we wait on its
+// fence, so the cpu can build frame N+1 while the gpu is still reading frame N
+// and we never call glBufferSubData or map/unmap per frame.
+//
+//  ring.beginFrame();
+//  auto frame = ring.write(&uniforms, 1, ring.uniformAlignment());
+//  glBindBufferRange(GL_UNIFORM_BUFFER, 0, ring.buffer(), frame.offset, frame.size);
+//  ... draw ...
+//  ring.endFrame();
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace gl;
+
+namespace gpuStreaming {
+
+class PersistentRingBuffer {
+  public:
+    struct Allocation {
+        void* data = nullptr;
+        // offset from the start of the whole buffer, ready for
+        // glBindBufferRange or as an indirect/element buffer offset
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    PersistentRingBuffer(size_t bytesPerFrame, int frameCount = 3)
+        : frameCount(frameCount)
+        , fences(frameCount, nullptr) {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformOffsetAlignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageOffsetAlignment);
+
+        // keep every region start aligned for any use
+        auto maxAlignment =
+            static_cast<size_t>(std::max(uniformOffsetAlignment, storageOffsetAlignment));
+        regionSize = alignUp(bytesPerFrame, maxAlignment);
+
+        glCreateBuffers(1, &bufferName);
+        glNamedBufferStorage(bufferName, regionSize * frameCount, nullptr,
+                             GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+        mapped = static_cast<std::byte*>(
+            glMapNamedBufferRange(bufferName, 0, regionSize * frameCount,
+                                  GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT));
+        if (!mapped) {
+            fmt::print(stderr, "failed to persistently map ring buffer\n");
+        }
+    }
+
+    ~PersistentRingBuffer() {
+        for (auto fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+        if (bufferName) {
+            glUnmapNamedBuffer(bufferName);
+            glDeleteBuffers(1, &bufferName);
+        }
+    }
+
+    PersistentRingBuffer(const PersistentRingBuffer&) = delete;
+    PersistentRingBuffer& operator=(const PersistentRingBuffer&) = delete;
+
+    // moves on to the next region. only blocks if the gpu hasn't finished
+    // with the frame that used it frameCount frames ago
+    void beginFrame() {
+        currentRegion = (currentRegion + 1) % frameCount;
+        regionOffset = 0;
+
+        auto& fence = fences[currentRegion];
+        if (!fence) {
+            return;
+        }
+        // flushing makes sure the fence actually reaches the gpu
+        while (true) {
+            auto result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, oneSecondInNs);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+                break;
+            }
+            if (result == GL_WAIT_FAILED) {
+                fmt::print(stderr, "ring buffer fence wait failed\n");
+                break;
+            }
+            ++stallCount;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // call after the last draw that reads this frame's region
+    void endFrame() {
+        fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+    }
+
+    // space for this frame. returns an empty allocation if the region is full
+    Allocation allocate(size_t size, size_t alignment) {
+        auto offset = alignUp(regionOffset, std::max<size_t>(alignment, 1));
+        if (offset + size > regionSize) {
+            fmt::print(stderr, "ring buffer region full, asked for {} bytes with {} left\n", size,
+                       regionSize - regionOffset);
+            return {};
+        }
+        regionOffset = offset + size;
+
+        auto bufferOffset = currentRegion * regionSize + offset;
+        return {mapped + bufferOffset, static_cast<GLintptr>(bufferOffset),
+                static_cast<GLsizeiptr>(size)};
+    }
+
+    // allocate and copy in one go
+    template <typename T> Allocation write(const T* data, size_t count, size_t alignment) {
+        auto allocation = allocate(sizeof(T) * count, alignment);
+        if (allocation.data) {
+            std::memcpy(allocation.data, data, sizeof(T) * count);
+        }
+        return allocation;
+    }
+
+    template <typename T> Allocation write(const std::vector<T>& data, size_t alignment) {
+        return write(data.data(), data.size(), alignment);
+    }
+
+    void bindRange(GLenum target, GLuint index, const Allocation& allocation) const {
+        glBindBufferRange(target, index, bufferName, allocation.offset, allocation.size);
+    }
+
+    GLuint buffer() const {
+        return bufferName;
+    }
+
+    size_t uniformAlignment() const {
+        return static_cast<size_t>(uniformOffsetAlignment);
+    }
+
+    size_t storageAlignment() const {
+        return static_cast<size_t>(storageOffsetAlignment);
+    }
+
+    // how many times beginFrame had to wait more than a second. should stay 0
+    uint64_t stalls() const {
+        return stallCount;
+    }
+
+  private:
+    static size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr GLuint64 oneSecondInNs = 1000000000;
+
+    int frameCount;
+    std::vector<GLsync> fences;
+    GLint uniformOffsetAlignment = 256;
+    GLint storageOffsetAlignment = 256;
+    size_t regionSize = 0;
+    GLuint bufferName = 0;
+    std::byte* mapped = nullptr;
+    int currentRegion = 0;
+    size_t regionOffset = 0;
+    uint64_t stallCount = 0;
+};
+
+} // namespace gpuStreaming
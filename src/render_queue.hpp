@@ -0,0 +1,268 @@
+#pragma once
+
+// rather than each pass binding its program and vao and drawing in whatever
+// order the code happens to be written, draws are submitted to a queue with
+// the state they need. once a frame the queue sorts them by a 64 bit key
+//
+//   63..60 pass | 59..48 program | 47..36 vao | 35..20 texture | 19..0 depth
+//
+// so draws that share state end up next to each other, binds only happen when
+// the state actually changes, and runs of draws with the same state go out as
+// one glMultiDrawElementsIndirect. within a pass and state, opaque draws go
+// front to back (so early z throws away what's hidden) and blended ones back
+// to front.
+//
+// each pass can have its own colour/depth write and depth test state, which
+// is how a depth pre-pass works: the pre-pass writes depth only, then the
+// opaque pass tests GL_EQUAL against it so only the visible fragment of each
+// pixel runs the real fragment shader.
+//
+// per draw data has to come from somewhere the batch can't break, so shaders
+// index it by gl_BaseInstance, as the mesh pool's commands allow. uniforms set
+// with glProgramUniform before flush() stay with their program.
+//
+//  renderQueue::RenderQueue queue(10000);
+//  queue.submit({renderQueue::Pass::Opaque, program, vao, 0, 0, depth, command});
+//  auto stats = queue.flush();
+
+#include "draw_indirect.hpp"
+#include "persistent_ring_buffer.hpp"
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace gl;
+
+namespace renderQueue {
+
+// drawn in this order
+enum class Pass : uint8_t { DepthPrepass, Opaque, Background, Transparent, Count };
+
+// set when the pass starts, and put back to the defaults after the flush (a
+// depth mask left off would stop glClearBufferfv clearing depth)
+struct PassState {
+    bool colourWrites = true;
+    bool depthWrites = true;
+    GLenum depthFunc = GL_LESS;
+};
+
+struct Draw {
+    Pass pass = Pass::Opaque;
+    GLuint program = 0;
+    GLuint vao = 0;
+    // bound to textureUnit. 0 leaves the unit as it is, for textures that are
+    // bound once up front
+    GLuint texture = 0;
+    GLuint textureUnit = 0;
+    // 0 near to 1 far, anything will do as long as it's consistent. only
+    // orders draws within the same state
+    float depth = 0.f;
+    DrawElementsIndirectCommand command{};
+};
+
+struct FrameStats {
+    uint32_t draws = 0;
+    uint32_t batches = 0;
+    uint32_t programBinds = 0;
+    uint32_t vaoBinds = 0;
+    uint32_t textureBinds = 0;
+    // binds an unsorted, unbatched loop would have made that were left out
+    uint32_t skippedBinds = 0;
+};
+
+namespace detail {
+
+struct Entry {
+    uint64_t key;
+    uint32_t draw;
+};
+
+// least significant byte first, 8 bits at a time. passes where every key has
+// the same byte are skipped, which with a handful of programs and vaos is
+// most of the upper ones
+inline void radixSort(std::vector<Entry>& entries, std::vector<Entry>& scratch) {
+    scratch.resize(entries.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        std::array<uint32_t, 256> counts{};
+        for (const auto& entry : entries) {
+            ++counts[(entry.key >> shift) & 0xff];
+        }
+        if (std::any_of(counts.begin(), counts.end(),
+                        [&](uint32_t count) { return count == entries.size(); })) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for (auto& count : counts) {
+            auto bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+        for (const auto& entry : entries) {
+            scratch[counts[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
+
+} // namespace detail
+
+class RenderQueue {
+  public:
+    // commands for up to maxDraws a frame go through a persistently mapped
+    // ring, so the cpu never waits on the frame the gpu is drawing
+    explicit RenderQueue(size_t maxDraws)
+        : ring(std::max<size_t>(maxDraws, 1) * sizeof(DrawElementsIndirectCommand)) {
+        passStates[size_t(Pass::DepthPrepass)].colourWrites = false;
+    }
+
+    void setPassState(Pass pass, const PassState& state) {
+        passStates[size_t(pass)] = state;
+    }
+
+    void submit(const Draw& draw) {
+        draws.push_back(draw);
+    }
+
+    uint64_t sortKey(const Draw& draw) {
+        // quantised so nearby depths don't split what would otherwise sort
+        // together by state
+        float depth = std::clamp(draw.depth, 0.f, 1.f);
+        if (draw.pass == Pass::Transparent) {
+            depth = 1.f - depth;
+        }
+        auto depthBucket = static_cast<uint64_t>(depth * float(depthMask));
+        return (uint64_t(draw.pass) & 0xf) << 60 |
+               (denseId(programIds, draw.program) & 0xfff) << 48 |
+               (denseId(vaoIds, draw.vao) & 0xfff) << 36 |
+               (denseId(textureIds, draw.texture) & 0xffff) << 20 | depthBucket;
+    }
+
+    // sorts, batches and draws everything submitted since the last flush
+    FrameStats flush() {
+        FrameStats stats;
+        stats.draws = static_cast<uint32_t>(draws.size());
+        if (draws.empty()) {
+            return stats;
+        }
+
+        entries.clear();
+        for (auto i = 0u; i < draws.size(); ++i) {
+            entries.push_back({sortKey(draws[i]), i});
+        }
+        detail::radixSort(entries, scratch);
+
+        sortedCommands.clear();
+        for (const auto& entry : entries) {
+            sortedCommands.push_back(draws[entry.draw].command);
+        }
+
+        ring.beginFrame();
+        auto allocation = ring.write(sortedCommands, alignof(DrawElementsIndirectCommand));
+        if (!allocation.data) {
+            draws.clear();
+            return stats;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer());
+
+        // nothing is known to be bound when we start, something else could
+        // have changed it since the last flush
+        GLuint boundProgram = unknown;
+        GLuint boundVao = unknown;
+        auto currentPass = Pass::Count;
+        std::unordered_map<GLuint, GLuint> boundTextures;
+
+        size_t batchStart = 0;
+        auto drawBatch = [&](size_t batchEnd) {
+            const auto& state = draws[entries[batchStart].draw];
+            if (state.pass != currentPass) {
+                applyPassState(passStates[size_t(state.pass)]);
+                currentPass = state.pass;
+            }
+            if (state.program != boundProgram) {
+                glUseProgram(state.program);
+                boundProgram = state.program;
+                ++stats.programBinds;
+            }
+            if (state.vao != boundVao) {
+                glBindVertexArray(state.vao);
+                boundVao = state.vao;
+                ++stats.vaoBinds;
+            }
+            if (state.texture) {
+                auto bound = boundTextures.find(state.textureUnit);
+                if (bound == boundTextures.end() || bound->second != state.texture) {
+                    glBindTextureUnit(state.textureUnit, state.texture);
+                    boundTextures[state.textureUnit] = state.texture;
+                    ++stats.textureBinds;
+                }
+            }
+            auto offset = allocation.offset + batchStart * sizeof(DrawElementsIndirectCommand);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                        reinterpret_cast<const void*>(offset),
+                                        static_cast<GLsizei>(batchEnd - batchStart), 0);
+            ++stats.batches;
+        };
+
+        for (auto i = 1u; i <= entries.size(); ++i) {
+            if (i == entries.size() ||
+                !sameState(draws[entries[i].draw], draws[entries[batchStart].draw])) {
+                drawBatch(i);
+                batchStart = i;
+            }
+        }
+        ring.endFrame();
+        applyPassState(PassState{});
+
+        // a bind of each kind per draw is what drawing them one by one costs
+        auto texturedDraws = std::count_if(draws.begin(), draws.end(),
+                                           [](const Draw& draw) { return draw.texture != 0; });
+        stats.skippedBinds = stats.draws * 2 + static_cast<uint32_t>(texturedDraws) -
+                             stats.programBinds - stats.vaoBinds - stats.textureBinds;
+
+        draws.clear();
+        return stats;
+    }
+
+  private:
+    static constexpr GLuint unknown = ~GLuint(0);
+    static constexpr uint64_t depthMask = (1u << 20) - 1;
+
+    static void applyPassState(const PassState& state) {
+        auto colour = state.colourWrites ? GL_TRUE : GL_FALSE;
+        glColorMask(colour, colour, colour, colour);
+        glDepthMask(state.depthWrites ? GL_TRUE : GL_FALSE);
+        glDepthFunc(state.depthFunc);
+    }
+
+    static bool sameState(const Draw& a, const Draw& b) {
+        return a.pass == b.pass && a.program == b.program && a.vao == b.vao &&
+               a.texture == b.texture && (a.texture == 0 || a.textureUnit == b.textureUnit);
+    }
+
+    // gl names can be anything, so each gets a small id the first time it's
+    // seen. ids stay the same from frame to frame so the order does too
+    static uint64_t denseId(std::unordered_map<GLuint, uint32_t>& ids, GLuint name) {
+        auto it = ids.find(name);
+        if (it == ids.end()) {
+            it = ids.emplace(name, static_cast<uint32_t>(ids.size())).first;
+        }
+        return it->second;
+    }
+
+    gpuStreaming::PersistentRingBuffer ring;
+    std::array<PassState, size_t(Pass::Count)> passStates{};
+    std::vector<Draw> draws;
+    std::vector<detail::Entry> entries;
+    std::vector<detail::Entry> scratch;
+    std::vector<DrawElementsIndirectCommand> sortedCommands;
+    std::unordered_map<GLuint, uint32_t> programIds;
+    std::unordered_map<GLuint, uint32_t> vaoIds;
+    std::unordered_map<GLuint, uint32_t> textureIds;
+};
+
+} // namespace renderQueue
@@ -0,0 +1,415 @@
+#pragma once
+
+// full screen effects cost the same for every pixel, so the cheapest pixel is
+// one that isn't shaded. ScaledRenderer has the effect draw into a target a
+// fraction of the window's size and scales the result up with a linear blit,
+// so a scale of 0.5 shades a quarter of the pixels.
+//
+// checkerboard mode halves it again. each frame shades every other pixel, in
+// a checkerboard that flips each frame, into a half width target. a resolve
+// pass then fills the pixels that weren't shaded from the last resolved frame,
+// clamped to the range of the four neighbours shaded this frame so anything
+// that moved doesn't leave a trail. a procedural effect has no motion vectors,
+// so the history is reprojected with zero motion and the clamp does the rest.
+//
+// with a targetMs the scale isn't fixed. the effect is timed on the gpu and
+// the scale moves (in steps, a few frames apart) to keep it near the target.
+//
+// the effect's fragment shader puts renderScale::glsl straight after #version
+// and uses effectFragCoord() where it used gl_FragCoord. iResolution is set to
+// the size being shaded.
+//
+//  renderScale::ScaledRenderer scaled({0.5f, true});
+//  while (...) {
+//      scaled.begin(program, framebufferWidth, framebufferHeight);
+//      glDrawArrays(GL_TRIANGLES, 0, 3);
+//      scaled.end();
+//      glfwSwapBuffers(window);
+//  }
+
+#include "error_handling.hpp"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+using namespace gl;
+
+namespace renderScale {
+
+constexpr const char* glsl = R"(
+    // the size of the image being shaded, not of the window
+    uniform vec2 iResolution;
+    // which half of the checkerboard this frame shades, or -1 for all of it
+    uniform int checkerboardParity;
+
+    // in checkerboard mode each texel of the half width target stands for
+    // one of a pair of pixels, the left one on even rows of even frames
+    vec2 effectFragCoord() {
+        if (checkerboardParity < 0) {
+            return gl_FragCoord.xy;
+        }
+        ivec2 texel = ivec2(gl_FragCoord.xy);
+        int x = texel.x * 2 + ((texel.y + checkerboardParity) & 1);
+        return vec2(x, texel.y) + 0.5f;
+    }
+)";
+
+struct Settings {
+    // of the window's width and height
+    float scale = 1.f;
+    bool checkerboard = false;
+    // above 0 the scale is picked to keep the effect's gpu time near this
+    float targetMs = 0.f;
+    float minScale = 0.25f;
+    float maxScale = 1.f;
+};
+
+// frame times in, scales out
+class ScaleController {
+  public:
+    ScaleController(float scale, float minScale, float maxScale)
+        : current(std::clamp(scale, minScale, maxScale))
+        , minScale(minScale)
+        , maxScale(maxScale) {}
+
+    float update(float frameMs, float targetMs) {
+        if (frameMs <= 0.f || targetMs <= 0.f) {
+            return current;
+        }
+        smoothedMs = smoothedMs > 0.f ? smoothedMs * 0.9f + frameMs * 0.1f : frameMs;
+        if (cooldown > 0) {
+            --cooldown;
+            return current;
+        }
+        // the cost goes with the pixel count, which is the square of the scale
+        float ideal = std::clamp(current * std::sqrt(targetMs / smoothedMs), minScale, maxScale);
+        if (std::abs(ideal - current) < step) {
+            return current;
+        }
+        float next = std::clamp(std::round(ideal / step) * step, minScale, maxScale);
+        // expect the time to follow the scale, rather than waiting for the
+        // average to catch up
+        smoothedMs *= (next * next) / (current * current);
+        current = next;
+        // the timings lag a few frames behind, let them come from the new scale
+        cooldown = 8;
+        return current;
+    }
+
+    float scale() const {
+        return current;
+    }
+
+  private:
+    // so the targets aren't remade every frame for a 1% change
+    static constexpr float step = 1.f / 16.f;
+
+    float current;
+    float minScale;
+    float maxScale;
+    float smoothedMs = 0.f;
+    int cooldown = 0;
+};
+
+class ScaledRenderer {
+  public:
+    explicit ScaledRenderer(const Settings& settings = {})
+        : currentSettings(settings)
+        , controller(settings.scale, settings.minScale, settings.maxScale) {
+        resolveProgram = createResolveProgram();
+        resolveParityLocation = glGetUniformLocation(resolveProgram, "parity");
+        resolveHistoryLocation = glGetUniformLocation(resolveProgram, "historyValid");
+        glCreateVertexArrays(1, &emptyVao);
+        glCreateQueries(GL_TIME_ELAPSED, static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    ~ScaledRenderer() {
+        releaseTargets();
+        glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        glDeleteVertexArrays(1, &emptyVao);
+        glDeleteProgram(resolveProgram);
+    }
+
+    ScaledRenderer(const ScaledRenderer&) = delete;
+    ScaledRenderer& operator=(const ScaledRenderer&) = delete;
+
+    void setSettings(const Settings& settings) {
+        currentSettings = settings;
+        controller = ScaleController(settings.scale, settings.minScale, settings.maxScale);
+    }
+
+    const Settings& settings() const {
+        return currentSettings;
+    }
+
+    // binds what the effect draws into, with its viewport, and sets the
+    // program's iResolution and checkerboardParity
+    void begin(GLuint program, int framebufferWidth, int framebufferHeight) {
+        windowWidth = std::max(framebufferWidth, 1);
+        windowHeight = std::max(framebufferHeight, 1);
+        auto scaleNow = scale();
+        auto newWidth = std::max(1, static_cast<int>(std::lround(windowWidth * scaleNow)));
+        auto newHeight = std::max(1, static_cast<int>(std::lround(windowHeight * scaleNow)));
+        bool resized = newWidth != shadedWidth || newHeight != shadedHeight;
+        shadedWidth = newWidth;
+        shadedHeight = newHeight;
+        if (resized || currentSettings.checkerboard != targetsCheckerboard ||
+            direct() != targetsDirect) {
+            createTargets();
+        }
+        parity = static_cast<int>(frame & 1);
+
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % queries.size()]);
+        if (direct()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, windowWidth, windowHeight);
+        } else if (currentSettings.checkerboard) {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadeFramebuffer);
+            glViewport(0, 0, (shadedWidth + 1) / 2, shadedHeight);
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadeFramebuffer);
+            glViewport(0, 0, shadedWidth, shadedHeight);
+        }
+        glProgramUniform2f(program, glGetUniformLocation(program, "iResolution"),
+                           static_cast<float>(shadedWidth), static_cast<float>(shadedHeight));
+        glProgramUniform1i(program, glGetUniformLocation(program, "checkerboardParity"),
+                           currentSettings.checkerboard ? parity : -1);
+    }
+
+    // fills in the checkerboard and scales up into the default framebuffer.
+    // the program and vao bound before are bound again after
+    void end() {
+        if (currentSettings.checkerboard) {
+            GLint program = 0;
+            GLint vao = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+            glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+
+            auto written = static_cast<size_t>(frame & 1);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffers[written]);
+            glViewport(0, 0, shadedWidth, shadedHeight);
+            glUseProgram(resolveProgram);
+            glProgramUniform1i(resolveProgram, resolveParityLocation, parity);
+            glProgramUniform1i(resolveProgram, resolveHistoryLocation, historyValid ? 1 : 0);
+            glBindTextureUnit(0, shadeTexture);
+            glBindTextureUnit(1, resolveTextures[1 - written]);
+            glBindVertexArray(emptyVao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            historyValid = true;
+
+            glBlitNamedFramebuffer(resolveFramebuffers[written], 0, 0, 0, shadedWidth,
+                                   shadedHeight, 0, 0, windowWidth, windowHeight,
+                                   GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            glUseProgram(static_cast<GLuint>(program));
+            glBindVertexArray(static_cast<GLuint>(vao));
+        } else if (!direct()) {
+            glBlitNamedFramebuffer(shadeFramebuffer, 0, 0, 0, shadedWidth, shadedHeight, 0, 0,
+                                   windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // the oldest query, if the gpu has got to it. never waits
+        ++frame;
+        if (frame >= queries.size()) {
+            auto query = queries[frame % queries.size()];
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                lastGpuMs = static_cast<float>(nanoseconds / 1e6);
+                controller.update(lastGpuMs, currentSettings.targetMs);
+            }
+        }
+    }
+
+    // what begin() will use next
+    float scale() const {
+        return currentSettings.targetMs > 0.f ? controller.scale()
+                                               : std::clamp(currentSettings.scale, 0.05f, 1.f);
+    }
+
+    int width() const {
+        return shadedWidth;
+    }
+
+    int height() const {
+        return shadedHeight;
+    }
+
+    // pixels the effect shades per frame
+    int64_t shadedPixels() const {
+        auto columns = currentSettings.checkerboard ? (shadedWidth + 1) / 2 : shadedWidth;
+        return int64_t(columns) * shadedHeight;
+    }
+
+    // the effect, resolve and scale up, a few frames ago
+    float gpuMs() const {
+        return lastGpuMs;
+    }
+
+  private:
+    static constexpr const char* resolveVertexSource = R"(
+        #version 450 core
+
+        const vec4 vertices[] = vec4[]( vec4(-1.f, -1.f, 0.0, 1.0),
+                                        vec4( 3.f, -1.f, 0.0, 1.0),
+                                        vec4(-1.f,  3.f, 0.0, 1.0));
+
+        void main(){
+            gl_Position = vertices[gl_VertexID];
+        }
+    )";
+
+    static constexpr const char* resolveFragmentSource = R"(
+        #version 450 core
+
+        // this frame's half, half as wide as the output
+        layout (binding = 0) uniform sampler2D shaded;
+        // the last resolved frame
+        layout (binding = 1) uniform sampler2D history;
+
+        uniform int parity;
+        uniform bool historyValid;
+
+        out vec4 finalColor;
+
+        // only for pixels on this frame's half of the checkerboard
+        vec4 shadedAt(ivec2 pixel) {
+            ivec2 size = textureSize(shaded, 0);
+            return texelFetch(shaded, clamp(ivec2(pixel.x >> 1, pixel.y), ivec2(0), size - 1), 0);
+        }
+
+        void main() {
+            ivec2 pixel = ivec2(gl_FragCoord.xy);
+            if ((pixel.x & 1) == ((pixel.y + parity) & 1)) {
+                finalColor = shadedAt(pixel);
+                return;
+            }
+            // the four pixels next to one that wasn't shaded all were
+            vec4 left = shadedAt(pixel - ivec2(1, 0));
+            vec4 right = shadedAt(pixel + ivec2(1, 0));
+            vec4 down = shadedAt(pixel - ivec2(0, 1));
+            vec4 up = shadedAt(pixel + ivec2(0, 1));
+            vec4 lowest = min(min(left, right), min(down, up));
+            vec4 highest = max(max(left, right), max(down, up));
+
+            vec4 previous = historyValid ? texelFetch(history, pixel, 0)
+                                         : (left + right + down + up) * 0.25f;
+            finalColor = clamp(previous, lowest, highest);
+        }
+    )";
+
+    static GLuint createResolveProgram() {
+        auto vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        const char* vertexSource = resolveVertexSource;
+        glShaderSource(vertexShader, 1, &vertexSource, nullptr);
+        glCompileShader(vertexShader);
+        errorHandler::checkShader(vertexShader, "Checkerboard resolve vertex");
+
+        auto fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        const char* fragmentSource = resolveFragmentSource;
+        glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
+        glCompileShader(fragmentShader);
+        errorHandler::checkShader(fragmentShader, "Checkerboard resolve fragment");
+
+        auto program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return program;
+    }
+
+    // full resolution and no checkerboard draws straight to the window
+    bool direct() const {
+        return !currentSettings.checkerboard && shadedWidth == windowWidth &&
+               shadedHeight == windowHeight;
+    }
+
+    GLuint createTarget(GLuint& texture, int targetWidth, int targetHeight) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, 1, GL_RGBA8, targetWidth, targetHeight);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLuint framebuffer;
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, texture, 0);
+        if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+            fmt::print(stderr, "render scale target {}x{} is incomplete\n", targetWidth,
+                       targetHeight);
+        }
+        return framebuffer;
+    }
+
+    void createTargets() {
+        releaseTargets();
+        targetsCheckerboard = currentSettings.checkerboard;
+        targetsDirect = direct();
+        historyValid = false;
+        if (targetsDirect) {
+            return;
+        }
+        if (targetsCheckerboard) {
+            shadeFramebuffer = createTarget(shadeTexture, (shadedWidth + 1) / 2, shadedHeight);
+            for (auto i = 0u; i < resolveTextures.size(); ++i) {
+                resolveFramebuffers[i] =
+                    createTarget(resolveTextures[i], shadedWidth, shadedHeight);
+            }
+        } else {
+            shadeFramebuffer = createTarget(shadeTexture, shadedWidth, shadedHeight);
+        }
+    }
+
+    void releaseTargets() {
+        glDeleteFramebuffers(1, &shadeFramebuffer);
+        glDeleteTextures(1, &shadeTexture);
+        glDeleteFramebuffers(static_cast<GLsizei>(resolveFramebuffers.size()),
+                             resolveFramebuffers.data());
+        glDeleteTextures(static_cast<GLsizei>(resolveTextures.size()), resolveTextures.data());
+        shadeFramebuffer = 0;
+        shadeTexture = 0;
+        resolveFramebuffers = {};
+        resolveTextures = {};
+    }
+
+    Settings currentSettings;
+    ScaleController controller;
+
+    GLuint resolveProgram = 0;
+    GLint resolveParityLocation = -1;
+    GLint resolveHistoryLocation = -1;
+    GLuint emptyVao = 0;
+
+    // the effect draws into this, half width in checkerboard mode
+    GLuint shadeFramebuffer = 0;
+    GLuint shadeTexture = 0;
+    // resolved frames, written and read as history in turn
+    std::array<GLuint, 2> resolveFramebuffers{};
+    std::array<GLuint, 2> resolveTextures{};
+    bool targetsCheckerboard = false;
+    bool targetsDirect = false;
+    bool historyValid = false;
+
+    std::array<GLuint, 4> queries{};
+    uint64_t frame = 0;
+    int parity = 0;
+    float lastGpuMs = 0.f;
+
+    int windowWidth = 0;
+    int windowHeight = 0;
+    int shadedWidth = 0;
+    int shadedHeight = 0;
+};
+
+} // namespace renderScale
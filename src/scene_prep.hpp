@@ -0,0 +1,191 @@
+#pragma once
+
+// cpu side of drawing lots of animated, instanced meshes. everything that used
+// to happen on the main thread before a draw (animating transforms, culling,
+// building the indirect commands) is split into jobs so the gl thread only has
+// to bind the results and issue one glMultiDrawElementsIndirect.
+//
+// objects are kept sorted by mesh and cut into chunks that never cross a mesh
+// boundary. a frame is three steps:
+//  1. (jobs) each chunk animates and culls its objects, packing the visible
+//     transforms to the front of its own slice of scratch
+//  2. (one thread) prefix sum over the chunk counts gives every chunk its
+//     output offset, and every mesh its baseInstance and instanceCount
+//  3. (jobs) each chunk copies its visible transforms to the output, which can
+//     be straight into a persistently mapped buffer
+//
+// the shader then finds its transform at gl_BaseInstance + gl_InstanceID.
+
+#include "bounds.hpp"
+#include "draw_indirect.hpp"
+#include "job_system.hpp"
+#include "trace.hpp"
+
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace scenePrep {
+
+// where a mesh lives in the shared vertex/index buffers
+struct MeshInfo {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t baseVertex = 0;
+    // around the mesh's own origin, used for culling
+    float boundingRadius = 1.0f;
+};
+
+struct SceneObject {
+    glm::vec3 position;
+    float phase;
+    float scale;
+    float spinSpeed;
+    uint32_t mesh;
+};
+
+struct Chunk {
+    uint32_t begin;
+    uint32_t end;
+    uint32_t mesh;
+    uint32_t visible;
+    uint32_t outputOffset;
+};
+
+struct Scene {
+    std::vector<MeshInfo> meshes;
+    // sorted by mesh
+    std::vector<SceneObject> objects;
+    std::vector<Chunk> chunks;
+    std::vector<glm::mat4> scratch;
+};
+
+constexpr uint32_t objectsPerChunk = 1024;
+
+// cheap integer hash so the layout only depends on the seed
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline float unitFloat(uint32_t x) {
+    return static_cast<float>(hash(x) >> 8) / 16777216.0f;
+}
+
+// scatters objectCount objects over a square field fieldSize across, shared
+// evenly between the meshes
+inline Scene makeScene(const std::vector<MeshInfo>& meshes, uint32_t objectCount, float fieldSize,
+                       uint32_t seed = 1) {
+    Scene scene;
+    scene.meshes = meshes;
+    if (meshes.empty()) {
+        return scene;
+    }
+    scene.objects.reserve(objectCount);
+
+    for (auto i = 0u; i < objectCount; ++i) {
+        auto key = i * 4 + seed * 0x9e3779b9u;
+        SceneObject object;
+        object.position = glm::vec3((unitFloat(key) - 0.5f) * fieldSize, 0.f,
+                                    (unitFloat(key + 1) - 0.5f) * fieldSize);
+        object.phase = unitFloat(key + 2) * 6.2831853f;
+        object.scale = 0.75f + unitFloat(key + 3) * 0.5f;
+        object.spinSpeed = 0.5f + unitFloat(key + 3) * 1.5f;
+        // contiguous runs per mesh, so already sorted
+        object.mesh = static_cast<uint32_t>(static_cast<uint64_t>(i) * meshes.size() / objectCount);
+        scene.objects.push_back(object);
+    }
+
+    for (uint32_t begin = 0; begin < objectCount;) {
+        auto mesh = scene.objects[begin].mesh;
+        auto end = begin;
+        while (end < objectCount && end - begin < objectsPerChunk &&
+               scene.objects[end].mesh == mesh) {
+            ++end;
+        }
+        scene.chunks.push_back({begin, end, mesh, 0, 0});
+        begin = end;
+    }
+
+    scene.scratch.resize(objectCount);
+    return scene;
+}
+
+// fills transformsOut (room for every object) and commandsOut (one per mesh).
+// returns how many objects survived culling. both outputs are only written
+// by the jobs, so they can point into mapped gpu memory
+inline uint32_t prepareFrame(jobs::JobSystem& jobSystem, Scene& scene,
+                             const glm::mat4& viewProjection, float time,
+                             glm::mat4* transformsOut, DrawElementsIndirectCommand* commandsOut) {
+    TRACE_SCOPE("scene prep");
+    auto planes = bounds::frustumPlanes(viewProjection);
+
+    {
+        TRACE_SCOPE("animate and cull");
+        jobSystem.parallelFor(scene.chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (auto c = begin; c < end; ++c) {
+                auto& chunk = scene.chunks[c];
+                auto radius = scene.meshes[chunk.mesh].boundingRadius;
+                auto visible = 0u;
+
+                for (auto i = chunk.begin; i < chunk.end; ++i) {
+                    const auto& object = scene.objects[i];
+                    auto position =
+                        object.position +
+                        glm::vec3(0.f, std::sin(time * 2.0f + object.phase) * radius * 0.25f, 0.f);
+                    if (!bounds::sphereVisible(planes, position, radius * object.scale)) {
+                        continue;
+                    }
+
+                    auto transform = glm::translate(glm::mat4(1.0f), position);
+                    transform = glm::rotate(transform, time * object.spinSpeed + object.phase,
+                                            glm::vec3(0.f, 1.f, 0.f));
+                    scene.scratch[chunk.begin + visible++] =
+                        glm::scale(transform, glm::vec3(object.scale));
+                }
+                chunk.visible = visible;
+            }
+        });
+    }
+
+    // cheap enough to not be worth splitting up, one add per chunk
+    uint32_t visibleTotal = 0;
+    for (auto m = 0u; m < scene.meshes.size(); ++m) {
+        const auto& mesh = scene.meshes[m];
+        commandsOut[m] = {mesh.indexCount, 0, mesh.firstIndex, mesh.baseVertex, 0};
+    }
+    for (auto& chunk : scene.chunks) {
+        auto& command = commandsOut[chunk.mesh];
+        if (command.instanceCount == 0) {
+            command.baseInstance = visibleTotal;
+        }
+        chunk.outputOffset = visibleTotal;
+        command.instanceCount += chunk.visible;
+        visibleTotal += chunk.visible;
+    }
+
+    {
+        TRACE_SCOPE("pack transforms");
+        jobSystem.parallelFor(scene.chunks.size(), 1, [&](size_t begin, size_t end) {
+            for (auto c = begin; c < end; ++c) {
+                const auto& chunk = scene.chunks[c];
+                std::memcpy(transformsOut + chunk.outputOffset, &scene.scratch[chunk.begin],
+                            chunk.visible * sizeof(glm::mat4));
+            }
+        });
+    }
+
+    return visibleTotal;
+}
+
+} // namespace scenePrep
@@ -0,0 +1,813 @@
+#pragma once
+
+// a software rasterizer that eats the same vertex3D/index buffers and
+// DrawElementsIndirectCommand lists the chapters hand to gl, and shades them
+// like chapter 19 does. there's no gpu in ci, so this is what renders frames
+// there: to check the output of a mesh or draw change, and to count what it
+// costs (triangles, fragments, overdraw).
+//
+//  softRaster::Renderer renderer(jobSystem, 1280, 640);
+//  renderer.clear(glm::vec4(0.f), 1.0f);
+//  renderer.drawElementsIndirect(meshData.vertices, meshData.indices, commands, state);
+//  renderer.writePpm("frame.ppm");
+//  fmt::print("{} fragments\n", renderer.stats().fragmentsShaded);
+//
+// the frame goes through three stages:
+//  - vertices are transformed once per draw call, in parallel
+//  - triangles are clipped, culled, snapped and binned into 64x64 tiles.
+//    every chunk of triangles keeps its own bins so submission order survives
+//  - every tile is its own job. triangles are walked with integer edge
+//    functions (1/16 pixel, top-left fill rule, so shared edges are never
+//    drawn twice or missed), 8 pixels at a time with avx2 or 4 with sse2.
+//    depth is tested before shading, like early z on a gpu
+//
+// it follows gl where it matters for testing: ccw front faces, depth in 0..1
+// with GL_LESS, window y going up, pixel centres at .5. texture arrays are
+// sampled bilinear with repeat but without mips.
+
+#include "draw_indirect.hpp"
+#include "job_system.hpp"
+#include "obj_loader.hpp"
+#include "trace.hpp"
+
+#include <fmt/core.h>
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace softRaster {
+
+// layers of the same size, rows bottom up like stbi with flipping on. the
+// layout glTextureSubImage3D takes for GL_RGB/GL_RGBA and GL_UNSIGNED_BYTE
+struct TextureArray {
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    int channels = 3;
+    std::vector<uint8_t> texels;
+
+    // bilinear, repeating, layer rounded and clamped like sampler2DArray
+    glm::vec4 sample(const glm::vec2& uv, float layer) const {
+        if (texels.empty()) {
+            return glm::vec4(1.f);
+        }
+        auto l = std::min(std::max(static_cast<int>(std::floor(layer + 0.5f)), 0), layers - 1);
+        const uint8_t* base = texels.data() + size_t(l) * width * height * channels;
+
+        float x = uv.x * width - 0.5f;
+        float y = uv.y * height - 0.5f;
+        float fx = std::floor(x);
+        float fy = std::floor(y);
+        float tx = x - fx;
+        float ty = y - fy;
+        auto wrap = [](int i, int size) { return ((i % size) + size) % size; };
+        int x0 = wrap(static_cast<int>(fx), width), x1 = wrap(x0 + 1, width);
+        int y0 = wrap(static_cast<int>(fy), height), y1 = wrap(y0 + 1, height);
+
+        auto texel = [&](int tx, int ty) {
+            const uint8_t* p = base + (size_t(ty) * width + tx) * channels;
+            glm::vec4 result(0.f, 0.f, 0.f, 255.f);
+            for (auto c = 0; c < std::min(channels, 4); ++c) {
+                result[c] = p[c];
+            }
+            if (channels < 3) {
+                result = glm::vec4(result.x, result.x, result.x, result.w);
+            }
+            return result;
+        };
+        auto bottom = texel(x0, y0) * (1.f - tx) + texel(x1, y0) * tx;
+        auto top = texel(x0, y1) * (1.f - tx) + texel(x1, y1) * tx;
+        return (bottom * (1.f - ty) + top * ty) * (1.f / 255.f);
+    }
+};
+
+enum class Shading {
+    // colour is the normal attribute, the background in chapter 19
+    Normals,
+    // chapter 19's two point lights on white
+    Lit,
+    // chapter 19's two point lights on the texture array
+    TexturedLit
+};
+
+struct DrawState {
+    glm::mat4 mvp = glm::mat4(1.f);
+    Shading shading = Shading::Normals;
+    const TextureArray* textures = nullptr;
+    // the per instance texture index attribute (divisor 1), so each command
+    // picks its layer with baseInstance
+    std::vector<float> textureIndices;
+    bool cullBackFaces = true;
+};
+
+struct Stats {
+    uint64_t drawCalls = 0;
+    uint64_t trianglesSubmitted = 0;
+    // back facing, outside the frustum or between pixel centres
+    uint64_t trianglesCulled = 0;
+    // crossed the near/far plane or the guard band and had to be cut
+    uint64_t trianglesClipped = 0;
+    uint64_t trianglesRasterized = 0;
+    // triangle/tile pairs, how much binning duplicated big triangles
+    uint64_t tileBins = 0;
+    // pixel centres inside a triangle, then the ones that passed depth
+    uint64_t fragmentsCovered = 0;
+    uint64_t fragmentsShaded = 0;
+    double vertexMs = 0.0;
+    double setupMs = 0.0;
+    double rasterMs = 0.0;
+
+    void add(const Stats& other) {
+        drawCalls += other.drawCalls;
+        trianglesSubmitted += other.trianglesSubmitted;
+        trianglesCulled += other.trianglesCulled;
+        trianglesClipped += other.trianglesClipped;
+        trianglesRasterized += other.trianglesRasterized;
+        tileBins += other.tileBins;
+        fragmentsCovered += other.fragmentsCovered;
+        fragmentsShaded += other.fragmentsShaded;
+        vertexMs += other.vertexMs;
+        setupMs += other.setupMs;
+        rasterMs += other.rasterMs;
+    }
+
+    double totalMs() const {
+        return vertexMs + setupMs + rasterMs;
+    }
+};
+
+namespace detail {
+
+constexpr int subpixelBits = 4;
+constexpr int subpixelScale = 1 << subpixelBits;
+// snapped coordinates stay inside +-2^14 pixels, so edge function steps
+// across a tile fit in 32 bits
+constexpr float guardBandPixels = 8192.f;
+
+#if defined(__AVX2__)
+constexpr int laneCount = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+constexpr int laneCount = 4;
+#else
+constexpr int laneCount = 1;
+#endif
+
+struct ClipVertex {
+    glm::vec4 clip;
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+inline ClipVertex lerp(const ClipVertex& a, const ClipVertex& b, float t) {
+    return {a.clip + (b.clip - a.clip) * t, a.position + (b.position - a.position) * t,
+            a.normal + (b.normal - a.normal) * t, a.texCoord + (b.texCoord - a.texCoord) * t};
+}
+
+// everything the tiles need, after clipping and snapping
+struct SetupTriangle {
+    // window position in 1/16 pixels
+    std::array<int32_t, 3> x;
+    std::array<int32_t, 3> y;
+    std::array<float, 3> z;
+    std::array<float, 3> inverseW;
+    float inverseArea;
+    // pixels with centres that might be covered
+    int minX, minY, maxX, maxY;
+    float layer;
+    std::array<glm::vec3, 3> position;
+    std::array<glm::vec3, 3> normal;
+    std::array<glm::vec2, 3> texCoord;
+};
+
+struct Chunk {
+    std::vector<SetupTriangle> triangles;
+    // per tile, indices into triangles in submission order
+    std::vector<std::vector<uint32_t>> bins;
+    Stats stats;
+};
+
+} // namespace detail
+
+class Renderer {
+  public:
+    Renderer(jobs::JobSystem& jobSystem, int width, int height, int tileSize = 64)
+        : jobSystem(jobSystem)
+        , width(std::min(std::max(width, 1), 8192))
+        , height(std::min(std::max(height, 1), 8192))
+        , tileSize(std::max(8, tileSize / 8 * 8)) {
+        // rows padded to whole spans so simd loads at the right edge stay in
+        // the buffer
+        stride = (this->width + detail::laneCount - 1) / detail::laneCount * detail::laneCount;
+        colourBuffer.resize(size_t(stride) * this->height);
+        depthBuffer.resize(size_t(stride) * this->height);
+        tilesX = (this->width + this->tileSize - 1) / this->tileSize;
+        tilesY = (this->height + this->tileSize - 1) / this->tileSize;
+    }
+
+    int frameWidth() const {
+        return width;
+    }
+
+    int frameHeight() const {
+        return height;
+    }
+
+    const Stats& stats() const {
+        return frameStats;
+    }
+
+    void resetStats() {
+        frameStats = {};
+    }
+
+    // colour is 0..1, depth is what GL_LESS compares against
+    void clear(const glm::vec4& colour, float depth = 1.0f) {
+        TRACE_SCOPE("soft raster clear");
+        clearDepth = depth;
+        auto packed = pack(colour);
+        std::fill(colourBuffer.begin(), colourBuffer.end(), packed);
+        std::fill(depthBuffer.begin(), depthBuffer.end(), depth);
+    }
+
+    // rgba8, r in the low byte, rows bottom up, stride pixels apart
+    uint32_t pixel(int x, int y) const {
+        return colourBuffer[size_t(y) * stride + x];
+    }
+
+    float depth(int x, int y) const {
+        return depthBuffer[size_t(y) * stride + x];
+    }
+
+    // pixels something was drawn to. fragmentsShaded over this is the overdraw
+    uint64_t coveredPixels() const {
+        uint64_t covered = 0;
+        for (auto y = 0; y < height; ++y) {
+            for (auto x = 0; x < width; ++x) {
+                covered += depth(x, y) != clearDepth;
+            }
+        }
+        return covered;
+    }
+
+    double overdraw() const {
+        auto covered = coveredPixels();
+        return covered ? static_cast<double>(frameStats.fragmentsShaded) / covered : 0.0;
+    }
+
+    // binary ppm, top row first
+    bool writePpm(const std::string& filePath) const {
+        FILE* fp = fopen(filePath.c_str(), "wb");
+        if (!fp) {
+            fmt::print(stderr, "Error opening file {}\n", filePath);
+            return false;
+        }
+        fmt::print(fp, "P6\n{} {}\n255\n", width, height);
+        std::vector<uint8_t> row(size_t(width) * 3);
+        for (auto y = height - 1; y >= 0; --y) {
+            for (auto x = 0; x < width; ++x) {
+                auto value = pixel(x, y);
+                row[x * 3 + 0] = static_cast<uint8_t>(value);
+                row[x * 3 + 1] = static_cast<uint8_t>(value >> 8);
+                row[x * 3 + 2] = static_cast<uint8_t>(value >> 16);
+            }
+            fwrite(row.data(), 1, row.size(), fp);
+        }
+        fclose(fp);
+        return true;
+    }
+
+    // what glMultiDrawElementsIndirect does with the commands, a vao holding
+    // vertices/indices and the per instance texture index from state
+    void drawElementsIndirect(const std::vector<vertex3D>& vertices,
+                              const std::vector<int>& indices,
+                              const std::vector<DrawElementsIndirectCommand>& commands,
+                              const DrawState& state) {
+        using namespace std::chrono;
+        TRACE_SCOPE("soft raster draw");
+        Stats drawStats;
+        drawStats.drawCalls = 1;
+
+        auto startTime = steady_clock::now();
+        transformVertices(vertices, state.mvp);
+        auto vertexTime = steady_clock::now();
+
+        // one entry per instance of every command, so triangles can be
+        // numbered across the whole call and split into even chunks
+        struct Range {
+            const DrawElementsIndirectCommand* command;
+            uint32_t instance;
+            uint64_t firstTriangle;
+        };
+        std::vector<Range> ranges;
+        uint64_t triangleCount = 0;
+        for (const auto& command : commands) {
+            for (auto instance = 0u; instance < command.instanceCount; ++instance) {
+                ranges.push_back({&command, instance, triangleCount});
+                triangleCount += command.vertexCount / 3;
+            }
+        }
+        drawStats.trianglesSubmitted = triangleCount;
+
+        const uint64_t chunkTriangles = 4096;
+        auto chunkCount =
+            static_cast<size_t>((triangleCount + chunkTriangles - 1) / chunkTriangles);
+        if (chunks.size() < chunkCount) {
+            chunks.resize(chunkCount);
+        }
+
+        jobSystem.parallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+            TRACE_SCOPE("soft raster setup");
+            for (auto c = begin; c < end; ++c) {
+                auto& chunk = chunks[c];
+                chunk.triangles.clear();
+                chunk.bins.resize(size_t(tilesX) * tilesY);
+                for (auto& bin : chunk.bins) {
+                    bin.clear();
+                }
+                chunk.stats = {};
+
+                auto first = c * chunkTriangles;
+                auto last = std::min<uint64_t>(first + chunkTriangles, triangleCount);
+                auto range = std::upper_bound(ranges.begin(), ranges.end(), first,
+                                              [](uint64_t t, const Range& r) {
+                                                  return t < r.firstTriangle;
+                                              }) -
+                             1;
+                for (auto t = first; t < last; ++t) {
+                    while (t >= range->firstTriangle + range->command->vertexCount / 3) {
+                        ++range;
+                    }
+                    const auto& command = *range->command;
+                    auto firstIndex = command.firstIndex + (t - range->firstTriangle) * 3;
+                    std::array<int, 3> corner;
+                    bool valid = firstIndex + 3 <= indices.size();
+                    for (auto k = 0; k < 3 && valid; ++k) {
+                        corner[k] = indices[firstIndex + k] + command.baseVertex;
+                        valid = corner[k] >= 0 && size_t(corner[k]) < vertices.size();
+                    }
+                    if (!valid) {
+                        ++chunk.stats.trianglesCulled;
+                        continue;
+                    }
+                    auto textureIndex = command.baseInstance + range->instance;
+                    float layer = textureIndex < state.textureIndices.size()
+                                      ? state.textureIndices[textureIndex]
+                                      : 0.f;
+                    setupTriangle(chunk, vertices, corner, layer, state.cullBackFaces);
+                }
+            }
+        });
+        auto setupTime = steady_clock::now();
+        for (auto c = 0u; c < chunkCount; ++c) {
+            drawStats.add(chunks[c].stats);
+        }
+
+        std::mutex statsMutex;
+        jobSystem.parallelFor(size_t(tilesX) * tilesY, 1, [&](size_t begin, size_t end) {
+            TRACE_SCOPE("soft raster tiles");
+            Stats tileStats;
+            for (auto tile = begin; tile < end; ++tile) {
+                for (auto c = 0u; c < chunkCount; ++c) {
+                    const auto& chunk = chunks[c];
+                    for (auto id : chunk.bins[tile]) {
+                        rasterize(chunk.triangles[id], static_cast<int>(tile), state, tileStats);
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> lock(statsMutex);
+            drawStats.add(tileStats);
+        });
+        auto endTime = steady_clock::now();
+
+        auto ms = [](auto from, auto to) { return duration<double>(to - from).count() * 1e3; };
+        drawStats.vertexMs = ms(startTime, vertexTime);
+        drawStats.setupMs = ms(vertexTime, setupTime);
+        drawStats.rasterMs = ms(setupTime, endTime);
+        frameStats.add(drawStats);
+    }
+
+  private:
+    static uint32_t pack(const glm::vec4& colour) {
+        auto channel = [](float value) {
+            return static_cast<uint32_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+        };
+        return channel(colour.x) | channel(colour.y) << 8 | channel(colour.z) << 16 |
+               channel(colour.w) << 24;
+    }
+
+    void transformVertices(const std::vector<vertex3D>& vertices, const glm::mat4& mvp) {
+        TRACE_SCOPE("soft raster vertices");
+        clipPositions.resize(vertices.size());
+        jobSystem.parallelFor(vertices.size(), 16384, [&](size_t begin, size_t end) {
+            for (auto i = begin; i < end; ++i) {
+                clipPositions[i] = mvp * glm::vec4(vertices[i].position, 1.0f);
+            }
+        });
+    }
+
+    void setupTriangle(detail::Chunk& chunk, const std::vector<vertex3D>& vertices,
+                       const std::array<int, 3>& corner, float layer, bool cullBackFaces) {
+        std::array<detail::ClipVertex, 3> triangle;
+        for (auto k = 0; k < 3; ++k) {
+            const auto& vertex = vertices[corner[k]];
+            triangle[k] = {clipPositions[corner[k]], vertex.position, vertex.normal,
+                           vertex.texCoord};
+        }
+
+        // planes as dot(plane, clip) >= 0. near, far, then the guard band,
+        // which only stops the snapped coordinates overflowing. the real
+        // sides of the frustum are left to the tile bounds
+        const float guardX = 2.0f * detail::guardBandPixels / width;
+        const float guardY = 2.0f * detail::guardBandPixels / height;
+        const std::array<glm::vec4, 6> planes{
+            glm::vec4(0.f, 0.f, 1.f, 1.f),     glm::vec4(0.f, 0.f, -1.f, 1.f),
+            glm::vec4(1.f, 0.f, 0.f, guardX),  glm::vec4(-1.f, 0.f, 0.f, guardX),
+            glm::vec4(0.f, 1.f, 0.f, guardY),  glm::vec4(0.f, -1.f, 0.f, guardY)};
+        const std::array<glm::vec4, 4> sides{
+            glm::vec4(1.f, 0.f, 0.f, 1.f), glm::vec4(-1.f, 0.f, 0.f, 1.f),
+            glm::vec4(0.f, 1.f, 0.f, 1.f), glm::vec4(0.f, -1.f, 0.f, 1.f)};
+
+        uint32_t outsideAny = 0;
+        for (auto p = 0u; p < planes.size() + sides.size(); ++p) {
+            const auto& plane = p < planes.size() ? planes[p] : sides[p - planes.size()];
+            uint32_t outside = 0;
+            for (auto k = 0; k < 3; ++k) {
+                outside += glm::dot(plane, triangle[k].clip) < 0.f;
+            }
+            if (outside == 3) {
+                ++chunk.stats.trianglesCulled;
+                return;
+            }
+            if (outside > 0 && p < planes.size()) {
+                outsideAny |= 1u << p;
+            }
+        }
+
+        if (!outsideAny) {
+            emit(chunk, triangle[0], triangle[1], triangle[2], layer, cullBackFaces);
+            return;
+        }
+
+        // sutherland hodgman against the planes the triangle crosses, then
+        // fan the polygon back into triangles
+        ++chunk.stats.trianglesClipped;
+        std::array<detail::ClipVertex, 9> polygon, clipped;
+        std::copy(triangle.begin(), triangle.end(), polygon.begin());
+        size_t count = 3;
+        for (auto p = 0u; p < planes.size() && count >= 3; ++p) {
+            if (!(outsideAny & (1u << p))) {
+                continue;
+            }
+            size_t clippedCount = 0;
+            for (auto i = 0u; i < count; ++i) {
+                const auto& a = polygon[i];
+                const auto& b = polygon[(i + 1) % count];
+                float da = glm::dot(planes[p], a.clip);
+                float db = glm::dot(planes[p], b.clip);
+                if (da >= 0.f) {
+                    clipped[clippedCount++] = a;
+                }
+                if ((da >= 0.f) != (db >= 0.f)) {
+                    clipped[clippedCount++] = detail::lerp(a, b, da / (da - db));
+                }
+            }
+            std::copy(clipped.begin(), clipped.begin() + clippedCount, polygon.begin());
+            count = clippedCount;
+        }
+        if (count < 3) {
+            ++chunk.stats.trianglesCulled;
+            return;
+        }
+        for (auto i = 1u; i + 1 < count; ++i) {
+            emit(chunk, polygon[0], polygon[i], polygon[i + 1], layer, cullBackFaces);
+        }
+    }
+
+    void emit(detail::Chunk& chunk, const detail::ClipVertex& a, const detail::ClipVertex& b,
+              const detail::ClipVertex& c, float layer, bool cullBackFaces) {
+        std::array<const detail::ClipVertex*, 3> corners{&a, &b, &c};
+        detail::SetupTriangle triangle;
+        for (auto k = 0; k < 3; ++k) {
+            const auto& vertex = *corners[k];
+            float inverseW = 1.0f / vertex.clip.w;
+            float windowX = (vertex.clip.x * inverseW * 0.5f + 0.5f) * width;
+            float windowY = (vertex.clip.y * inverseW * 0.5f + 0.5f) * height;
+            triangle.x[k] = static_cast<int32_t>(std::lround(windowX * detail::subpixelScale));
+            triangle.y[k] = static_cast<int32_t>(std::lround(windowY * detail::subpixelScale));
+            triangle.z[k] = vertex.clip.z * inverseW * 0.5f + 0.5f;
+            triangle.inverseW[k] = inverseW;
+            triangle.position[k] = vertex.position;
+            triangle.normal[k] = vertex.normal;
+            triangle.texCoord[k] = vertex.texCoord;
+        }
+
+        auto twiceArea = int64_t(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                         int64_t(triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+        if (twiceArea == 0 || (twiceArea < 0 && cullBackFaces)) {
+            ++chunk.stats.trianglesCulled;
+            return;
+        }
+        if (twiceArea < 0) {
+            // drawn from behind. flip it so the edge functions are positive inside
+            auto swap = [](auto& values) { std::swap(values[1], values[2]); };
+            swap(triangle.x);
+            swap(triangle.y);
+            swap(triangle.z);
+            swap(triangle.inverseW);
+            swap(triangle.position);
+            swap(triangle.normal);
+            swap(triangle.texCoord);
+            twiceArea = -twiceArea;
+        }
+        triangle.inverseArea = 1.0f / static_cast<float>(twiceArea);
+        triangle.layer = layer;
+
+        // pixels whose centres (16i + 8) land inside the snapped box
+        auto firstCentre = [](int32_t minimum) {
+            return static_cast<int>(
+                std::ceil((minimum - detail::subpixelScale / 2) / float(detail::subpixelScale)));
+        };
+        auto lastCentre = [](int32_t maximum) {
+            return static_cast<int>(
+                std::floor((maximum - detail::subpixelScale / 2) / float(detail::subpixelScale)));
+        };
+        auto xs = std::minmax({triangle.x[0], triangle.x[1], triangle.x[2]});
+        auto ys = std::minmax({triangle.y[0], triangle.y[1], triangle.y[2]});
+        triangle.minX = std::max(firstCentre(xs.first), 0);
+        triangle.minY = std::max(firstCentre(ys.first), 0);
+        triangle.maxX = std::min(lastCentre(xs.second), width - 1);
+        triangle.maxY = std::min(lastCentre(ys.second), height - 1);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+            ++chunk.stats.trianglesCulled;
+            return;
+        }
+
+        auto id = static_cast<uint32_t>(chunk.triangles.size());
+        chunk.triangles.push_back(triangle);
+        ++chunk.stats.trianglesRasterized;
+        for (auto ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ++ty) {
+            for (auto tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; ++tx) {
+                chunk.bins[size_t(ty) * tilesX + tx].push_back(id);
+                ++chunk.stats.tileBins;
+            }
+        }
+    }
+
+    glm::vec4 shade(const detail::SetupTriangle& triangle, float weight1, float weight2,
+                    const DrawState& state) const {
+        // perspective correct weights for the attributes
+        float b0 = (1.f - weight1 - weight2) * triangle.inverseW[0];
+        float b1 = weight1 * triangle.inverseW[1];
+        float b2 = weight2 * triangle.inverseW[2];
+        float normalize = 1.f / (b0 + b1 + b2);
+        b0 *= normalize;
+        b1 *= normalize;
+        b2 *= normalize;
+
+        auto normal = triangle.normal[0] * b0 + triangle.normal[1] * b1 + triangle.normal[2] * b2;
+        if (state.shading == Shading::Normals) {
+            return glm::vec4(normal, 1.0f);
+        }
+
+        auto position =
+            triangle.position[0] * b0 + triangle.position[1] * b1 + triangle.position[2] * b2;
+        float length = glm::length(normal);
+        normal = length > 0.f ? normal / length : normal;
+        float diffuse =
+            std::max(glm::dot(normal, glm::normalize(glm::vec3(1.f, 1.f, 1.f) - position)), 0.f);
+        float diffuse2 =
+            std::max(glm::dot(normal, glm::normalize(glm::vec3(-2.f, 0.f, 0.f) - position)), 0.f);
+        float lighting = diffuse + diffuse2 * 0.5f;
+
+        glm::vec4 albedo(1.f);
+        if (state.shading == Shading::TexturedLit && state.textures) {
+            auto texCoord =
+                triangle.texCoord[0] * b0 + triangle.texCoord[1] * b1 + triangle.texCoord[2] * b2;
+            albedo = state.textures->sample(texCoord, triangle.layer);
+        }
+        return albedo * lighting;
+    }
+
+    void rasterize(const detail::SetupTriangle& triangle, int tile, const DrawState& state,
+                   Stats& stats) {
+        const int tileX = (tile % tilesX) * tileSize;
+        const int tileY = (tile / tilesX) * tileSize;
+        const int minX = std::max(triangle.minX, tileX);
+        const int maxX = std::min(triangle.maxX, std::min(tileX + tileSize, width) - 1);
+        const int minY = std::max(triangle.minY, tileY);
+        const int maxY = std::min(triangle.maxY, std::min(tileY + tileSize, height) - 1);
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+        // spans start on a lane boundary, tiles are a multiple of the lanes
+        const int spanX = minX / detail::laneCount * detail::laneCount;
+
+        // edge k is opposite corner k. values at the first pixel centre and
+        // the steps across are worked out exactly in 64 bits. an edge that's
+        // positive over the whole rectangle is dropped, one that's negative
+        // over all of it means nothing here is covered. the rest cross the
+        // rectangle so they can't be far from zero in it, which is what lets
+        // the per pixel values live in 32 bits
+        std::array<int32_t, 3> rowStart, stepX, stepY;
+        // corner 1 and 2's weights (corner 0 gets the rest) as planes in
+        // float. they only have to be close, not exact like the coverage
+        std::array<float, 3> weightRow{}, weightStepX{}, weightStepY{};
+        for (auto k = 0; k < 3; ++k) {
+            auto a = (k + 1) % 3;
+            auto b = (k + 2) % 3;
+            int64_t dx = int64_t(triangle.x[b]) - triangle.x[a];
+            int64_t dy = int64_t(triangle.y[b]) - triangle.y[a];
+            // top-left rule: pixel centres exactly on a right or bottom edge
+            // belong to the neighbour
+            bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+            auto valueAt = [&](int px, int py) {
+                return -dy * (int64_t(px) * detail::subpixelScale + detail::subpixelScale / 2 -
+                              triangle.x[a]) +
+                       dx * (int64_t(py) * detail::subpixelScale + detail::subpixelScale / 2 -
+                             triangle.y[a]);
+            };
+            int64_t bias = topLeft ? 0 : -1;
+            auto start = valueAt(spanX, minY);
+            weightRow[k] = static_cast<float>(static_cast<double>(start) * triangle.inverseArea);
+            weightStepX[k] = static_cast<float>(-dy * detail::subpixelScale * triangle.inverseArea);
+            weightStepY[k] = static_cast<float>(dx * detail::subpixelScale * triangle.inverseArea);
+
+            std::array<int64_t, 4> corners{valueAt(minX, minY), valueAt(maxX, minY),
+                                           valueAt(minX, maxY), valueAt(maxX, maxY)};
+            auto lowest = *std::min_element(corners.begin(), corners.end()) + bias;
+            auto highest = *std::max_element(corners.begin(), corners.end()) + bias;
+            if (highest < 0) {
+                return;
+            }
+            if (lowest >= 0) {
+                rowStart[k] = 0;
+                stepX[k] = 0;
+                stepY[k] = 0;
+                continue;
+            }
+            rowStart[k] = static_cast<int32_t>(start + bias);
+            stepX[k] = static_cast<int32_t>(-dy * detail::subpixelScale);
+            stepY[k] = static_cast<int32_t>(dx * detail::subpixelScale);
+        }
+
+        const float z0 = triangle.z[0];
+        const float dz1 = triangle.z[1] - triangle.z[0];
+        const float dz2 = triangle.z[2] - triangle.z[0];
+
+        auto shadeLanes = [&](int x, int y, uint32_t bits, const float* weight1,
+                              const float* weight2, const float* z) {
+            auto* colourRow = colourBuffer.data() + size_t(y) * stride;
+            auto* depthRow = depthBuffer.data() + size_t(y) * stride;
+            for (; bits; bits &= bits - 1) {
+                auto lane = objLoader::detail::bitCount((bits & (0u - bits)) - 1);
+                auto colour = shade(triangle, weight1[lane], weight2[lane], state);
+                depthRow[x + lane] = z[lane];
+                colourRow[x + lane] = pack(colour);
+                ++stats.fragmentsShaded;
+            }
+        };
+
+#if defined(__AVX2__)
+        const auto laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const auto laneOffsets = _mm256_cvtepi32_ps(laneIndices);
+        __m256i edgeOffsets[3];
+        for (auto k = 0; k < 3; ++k) {
+            edgeOffsets[k] = _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(stepX[k]));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        const auto laneOffsets = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+        // no 32 bit multiply in sse2, the lane offsets are sums
+        __m128i edgeOffsets[3];
+        for (auto k = 0; k < 3; ++k) {
+            auto step = _mm_set1_epi32(stepX[k]);
+            auto twice = _mm_add_epi32(step, step);
+            edgeOffsets[k] =
+                _mm_unpacklo_epi64(_mm_unpacklo_epi32(_mm_setzero_si128(), step),
+                                   _mm_unpacklo_epi32(twice, _mm_add_epi32(twice, step)));
+        }
+#endif
+
+        for (auto y = minY; y <= maxY; ++y) {
+            std::array<int32_t, 3> e = rowStart;
+            float weight1 = weightRow[1];
+            float weight2 = weightRow[2];
+            const float* depthRow = depthBuffer.data() + size_t(y) * stride;
+            for (auto x = spanX; x <= maxX; x += detail::laneCount) {
+                // lanes left of minX or right of maxX aren't this tile's
+                uint32_t columns = (1u << detail::laneCount) - 1;
+                if (x < minX) {
+                    columns &= ~((1u << (minX - x)) - 1);
+                }
+                if (x + detail::laneCount - 1 > maxX) {
+                    columns &= (1u << (maxX - x + 1)) - 1;
+                }
+
+#if defined(__AVX2__)
+                auto edge = [&](int k) {
+                    return _mm256_add_epi32(_mm256_set1_epi32(e[k]), edgeOffsets[k]);
+                };
+                auto outside = _mm256_or_si256(edge(0), _mm256_or_si256(edge(1), edge(2)));
+                uint32_t covered =
+                    ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(outside))) &
+                    columns;
+                if (covered) {
+                    auto w1 = _mm256_add_ps(
+                        _mm256_set1_ps(weight1),
+                        _mm256_mul_ps(laneOffsets, _mm256_set1_ps(weightStepX[1])));
+                    auto w2 = _mm256_add_ps(
+                        _mm256_set1_ps(weight2),
+                        _mm256_mul_ps(laneOffsets, _mm256_set1_ps(weightStepX[2])));
+                    auto z = _mm256_add_ps(_mm256_set1_ps(z0),
+                                           _mm256_add_ps(_mm256_mul_ps(w1, _mm256_set1_ps(dz1)),
+                                                         _mm256_mul_ps(w2, _mm256_set1_ps(dz2))));
+                    auto nearer = _mm256_cmp_ps(z, _mm256_loadu_ps(depthRow + x), _CMP_LT_OQ);
+                    uint32_t passed = covered & static_cast<uint32_t>(_mm256_movemask_ps(nearer));
+                    stats.fragmentsCovered += objLoader::detail::bitCount(covered);
+                    if (passed) {
+                        alignas(32) float w1s[8], w2s[8], zs[8];
+                        _mm256_store_ps(w1s, w1);
+                        _mm256_store_ps(w2s, w2);
+                        _mm256_store_ps(zs, z);
+                        shadeLanes(x, y, passed, w1s, w2s, zs);
+                    }
+                }
+#elif defined(__SSE2__) || defined(_M_X64)
+                auto edge = [&](int k) {
+                    return _mm_add_epi32(_mm_set1_epi32(e[k]), edgeOffsets[k]);
+                };
+                auto outside = _mm_or_si128(edge(0), _mm_or_si128(edge(1), edge(2)));
+                uint32_t covered =
+                    ~static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(outside))) & columns;
+                if (covered) {
+                    auto w1 = _mm_add_ps(_mm_set1_ps(weight1),
+                                         _mm_mul_ps(laneOffsets, _mm_set1_ps(weightStepX[1])));
+                    auto w2 = _mm_add_ps(_mm_set1_ps(weight2),
+                                         _mm_mul_ps(laneOffsets, _mm_set1_ps(weightStepX[2])));
+                    auto z = _mm_add_ps(_mm_set1_ps(z0),
+                                        _mm_add_ps(_mm_mul_ps(w1, _mm_set1_ps(dz1)),
+                                                   _mm_mul_ps(w2, _mm_set1_ps(dz2))));
+                    auto nearer = _mm_cmplt_ps(z, _mm_loadu_ps(depthRow + x));
+                    uint32_t passed = covered & static_cast<uint32_t>(_mm_movemask_ps(nearer));
+                    stats.fragmentsCovered += objLoader::detail::bitCount(covered);
+                    if (passed) {
+                        alignas(16) float w1s[4], w2s[4], zs[4];
+                        _mm_store_ps(w1s, w1);
+                        _mm_store_ps(w2s, w2);
+                        _mm_store_ps(zs, z);
+                        shadeLanes(x, y, passed, w1s, w2s, zs);
+                    }
+                }
+#else
+                if (columns && (e[0] | e[1] | e[2]) >= 0) {
+                    float z = z0 + weight1 * dz1 + weight2 * dz2;
+                    ++stats.fragmentsCovered;
+                    if (z < depthRow[x]) {
+                        shadeLanes(x, y, 1u, &weight1, &weight2, &z);
+                    }
+                }
+#endif
+                for (auto k = 0; k < 3; ++k) {
+                    e[k] += stepX[k] * detail::laneCount;
+                }
+                weight1 += weightStepX[1] * detail::laneCount;
+                weight2 += weightStepX[2] * detail::laneCount;
+            }
+            for (auto k = 0; k < 3; ++k) {
+                rowStart[k] += stepY[k];
+                weightRow[k] += weightStepY[k];
+            }
+        }
+    }
+
+    jobs::JobSystem& jobSystem;
+    int width;
+    int height;
+    int tileSize;
+    int stride = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    float clearDepth = 1.0f;
+    std::vector<uint32_t> colourBuffer;
+    std::vector<float> depthBuffer;
+    std::vector<glm::vec4> clipPositions;
+    std::vector<detail::Chunk> chunks;
+    Stats frameStats;
+};
+
+} // namespace softRaster
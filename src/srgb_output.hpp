@@ -0,0 +1,130 @@
+#pragma once
+
+// lighting maths only works on linear values, but monitors expect srgb. with
+// srgb textures (GL_SRGB8 / GL_SRGB8_ALPHA8) the sampler hands the shader
+// linear values, and with GL_FRAMEBUFFER_SRGB on an srgb framebuffer the
+// blender encodes what the shader writes. both conversions are done by the
+// texture and render hardware for free, so the shaders don't change.
+//
+// glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE) asks for an srgb default
+// framebuffer, but it's only a hint and some platforms ignore it. Output
+// checks what it got and, if the default framebuffer isn't srgb, draws into
+// an srgb target and copies the encoded bytes across at the end of the frame.
+//
+//  srgbOutput::Output output;
+//  while (...) {
+//      output.begin(framebufferWidth, framebufferHeight);
+//      ... draw
+//      output.end();
+//      glfwSwapBuffers(window);
+//  }
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+using namespace gl;
+
+namespace srgbOutput {
+
+inline bool defaultFramebufferIsSrgb() {
+    GLint encoding = static_cast<GLint>(GL_LINEAR);
+    glGetNamedFramebufferAttachmentParameteriv(0, GL_BACK_LEFT,
+                                               GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &encoding);
+    return encoding == static_cast<GLint>(GL_SRGB);
+}
+
+class Output {
+  public:
+    Output() : native(defaultFramebufferIsSrgb()) {
+        glEnable(GL_FRAMEBUFFER_SRGB);
+        if (!native) {
+            fmt::print(stderr, "default framebuffer isn't srgb, drawing to an srgb target\n");
+        }
+    }
+
+    ~Output() {
+        release();
+    }
+
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    // the framebuffer to draw the frame into is bound when this returns
+    void begin(int frameWidth, int frameHeight) {
+        if (native) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return;
+        }
+        if (frameWidth != width || frameHeight != height) {
+            create(frameWidth, frameHeight);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+    }
+
+    // leaves the finished frame in the default framebuffer, ready to swap
+    void end() {
+        if (native) {
+            return;
+        }
+        // copyFramebuffer reads the same texels through a plain rgba8 view,
+        // so the blit is a straight copy of the already encoded bytes with
+        // no decode on the way out and no encode on the way in
+        glBlitNamedFramebuffer(copyFramebuffer, 0, 0, 0, width, height, 0, 0, width, height,
+                               GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    bool usesDefaultFramebuffer() const {
+        return native;
+    }
+
+  private:
+    void create(int frameWidth, int frameHeight) {
+        release();
+        width = frameWidth;
+        height = frameHeight;
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &colour);
+        glTextureStorage2D(colour, 1, GL_SRGB8_ALPHA8, width, height);
+        // a view needs a name that has never been bound, so glGenTextures
+        glGenTextures(1, &colourView);
+        glTextureView(colourView, GL_TEXTURE_2D, colour, GL_RGBA8, 0, 1, 0, 1);
+
+        glCreateRenderbuffers(1, &depth);
+        glNamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, width, height);
+
+        glCreateFramebuffers(1, &drawFramebuffer);
+        glNamedFramebufferTexture(drawFramebuffer, GL_COLOR_ATTACHMENT0, colour, 0);
+        glNamedFramebufferRenderbuffer(drawFramebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                                       depth);
+
+        glCreateFramebuffers(1, &copyFramebuffer);
+        glNamedFramebufferTexture(copyFramebuffer, GL_COLOR_ATTACHMENT0, colourView, 0);
+        glNamedFramebufferReadBuffer(copyFramebuffer, GL_COLOR_ATTACHMENT0);
+    }
+
+    void release() {
+        if (!drawFramebuffer) {
+            return;
+        }
+        glDeleteFramebuffers(1, &drawFramebuffer);
+        glDeleteFramebuffers(1, &copyFramebuffer);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteTextures(1, &colourView);
+        glDeleteTextures(1, &colour);
+        drawFramebuffer = copyFramebuffer = depth = colourView = colour = 0;
+        width = height = 0;
+    }
+
+    bool native = false;
+    int width = 0;
+    int height = 0;
+    GLuint colour = 0;
+    GLuint colourView = 0;
+    GLuint depth = 0;
+    GLuint drawFramebuffer = 0;
+    GLuint copyFramebuffer = 0;
+};
+
+} // namespace srgbOutput
@@ -0,0 +1,306 @@
+#pragma once
+
+// texture arrays need every layer to be the same size and format, so putting
+// a 512x512 and a 1024x1024 texture in one array means either scaling one of
+// them or paying for 1024x1024 twice. the packer sorts textures into size
+// classes instead, one GL_TEXTURE_2D_ARRAY per class, so each texture is
+// stored at exactly its own size.
+//
+// which array and layer a texture ended up in goes in a small table (a
+// storage buffer) the shader looks up by texture index:
+//
+//  struct TextureSlot { int array; int layer; };
+//  layout (std430, binding = 2) readonly buffer TextureSlots { TextureSlot slots[]; };
+//  layout (binding = 0) uniform sampler2DArray Textures[TEXTURE_ARRAYS];
+//
+// sampler arrays can only be indexed with dynamically uniform values, so the
+// shader loops over the arrays and samples the one that matches (see
+// chapter 19).
+//
+// images that come with a mip chain from mip_chain.hpp have every level
+// uploaded as is. a size class where any image doesn't falls back to
+// glGenerateTextureMipmap.
+
+#include "mip_chain.hpp"
+
+#include <fmt/core.h>
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace gl;
+
+namespace texturePacker {
+
+// decoded pixels owned by someone else, tightly packed, 1-4 channels
+struct ImageView {
+    const uint8_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    // levels 1 down to 1x1, or null to have the gpu make them
+    const std::vector<mipChain::Level>* mips = nullptr;
+    // colour in srgb, stored in an srgb format so the shader samples linear
+    // values. off for data like normal maps
+    bool srgb = true;
+};
+
+// grey is stored as rgb and grey + alpha as rgba, so only rgb and rgba layouts
+inline int storedChannels(int channels) {
+    return channels == 2 || channels == 4 ? 4 : 3;
+}
+
+// one array's worth of textures
+struct SizeClass {
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+    bool srgb = true;
+    std::vector<size_t> images;
+};
+
+inline GLenum internalFormat(const SizeClass& sizeClass) {
+    if (sizeClass.srgb) {
+        return sizeClass.channels == 4 ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+    }
+    return sizeClass.channels == 4 ? GL_RGBA8 : GL_RGB8;
+}
+
+// where a texture ended up. matches TextureSlot in the shader
+struct TextureSlot {
+    int32_t array = -1;
+    int32_t layer = 0;
+};
+
+struct Plan {
+    std::vector<SizeClass> classes;
+    std::vector<TextureSlot> slots;
+};
+
+// a class per distinct width/height/format (srgb or not counts). if that's
+// more arrays than the shader has samplers for, the class with the fewest
+// texels is folded into the remaining class of the same format closest in
+// area and resampled. that only happens with a lot of odd sizes, and a
+// message says so
+inline Plan plan(const std::vector<ImageView>& images, size_t maxArrays) {
+    Plan result;
+    result.slots.resize(images.size());
+
+    for (auto i = 0u; i < images.size(); ++i) {
+        const auto& image = images[i];
+        if (!image.pixels || image.width <= 0 || image.height <= 0) {
+            continue;
+        }
+        auto channels = storedChannels(image.channels);
+        auto sizeClass =
+            std::find_if(result.classes.begin(), result.classes.end(), [&](const SizeClass& c) {
+                return c.width == image.width && c.height == image.height &&
+                       c.channels == channels && c.srgb == image.srgb;
+            });
+        if (sizeClass == result.classes.end()) {
+            result.classes.push_back({image.width, image.height, channels, image.srgb, {}});
+            sizeClass = result.classes.end() - 1;
+        }
+        sizeClass->images.push_back(i);
+    }
+
+    auto texels = [](const SizeClass& c) {
+        return size_t(c.width) * c.height * c.images.size();
+    };
+    auto area = [](const SizeClass& c) { return double(c.width) * c.height; };
+    while (result.classes.size() > std::max<size_t>(maxArrays, 1)) {
+        // the smallest class that has another of its format to go into
+        auto smallest = result.classes.end();
+        auto closest = result.classes.end();
+        for (auto from = result.classes.begin(); from != result.classes.end(); ++from) {
+            auto into = result.classes.end();
+            for (auto it = result.classes.begin(); it != result.classes.end(); ++it) {
+                if (it == from || it->channels != from->channels || it->srgb != from->srgb) {
+                    continue;
+                }
+                if (into == result.classes.end() ||
+                    std::abs(area(*it) - area(*from)) < std::abs(area(*into) - area(*from))) {
+                    into = it;
+                }
+            }
+            if (into != result.classes.end() &&
+                (smallest == result.classes.end() || texels(*from) < texels(*smallest))) {
+                smallest = from;
+                closest = into;
+            }
+        }
+        if (smallest == result.classes.end()) {
+            // one class per format already, nothing left to fold
+            break;
+        }
+        fmt::print(stderr, "texture packer: more than {} sizes, resampling {}x{} to {}x{}\n",
+                   maxArrays, smallest->width, smallest->height, closest->width, closest->height);
+        closest->images.insert(closest->images.end(), smallest->images.begin(),
+                               smallest->images.end());
+        result.classes.erase(smallest);
+    }
+
+    for (auto c = 0u; c < result.classes.size(); ++c) {
+        const auto& members = result.classes[c].images;
+        for (auto layer = 0u; layer < members.size(); ++layer) {
+            result.slots[members[layer]] = {static_cast<int32_t>(c),
+                                            static_cast<int32_t>(layer)};
+        }
+    }
+    return result;
+}
+
+inline GLsizei mipLevels(int width, int height) {
+    GLsizei levels = 1;
+    for (auto size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+// the arrays, the table that says where each texture is and what it all cost
+class PackedTextures {
+  public:
+    PackedTextures(const std::vector<ImageView>& images, size_t maxArrays) {
+        auto layout = plan(images, maxArrays);
+        textureSlots = layout.slots;
+
+        arrays.resize(layout.classes.size());
+        if (!arrays.empty()) {
+            glCreateTextures(GL_TEXTURE_2D_ARRAY, static_cast<GLsizei>(arrays.size()),
+                             arrays.data());
+        }
+
+        // rows of rgb8 aren't 4 byte aligned for odd widths
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<uint8_t> converted;
+        for (auto c = 0u; c < layout.classes.size(); ++c) {
+            const auto& sizeClass = layout.classes[c];
+            auto textureName = arrays[c];
+            auto levels = mipLevels(sizeClass.width, sizeClass.height);
+            glTextureStorage3D(textureName, levels, internalFormat(sizeClass), sizeClass.width,
+                               sizeClass.height, static_cast<GLsizei>(sizeClass.images.size()));
+
+            // the cpu made mips can only be used if every layer has them and
+            // none was resampled to fit
+            bool cpuMips = std::all_of(
+                sizeClass.images.begin(), sizeClass.images.end(), [&](size_t i) {
+                    return images[i].mips && images[i].mips->size() == size_t(levels - 1) &&
+                           images[i].width == sizeClass.width &&
+                           images[i].height == sizeClass.height;
+                });
+
+            for (auto layer = 0u; layer < sizeClass.images.size(); ++layer) {
+                const auto& image = images[sizeClass.images[layer]];
+                for (auto level = 0; level < (cpuMips ? levels : 1); ++level) {
+                    auto view = image;
+                    SizeClass target = sizeClass;
+                    if (level > 0) {
+                        const auto& mip = (*image.mips)[level - 1];
+                        view.pixels = mip.pixels.data();
+                        view.width = target.width = mip.width;
+                        view.height = target.height = mip.height;
+                    }
+                    const uint8_t* pixels = view.pixels;
+                    if (view.channels != target.channels || view.width != target.width ||
+                        view.height != target.height) {
+                        convert(view, target, converted);
+                        pixels = converted.data();
+                    }
+                    glTextureSubImage3D(textureName, level, 0, 0, layer, target.width,
+                                        target.height, 1,
+                                        sizeClass.channels == 4 ? GL_RGBA : GL_RGB,
+                                        GL_UNSIGNED_BYTE, pixels);
+                }
+            }
+
+            glTextureParameteri(textureName, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTextureParameteri(textureName, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTextureParameteri(textureName, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTextureParameteri(textureName, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            if (!cpuMips) {
+                glGenerateTextureMipmap(textureName);
+            }
+
+            for (auto level = 0; level < levels; ++level) {
+                allocatedBytes += size_t(std::max(sizeClass.width >> level, 1)) *
+                                  std::max(sizeClass.height >> level, 1) * sizeClass.channels *
+                                  sizeClass.images.size();
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glCreateBuffers(1, &slotBuffer);
+        glNamedBufferStorage(slotBuffer,
+                             std::max<size_t>(textureSlots.size(), 1) * sizeof(TextureSlot),
+                             textureSlots.data(), GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    ~PackedTextures() {
+        glDeleteTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+        glDeleteBuffers(1, &slotBuffer);
+    }
+
+    PackedTextures(const PackedTextures&) = delete;
+    PackedTextures& operator=(const PackedTextures&) = delete;
+
+    // array i goes to unit firstUnit + i, the table to storage binding
+    // slotBinding
+    void bind(GLuint firstUnit, GLuint slotBinding) const {
+        if (!arrays.empty()) {
+            glBindTextures(firstUnit, static_cast<GLsizei>(arrays.size()), arrays.data());
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, slotBinding, slotBuffer);
+    }
+
+    // what the shader's TEXTURE_ARRAYS has to be (at least 1, glsl has no
+    // empty arrays)
+    size_t arrayCount() const {
+        return arrays.size();
+    }
+
+    const std::vector<TextureSlot>& slots() const {
+        return textureSlots;
+    }
+
+    size_t bytes() const {
+        return allocatedBytes;
+    }
+
+  private:
+    // to the class's format and size. nearest, only used for grey images and
+    // the rare texture that had to be folded into another class
+    static void convert(const ImageView& image, const SizeClass& sizeClass,
+                        std::vector<uint8_t>& out) {
+        out.resize(size_t(sizeClass.width) * sizeClass.height * sizeClass.channels);
+        for (auto y = 0; y < sizeClass.height; ++y) {
+            auto sourceY = size_t(y) * image.height / sizeClass.height;
+            for (auto x = 0; x < sizeClass.width; ++x) {
+                auto sourceX = size_t(x) * image.width / sizeClass.width;
+                const auto* source =
+                    &image.pixels[(sourceY * image.width + sourceX) * image.channels];
+                auto* texel = &out[(size_t(y) * sizeClass.width + x) * sizeClass.channels];
+                bool grey = image.channels <= 2;
+                texel[0] = source[0];
+                texel[1] = grey ? source[0] : source[1];
+                texel[2] = grey ? source[0] : source[2];
+                if (sizeClass.channels == 4) {
+                    texel[3] = image.channels == 4 ? source[3]
+                               : image.channels == 2 ? source[1]
+                                                     : 255;
+                }
+            }
+        }
+    }
+
+    std::vector<GLuint> arrays;
+    std::vector<TextureSlot> textureSlots;
+    GLuint slotBuffer = 0;
+    size_t allocatedBytes = 0;
+};
+
+} // namespace texturePacker
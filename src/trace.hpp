@@ -0,0 +1,235 @@
+#pragma once
+
+// a tiny scoped-event tracer that writes chrome trace event json
+// (open the file in chrome://tracing or https://ui.perfetto.dev).
+//
+// every thread records into its own chain of fixed size blocks. only the
+// owning thread ever writes to a block, and it publishes the new count with a
+// release store, so recording never takes a lock. the blocks are kept alive
+// until exit, when they are walked and written out.
+//
+// tracing is off by default. call tracer::start("trace.json") or set the
+// OPENGL_TUTORIAL_TRACE environment variable and call
+// tracer::startFromEnvironment(). when off, a scope is one relaxed load.
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tracer {
+
+struct Event {
+    // names must be string literals (or otherwise outlive the tracer)
+    const char* name;
+    const char* category;
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+struct ThreadBuffer {
+    static constexpr size_t blockSize = 4096;
+    // stop recording after this many events per thread so a long running
+    // chapter can't eat all the memory
+    static constexpr size_t maxBlocks = 1024;
+
+    struct Block {
+        Event events[blockSize];
+        std::atomic<size_t> count{0};
+        std::atomic<Block*> next{nullptr};
+    };
+
+    int id = 0;
+    std::string name;
+    std::atomic<Block*> head{nullptr};
+    Block* tail = nullptr;
+    size_t blockCount = 0;
+    ThreadBuffer* nextBuffer = nullptr;
+
+    void record(const Event& event) {
+        if (!tail || tail->count.load(std::memory_order_relaxed) == blockSize) {
+            if (blockCount == maxBlocks) {
+                return;
+            }
+            auto block = new Block;
+            ++blockCount;
+            if (tail) {
+                tail->next.store(block, std::memory_order_release);
+            } else {
+                head.store(block, std::memory_order_release);
+            }
+            tail = block;
+        }
+        auto count = tail->count.load(std::memory_order_relaxed);
+        tail->events[count] = event;
+        tail->count.store(count + 1, std::memory_order_release);
+    }
+};
+
+namespace detail {
+inline std::atomic<bool> enabled{false};
+inline std::atomic<ThreadBuffer*> buffers{nullptr};
+inline std::atomic<int> nextThreadId{1};
+inline std::string outputPath;
+inline const auto epoch = std::chrono::steady_clock::now();
+
+// buffers are pushed onto a lock free list and never freed. threads can come
+// and go (workers, loaders) but their events survive until exit.
+inline ThreadBuffer* registerBuffer(std::string name) {
+    auto buffer = new ThreadBuffer;
+    buffer->id = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    buffer->name = name.empty() ? fmt::format("thread {}", buffer->id) : std::move(name);
+    auto head = buffers.load(std::memory_order_relaxed);
+    do {
+        buffer->nextBuffer = head;
+    } while (!buffers.compare_exchange_weak(head, buffer, std::memory_order_release,
+                                            std::memory_order_relaxed));
+    return buffer;
+}
+
+inline ThreadBuffer& threadBuffer() {
+    thread_local ThreadBuffer* buffer = registerBuffer({});
+    return *buffer;
+}
+} // namespace detail
+
+inline int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                detail::epoch)
+        .count();
+}
+
+inline bool enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline void setThreadName(std::string name) {
+    detail::threadBuffer().name = std::move(name);
+}
+
+// for timelines that aren't a cpu thread, e.g. the gpu. only one thread may
+// record into the returned buffer
+inline ThreadBuffer* createTimeline(std::string name) {
+    return detail::registerBuffer(std::move(name));
+}
+
+inline void record(const char* name, const char* category, int64_t startNs, int64_t durationNs) {
+    detail::threadBuffer().record({name, category, startNs, durationNs});
+}
+
+// calls func for every event recorded so far with the id of the timeline
+// it belongs to. safe to call while other threads are still recording
+template <typename Func> void forEachEvent(Func&& func) {
+    for (auto buffer = detail::buffers.load(std::memory_order_acquire); buffer;
+         buffer = buffer->nextBuffer) {
+        for (auto block = buffer->head.load(std::memory_order_acquire); block;
+             block = block->next.load(std::memory_order_acquire)) {
+            auto count = block->count.load(std::memory_order_acquire);
+            for (auto i = 0u; i < count; ++i) {
+                func(*buffer, block->events[i]);
+            }
+        }
+    }
+}
+
+// total time in seconds spent in each named scope. handy for benchmarks that
+// want per phase numbers without going through the json
+inline std::unordered_map<std::string, double> totalsByName() {
+    std::unordered_map<std::string, double> totals;
+    forEachEvent([&](const ThreadBuffer&, const Event& event) {
+        totals[event.name] += static_cast<double>(event.durationNs) * 1e-9;
+    });
+    return totals;
+}
+
+inline void writeJson(const std::string& filePath) {
+    FILE* fp = fopen(filePath.c_str(), "w");
+    if (!fp) {
+        fmt::print(stderr, "Error opening trace file {}\n", filePath);
+        return;
+    }
+
+    fmt::print(fp, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (auto buffer = detail::buffers.load(std::memory_order_acquire); buffer;
+         buffer = buffer->nextBuffer) {
+        fmt::print(fp,
+                   "{}{{\"ph\":\"M\",\"pid\":1,\"tid\":{},\"name\":\"thread_name\","
+                   "\"args\":{{\"name\":\"{}\"}}}}",
+                   first ? "" : ",\n", buffer->id, buffer->name);
+        first = false;
+    }
+    forEachEvent([&](const ThreadBuffer& buffer, const Event& event) {
+        // chrome wants microseconds
+        fmt::print(fp,
+                   ",\n{{\"ph\":\"X\",\"pid\":1,\"tid\":{},\"name\":\"{}\",\"cat\":\"{}\","
+                   "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                   buffer.id, event.name, event.category, static_cast<double>(event.startNs) * 1e-3,
+                   static_cast<double>(event.durationNs) * 1e-3);
+    });
+    fmt::print(fp, "\n]}}\n");
+    fclose(fp);
+    fmt::print(stderr, "wrote trace to {}\n", filePath);
+}
+
+// record events without writing them anywhere at exit
+inline void enable() {
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+inline void start(const std::string& filePath) {
+    if (!detail::outputPath.empty()) {
+        return;
+    }
+    enable();
+    detail::outputPath = filePath;
+    std::atexit([] { writeJson(detail::outputPath); });
+}
+
+inline void startFromEnvironment() {
+    if (auto filePath = std::getenv("OPENGL_TUTORIAL_TRACE")) {
+        start(filePath);
+    }
+}
+
+struct Scope {
+    explicit Scope(const char* name, const char* category = "cpu")
+        : name(name)
+        , category(category)
+        , startNs(enabled() ? now() : -1) {
+    }
+
+    ~Scope() {
+        end();
+    }
+
+    // for phases that don't line up with a c++ scope
+    void end() {
+        if (startNs >= 0) {
+            record(name, category, startNs, now() - startNs);
+            startNs = -1;
+        }
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    const char* name;
+    const char* category;
+    int64_t startNs;
+};
+
+} // namespace tracer
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) tracer::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_CATEGORY(name, category)                                                     \
+    tracer::Scope TRACE_CONCAT(traceScope, __LINE__)(name, category)
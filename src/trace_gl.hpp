@@ -0,0 +1,151 @@
+#pragma once
+
+// gpu side of the tracer. wraps gl timestamp queries so passes show up on a
+// "GPU" row in the same trace as the cpu threads.
+//
+// each frame gets its own set of queries and the results are only read back
+// framesInFlight frames later, so we never stall waiting on the gpu.
+
+#include "trace.hpp"
+
+#include <glbinding/gl/gl.h>
+
+#include <array>
+
+using namespace gl;
+
+namespace tracer {
+
+class GpuTimeline {
+  public:
+    static constexpr int framesInFlight = 4;
+    static constexpr int maxScopesPerFrame = 32;
+
+    GpuTimeline() {
+        if (!enabled()) {
+            return;
+        }
+        timeline = createTimeline("GPU");
+        for (auto& frame : frames) {
+            glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(frame.queries.size()),
+                            frame.queries.data());
+        }
+        calibrate();
+    }
+
+    ~GpuTimeline() {
+        shutdown();
+    }
+
+    GpuTimeline(const GpuTimeline&) = delete;
+    GpuTimeline& operator=(const GpuTimeline&) = delete;
+
+    // call once at the top of the render loop
+    void beginFrame() {
+        if (!timeline) {
+            return;
+        }
+        ++frameIndex;
+        collect(frames[frameIndex % framesInFlight], false);
+    }
+
+    // call before the context goes away. picks up the last few frames and
+    // releases the queries
+    void shutdown() {
+        if (!timeline) {
+            return;
+        }
+        glFinish();
+        for (auto& frame : frames) {
+            collect(frame, true);
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+        timeline = nullptr;
+    }
+
+    struct Scope {
+        Scope(GpuTimeline& gpuTimeline, const char* name) : gpuTimeline(gpuTimeline) {
+            slot = gpuTimeline.begin(name);
+        }
+        ~Scope() {
+            gpuTimeline.end(slot);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        GpuTimeline& gpuTimeline;
+        int slot;
+    };
+
+  private:
+    struct Frame {
+        std::array<GLuint, maxScopesPerFrame * 2> queries{};
+        std::array<const char*, maxScopesPerFrame> names{};
+        int count = 0;
+    };
+
+    int begin(const char* name) {
+        if (!timeline) {
+            return -1;
+        }
+        auto& frame = frames[frameIndex % framesInFlight];
+        if (frame.count == maxScopesPerFrame) {
+            return -1;
+        }
+        auto slot = frame.count++;
+        frame.names[slot] = name;
+        glQueryCounter(frame.queries[slot * 2], GL_TIMESTAMP);
+        return slot;
+    }
+
+    void end(int slot) {
+        if (slot < 0) {
+            return;
+        }
+        auto& frame = frames[frameIndex % framesInFlight];
+        glQueryCounter(frame.queries[slot * 2 + 1], GL_TIMESTAMP);
+    }
+
+    void collect(Frame& frame, bool wait) {
+        if (frame.count == 0) {
+            return;
+        }
+        GLint available = 1;
+        if (!wait) {
+            // the last query issued is the last to finish
+            glGetQueryObjectiv(frame.queries[frame.count * 2 - 1], GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+        }
+        if (available != 0) {
+            for (auto i = 0; i < frame.count; ++i) {
+                GLuint64 start, end;
+                glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+                timeline->record({frame.names[i], "gpu",
+                                  static_cast<int64_t>(start) + gpuToCpuOffsetNs,
+                                  static_cast<int64_t>(end - start)});
+            }
+        }
+        // if the gpu is more than framesInFlight behind we just drop the frame
+        frame.count = 0;
+    }
+
+    // gl timestamps are on the gpu's own clock. line it up with ours once at
+    // startup. drift over a short capture is small enough to ignore
+    void calibrate() {
+        glFinish();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuToCpuOffsetNs = now() - static_cast<int64_t>(gpuNow);
+    }
+
+    ThreadBuffer* timeline = nullptr;
+    std::array<Frame, framesInFlight> frames;
+    uint64_t frameIndex = 0;
+    int64_t gpuToCpuOffsetNs = 0;
+};
+
+} // namespace tracer
+
+#define TRACE_GPU_SCOPE(timeline, name)                                                          \
+    tracer::GpuTimeline::Scope TRACE_CONCAT(gpuTraceScope, __LINE__)(timeline, name)
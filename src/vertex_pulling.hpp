@@ -0,0 +1,172 @@
+#pragma once
+
+// vertex pulling. rather than describing the vertex layout to a vao and having
+// the fixed function fetch hand the shader its attributes, the vertices of
+// every mesh go in one storage buffer and the vertex shader reads them itself.
+// the vao is left holding nothing but the element buffer, so the same vao
+// works for every mesh and one glMultiDrawElementsIndirect draws all of them
+// with no buffer or vao binds in between.
+//
+// the indices go in the same buffer after the vertices. the hardware still
+// fetches those (so the post transform cache still works) and gl_VertexID
+// already has the command's baseVertex added, so the shader only has to do
+//
+//  layout (std430, binding = 0) readonly buffer Vertices { float vertexData[]; };
+//  vec3 position = vec3(vertexData[gl_VertexID * 8], ...);
+//
+// vertexPulling::glsl has that as pullVertex(). put it straight after #version.
+//
+//  vertexPulling::MeshBuffer meshBuffer({&meshA, &meshB});
+//  commands.push_back(meshBuffer.command(1, objectIndex));
+//  meshBuffer.bind();
+//  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commandCount, 0);
+
+#include "draw_indirect.hpp"
+#include "obj_loader.hpp"
+
+#include <glbinding/gl/gl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace gl;
+
+namespace vertexPulling {
+
+// std430 would pad a vec3 member to 16 bytes, so the shader sees the vertices
+// as plain floats and picks them apart itself
+constexpr size_t floatsPerVertex = sizeof(vertex3D) / sizeof(float);
+static_assert(sizeof(vertex3D) == 8 * sizeof(float),
+              "pullVertex expects position, normal and texCoord tightly packed");
+
+// the storage binding the glsl below reads the vertices from
+constexpr GLuint vertexBinding = 0;
+
+constexpr const char* glsl = R"(
+    struct PulledVertex {
+        vec3 position;
+        vec3 normal;
+        vec2 texCoord;
+    };
+
+    layout (std430, binding = 0) readonly buffer Vertices {
+        float vertexData[];
+    };
+
+    PulledVertex pullVertex(int vertexId) {
+        int base = vertexId * 8;
+        PulledVertex vertex;
+        vertex.position = vec3(vertexData[base], vertexData[base + 1], vertexData[base + 2]);
+        vertex.normal = vec3(vertexData[base + 3], vertexData[base + 4], vertexData[base + 5]);
+        vertex.texCoord = vec2(vertexData[base + 6], vertexData[base + 7]);
+        return vertex;
+    }
+)";
+
+// where a mesh ended up, in the units an indirect command wants
+struct MeshRange {
+    int32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+    // counted from the start of the buffer, not the start of the indices
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+// every mesh's vertices and indices in one immutable buffer, and the one vao
+// that draws them
+class MeshBuffer {
+  public:
+    explicit MeshBuffer(const std::vector<const objLoader::MeshDataElements*>& meshes) {
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (const auto* mesh : meshes) {
+            vertexCount += mesh->vertices.size();
+            indexCount += mesh->indices.size();
+        }
+        // vertices are 32 bytes, so the indices after them start 4 byte
+        // aligned and firstIndex can count from the start of the buffer
+        vertexBytes = vertexCount * sizeof(vertex3D);
+        totalBytes = vertexBytes + indexCount * sizeof(GLuint);
+
+        glCreateBuffers(1, &bufferObject);
+        glNamedBufferStorage(bufferObject, std::max<size_t>(totalBytes, 1), nullptr,
+                             GL_DYNAMIC_STORAGE_BIT);
+
+        static_assert(sizeof(int) == sizeof(GLuint), "indices are uploaded as they are");
+        size_t vertexOffset = 0;
+        size_t indexOffset = vertexBytes;
+        for (const auto* mesh : meshes) {
+            MeshRange range;
+            range.baseVertex = static_cast<int32_t>(vertexOffset / sizeof(vertex3D));
+            range.vertexCount = static_cast<uint32_t>(mesh->vertices.size());
+            range.firstIndex = static_cast<uint32_t>(indexOffset / sizeof(GLuint));
+            range.indexCount = static_cast<uint32_t>(mesh->indices.size());
+            ranges.push_back(range);
+
+            auto meshVertexBytes = mesh->vertices.size() * sizeof(vertex3D);
+            auto meshIndexBytes = mesh->indices.size() * sizeof(GLuint);
+            if (meshVertexBytes) {
+                glNamedBufferSubData(bufferObject, vertexOffset, meshVertexBytes,
+                                     mesh->vertices.data());
+            }
+            if (meshIndexBytes) {
+                glNamedBufferSubData(bufferObject, indexOffset, meshIndexBytes,
+                                     mesh->indices.data());
+            }
+            vertexOffset += meshVertexBytes;
+            indexOffset += meshIndexBytes;
+        }
+
+        // no attributes at all, just somewhere for the element buffer to live
+        glCreateVertexArrays(1, &vao);
+        glVertexArrayElementBuffer(vao, bufferObject);
+    }
+
+    ~MeshBuffer() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &bufferObject);
+    }
+
+    MeshBuffer(const MeshBuffer&) = delete;
+    MeshBuffer& operator=(const MeshBuffer&) = delete;
+
+    // draws all of mesh i. baseInstance is free for the shader to use as the
+    // index of whatever per draw data it wants
+    DrawElementsIndirectCommand command(size_t mesh, uint32_t baseInstance,
+                                        uint32_t instanceCount = 1) const {
+        const auto& range = ranges[mesh];
+        return {range.indexCount, instanceCount, range.firstIndex, range.baseVertex,
+                baseInstance};
+    }
+
+    // the vao, and the vertices to storage binding vertexBinding
+    void bind() const {
+        glBindVertexArray(vao);
+        if (vertexBytes) {
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, vertexBinding, bufferObject, 0,
+                              vertexBytes);
+        }
+    }
+
+    const MeshRange& mesh(size_t i) const {
+        return ranges[i];
+    }
+
+    size_t meshCount() const {
+        return ranges.size();
+    }
+
+    size_t bytes() const {
+        return totalBytes;
+    }
+
+  private:
+    std::vector<MeshRange> ranges;
+    GLuint bufferObject = 0;
+    GLuint vao = 0;
+    size_t vertexBytes = 0;
+    size_t totalBytes = 0;
+};
+
+} // namespace vertexPulling